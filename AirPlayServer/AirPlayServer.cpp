@@ -195,6 +195,24 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     g_pPlayer = &player;  // Set global pointer for cleanup handlers
     player.setServerName(hostName);
 
+    // --audio-sink=null|wav plays without sound hardware, for latency and
+    // drift runs; wav also records the output to airplay-output.wav
+    const char* sinkArg = lpCmdLine ? strstr(lpCmdLine, "--audio-sink=") : NULL;
+    if (sinkArg != NULL) {
+        char sinkName[16] = {0};
+        sinkArg += strlen("--audio-sink=");
+        size_t len = strcspn(sinkArg, " \t");
+        if (len < sizeof(sinkName)) {
+            memcpy(sinkName, sinkArg, len);
+        }
+        if (!player.setAudioSink(sinkName)) {
+            DebugLogger::Write("startup", "unknown audio sink; using the device");
+        }
+        else {
+            DebugLogger::Write("startup", "audio sink: %s", sinkName);
+        }
+    }
+
     if (!player.init()) {
         DebugLogger::Write("startup", "player initialization failed");
         g_pPlayer = NULL;
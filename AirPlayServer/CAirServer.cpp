@@ -12,8 +12,9 @@ CAirServer::CAirServer()
 
 CAirServer::~CAirServer()
 {
-    delete m_pCallback;
+    // Session decode threads call into the callback until the server stops
     stop();
+    delete m_pCallback;
 }
 
 bool getHostName(char hostName[512]) 
@@ -60,6 +61,12 @@ void CAirServer::start(CSDLPlayer* pPlayer, const char* serverName,
 	}
     m_pServer = fgServerStartWithDisplay(finalServerName, 5001, 7001,
 		m_pCallback, password, displayWidth, displayHeight);
+	if (m_pServer != NULL) {
+		// The player retains decoded frames and uploads them without a copy
+		fgServerSetVideoFrameMode(m_pServer, FG_VIDEO_FRAME_REFCOUNTED);
+		// The player's audio path is float from the resampler to the device
+		fgServerSetAudioSampleFormat(m_pServer, FG_AUDIO_FORMAT_F32);
+	}
 }
 
 void CAirServer::stop()
@@ -19,26 +19,48 @@ CAirServerCallback::~CAirServerCallback()
 void CAirServerCallback::setPlayer(CSDLPlayer* pPlayer)
 {
 	m_pPlayer = pPlayer;
+	m_compositor.setPlayer(pPlayer);
+	if (pPlayer != NULL) {
+		// The tiled wall fills the display size advertised to senders
+		unsigned int width = 0;
+		unsigned int height = 0;
+		pPlayer->getAdvertisedDisplaySize(width, height);
+		m_compositor.setCanvasSize(width, height);
+	}
+}
+
+// UI label for the wall: the newest sender, plus how many others share it
+static void formatSessionLabel(char* label, size_t labelSize, const char* remoteName, int sessionCount)
+{
+	char nameUtf8[256] = { 0 };
+	if (remoteName) {
+		std::wstring name = CFgUtf8Utils::UTF8_To_UTF16(remoteName);
+		WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, nameUtf8, sizeof(nameUtf8), NULL, NULL);
+	}
+	if (sessionCount > 1) {
+		sprintf_s(label, labelSize, "%s (+%d)", nameUtf8, sessionCount - 1);
+	}
+	else {
+		strncpy_s(label, labelSize, nameUtf8, _TRUNCATE);
+	}
 }
 
 void CAirServerCallback::connected(const char* remoteName, const char* remoteDeviceId) {
 	DebugLogger::Write("connection", "connected name=%s device=%s", remoteName ? remoteName : "(null)", remoteDeviceId ? remoteDeviceId : "(null)");
-	if (remoteDeviceId != NULL) {
+	// The first sender keeps the audio until it leaves
+	if (remoteDeviceId != NULL && m_chRemoteDeviceId[0] == '\0') {
 		strncpy(m_chRemoteDeviceId, remoteDeviceId, 128);
 	}
+	int sessionCount = m_compositor.addSession(remoteDeviceId, remoteName);
 
 	setlocale(LC_CTYPE, "");
 	std::wstring name = CFgUtf8Utils::UTF8_To_UTF16(remoteName);
-	wprintf(L"Client connected: %s\n", name.c_str());
+	wprintf(L"Client connected: %s (%d active)\n", name.c_str(), sessionCount);
 
 	// Update connection state and show the window when a client connects
 	if (m_pPlayer) {
-		// Convert wide string to UTF-8 for ImGui
 		char deviceNameUtf8[256] = { 0 };
-		if (remoteName) {
-			// Simple conversion - in production, use proper UTF-8 conversion
-			WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, deviceNameUtf8, sizeof(deviceNameUtf8), NULL, NULL);
-		}
+		formatSessionLabel(deviceNameUtf8, sizeof(deviceNameUtf8), remoteName, sessionCount);
 		m_pPlayer->setConnected(true, deviceNameUtf8);
 		m_pPlayer->requestShowWindow();
 	}
@@ -46,14 +68,26 @@ void CAirServerCallback::connected(const char* remoteName, const char* remoteDev
 
 void CAirServerCallback::disconnected(const char* remoteName, const char* remoteDeviceId) {
 	DebugLogger::Write("connection", "disconnected name=%s device=%s", remoteName ? remoteName : "(null)", remoteDeviceId ? remoteDeviceId : "(null)");
-	memset(m_chRemoteDeviceId, 0, 128);
-	printf("Client disconnected\n");
+	if (remoteDeviceId == NULL || 0 == strcmp(m_chRemoteDeviceId, remoteDeviceId)) {
+		// Audio goes to whichever sender streams next
+		memset(m_chRemoteDeviceId, 0, 128);
+	}
+	std::string remainingName;
+	int sessionCount = m_compositor.removeSession(remoteDeviceId, &remainingName);
+	printf("Client disconnected (%d active)\n", sessionCount);
 
-	// Update connection state - keep window visible to show home screen
 	if (m_pPlayer) {
-		m_pPlayer->setConnected(false, NULL);
-		// Don't hide window - show home screen instead
-		// GPU render loop clears to black each frame, so no explicit clear needed
+		if (sessionCount > 0) {
+			char deviceNameUtf8[256] = { 0 };
+			formatSessionLabel(deviceNameUtf8, sizeof(deviceNameUtf8), remainingName.c_str(), sessionCount);
+			m_pPlayer->setConnected(true, deviceNameUtf8);
+		}
+		else {
+			// Update connection state - keep window visible to show home screen
+			m_pPlayer->setConnected(false, NULL);
+			// Don't hide window - show home screen instead
+			// GPU render loop clears to black each frame, so no explicit clear needed
+		}
 	}
 }
 
@@ -77,15 +111,7 @@ void CAirServerCallback::outputVideo(SFgVideoFrame* data, const char* remoteName
 {
 	if (m_pPlayer)
 	{
-		if (m_chRemoteDeviceId[0] == '\0' && remoteDeviceId != NULL)
-		{
-			strncpy(m_chRemoteDeviceId, remoteDeviceId, 128);
-		}
-		if (0 != strcmp(m_chRemoteDeviceId, remoteDeviceId))
-		{
-			return;
-		}
-		m_pPlayer->outputVideo(data);
+		m_compositor.outputVideo(data, remoteName, remoteDeviceId);
 	}
 }
 
@@ -98,6 +124,11 @@ void CAirServerCallback::videoPlay(char* url, double volume, double startPos)
 void CAirServerCallback::setVolume(float volume, const char* remoteName, const char* remoteDeviceId)
 {
 	DebugLogger::Write("audio", "volume=%.3f name=%s device=%s", volume, remoteName ? remoteName : "(null)", remoteDeviceId ? remoteDeviceId : "(null)");
+	if (m_chRemoteDeviceId[0] != '\0' && remoteDeviceId != NULL && 0 != strcmp(m_chRemoteDeviceId, remoteDeviceId))
+	{
+		// Only the sender that owns the audio output sets its volume
+		return;
+	}
 	if (m_pPlayer)
 	{
 		m_pPlayer->setVolume(volume);
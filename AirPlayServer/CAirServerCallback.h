@@ -1,6 +1,7 @@
 #pragma once
 #include <Windows.h>
 #include "CSDLPlayer.h"
+#include "CVideoCompositor.h"
 
 
 class CAirServerCallback : public IAirServerCallback
@@ -29,5 +30,6 @@ public:
 
 protected:
 	CSDLPlayer* m_pPlayer;
-	char m_chRemoteDeviceId[128];
+	CVideoCompositor m_compositor;  // Video from every admitted sender, tiled by device ID
+	char m_chRemoteDeviceId[128];   // Sender whose audio is played
 };
@@ -0,0 +1,498 @@
+#include "CAudioEngine.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include "CVideoPresentQueue.h"
+#include "DebugLogger.h"
+
+// Bandwidth of the loop tracking the device position. The sink reports its
+// queue in device-sized steps; this averages them over tens of seconds into
+// a steady rate, and still follows a card that warms up.
+static const double DEVICE_LOOP_BANDWIDTH_HZ = 0.05;
+// The sender rate is frames received over the span of timeline they cover.
+// Clock mapping updates move the timeline by a millisecond or so, so the
+// span has to be long for that to be small against it.
+static const LONGLONG SENDER_MIN_SPAN_NS = 5000000000LL;
+static const LONGLONG SENDER_MAX_SPAN_NS = 60000000000LL;
+// A timeline this far from where the frame count puts it is a new stretch
+// of audio, after a pause or a flush, not drift
+static const LONGLONG SENDER_DISCONTINUITY_NS = 100000000LL;
+// Meter smoothing per block written, several per device buffer
+static const float PEAK_DECAY = 0.99f;
+// A block peaking above this (-80 dBFS) is the first sound, not priming
+static const float AUDIBLE_LEVEL = 0.0001f;
+
+static double clampRatio(double value, double limit)
+{
+	if (value > 1.0 + limit) {
+		return 1.0 + limit;
+	}
+	if (value < 1.0 - limit) {
+		return 1.0 - limit;
+	}
+	return value;
+}
+
+CAudioEngine::CAudioEngine()
+	: m_sink(NULL)
+	, m_hThread(NULL)
+	, m_hStopEvent(NULL)
+	, m_streamRate(0)
+	, m_deviceRate(0)
+	, m_channels(0)
+	, m_maxStreamFrames(0)
+	, m_startStreamFrames(0)
+	, m_startDepthMs(0)
+	, m_maxDepthFloorMs(0)
+	, m_startNs(0)
+	, m_sinkQueueFrames(0)
+	, m_deviceLatencyFrames(0)
+	, m_targetDepthMs(0)
+	, m_gain(1.0f)
+	, m_limit(false)
+	, m_producedFrames(0)
+	, m_senderAnchorNs(0)
+	, m_senderAnchorFrames(0)
+	, m_senderNextNs(0)
+	, m_senderNextFrames(0)
+	, m_senderRate(0.0)
+	, m_senderRateMilliHz(0)
+	, m_scratch(NULL)
+	, m_scratchFrames(0)
+	, m_playing(false)
+	, m_dry(false)
+	, m_dryNs(0)
+	, m_sinkWritten(0)
+	, m_deviceLocked(false)
+	, m_devicePos(0.0)
+	, m_deviceClock(0.0)
+	, m_deviceTimeNs(0)
+	, m_sinkQueued(0)
+	, m_deviceRateMilliHz(0)
+	, m_ratioPpb(0)
+	, m_peakLevel(0.0f)
+	, m_limiterGain(1.0f)
+	, m_underruns(0)
+	, m_dropped(0)
+	, m_depthFloorMs(0)
+	, m_firstAudibleMs(-1)
+{
+}
+
+CAudioEngine::~CAudioEngine()
+{
+	stop();
+}
+
+LONGLONG CAudioEngine::nowNs()
+{
+	static LARGE_INTEGER s_qpcFreq;
+	if (s_qpcFreq.QuadPart == 0) {
+		QueryPerformanceFrequency(&s_qpcFreq);
+	}
+	LARGE_INTEGER qpcNow;
+	QueryPerformanceCounter(&qpcNow);
+	return CVideoPresentQueue::qpcToNs(qpcNow.QuadPart, s_qpcFreq.QuadPart);
+}
+
+bool CAudioEngine::start(IAudioSink* sink, unsigned int streamRate, unsigned int deviceRate, unsigned int channels,
+	CAudioResampler::EQuality quality, int maxDepthMs, int startDepthMs)
+{
+	stop();
+	if (sink == NULL || streamRate == 0 || deviceRate == 0 || channels == 0) {
+		return false;
+	}
+	m_streamRate = streamRate;
+	m_deviceRate = deviceRate;
+	m_channels = channels;
+	m_maxStreamFrames = streamRate * maxDepthMs / 1000;
+	m_startStreamFrames = streamRate * startDepthMs / 1000;
+	m_startDepthMs = startDepthMs;
+	m_maxDepthFloorMs = maxDepthMs - DEPTH_FLOOR_HEADROOM_MS;
+	if (m_maxDepthFloorMs < startDepthMs) {
+		m_maxDepthFloorMs = startDepthMs;
+	}
+	m_sinkQueueFrames = deviceRate * SINK_QUEUE_MS / 1000;
+
+	// The resampler always runs, even with equal nominal rates: the two
+	// clocks are still never the same
+	double nominal = (double)deviceRate / (double)streamRate;
+	double maxRatio = nominal * (1.0 + MAX_CLOCK_ERROR) * (1.0 + MAX_CORRECTION);
+	// Twice the maximum depth leaves headroom for bursts before playback starts
+	if (!m_input.init(m_maxStreamFrames * 2, channels) ||
+		!m_resampler.init(channels, nominal, quality) ||
+		!m_outputStage.init(deviceRate, channels)) {
+		printf("Cannot allocate audio engine\n");
+		stop();
+		return false;
+	}
+	m_scratchFrames = m_resampler.maxOutputFrames(CHUNK_FRAMES, maxRatio);
+	m_scratch = (float*)_aligned_malloc((size_t)m_scratchFrames * channels * sizeof(float), 64);
+	if (m_scratch == NULL) {
+		printf("Cannot allocate audio engine\n");
+		stop();
+		return false;
+	}
+
+	if (!sink->open(deviceRate, channels, DEVICE_PERIOD_FRAMES)) {
+		stop();
+		return false;
+	}
+	m_sink = sink;
+	m_deviceLatencyFrames = sink->deviceLatencyFrames();
+
+	m_producedFrames = 0;
+	m_senderAnchorNs = 0;
+	m_senderAnchorFrames = 0;
+	m_senderNextNs = 0;
+	m_senderNextFrames = 0;
+	m_senderRate = (double)streamRate;
+	InterlockedExchange64(&m_senderRateMilliHz, (LONGLONG)streamRate * 1000);
+
+	m_playing = false;
+	m_dry = false;
+	m_dryNs = 0;
+	m_sinkWritten = 0;
+	m_deviceLocked = false;
+	m_devicePos = 0.0;
+	m_deviceClock = (double)deviceRate;
+	m_deviceTimeNs = 0;
+	InterlockedExchange(&m_sinkQueued, 0);
+	InterlockedExchange64(&m_deviceRateMilliHz, (LONGLONG)deviceRate * 1000);
+	InterlockedExchange64(&m_ratioPpb, (LONGLONG)(nominal * 1000000000.0));
+	m_peakLevel = 0.0f;
+	m_limiterGain = 1.0f;
+	InterlockedExchange(&m_underruns, 0);
+	InterlockedExchange(&m_dropped, 0);
+	InterlockedExchange(&m_depthFloorMs, 0);
+	InterlockedExchange(&m_firstAudibleMs, -1);
+	m_startNs = nowNs();
+
+	m_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	m_hThread = (m_hStopEvent != NULL) ? CreateThread(NULL, 0, threadProc, this, 0, NULL) : NULL;
+	if (m_hThread == NULL) {
+		printf("Cannot start audio engine thread\n");
+		stop();
+		return false;
+	}
+	printf("Audio engine: %u -> %u Hz through the %s sink, %u resampler taps, %s kernel\n",
+		streamRate, deviceRate, sink->name(), m_resampler.taps(), CAudioResampler::kernelName());
+	return true;
+}
+
+void CAudioEngine::stop()
+{
+	if (m_hThread != NULL) {
+		SetEvent(m_hStopEvent);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = NULL;
+
+		SStats stats;
+		getStats(&stats);
+		printf("Audio engine stopped: device %.2f Hz, sender %.2f Hz, %d underruns, %d drops, "
+			"first sound after %d ms, depth floor %d ms\n",
+			stats.deviceRateHz, stats.senderRateHz, stats.underruns, stats.dropped,
+			stats.firstAudibleMs, stats.depthFloorMs);
+		DebugLogger::Write("audio", "engine stopped: device %.2f Hz, sender %.2f Hz, %d underruns, %d drops, "
+			"first sound after %d ms, depth floor %d ms",
+			stats.deviceRateHz, stats.senderRateHz, stats.underruns, stats.dropped,
+			stats.firstAudibleMs, stats.depthFloorMs);
+	}
+	if (m_hStopEvent != NULL) {
+		CloseHandle(m_hStopEvent);
+		m_hStopEvent = NULL;
+	}
+	if (m_sink != NULL) {
+		m_sink->close();
+		m_sink = NULL;
+	}
+	_aligned_free(m_scratch);
+	m_scratch = NULL;
+	m_scratchFrames = 0;
+	m_input.reset();
+	m_resampler.reset();
+	m_outputStage.reset();
+	InterlockedExchange(&m_sinkQueued, 0);
+	m_peakLevel = 0.0f;
+	m_limiterGain = 1.0f;
+}
+
+DWORD WINAPI CAudioEngine::threadProc(LPVOID param)
+{
+	((CAudioEngine*)param)->run();
+	return 0;
+}
+
+void CAudioEngine::run()
+{
+	// Above the decoder and the renderer: a late wake-up here is a gap in
+	// the sound, anywhere else it is only a late frame
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	const LONGLONG periodNs = (LONGLONG)PERIOD_MS * 1000000LL;
+	LONGLONG deadlineNs = nowNs();
+	for (;;) {
+		LONGLONG waitNs = deadlineNs - nowNs();
+		DWORD waitMs = (waitNs > 0) ? (DWORD)((waitNs + 999999) / 1000000) : 0;
+		if (WaitForSingleObject(m_hStopEvent, waitMs) == WAIT_OBJECT_0) {
+			break;
+		}
+		LONGLONG now = nowNs();
+		service(now);
+
+		// A missed deadline is not made up with a burst of wake-ups; the
+		// sink queue covers it
+		deadlineNs += periodNs;
+		if (deadlineNs < now) {
+			deadlineNs = now + periodNs;
+		}
+	}
+}
+
+void CAudioEngine::trackDevice(LONGLONG nowNs, unsigned int queued)
+{
+	double consumed = (double)(m_sinkWritten - queued);
+	if (!m_deviceLocked) {
+		m_devicePos = consumed;
+		m_deviceTimeNs = nowNs;
+		m_deviceLocked = true;
+		return;
+	}
+
+	// Second-order delay-locked loop: predict where the device should be by
+	// now, then pull the position and the rate toward what it reported
+	double dt = (double)(nowNs - m_deviceTimeNs) / 1000000000.0;
+	if (dt <= 0.0) {
+		return;
+	}
+	double omega = 2.0 * 3.14159265358979 * DEVICE_LOOP_BANDWIDTH_HZ * dt;
+	double predicted = m_devicePos + m_deviceClock * dt;
+	double error = consumed - predicted;
+	m_devicePos = predicted + sqrt(2.0) * omega * error;
+	m_deviceClock += omega * omega * error / dt;
+	m_deviceClock = (double)m_deviceRate * clampRatio(m_deviceClock / (double)m_deviceRate, MAX_CLOCK_ERROR);
+	m_deviceTimeNs = nowNs;
+	InterlockedExchange64(&m_deviceRateMilliHz, (LONGLONG)(m_deviceClock * 1000.0));
+}
+
+double CAudioEngine::resampleRatio(unsigned int queued)
+{
+	// Feed forward: one sender second of audio has to last one device second
+	double senderRate = (double)InterlockedCompareExchange64(&m_senderRateMilliHz, 0, 0) / 1000.0;
+	double drift = (m_deviceClock / (double)m_deviceRate) / (senderRate / (double)m_streamRate);
+	double ratio = ((double)m_deviceRate / (double)m_streamRate) * clampRatio(drift, MAX_CLOCK_ERROR);
+
+	// Feedback: what the measured rates got wrong shows up as depth. The
+	// sink part comes from the tracked position, not its stepped queue.
+	double sinkQueued = m_deviceLocked ? (double)m_sinkWritten - m_devicePos : (double)queued;
+	if (sinkQueued < 0.0) {
+		sinkQueued = 0.0;
+	}
+	double depthMs = (double)m_input.available() * 1000.0 / (double)m_streamRate +
+		sinkQueued * 1000.0 / (double)m_deviceRate;
+	double targetMs = (double)targetDepthMs();
+	double correction = (targetMs - depthMs) / (double)DEPTH_ERROR_UNIT_MS * DEPTH_PROPORTIONAL_GAIN;
+	return ratio * clampRatio(1.0 + correction, MAX_CORRECTION);
+}
+
+int CAudioEngine::targetDepthMs() const
+{
+	int target = (int)InterlockedCompareExchange((volatile LONG*)&m_targetDepthMs, 0, 0);
+	int floor = (int)InterlockedCompareExchange((volatile LONG*)&m_depthFloorMs, 0, 0);
+	return (target > floor) ? target : floor;
+}
+
+void CAudioEngine::raiseDepthFloor(int starvedMs)
+{
+	int floor = (int)InterlockedCompareExchange(&m_depthFloorMs, 0, 0);
+	if (floor < m_startDepthMs) {
+		floor = m_startDepthMs;
+	}
+	floor += starvedMs + UNDERRUN_DEPTH_STEP_MS;
+	if (floor > m_maxDepthFloorMs) {
+		floor = m_maxDepthFloorMs;
+	}
+	InterlockedExchange(&m_depthFloorMs, floor);
+}
+
+void CAudioEngine::service(LONGLONG nowNs)
+{
+	unsigned int queued = m_sink->queuedFrames();
+	if (m_playing) {
+		if (queued == 0) {
+			// The device is playing silence; the position loop restarts
+			// once there is audio to track again, and playback once the
+			// raised floor is buffered
+			if (!m_dry) {
+				InterlockedIncrement(&m_underruns);
+				m_outputStage.startFadeIn();
+				m_dry = true;
+				m_dryNs = nowNs;
+				m_playing = false;
+			}
+			m_deviceLocked = false;
+			m_peakLevel = m_peakLevel * PEAK_DECAY;
+		} else {
+			m_dry = false;
+			trackDevice(nowNs, queued);
+		}
+	}
+
+	// The producer cannot drop the oldest audio, so it is skipped here
+	unsigned int available = m_input.available();
+	if (available > m_maxStreamFrames) {
+		m_input.consume(available - m_maxStreamFrames);
+		InterlockedIncrement(&m_dropped);
+	}
+	if (!m_playing) {
+		if (m_dryNs != 0 && available > 0) {
+			// Input is back: the depth should have covered the wait
+			raiseDepthFloor((int)((nowNs - m_dryNs) / 1000000));
+			m_dryNs = 0;
+		}
+		unsigned int floorFrames = m_streamRate * (unsigned int)InterlockedCompareExchange(&m_depthFloorMs, 0, 0) / 1000;
+		if (available < m_startStreamFrames || available < floorFrames) {
+			InterlockedExchange(&m_sinkQueued, (LONG)queued);
+			return;
+		}
+		m_playing = true;
+	}
+
+	if (queued < m_sinkQueueFrames) {
+		unsigned int want = m_sinkQueueFrames - queued;
+		double ratio = resampleRatio(queued);
+		InterlockedExchange64(&m_ratioPpb, (LONGLONG)(ratio * 1000000000.0));
+		float gain = m_gain;
+		bool limit = m_limit;
+		while (want > 0) {
+			unsigned int inWant = (unsigned int)ceil((double)want / ratio);
+			if (inWant > CHUNK_FRAMES) {
+				inWant = CHUNK_FRAMES;
+			}
+			const float* src = NULL;
+			unsigned int inFrames = m_input.peek(&src, inWant);
+			if (inFrames == 0) {
+				break;
+			}
+			unsigned int outFrames = m_resampler.process(src, inFrames, m_scratch, m_scratchFrames, ratio);
+			m_input.consume(inFrames);
+			if (outFrames == 0) {
+				continue;
+			}
+			m_outputStage.process(m_scratch, outFrames, gain, limit);
+			m_limiterGain = m_outputStage.limiterGain();
+			float blockPeak = m_outputStage.blockPeak();
+			m_peakLevel = (blockPeak > m_peakLevel) ? blockPeak :
+				m_peakLevel * PEAK_DECAY + blockPeak * (1.0f - PEAK_DECAY);
+			if (m_firstAudibleMs < 0 && blockPeak > AUDIBLE_LEVEL) {
+				// Heard once what the sink holds ahead of it has played
+				LONGLONG heardNs = nowNs + (LONGLONG)(queued + m_deviceLatencyFrames) * 1000000000LL / m_deviceRate;
+				InterlockedExchange(&m_firstAudibleMs, (LONG)((heardNs - m_startNs) / 1000000));
+			}
+
+			if (!m_sink->write(m_scratch, outFrames)) {
+				break;
+			}
+			m_sinkWritten += outFrames;
+			queued += outFrames;
+			want = (outFrames < want) ? want - outFrames : 0;
+		}
+	}
+	// Reported the way the depth loop sees it
+	if (m_deviceLocked && (double)m_sinkWritten > m_devicePos) {
+		queued = (unsigned int)((double)m_sinkWritten - m_devicePos);
+	}
+	InterlockedExchange(&m_sinkQueued, (LONG)queued);
+}
+
+void CAudioEngine::noteTimeline(unsigned int frames, LONGLONG timelineNs)
+{
+	if (timelineNs > 0) {
+		if (m_senderAnchorNs != 0) {
+			// Where the frame count says this packet should be
+			LONGLONG expectedNs = m_senderAnchorNs +
+				(LONGLONG)((double)(m_producedFrames - m_senderAnchorFrames) * 1000000000.0 / m_senderRate);
+			LONGLONG offNs = timelineNs - expectedNs;
+			if (offNs > SENDER_DISCONTINUITY_NS || offNs < -SENDER_DISCONTINUITY_NS) {
+				m_senderAnchorNs = 0;
+				m_senderNextNs = 0;
+			}
+		}
+		if (m_senderAnchorNs == 0) {
+			m_senderAnchorNs = timelineNs;
+			m_senderAnchorFrames = m_producedFrames;
+		}
+
+		LONGLONG spanNs = timelineNs - m_senderAnchorNs;
+		if (spanNs >= SENDER_MIN_SPAN_NS) {
+			double measured = (double)(m_producedFrames - m_senderAnchorFrames) * 1000000000.0 / (double)spanNs;
+			m_senderRate = (double)m_streamRate * clampRatio(measured / (double)m_streamRate, MAX_CLOCK_ERROR);
+			InterlockedExchange64(&m_senderRateMilliHz, (LONGLONG)(m_senderRate * 1000.0));
+		}
+		// The span slides: halfway through it a newer anchor is noted, and
+		// takes over once the span is at its longest
+		if (m_senderNextNs == 0 && spanNs >= SENDER_MAX_SPAN_NS / 2) {
+			m_senderNextNs = timelineNs;
+			m_senderNextFrames = m_producedFrames;
+		} else if (m_senderNextNs != 0 && spanNs >= SENDER_MAX_SPAN_NS) {
+			m_senderAnchorNs = m_senderNextNs;
+			m_senderAnchorFrames = m_senderNextFrames;
+			m_senderNextNs = 0;
+		}
+	}
+	m_producedFrames += frames;
+}
+
+unsigned int CAudioEngine::write(const float* samples, unsigned int frames, LONGLONG timelineNs)
+{
+	if (m_hThread == NULL) {
+		return 0;
+	}
+	noteTimeline(frames, timelineNs);
+	return m_input.write(samples, frames);
+}
+
+unsigned int CAudioEngine::write(const Sint16* samples, unsigned int frames, LONGLONG timelineNs)
+{
+	if (m_hThread == NULL) {
+		return 0;
+	}
+	noteTimeline(frames, timelineNs);
+	return m_input.write(samples, frames);
+}
+
+int CAudioEngine::depthMs() const
+{
+	if (m_streamRate == 0 || m_deviceRate == 0) {
+		return 0;
+	}
+	unsigned long long queued = (unsigned long long)InterlockedCompareExchange((volatile LONG*)&m_sinkQueued, 0, 0);
+	return (int)((unsigned long long)m_input.available() * 1000 / m_streamRate + queued * 1000 / m_deviceRate);
+}
+
+LONGLONG CAudioEngine::latencyNs() const
+{
+	if (m_streamRate == 0 || m_deviceRate == 0) {
+		return 0;
+	}
+	LONGLONG streamFrames = (LONGLONG)m_input.available() + m_resampler.latencyFrames();
+	LONGLONG deviceFrames = (LONGLONG)InterlockedCompareExchange((volatile LONG*)&m_sinkQueued, 0, 0) +
+		m_deviceLatencyFrames + m_outputStage.lookaheadFrames();
+	return streamFrames * 1000000000LL / m_streamRate + deviceFrames * 1000000000LL / m_deviceRate;
+}
+
+void CAudioEngine::getStats(SStats* stats) const
+{
+	stats->deviceRateHz = (double)InterlockedCompareExchange64((volatile LONGLONG*)&m_deviceRateMilliHz, 0, 0) / 1000.0;
+	stats->senderRateHz = (double)InterlockedCompareExchange64((volatile LONGLONG*)&m_senderRateMilliHz, 0, 0) / 1000.0;
+	stats->ratio = (double)InterlockedCompareExchange64((volatile LONGLONG*)&m_ratioPpb, 0, 0) / 1000000000.0;
+	stats->depthMs = depthMs();
+	stats->targetDepthMs = targetDepthMs();
+	stats->depthFloorMs = (int)InterlockedCompareExchange((volatile LONG*)&m_depthFloorMs, 0, 0);
+	stats->firstAudibleMs = (int)InterlockedCompareExchange((volatile LONG*)&m_firstAudibleMs, 0, 0);
+	stats->sinkQueuedFrames = (unsigned int)InterlockedCompareExchange((volatile LONG*)&m_sinkQueued, 0, 0);
+	stats->underruns = (int)InterlockedCompareExchange((volatile LONG*)&m_underruns, 0, 0);
+	stats->dropped = (int)InterlockedCompareExchange((volatile LONG*)&m_dropped, 0, 0);
+}
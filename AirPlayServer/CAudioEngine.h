@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Windows.h>
+#include "SDL.h"
+#include "CAudioOutputStage.h"
+#include "CAudioResampler.h"
+#include "CAudioRing.h"
+#include "IAudioSink.h"
+
+// Audio playout on its own time-critical thread. outputAudio() writes decoded
+// PCM at the stream rate, with the local time its first frame belongs at;
+// the engine thread wakes every PERIOD_MS, measures how much the sink played
+// since the last wake-up, and tops the sink up to SINK_QUEUE_MS through the
+// resampler and the output stage.
+//
+// Both clocks are measured rather than inferred from a queue: the device
+// rate from the frames the sink consumed against the performance counter,
+// tracked by a delay-locked loop, and the sender rate from the frames
+// received against the sender timeline they are stamped with. Their ratio
+// runs the resampler, so drift is cancelled as it happens; the buffered depth
+// only trims what is left, steering to the target CAvSync sets.
+//
+// Playback starts at a shallow depth. Every underrun raises a floor under
+// that target by as long as the input stayed away, plus
+// UNDERRUN_DEPTH_STEP_MS, and buffers up to it again before resuming: a
+// link that stalls gets the depth that covers it after one gap, and one
+// that does not keeps the low latency.
+class CAudioEngine
+{
+public:
+	struct SStats {
+		double deviceRateHz;    // Device clock, frames per local second
+		double senderRateHz;    // Sender clock, frames per local second
+		double ratio;           // Output over input frames the resampler ran at last
+		int depthMs;            // Stream ring plus sink queue
+		int targetDepthMs;      // What the depth steers to, the floor included
+		int depthFloorMs;       // Raised by underruns, 0 before the first
+		int firstAudibleMs;     // From start() to the first sound out of the device, -1 before
+		unsigned int sinkQueuedFrames;
+		int underruns;          // Times the sink ran dry while playing
+		int dropped;            // Times audio was discarded over the maximum depth
+	};
+
+	static const unsigned int PERIOD_MS = 5;       // Engine deadline
+	static const unsigned int SINK_QUEUE_MS = 50;  // Written ahead of the device, part of the depth
+	static const unsigned int DEVICE_PERIOD_FRAMES = 512;
+	static const int DEPTH_ERROR_UNIT_MS = 10;     // About one AAC-ELD packet
+	static constexpr double DEPTH_PROPORTIONAL_GAIN = 0.001;  // 1000ppm per error unit
+	static constexpr double MAX_CORRECTION = 0.005;  // Never alter pitch by more than 0.5%
+	static constexpr double MAX_CLOCK_ERROR = 0.002; // Measured rates further off are not trusted
+	static const int UNDERRUN_DEPTH_STEP_MS = 20;  // Depth floor added per underrun, over the gap
+	static const int DEPTH_FLOOR_HEADROOM_MS = 100; // The floor stays this far under the maximum
+
+	CAudioEngine();
+	~CAudioEngine();
+
+	// Opens the sink at deviceRate and starts the thread. Nothing is played
+	// until startDepthMs of audio is buffered, or the depth floor once
+	// underruns raised it; beyond maxDepthMs the oldest audio is discarded.
+	bool start(IAudioSink* sink, unsigned int streamRate, unsigned int deviceRate, unsigned int channels,
+		CAudioResampler::EQuality quality, int maxDepthMs, int startDepthMs);
+	// Stops the thread and closes the sink
+	void stop();
+	bool running() const { return m_hThread != NULL; }
+
+	// Producer, one thread. timelineNs is when the first frame belongs on the
+	// local clock, 0 when unknown. Returns the frames that fit.
+	unsigned int write(const float* samples, unsigned int frames, LONGLONG timelineNs);
+	unsigned int write(const Sint16* samples, unsigned int frames, LONGLONG timelineNs);
+
+	// Any thread
+	void setTargetDepthMs(int depthMs) { InterlockedExchange(&m_targetDepthMs, depthMs); }
+	void setGain(float gain) { m_gain = gain; }
+	void setLimiter(bool enabled) { m_limit = enabled; }
+	int depthMs() const;
+	// From a frame written now to it being heard
+	LONGLONG latencyNs() const;
+	float peakLevel() const { return m_peakLevel; }
+	float limiterGain() const { return m_limiterGain; }
+	void getStats(SStats* stats) const;
+
+	static LONGLONG nowNs();
+
+private:
+	// Stream frames converted per pass
+	static const unsigned int CHUNK_FRAMES = 1024;
+
+	static DWORD WINAPI threadProc(LPVOID param);
+	void run();
+	void service(LONGLONG nowNs);
+	void trackDevice(LONGLONG nowNs, unsigned int queued);
+	double resampleRatio(unsigned int queued);
+	int targetDepthMs() const;
+	void raiseDepthFloor(int starvedMs);
+	void noteTimeline(unsigned int frames, LONGLONG timelineNs);
+
+	IAudioSink* m_sink;
+	HANDLE m_hThread;
+	HANDLE m_hStopEvent;
+	unsigned int m_streamRate;
+	unsigned int m_deviceRate;
+	unsigned int m_channels;
+	unsigned int m_maxStreamFrames;
+	unsigned int m_startStreamFrames;
+	int m_startDepthMs;
+	int m_maxDepthFloorMs;
+	LONGLONG m_startNs;
+	unsigned int m_sinkQueueFrames;
+	unsigned int m_deviceLatencyFrames;
+
+	CAudioRing m_input;                 // Stream rate, producer -> engine thread
+	volatile LONG m_targetDepthMs;
+	volatile float m_gain;
+	volatile bool m_limit;
+
+	// Producer: the sender clock
+	unsigned long long m_producedFrames;
+	LONGLONG m_senderAnchorNs;
+	unsigned long long m_senderAnchorFrames;
+	LONGLONG m_senderNextNs;            // Anchor that takes over as the span slides
+	unsigned long long m_senderNextFrames;
+	double m_senderRate;
+	volatile LONGLONG m_senderRateMilliHz;  // Published to the engine thread
+
+	// Engine thread
+	CAudioResampler m_resampler;
+	CAudioOutputStage m_outputStage;
+	float* m_scratch;
+	unsigned int m_scratchFrames;
+	bool m_playing;
+	bool m_dry;
+	LONGLONG m_dryNs;                   // When the last underrun began, until input is back
+	unsigned long long m_sinkWritten;
+	bool m_deviceLocked;                // The loop below has a position to track
+	double m_devicePos;                 // Frames consumed at m_deviceTimeNs, smoothed
+	double m_deviceClock;               // Frames per second
+	LONGLONG m_deviceTimeNs;
+
+	// Published by the engine thread
+	volatile LONG m_sinkQueued;
+	volatile LONGLONG m_deviceRateMilliHz;
+	volatile LONGLONG m_ratioPpb;       // Last ratio, in parts per billion
+	volatile float m_peakLevel;
+	volatile float m_limiterGain;
+	volatile LONG m_underruns;
+	volatile LONG m_dropped;
+	volatile LONG m_depthFloorMs;
+	volatile LONG m_firstAudibleMs;
+};
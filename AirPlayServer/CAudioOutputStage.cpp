@@ -0,0 +1,259 @@
+#include "CAudioOutputStage.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OUTPUT_STAGE_SSE2 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define OUTPUT_STAGE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Largest magnitude among count samples
+static float peakAbs(const float* samples, unsigned int count)
+{
+	unsigned int i = 0;
+	float peak = 0.0f;
+#if defined(OUTPUT_STAGE_SSE2)
+	// Clearing the sign bit is the absolute value
+	const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 m = _mm_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(samples + i), magnitude));
+		m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(samples + i + 4), magnitude));
+	}
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	peak = _mm_cvtss_f32(m);
+#elif defined(OUTPUT_STAGE_NEON)
+	float32x4_t m = vdupq_n_f32(0.0f);
+	for (; i + 8 <= count; i += 8) {
+		m = vmaxq_f32(m, vabsq_f32(vld1q_f32(samples + i)));
+		m = vmaxq_f32(m, vabsq_f32(vld1q_f32(samples + i + 4)));
+	}
+	peak = vmaxvq_f32(m);
+#endif
+	for (; i < count; i++) {
+		float v = fabsf(samples[i]);
+		if (v > peak) {
+			peak = v;
+		}
+	}
+	return peak;
+}
+
+// out = in * gain; out may be in
+static void applyGain(float* out, const float* in, unsigned int count, float gain)
+{
+	unsigned int i = 0;
+	if (gain == 1.0f) {
+		memmove(out, in, count * sizeof(float));
+		return;
+	}
+#if defined(OUTPUT_STAGE_SSE2)
+	const __m128 g = _mm_set1_ps(gain);
+	for (; i + 8 <= count; i += 8) {
+		__m128 lo = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+		__m128 hi = _mm_mul_ps(_mm_loadu_ps(in + i + 4), g);
+		_mm_storeu_ps(out + i, lo);
+		_mm_storeu_ps(out + i + 4, hi);
+	}
+#elif defined(OUTPUT_STAGE_NEON)
+	for (; i + 8 <= count; i += 8) {
+		float32x4_t lo = vmulq_n_f32(vld1q_f32(in + i), gain);
+		float32x4_t hi = vmulq_n_f32(vld1q_f32(in + i + 4), gain);
+		vst1q_f32(out + i, lo);
+		vst1q_f32(out + i + 4, hi);
+	}
+#endif
+	for (; i < count; i++) {
+		out[i] = in[i] * gain;
+	}
+}
+
+// out[i] = in[i] * gains[i]; out may be in
+static void applyGains(float* out, const float* in, const float* gains, unsigned int count)
+{
+	unsigned int i = 0;
+#if defined(OUTPUT_STAGE_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		__m128 lo = _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(gains + i));
+		__m128 hi = _mm_mul_ps(_mm_loadu_ps(in + i + 4), _mm_loadu_ps(gains + i + 4));
+		_mm_storeu_ps(out + i, lo);
+		_mm_storeu_ps(out + i + 4, hi);
+	}
+#elif defined(OUTPUT_STAGE_NEON)
+	for (; i + 8 <= count; i += 8) {
+		float32x4_t lo = vmulq_f32(vld1q_f32(in + i), vld1q_f32(gains + i));
+		float32x4_t hi = vmulq_f32(vld1q_f32(in + i + 4), vld1q_f32(gains + i + 4));
+		vst1q_f32(out + i, lo);
+		vst1q_f32(out + i + 4, hi);
+	}
+#endif
+	for (; i < count; i++) {
+		out[i] = in[i] * gains[i];
+	}
+}
+
+CAudioOutputStage::CAudioOutputStage()
+	: m_channels(0)
+	, m_lookahead(0)
+	, m_scratch(NULL)
+	, m_gains(NULL)
+	, m_attackCoef(0.0f)
+	, m_releaseCoef(0.0f)
+	, m_limiterGain(1.0f)
+	, m_holdPeak(0.0f)
+	, m_holdTarget(1.0f)
+	, m_holdFrames(0)
+	, m_fadeFrames(0)
+	, m_blockPeak(0.0f)
+{
+}
+
+CAudioOutputStage::~CAudioOutputStage()
+{
+	release();
+}
+
+void CAudioOutputStage::release()
+{
+	_aligned_free(m_scratch);
+	_aligned_free(m_gains);
+	m_scratch = NULL;
+	m_gains = NULL;
+	m_channels = 0;
+	m_lookahead = 0;
+}
+
+bool CAudioOutputStage::init(unsigned int sampleRate, unsigned int channels)
+{
+	release();
+	if (sampleRate == 0 || channels == 0) {
+		return false;
+	}
+	m_lookahead = (unsigned int)(sampleRate * LIMITER_ATTACK);
+	if (m_lookahead == 0) {
+		m_lookahead = 1;
+	}
+	m_scratch = (float*)_aligned_malloc((size_t)(m_lookahead + CHUNK_FRAMES) * channels * sizeof(float), 64);
+	m_gains = (float*)_aligned_malloc((size_t)CHUNK_FRAMES * channels * sizeof(float), 64);
+	if (m_scratch == NULL || m_gains == NULL) {
+		release();
+		return false;
+	}
+	m_channels = channels;
+
+	// Attack gets within 2% of its target over the look-ahead; release is
+	// a plain time constant
+	m_attackCoef = (float)exp(-4.0 / m_lookahead);
+	m_releaseCoef = (float)exp(-1.0 / (sampleRate * LIMITER_RELEASE));
+	reset();
+	return true;
+}
+
+void CAudioOutputStage::reset()
+{
+	if (m_scratch != NULL) {
+		memset(m_scratch, 0, (size_t)m_lookahead * m_channels * sizeof(float));
+	}
+	m_limiterGain = 1.0f;
+	m_holdPeak = 0.0f;
+	m_holdTarget = 1.0f;
+	m_holdFrames = 0;
+	m_fadeFrames = 0;
+	m_blockPeak = 0.0f;
+}
+
+float CAudioOutputStage::limiterStep(float framePeak)
+{
+	// Hold the loudest frame for as long as it is in the look-ahead, so the
+	// gain stays down until it has been played
+	if (framePeak >= m_holdPeak || m_holdFrames == 0) {
+		if (framePeak != m_holdPeak) {
+			m_holdPeak = framePeak;
+			m_holdTarget = 1.0f;
+			if (m_holdPeak > LIMITER_THRESHOLD) {
+				m_holdTarget = (LIMITER_THRESHOLD + (m_holdPeak - LIMITER_THRESHOLD) * LIMITER_RATIO) / m_holdPeak;
+			}
+		}
+		m_holdFrames = m_lookahead;
+	} else {
+		m_holdFrames--;
+	}
+
+	const float target = m_holdTarget;
+	float coef = (target < m_limiterGain) ? m_attackCoef : m_releaseCoef;
+	m_limiterGain = target + (m_limiterGain - target) * coef;
+	if (target == 1.0f && m_limiterGain > 0.9999f) {
+		m_limiterGain = 1.0f;
+	}
+	return m_limiterGain;
+}
+
+void CAudioOutputStage::processChunk(float* samples, unsigned int frames, float gain, bool limit)
+{
+	const unsigned int count = frames * m_channels;
+	float* incoming = m_scratch + m_lookahead * m_channels;
+	memcpy(incoming, samples, count * sizeof(float));
+
+	float peak = peakAbs(incoming, count);
+	if (peak > m_blockPeak) {
+		m_blockPeak = peak;
+	}
+
+	// A limiter just switched off releases back to unity first
+	bool limiting = limit || m_limiterGain < 1.0f;
+	if (!limiting && m_fadeFrames == 0) {
+		// Common case: one gain for the whole chunk
+		applyGain(samples, m_scratch, count, gain);
+	} else {
+		// The gain for each frame going out comes from the frame coming in
+		// a look-ahead later
+		float* gains = m_gains;
+		for (unsigned int f = 0; f < frames; f++) {
+			float frameGain = gain;
+			if (limiting) {
+				float framePeak = 0.0f;
+				if (limit) {
+					const float* frame = incoming + f * m_channels;
+					for (unsigned int c = 0; c < m_channels; c++) {
+						float v = fabsf(frame[c]);
+						if (v > framePeak) {
+							framePeak = v;
+						}
+					}
+				}
+				frameGain *= limiterStep(framePeak);
+			}
+			if (m_fadeFrames > 0) {
+				frameGain *= (float)(FADE_IN_FRAMES - m_fadeFrames) / (float)FADE_IN_FRAMES;
+				m_fadeFrames--;
+			}
+			for (unsigned int c = 0; c < m_channels; c++) {
+				*gains++ = frameGain;
+			}
+		}
+		applyGains(samples, m_scratch, m_gains, count);
+	}
+
+	// The newest frames wait out the look-ahead for the next chunk
+	memmove(m_scratch, m_scratch + count, (size_t)m_lookahead * m_channels * sizeof(float));
+}
+
+void CAudioOutputStage::process(float* samples, unsigned int frames, float gain, bool limit)
+{
+	m_blockPeak = 0.0f;
+	if (m_scratch == NULL) {
+		return;
+	}
+	while (frames > 0) {
+		unsigned int chunk = (frames < CHUNK_FRAMES) ? frames : CHUNK_FRAMES;
+		processChunk(samples, chunk, gain, limit);
+		samples += chunk * m_channels;
+		frames -= chunk;
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Windows.h>
+
+// Last processing on the way to the device, run by the audio engine on a
+// block the resampler just produced: the peak meter, the optional limiter,
+// the volume and the fade-in after an underrun. Samples pass through a delay
+// of lookaheadFrames() so the limiter sees a peak coming and has the gain
+// down by the time it is played. The delay is there even with the limiter
+// off, so switching it does not move the audio in time.
+class CAudioOutputStage
+{
+public:
+	// Peaks above the threshold are compressed: the part above it is played
+	// at LIMITER_RATIO. Attack is also the look-ahead.
+	static constexpr float LIMITER_THRESHOLD = 0.5f;
+	static constexpr float LIMITER_RATIO = 0.6f;
+	static constexpr float LIMITER_ATTACK = 0.002f;
+	static constexpr float LIMITER_RELEASE = 0.100f;
+	static const unsigned int FADE_IN_FRAMES = 128;
+
+	CAudioOutputStage();
+	~CAudioOutputStage();
+
+	// Only call while the engine thread is not running
+	bool init(unsigned int sampleRate, unsigned int channels);
+	void reset();
+
+	// In place on interleaved samples, full scale at 1.0. gain is the volume,
+	// 0 to 1, applied after the limiter; limit turns the limiter on. Nothing
+	// is clipped here: the device conversion does that, if it has to.
+	void process(float* samples, unsigned int frames, float gain, bool limit);
+	// The next block starts from silence, so resuming after a gap does not click
+	void startFadeIn() { m_fadeFrames = FADE_IN_FRAMES; }
+
+	// Largest input level of the last block, 1 at full scale, before any gain
+	float blockPeak() const { return m_blockPeak; }
+	// Gain the limiter applied at the end of the last block
+	float limiterGain() const { return m_limiterGain; }
+	unsigned int lookaheadFrames() const { return m_lookahead; }
+
+private:
+	// Frames processed per pass, bounding the scratch buffers
+	static const unsigned int CHUNK_FRAMES = 1024;
+
+	void release();
+	void processChunk(float* samples, unsigned int frames, float gain, bool limit);
+	float limiterStep(float framePeak);
+
+	unsigned int m_channels;
+	unsigned int m_lookahead;
+	float* m_scratch;            // Delayed frames, then the chunk being processed
+	float* m_gains;              // Gain per output sample of a chunk, when it varies
+	float m_attackCoef;
+	float m_releaseCoef;
+	float m_limiterGain;
+	float m_holdPeak;            // Loudest frame still in the look-ahead window
+	float m_holdTarget;          // Limiter gain that peak calls for
+	unsigned int m_holdFrames;
+	unsigned int m_fadeFrames;
+	float m_blockPeak;
+};
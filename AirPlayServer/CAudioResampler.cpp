@@ -0,0 +1,403 @@
+#include "CAudioResampler.h"
+
+#include <malloc.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RESAMPLER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define RESAMPLER_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC compiles AVX2 intrinsics in any function; GCC and Clang need it marked
+#if defined(RESAMPLER_X86) && defined(__GNUC__)
+#define RESAMPLER_AVX2_FUNC __attribute__((target("avx2")))
+#else
+#define RESAMPLER_AVX2_FUNC
+#endif
+
+static const double RESAMPLER_PI = 3.14159265358979323846;
+
+// Sum of x[k] * (c0[k] + mix * (c1[k] - c0[k])): one output sample from the
+// two phases either side of its position
+typedef float (*DotFunc)(const float* x, const float* c0, const float* c1, float mix, unsigned int taps);
+
+static float dotScalar(const float* x, const float* c0, const float* c1, float mix, unsigned int taps)
+{
+	float a = 0.0f;
+	float b = 0.0f;
+	for (unsigned int k = 0; k < taps; k++) {
+		a += x[k] * c0[k];
+		b += x[k] * c1[k];
+	}
+	return a + (b - a) * mix;
+}
+
+#if defined(RESAMPLER_X86)
+static inline float sumSse(__m128 v)
+{
+	__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(v, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+}
+
+// taps is a multiple of 8 and the coefficient rows are 32-byte aligned
+static float dotSse2(const float* x, const float* c0, const float* c1, float mix, unsigned int taps)
+{
+	__m128 a = _mm_setzero_ps();
+	__m128 b = _mm_setzero_ps();
+	for (unsigned int k = 0; k < taps; k += 4) {
+		__m128 v = _mm_loadu_ps(x + k);
+		a = _mm_add_ps(a, _mm_mul_ps(v, _mm_load_ps(c0 + k)));
+		b = _mm_add_ps(b, _mm_mul_ps(v, _mm_load_ps(c1 + k)));
+	}
+	a = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(mix)));
+	return sumSse(a);
+}
+
+RESAMPLER_AVX2_FUNC
+static float dotAvx2(const float* x, const float* c0, const float* c1, float mix, unsigned int taps)
+{
+	__m256 a = _mm256_setzero_ps();
+	__m256 b = _mm256_setzero_ps();
+	for (unsigned int k = 0; k < taps; k += 8) {
+		__m256 v = _mm256_loadu_ps(x + k);
+		a = _mm256_add_ps(a, _mm256_mul_ps(v, _mm256_load_ps(c0 + k)));
+		b = _mm256_add_ps(b, _mm256_mul_ps(v, _mm256_load_ps(c1 + k)));
+	}
+	a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), _mm256_set1_ps(mix)));
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	return sumSse(sum);
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// The OS has to save the YMM registers as well
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+		return false;
+	}
+	if ((_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#if defined(RESAMPLER_NEON)
+static float dotNeon(const float* x, const float* c0, const float* c1, float mix, unsigned int taps)
+{
+	float32x4_t a = vdupq_n_f32(0.0f);
+	float32x4_t b = vdupq_n_f32(0.0f);
+	for (unsigned int k = 0; k < taps; k += 4) {
+		float32x4_t v = vld1q_f32(x + k);
+		a = vfmaq_f32(a, v, vld1q_f32(c0 + k));
+		b = vfmaq_f32(b, v, vld1q_f32(c1 + k));
+	}
+	a = vfmaq_n_f32(a, vsubq_f32(b, a), mix);
+	return vaddvq_f32(a);
+}
+#endif
+
+struct SResamplerKernel {
+	DotFunc dot;
+	const char* name;
+};
+
+static SResamplerKernel pickKernel()
+{
+	SResamplerKernel kernel = { dotScalar, "scalar" };
+#if defined(RESAMPLER_X86)
+	// SSE2 is part of every x64 CPU and of the x86 Windows baseline
+	kernel.dot = dotSse2;
+	kernel.name = "sse2";
+	if (cpuHasAvx2()) {
+		kernel.dot = dotAvx2;
+		kernel.name = "avx2";
+	}
+#elif defined(RESAMPLER_NEON)
+	kernel.dot = dotNeon;
+	kernel.name = "neon";
+#endif
+	return kernel;
+}
+
+static const SResamplerKernel& resamplerKernel()
+{
+	static const SResamplerKernel s_kernel = pickKernel();
+	return s_kernel;
+}
+
+// Modified Bessel function of the first kind, order zero, for the Kaiser window
+static double besselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double half = x / 2.0;
+	for (int k = 1; k < 64; k++) {
+		term *= (half / k) * (half / k);
+		sum += term;
+		if (term < sum * 1e-12) {
+			break;
+		}
+	}
+	return sum;
+}
+
+CAudioResampler::CAudioResampler()
+	: m_channels(0)
+	, m_taps(0)
+	, m_quality(QUALITY_LINEAR)
+	, m_coefs(NULL)
+	, m_history(NULL)
+	, m_stride(0)
+	, m_historyFrames(0)
+	, m_pos(0.0)
+{
+}
+
+CAudioResampler::~CAudioResampler()
+{
+	release();
+}
+
+void CAudioResampler::release()
+{
+	_aligned_free(m_coefs);
+	_aligned_free(m_history);
+	m_coefs = NULL;
+	m_history = NULL;
+	m_channels = 0;
+	m_taps = 0;
+	m_stride = 0;
+}
+
+bool CAudioResampler::init(unsigned int channels, double nominalRatio, EQuality quality)
+{
+	release();
+	if (channels == 0 || channels > MAX_CHANNELS || nominalRatio <= 0.0) {
+		return false;
+	}
+
+	// Passband edge as a share of the lower Nyquist frequency, and the Kaiser
+	// beta trading transition width for stopband depth at that length
+	unsigned int taps = 2;
+	double rolloff = 1.0;
+	double beta = 0.0;
+	if (quality == QUALITY_SINC16) {
+		taps = 16;
+		rolloff = 0.86;
+		beta = 6.0;
+	} else if (quality == QUALITY_SINC32) {
+		taps = 32;
+		rolloff = 0.92;
+		beta = 8.5;
+	} else {
+		quality = QUALITY_LINEAR;
+	}
+
+	m_stride = (taps + CHUNK_FRAMES + 7) & ~7u;
+	m_coefs = (float*)_aligned_malloc((size_t)(PHASES + 1) * taps * sizeof(float), 32);
+	m_history = (float*)_aligned_malloc((size_t)channels * m_stride * sizeof(float), 32);
+	if (m_coefs == NULL || m_history == NULL) {
+		release();
+		return false;
+	}
+	m_channels = channels;
+	m_taps = taps;
+	m_quality = quality;
+
+	// Row p holds the taps for an output p / PHASES of a frame past the centre
+	// tap, which is taps / 2 - 1. Each row is scaled to unity gain at DC so
+	// the gain does not change with the phase.
+	double cutoff = rolloff * (nominalRatio < 1.0 ? nominalRatio : 1.0);
+	double i0Beta = besselI0(beta);
+	double half = (double)(taps / 2);
+	for (unsigned int p = 0; p <= PHASES; p++) {
+		float* row = m_coefs + p * taps;
+		double coefs[32];
+		double sum = 0.0;
+		for (unsigned int k = 0; k < taps; k++) {
+			double t = (double)p / PHASES + (half - 1.0) - (double)k;
+			double h;
+			if (quality == QUALITY_LINEAR) {
+				h = 1.0 - fabs(t);
+			} else {
+				double x = t / half;
+				double arg = cutoff * t * RESAMPLER_PI;
+				double window = (x > -1.0 && x < 1.0) ? besselI0(beta * sqrt(1.0 - x * x)) / i0Beta : 0.0;
+				h = ((arg != 0.0) ? sin(arg) / arg : 1.0) * window;
+			}
+			coefs[k] = h;
+			sum += h;
+		}
+		for (unsigned int k = 0; k < taps; k++) {
+			row[k] = (float)(coefs[k] / sum);
+		}
+	}
+
+	reset();
+	return true;
+}
+
+void CAudioResampler::reset()
+{
+	if (m_history == NULL) {
+		return;
+	}
+	// Silence before the first frame, so the first output is the first input
+	memset(m_history, 0, (size_t)m_channels * m_stride * sizeof(float));
+	m_historyFrames = m_taps / 2 - 1;
+	m_pos = 0.0;
+}
+
+unsigned int CAudioResampler::maxOutputFrames(unsigned int inFrames, double ratio) const
+{
+	// Plus one for the position carried in, one for rounding
+	return (unsigned int)((double)inFrames * ratio) + 2;
+}
+
+const char* CAudioResampler::kernelName()
+{
+	return resamplerKernel().name;
+}
+
+unsigned int CAudioResampler::appendInput(const Sint16* in, unsigned int frames)
+{
+	const float scale = 1.0f / 32768.0f;
+	unsigned int room = m_stride - m_historyFrames;
+	if (frames > room) {
+		frames = room;
+	}
+	for (unsigned int c = 0; c < m_channels; c++) {
+		float* row = m_history + c * m_stride + m_historyFrames;
+		const Sint16* src = in + c;
+		for (unsigned int n = 0; n < frames; n++) {
+			row[n] = (float)src[n * m_channels] * scale;
+		}
+	}
+	m_historyFrames += frames;
+	return frames;
+}
+
+unsigned int CAudioResampler::appendInput(const float* in, unsigned int frames)
+{
+	unsigned int room = m_stride - m_historyFrames;
+	if (frames > room) {
+		frames = room;
+	}
+	for (unsigned int c = 0; c < m_channels; c++) {
+		float* row = m_history + c * m_stride + m_historyFrames;
+		const float* src = in + c;
+		for (unsigned int n = 0; n < frames; n++) {
+			row[n] = src[n * m_channels];
+		}
+	}
+	m_historyFrames += frames;
+	return frames;
+}
+
+unsigned int CAudioResampler::produce(float* out, unsigned int maxFrames, double step)
+{
+	// The SIMD kernels need whole vectors; linear has only two taps
+	DotFunc dot = (m_taps % 8 == 0) ? resamplerKernel().dot : dotScalar;
+	unsigned int made = 0;
+
+	while (made < maxFrames) {
+		unsigned int first = (unsigned int)m_pos;
+		if (first + m_taps > m_historyFrames) {
+			break;
+		}
+		double phase = (m_pos - first) * PHASES;
+		unsigned int p = (unsigned int)phase;
+		float mix = (float)(phase - p);
+		const float* c0 = m_coefs + p * m_taps;
+		const float* c1 = c0 + m_taps;
+		for (unsigned int c = 0; c < m_channels; c++) {
+			*out++ = dot(m_history + c * m_stride + first, c0, c1, mix, m_taps);
+		}
+		made++;
+		m_pos += step;
+	}
+	return made;
+}
+
+void CAudioResampler::compact()
+{
+	unsigned int drop = (unsigned int)m_pos;
+	if (drop > m_historyFrames) {
+		drop = m_historyFrames;
+	}
+	if (drop == 0) {
+		return;
+	}
+	for (unsigned int c = 0; c < m_channels; c++) {
+		float* row = m_history + c * m_stride;
+		memmove(row, row + drop, (m_historyFrames - drop) * sizeof(float));
+	}
+	m_historyFrames -= drop;
+	m_pos -= drop;
+}
+
+unsigned int CAudioResampler::process(const Sint16* in, unsigned int inFrames, float* out, unsigned int maxOutFrames, double ratio)
+{
+	unsigned int written = 0;
+	if (m_history == NULL || ratio <= 0.0) {
+		return 0;
+	}
+	double step = 1.0 / ratio;
+
+	while (inFrames > 0) {
+		unsigned int taken = appendInput(in, (inFrames < CHUNK_FRAMES) ? inFrames : CHUNK_FRAMES);
+		if (taken == 0) {
+			// The output is full and the history with it
+			break;
+		}
+		in += taken * m_channels;
+		inFrames -= taken;
+
+		written += produce(out + written * m_channels, maxOutFrames - written, step);
+		compact();
+	}
+	return written;
+}
+
+unsigned int CAudioResampler::process(const float* in, unsigned int inFrames, float* out, unsigned int maxOutFrames, double ratio)
+{
+	unsigned int written = 0;
+	if (m_history == NULL || ratio <= 0.0) {
+		return 0;
+	}
+	double step = 1.0 / ratio;
+
+	while (inFrames > 0) {
+		unsigned int taken = appendInput(in, (inFrames < CHUNK_FRAMES) ? inFrames : CHUNK_FRAMES);
+		if (taken == 0) {
+			break;
+		}
+		in += taken * m_channels;
+		inFrames -= taken;
+
+		written += produce(out + written * m_channels, maxOutFrames - written, step);
+		compact();
+	}
+	return written;
+}
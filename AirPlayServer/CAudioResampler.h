@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Windows.h>
+#include "SDL.h"
+
+// Sample rate conversion from the stream to the device rate. Interleaved 16-bit or
+// float PCM goes in and float comes out; the ratio may change on every call,
+// so the drift control in CAudioEngine can steer it. The sinc qualities take their
+// coefficients from a polyphase table, interpolated between neighbouring
+// phases so any ratio works. Input history is carried across calls, so packet boundaries are not
+// heard. Only one thread uses an instance.
+class CAudioResampler
+{
+public:
+	enum EQuality {
+		QUALITY_LINEAR = 0,  // Two taps: cheapest, but images and aliases are audible
+		QUALITY_SINC16,      // 16-tap Kaiser-windowed sinc
+		QUALITY_SINC32,      // 32-tap: flatter passband, steeper and deeper stopband
+	};
+
+	static const unsigned int MAX_CHANNELS = 8;
+
+	CAudioResampler();
+	~CAudioResampler();
+
+	// nominalRatio is the output rate over the input rate; the anti-alias
+	// cutoff is placed for it. Allocates, so only call outside the audio path.
+	bool init(unsigned int channels, double nominalRatio, EQuality quality);
+	// Forgets the history, for a new stream
+	void reset();
+
+	// Most frames process() can return for inFrames at ratio
+	unsigned int maxOutputFrames(unsigned int inFrames, double ratio) const;
+	// Converts inFrames at ratio, output over input rate, and returns the
+	// frames written. Input that would overflow maxOutFrames is dropped, so
+	// size out with maxOutputFrames(). Float samples are full scale at 1.0.
+	unsigned int process(const Sint16* in, unsigned int inFrames, float* out, unsigned int maxOutFrames, double ratio);
+	unsigned int process(const float* in, unsigned int inFrames, float* out, unsigned int maxOutFrames, double ratio);
+
+	// Input frames held back until the filter can see past them
+	unsigned int latencyFrames() const { return m_taps / 2; }
+	unsigned int taps() const { return m_taps; }
+	EQuality quality() const { return m_quality; }
+	// The filter kernel this CPU runs: "avx2", "sse2", "neon" or "scalar"
+	static const char* kernelName();
+
+private:
+	// Coefficient sets per input frame; with interpolation between them the
+	// phase error stays well under the stopband of either sinc quality
+	static const unsigned int PHASES = 256;
+	// Input converted per pass
+	static const unsigned int CHUNK_FRAMES = 1024;
+
+	void release();
+	unsigned int appendInput(const Sint16* in, unsigned int frames);
+	unsigned int appendInput(const float* in, unsigned int frames);
+	unsigned int produce(float* out, unsigned int maxFrames, double step);
+	void compact();
+
+	unsigned int m_channels;
+	unsigned int m_taps;
+	EQuality m_quality;
+	float* m_coefs;              // (PHASES + 1) rows of m_taps, 32-byte aligned
+	float* m_history;            // One row of m_stride floats per channel
+	unsigned int m_stride;
+	unsigned int m_historyFrames;
+	double m_pos;                // First tap of the next output, in history frames
+};
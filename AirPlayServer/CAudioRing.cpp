@@ -0,0 +1,145 @@
+#include "CAudioRing.h"
+
+#include <malloc.h>
+#include <string.h>
+
+CAudioRing::CAudioRing()
+	: m_samples(NULL)
+	, m_capacity(0)
+	, m_channels(0)
+	, m_head(0)
+	, m_tail(0)
+{
+}
+
+CAudioRing::~CAudioRing()
+{
+	_aligned_free(m_samples);
+	m_samples = NULL;
+}
+
+bool CAudioRing::init(unsigned int minFrames, unsigned int channels)
+{
+	unsigned int capacity = 1024;
+	while (capacity < minFrames && capacity < 0x40000000) {
+		capacity <<= 1;
+	}
+
+	if (capacity != m_capacity || channels != m_channels) {
+		_aligned_free(m_samples);
+		m_samples = (float*)_aligned_malloc((size_t)capacity * channels * sizeof(float), 64);
+		if (m_samples == NULL) {
+			m_capacity = 0;
+			m_channels = 0;
+			return false;
+		}
+		m_capacity = capacity;
+		m_channels = channels;
+	}
+	reset();
+	return true;
+}
+
+void CAudioRing::reset()
+{
+	InterlockedExchange(&m_head, 0);
+	InterlockedExchange(&m_tail, 0);
+}
+
+unsigned int CAudioRing::writable(unsigned int frames, unsigned int* pStart, unsigned int* pFirst) const
+{
+	if (m_samples == NULL) {
+		return 0;
+	}
+
+	LONG head = m_head;
+	LONG tail = InterlockedCompareExchange((volatile LONG*)&m_tail, 0, 0);
+	unsigned int space = m_capacity - (unsigned int)(ULONG)(head - tail);
+	if (frames > space) {
+		frames = space;
+	}
+
+	// Up to two runs: to the end of the buffer, then wrapped to the start
+	*pStart = (unsigned int)head & (m_capacity - 1);
+	*pFirst = m_capacity - *pStart;
+	if (*pFirst > frames) {
+		*pFirst = frames;
+	}
+	return frames;
+}
+
+void CAudioRing::publish(unsigned int frames)
+{
+	// The samples are written before the new head becomes visible
+	InterlockedExchange(&m_head, m_head + (LONG)frames);
+}
+
+unsigned int CAudioRing::write(const float* samples, unsigned int frames)
+{
+	unsigned int start = 0;
+	unsigned int first = 0;
+	frames = writable(frames, &start, &first);
+	if (frames == 0) {
+		return 0;
+	}
+	memcpy(m_samples + (size_t)start * m_channels, samples, (size_t)first * m_channels * sizeof(float));
+	memcpy(m_samples, samples + (size_t)first * m_channels, (size_t)(frames - first) * m_channels * sizeof(float));
+	publish(frames);
+	return frames;
+}
+
+unsigned int CAudioRing::write(const Sint16* samples, unsigned int frames)
+{
+	unsigned int start = 0;
+	unsigned int first = 0;
+	frames = writable(frames, &start, &first);
+	if (frames == 0) {
+		return 0;
+	}
+	const float scale = 1.0f / 32768.0f;
+	float* dst = m_samples + (size_t)start * m_channels;
+	size_t count = (size_t)first * m_channels;
+	for (size_t i = 0; i < count; i++) {
+		dst[i] = (float)samples[i] * scale;
+	}
+	samples += count;
+	count = (size_t)(frames - first) * m_channels;
+	for (size_t i = 0; i < count; i++) {
+		m_samples[i] = (float)samples[i] * scale;
+	}
+	publish(frames);
+	return frames;
+}
+
+unsigned int CAudioRing::peek(const float** ppSamples, unsigned int maxFrames) const
+{
+	LONG tail = m_tail;
+	LONG head = InterlockedCompareExchange((volatile LONG*)&m_head, 0, 0);
+	unsigned int frames = (unsigned int)(ULONG)(head - tail);
+	if (frames == 0 || m_samples == NULL) {
+		*ppSamples = NULL;
+		return 0;
+	}
+
+	unsigned int start = (unsigned int)tail & (m_capacity - 1);
+	if (frames > m_capacity - start) {
+		frames = m_capacity - start;
+	}
+	if (frames > maxFrames) {
+		frames = maxFrames;
+	}
+	*ppSamples = m_samples + (size_t)start * m_channels;
+	return frames;
+}
+
+void CAudioRing::consume(unsigned int frames)
+{
+	InterlockedExchange(&m_tail, m_tail + (LONG)frames);
+}
+
+unsigned int CAudioRing::available() const
+{
+	LONG head = InterlockedCompareExchange((volatile LONG*)&m_head, 0, 0);
+	LONG tail = InterlockedCompareExchange((volatile LONG*)&m_tail, 0, 0);
+	return (unsigned int)(ULONG)(head - tail);
+}
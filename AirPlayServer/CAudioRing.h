@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Windows.h>
+#include "SDL.h"
+
+// Interleaved float PCM between outputAudio (the only producer) and the
+// audio engine thread (the only consumer). Sizes are in sample frames, one sample
+// per channel. Neither side blocks or allocates; storage is sized by init().
+class CAudioRing
+{
+public:
+	CAudioRing();
+	~CAudioRing();
+
+	// Room for at least minFrames, rounded up to a power of two. Only call
+	// while neither side is running.
+	bool init(unsigned int minFrames, unsigned int channels);
+	void reset();
+
+	// Producer. Copies as many frames as fit and returns that count; 16-bit
+	// samples are converted on the way in.
+	unsigned int write(const float* samples, unsigned int frames);
+	unsigned int write(const Sint16* samples, unsigned int frames);
+
+	// Consumer. Points at up to maxFrames readable frames that are contiguous in
+	// memory and returns their count; call consume() once they are used.
+	unsigned int peek(const float** ppSamples, unsigned int maxFrames) const;
+	void consume(unsigned int frames);
+
+	// Either side; a snapshot that may be stale by the time it is used
+	unsigned int available() const;
+	unsigned int capacity() const { return m_capacity; }
+	unsigned int channels() const { return m_channels; }
+
+private:
+	// Room for up to frames at the head, which starts at *pStart and runs for
+	// *pFirst frames before wrapping
+	unsigned int writable(unsigned int frames, unsigned int* pStart, unsigned int* pFirst) const;
+	void publish(unsigned int frames);
+
+	float* m_samples;
+	unsigned int m_capacity;
+	unsigned int m_channels;
+	// Free-running frame counters; only the producer writes m_head, only the consumer m_tail
+	volatile LONG m_head;
+	volatile LONG m_tail;
+};
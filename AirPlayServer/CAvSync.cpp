@@ -0,0 +1,172 @@
+#include "CAvSync.h"
+
+// Share of each new report in the running latency averages: about one
+// second of audio packets or video frames
+static const double AVSYNC_AVERAGE_WEIGHT = 0.05;
+// A stream that has not reported for this long is gone, or paused
+static const LONGLONG AVSYNC_STALE_NS = 2000000000LL;
+static const LONGLONG AVSYNC_UPDATE_NS = 1000000000LL;
+// Skew nobody notices; corrections stop inside it so they do not hunt
+static const LONGLONG AVSYNC_DEADBAND_NS = 5000000LL;
+// Video is never held longer than this for sync, even when a low frame rate
+// leaves the presentation queue room for more
+static const LONGLONG AVSYNC_MAX_VIDEO_DELAY_NS = 80000000LL;
+// The resampler moves the depth a few ms per second at most. The target only
+// moves again once the depth has caught up, so the loop does not wind up.
+static const int AVSYNC_AUDIO_STEP_MS = 10;
+static const int AVSYNC_AUDIO_SETTLED_MS = 5;
+
+CAvSync::CAvSync()
+	: m_baseAudioTargetMs(0)
+	, m_minAudioTargetMs(0)
+	, m_maxAudioTargetMs(0)
+	, m_audioLatencyNs(0)
+	, m_audioReportNs(0)
+	, m_audioResetPending(0)
+	, m_audioHaveAverage(false)
+	, m_audioAverageNs(0.0)
+	, m_audioTargetMs(0)
+{
+	reset();
+}
+
+void CAvSync::configure(int baseAudioTargetMs, int minAudioTargetMs, int maxAudioTargetMs)
+{
+	m_baseAudioTargetMs = baseAudioTargetMs;
+	m_minAudioTargetMs = minAudioTargetMs;
+	m_maxAudioTargetMs = maxAudioTargetMs;
+	InterlockedExchange(&m_audioTargetMs, baseAudioTargetMs);
+}
+
+void CAvSync::reset()
+{
+	InterlockedExchange(&m_audioResetPending, 1);
+	InterlockedExchange64(&m_audioReportNs, 0);
+	InterlockedExchange(&m_audioTargetMs, m_baseAudioTargetMs);
+	m_videoHaveAverage = false;
+	m_videoAverageNs = 0.0;
+	m_videoReportNs = 0;
+	m_lastUpdateNs = 0;
+	m_videoDelayNs = 0;
+	m_skewNs = 0.0;
+	m_active = false;
+}
+
+void CAvSync::onAudio(LONGLONG timelineNs, LONGLONG playNs)
+{
+	if (InterlockedExchange(&m_audioResetPending, 0) != 0) {
+		m_audioHaveAverage = false;
+	}
+	double latency = (double)(playNs - timelineNs);
+	if (!m_audioHaveAverage) {
+		m_audioAverageNs = latency;
+		m_audioHaveAverage = true;
+	} else {
+		m_audioAverageNs += (latency - m_audioAverageNs) * AVSYNC_AVERAGE_WEIGHT;
+	}
+	InterlockedExchange64(&m_audioLatencyNs, (LONGLONG)m_audioAverageNs);
+	InterlockedExchange64(&m_audioReportNs, playNs);
+}
+
+void CAvSync::onVideo(LONGLONG timelineNs, LONGLONG presentNs)
+{
+	double latency = (double)(presentNs - timelineNs);
+	if (!m_videoHaveAverage) {
+		m_videoAverageNs = latency;
+		m_videoHaveAverage = true;
+	} else {
+		m_videoAverageNs += (latency - m_videoAverageNs) * AVSYNC_AVERAGE_WEIGHT;
+	}
+	m_videoReportNs = presentNs;
+}
+
+void CAvSync::update(LONGLONG nowNs, int audioDepthMs, LONGLONG maxVideoDelayNs)
+{
+	if (m_lastUpdateNs != 0 && nowNs - m_lastUpdateNs < AVSYNC_UPDATE_NS) {
+		return;
+	}
+	m_lastUpdateNs = nowNs;
+
+	// The queue cuts a longer delay anyway; what it cannot hold shows up as
+	// skew again and moves to the audio target below
+	LONGLONG maxDelayNs = (maxVideoDelayNs < AVSYNC_MAX_VIDEO_DELAY_NS) ? maxVideoDelayNs : AVSYNC_MAX_VIDEO_DELAY_NS;
+	if (maxDelayNs < 0) {
+		maxDelayNs = 0;
+	}
+	if (m_videoDelayNs > maxDelayNs) {
+		m_videoDelayNs = maxDelayNs;
+	}
+
+	int audioTarget = (int)InterlockedCompareExchange(&m_audioTargetMs, 0, 0);
+	LONGLONG audioReportNs = InterlockedCompareExchange64(&m_audioReportNs, 0, 0);
+	// The audio report is stamped with its play time, ahead of now by the depth
+	m_active = m_videoHaveAverage && audioReportNs != 0 &&
+		nowNs - m_videoReportNs < AVSYNC_STALE_NS &&
+		audioReportNs - nowNs > -AVSYNC_STALE_NS;
+
+	if (!m_active) {
+		// Nothing to sync against: drift back to the plain latencies
+		m_skewNs = 0.0;
+		m_videoDelayNs -= (m_videoDelayNs < AVSYNC_DEADBAND_NS) ? m_videoDelayNs : AVSYNC_DEADBAND_NS;
+		if (audioTarget < m_baseAudioTargetMs) {
+			audioTarget += (m_baseAudioTargetMs - audioTarget < AVSYNC_AUDIO_STEP_MS) ? m_baseAudioTargetMs - audioTarget : AVSYNC_AUDIO_STEP_MS;
+		} else if (audioTarget > m_baseAudioTargetMs) {
+			audioTarget -= (audioTarget - m_baseAudioTargetMs < AVSYNC_AUDIO_STEP_MS) ? audioTarget - m_baseAudioTargetMs : AVSYNC_AUDIO_STEP_MS;
+		}
+		InterlockedExchange(&m_audioTargetMs, audioTarget);
+		return;
+	}
+
+	m_skewNs = (double)InterlockedCompareExchange64(&m_audioLatencyNs, 0, 0) - m_videoAverageNs;
+	if (m_skewNs < AVSYNC_DEADBAND_NS && m_skewNs > -AVSYNC_DEADBAND_NS) {
+		return;
+	}
+
+	// Half the skew per second: fast, but a noisy reading is not followed fully
+	LONGLONG step = (LONGLONG)(m_skewNs / 2.0);
+	bool audioSettled = audioDepthMs - audioTarget < AVSYNC_AUDIO_SETTLED_MS &&
+		audioTarget - audioDepthMs < AVSYNC_AUDIO_SETTLED_MS;
+	if (step > 0) {
+		// Audio lags: hold video back, then play audio from a shallower ring
+		LONGLONG room = maxDelayNs - m_videoDelayNs;
+		LONGLONG video = (step < room) ? step : room;
+		m_videoDelayNs += video;
+		step -= video;
+		int audioMs = (int)(step / 1000000);
+		if (audioMs > 0 && audioSettled) {
+			audioTarget -= (audioMs < AVSYNC_AUDIO_STEP_MS) ? audioMs : AVSYNC_AUDIO_STEP_MS;
+			if (audioTarget < m_minAudioTargetMs) {
+				audioTarget = m_minAudioTargetMs;
+			}
+		}
+	} else {
+		// Video lags: release the video delay, then play audio from a deeper ring
+		step = -step;
+		LONGLONG video = (step < m_videoDelayNs) ? step : m_videoDelayNs;
+		m_videoDelayNs -= video;
+		step -= video;
+		int audioMs = (int)(step / 1000000);
+		if (audioMs > 0 && audioSettled) {
+			audioTarget += (audioMs < AVSYNC_AUDIO_STEP_MS) ? audioMs : AVSYNC_AUDIO_STEP_MS;
+			if (audioTarget > m_maxAudioTargetMs) {
+				audioTarget = m_maxAudioTargetMs;
+			}
+		}
+	}
+	InterlockedExchange(&m_audioTargetMs, audioTarget);
+}
+
+int CAvSync::audioTargetMs() const
+{
+	return (int)InterlockedCompareExchange((volatile LONG*)&m_audioTargetMs, 0, 0);
+}
+
+void CAvSync::getStats(SStats* stats) const
+{
+	stats->active = m_active;
+	stats->skewMs = (float)(m_skewNs / 1000000.0);
+	stats->audioLatencyMs = (float)((double)InterlockedCompareExchange64((volatile LONGLONG*)&m_audioLatencyNs, 0, 0) / 1000000.0);
+	stats->videoLatencyMs = (float)(m_videoAverageNs / 1000000.0);
+	stats->videoDelayMs = (float)((double)m_videoDelayNs / 1000000.0);
+	stats->audioTargetMs = audioTargetMs();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Windows.h>
+
+// Lip sync for one session. Audio and video both carry the sender's timeline
+// mapped to the local clock (SFgAudioFrame.localTimeNs, SFgVideoFrame.pts).
+// Each side reports how far behind that timeline it is heard or seen, and
+// the difference is the skew. update() removes it by holding video back
+// first, which only costs latency, then by moving the audio depth target
+// the resampler steers to.
+class CAvSync
+{
+public:
+	struct SStats {
+		bool active;            // Both streams reported within the last seconds
+		float skewMs;           // Audio minus video latency; positive when audio lags
+		float audioLatencyMs;
+		float videoLatencyMs;
+		float videoDelayMs;     // Added to the video playout delay
+		int audioTargetMs;      // Audio depth the resampler steers to
+	};
+
+	CAvSync();
+
+	// Audio depth used while there is nothing to sync, and the range the
+	// controller may move it in. Call before the streams start.
+	void configure(int baseAudioTargetMs, int minAudioTargetMs, int maxAudioTargetMs);
+	// Render thread. Drops the corrections; the next reports start new averages.
+	void reset();
+
+	// Audio thread: a packet that belongs at timelineNs will be heard at playNs
+	void onAudio(LONGLONG timelineNs, LONGLONG playNs);
+	// Render thread: a frame that belongs at timelineNs was presented at presentNs
+	void onVideo(LONGLONG timelineNs, LONGLONG presentNs);
+	// Render thread, every refresh. Moves the corrections once a second;
+	// audioDepthMs is the depth the audio ring has actually reached and
+	// maxVideoDelayNs how much delay the present queue still has room for.
+	// Skew beyond that room goes to the audio depth.
+	void update(LONGLONG nowNs, int audioDepthMs, LONGLONG maxVideoDelayNs);
+
+	LONGLONG videoDelayNs() const { return m_videoDelayNs; }  // Render thread
+	int audioTargetMs() const;                               // Any thread
+	void getStats(SStats* stats) const;                      // Render thread
+
+private:
+	int m_baseAudioTargetMs;
+	int m_minAudioTargetMs;
+	int m_maxAudioTargetMs;
+
+	// Written by the audio thread only; m_audioResetPending asks it to restart
+	volatile LONGLONG m_audioLatencyNs;
+	volatile LONGLONG m_audioReportNs;    // Local time of the last audio report
+	volatile LONG m_audioResetPending;
+	bool m_audioHaveAverage;              // Audio thread
+	double m_audioAverageNs;              // Audio thread
+
+	// Render thread
+	bool m_videoHaveAverage;
+	double m_videoAverageNs;
+	LONGLONG m_videoReportNs;
+	LONGLONG m_lastUpdateNs;
+	LONGLONG m_videoDelayNs;
+	double m_skewNs;
+	bool m_active;
+
+	volatile LONG m_audioTargetMs;
+};
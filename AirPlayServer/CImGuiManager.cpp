@@ -1397,7 +1397,7 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 	float availableWidth = MaxFloat(1.0f, io.DisplaySize.x - margin * 2.0f);
 	float availableHeight = MaxFloat(1.0f, io.DisplaySize.y - margin * 2.0f);
 	float panelWidth = MinFloat(420.0f * scale, availableWidth);
-	float panelHeight = MinFloat(380.0f * scale, availableHeight);
+	float panelHeight = MinFloat(455.0f * scale, availableHeight);
 	ImVec2 panelSize(panelWidth, panelHeight);
 	ImGuiViewport* viewport = ImGui::GetMainViewport();
 	ImVec2 defaultPosition(
@@ -1432,12 +1432,22 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 	char latency[32];
 	char bitrate[32];
 	char audioQueue[32];
+	char glassToGlass[32];
+	char playoutDelay[32];
+	char avSkew[32] = "--";
+	char audioTarget[32];
 	snprintf(sourceFps, sizeof(sourceFps), "%.1f", perf.sourceFps);
 	snprintf(displayFps, sizeof(displayFps), "%.1f / %.0f", perf.displayFps, perf.targetFps);
 	snprintf(frameTime, sizeof(frameTime), "%.2f ms", perf.frameTimeMs);
 	snprintf(latency, sizeof(latency), "%.2f ms", perf.latencyMs);
 	snprintf(bitrate, sizeof(bitrate), "%.2f Mbps", perf.bitrateMbps);
-	snprintf(audioQueue, sizeof(audioQueue), "%d frames", perf.audioQueueSize);
+	snprintf(audioQueue, sizeof(audioQueue), "%d ms", perf.audioQueueMs);
+	snprintf(glassToGlass, sizeof(glassToGlass), "%.2f ms", perf.glassToGlassMs);
+	snprintf(playoutDelay, sizeof(playoutDelay), "%.2f ms", perf.playoutDelayMs);
+	snprintf(audioTarget, sizeof(audioTarget), "%d ms", perf.audioTargetMs);
+	if (perf.avSyncActive) {
+		snprintf(avSkew, sizeof(avSkew), "%+.1f ms", perf.avSkewMs);
+	}
 
 	if (ImGui::BeginTable("##LiveSummary", 4,
 		ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_NoSavedSettings)) {
@@ -1454,6 +1464,12 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 		ImGui::TableNextRow();
 		DrawMetricPair("Bitrate", bitrate, m_pFontMono);
 		DrawMetricPair("Buffer", audioQueue, m_pFontMono);
+		ImGui::TableNextRow();
+		DrawMetricPair("Glass", glassToGlass, m_pFontMono);
+		DrawMetricPair("Playout", playoutDelay, m_pFontMono);
+		ImGui::TableNextRow();
+		DrawMetricPair("A/V skew", avSkew, m_pFontMono);
+		DrawMetricPair("Audio to", audioTarget, m_pFontMono);
 		ImGui::EndTable();
 	}
 
@@ -1488,9 +1504,17 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 				perf.historySize, perf.currentIdx, 0.0f, 33.0f,
 				UI_ACCENT, 16.67f, m_pFontMono, scale);
 			ImGui::TableNextColumn();
-			DrawPerfChart("Audio buffer", NULL, "20", perf.audioQueueHistory,
-				perf.historySize, perf.currentIdx, 0.0f, 20.0f,
+			DrawPerfChart("Audio buffer", NULL, "400 ms", perf.audioQueueHistory,
+				perf.historySize, perf.currentIdx, 0.0f, 400.0f,
+				UI_ACCENT, -1.0f, m_pFontMono, scale);
+			ImGui::TableNextColumn();
+			DrawPerfChart("Glass to glass", NULL, "200 ms", perf.glassToGlassHistory,
+				perf.historySize, perf.currentIdx, 0.0f, 200.0f,
 				UI_ACCENT, -1.0f, m_pFontMono, scale);
+			ImGui::TableNextColumn();
+			DrawPerfChart("A/V skew", NULL, "+-100 ms", perf.avSkewHistory,
+				perf.historySize, perf.currentIdx, -100.0f, 100.0f,
+				UI_ACCENT, 0.0f, m_pFontMono, scale);
 			ImGui::EndTable();
 		}
 	}
@@ -1503,6 +1527,7 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 	char dataInfo[48] = "0 MB";
 	char frameInfo[64];
 	char audioInfo[64];
+	char pacingInfo[80];
 	char uptime[48] = "--";
 	if (perf.videoWidth > 0 && perf.videoHeight > 0) {
 		float ar = (float)perf.videoWidth / (float)perf.videoHeight;
@@ -1523,6 +1548,12 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 	} else {
 		snprintf(frameInfo, sizeof(frameInfo), "%llu | stable", perf.totalFrames);
 	}
+	if (perf.framesLate > 0 || perf.framesOverflow > 0 || perf.framesRepeated > 0) {
+		snprintf(pacingInfo, sizeof(pacingInfo), "%llu late | %llu overflow | %llu repeated",
+			perf.framesLate, perf.framesOverflow, perf.framesRepeated);
+	} else {
+		strcpy_s(pacingInfo, sizeof(pacingInfo), "On time");
+	}
 	if (perf.audioUnderruns > 0 || perf.audioDropped > 0) {
 		snprintf(audioInfo, sizeof(audioInfo), "%d underruns | %d dropped",
 			perf.audioUnderruns, perf.audioDropped);
@@ -1546,6 +1577,7 @@ void CImGuiManager::RenderPerfGraphs(const SPerfData& perf, bool* pOpen)
 		DrawStatRow("Video", videoInfo, m_pFontMono);
 		DrawStatRow("Transferred", dataInfo, m_pFontMono);
 		DrawStatRow("Frames", frameInfo, m_pFontMono);
+		DrawStatRow("Pacing", pacingInfo, m_pFontMono);
 		DrawStatRow("Audio", audioInfo, m_pFontMono);
 		DrawStatRow("Uptime", uptime, m_pFontMono);
 		ImGui::EndTable();
@@ -12,8 +12,10 @@ struct SPerfData
 	const float* displayFpsHistory;
 	const float* frameTimeHistory;
 	const float* latencyHistory;
+	const float* glassToGlassHistory;
 	const float* bitrateHistory;
 	const float* audioQueueHistory;
+	const float* avSkewHistory;
 	int historySize;
 	int currentIdx;
 
@@ -22,6 +24,11 @@ struct SPerfData
 	float displayFps;
 	float frameTimeMs;
 	float latencyMs;
+	float glassToGlassMs;  // Sender timestamp to present
+	float playoutDelayMs;  // Current presentation queue delay
+	bool avSyncActive;     // Both streams carry timestamps
+	float avSkewMs;        // Audio minus video latency, positive when audio lags
+	int audioTargetMs;     // Audio depth lip sync steers to, or the underrun floor
 	float bitrateMbps;
 	float targetFps;       // From quality preset (30 or 60)
 
@@ -32,10 +39,13 @@ struct SPerfData
 	// Counters
 	unsigned long long totalFrames;
 	unsigned long long droppedFrames;
+	unsigned long long framesLate;      // Superseded by a newer frame due at the same refresh
+	unsigned long long framesOverflow;  // Presentation queue was full
+	unsigned long long framesRepeated;  // Refreshes that repeated a frame
 	unsigned long long totalBytes;
 	int audioUnderruns;
 	int audioDropped;
-	int audioQueueSize;
+	int audioQueueMs;
 	float connectionTimeSec;  // Time since connect in seconds
 };
 
@@ -0,0 +1,79 @@
+#include "CNullAudioSink.h"
+
+CNullAudioSink::CNullAudioSink(double clockScale)
+	: m_sampleRate(0)
+	, m_channels(0)
+	, m_periodFrames(0)
+	, m_clockScale(clockScale)
+	, m_writtenFrames(0)
+	, m_playedFrames(0)
+	, m_silentFrames(0)
+	, m_lastDeviceFrames(0)
+{
+	QueryPerformanceFrequency(&m_qpcFreq);
+	m_qpcOpen.QuadPart = 0;
+}
+
+CNullAudioSink::~CNullAudioSink()
+{
+}
+
+bool CNullAudioSink::open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames)
+{
+	if (sampleRate == 0 || channels == 0 || periodFrames == 0 || m_qpcFreq.QuadPart <= 0) {
+		return false;
+	}
+	m_sampleRate = sampleRate;
+	m_channels = channels;
+	m_periodFrames = periodFrames;
+	m_writtenFrames = 0;
+	m_playedFrames = 0;
+	m_silentFrames = 0;
+	m_lastDeviceFrames = 0;
+	QueryPerformanceCounter(&m_qpcOpen);
+	return true;
+}
+
+void CNullAudioSink::close()
+{
+	m_sampleRate = 0;
+}
+
+unsigned long long CNullAudioSink::deviceFrames() const
+{
+	LARGE_INTEGER qpcNow;
+	QueryPerformanceCounter(&qpcNow);
+	double seconds = (double)(qpcNow.QuadPart - m_qpcOpen.QuadPart) / (double)m_qpcFreq.QuadPart;
+	unsigned long long frames = (unsigned long long)(seconds * m_sampleRate * m_clockScale);
+	return frames - frames % m_periodFrames;
+}
+
+bool CNullAudioSink::write(const float* samples, unsigned int frames)
+{
+	(void)samples;
+	if (m_sampleRate == 0) {
+		return false;
+	}
+	queuedFrames();
+	m_writtenFrames += frames;
+	return true;
+}
+
+unsigned int CNullAudioSink::queuedFrames()
+{
+	if (m_sampleRate == 0) {
+		return 0;
+	}
+	// What the clock took since the last look plays queued audio first, and
+	// silence once that runs out; silence does not delay later writes
+	unsigned long long now = deviceFrames();
+	unsigned long long taken = now - m_lastDeviceFrames;
+	unsigned long long queued = m_writtenFrames - m_playedFrames;
+	m_lastDeviceFrames = now;
+	if (taken > queued) {
+		m_silentFrames += taken - queued;
+		taken = queued;
+	}
+	m_playedFrames += taken;
+	return (unsigned int)(m_writtenFrames - m_playedFrames);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "IAudioSink.h"
+
+// A device without hardware, for running headless: it takes a period of
+// audio every time one has elapsed on the performance counter, as a sound
+// card would, and discards it. clockScale runs that clock fast or slow, e.g.
+// 1.0002 for a card 200ppm fast, so drift control can be tested without one.
+class CNullAudioSink : public IAudioSink
+{
+public:
+	explicit CNullAudioSink(double clockScale = 1.0);
+	virtual ~CNullAudioSink();
+
+	bool open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames) override;
+	void close() override;
+	bool write(const float* samples, unsigned int frames) override;
+	unsigned int queuedFrames() override;
+	unsigned int deviceLatencyFrames() const override { return m_periodFrames; }
+	const char* name() const override { return "null"; }
+
+	void setClockScale(double clockScale) { m_clockScale = clockScale; }  // Before open()
+	// Frames of written audio the device has played, and of silence it played
+	// because nothing was queued
+	unsigned long long playedFrames() const { return m_playedFrames; }
+	unsigned long long silentFrames() const { return m_silentFrames; }
+
+protected:
+	// Whole periods the device clock has run since open()
+	unsigned long long deviceFrames() const;
+
+	unsigned int m_sampleRate;
+	unsigned int m_channels;
+	unsigned int m_periodFrames;
+
+private:
+	double m_clockScale;
+	LARGE_INTEGER m_qpcFreq;
+	LARGE_INTEGER m_qpcOpen;
+	unsigned long long m_writtenFrames;
+	unsigned long long m_playedFrames;
+	unsigned long long m_silentFrames;
+	unsigned long long m_lastDeviceFrames;
+};
@@ -307,7 +307,7 @@ CSDLPlayer::CSDLPlayer()
 	, m_lastMouseMoveTime(0)
 	, m_bCursorHidden(false)
 	, m_panCursor(NULL)
-	, m_audioDeviceID(0)
+	, m_audioSink(&m_sdlAudioSink)
 {
 	ZeroMemory(&m_sAudioFmt, sizeof(SFgAudioFrame));
 	ZeroMemory(&m_displayRect, sizeof(SDL_Rect));
@@ -320,30 +320,21 @@ CSDLPlayer::CSDLPlayer()
 	m_shuttingDown = 0;
 	m_bDisconnecting = false;
 	m_dwDisconnectStartTime = 0;
-	m_mutexAudio = CreateMutex(NULL, FALSE, NULL);
 	m_mutexVideo = CreateMutex(NULL, FALSE, NULL);
 	m_mutexPinApproval = CreateMutex(NULL, FALSE, NULL);
 	m_eventPinApproval = CreateEvent(NULL, TRUE, FALSE, NULL);
 	m_audioVolume = SDL_MIX_MAXVOLUME / 2;  // Half volume by default
 	m_localVolume = SDL_MIX_MAXVOLUME;     // Full local volume by default
 
-	// Initialize audio quality tracking
-	m_audioUnderrunCount = 0;
-	m_audioDroppedFrames = 0;
-	m_audioFadeOut = false;
-	m_audioFadeOutSamples = 0;
+	// Lip sync starts from the plain depth target
+	m_avSync.configure(AUDIO_RING_TARGET_MS, AUDIO_SYNC_MIN_TARGET_MS, AUDIO_SYNC_MAX_TARGET_MS);
+	memset(&m_avSyncStats, 0, sizeof(m_avSyncStats));
+	memset(&m_audioStats, 0, sizeof(m_audioStats));
 
-	// Initialize audio resampling
+	// The device rate is queried with the first session
 	m_systemSampleRate = 0;
-	m_streamSampleRate = 0;
-	m_resampleBuffer = NULL;
-	m_resampleBufferSize = 0;
-	m_resamplePos = 0.0;
-	m_resampleCorrection = 0.0;
-	m_needsResampling = false;
 
 	// Initialize dynamic limiter
-	m_limiterGain = 1.0f;
 	m_peakLevel = 0.0f;
 	m_deviceVolumeNormalized = 0.5f;
 	m_autoAdjustEnabled = false;
@@ -365,29 +356,30 @@ CSDLPlayer::CSDLPlayer()
 	m_qpcFrameStart.QuadPart = 0;
 	m_qpcPerfLastUpdate.QuadPart = 0;
 	m_qpcPerfLogStart.QuadPart = 0;
-	m_qpcFrameArrival = 0;
 	memset(m_perfFps, 0, sizeof(m_perfFps));
 	memset(m_perfDisplayFps, 0, sizeof(m_perfDisplayFps));
 	memset(m_perfFrameTime, 0, sizeof(m_perfFrameTime));
 	memset(m_perfLatency, 0, sizeof(m_perfLatency));
+	memset(m_perfGlassToGlass, 0, sizeof(m_perfGlassToGlass));
 	memset(m_perfBitrate, 0, sizeof(m_perfBitrate));
 	memset(m_perfAudioQueue, 0, sizeof(m_perfAudioQueue));
+	memset(m_perfAvSkew, 0, sizeof(m_perfAvSkew));
 	m_perfIdx = 0;
 	m_perfAccumFrameTime = 0.0f;
 	m_perfAccumLatency = 0.0f;
+	m_perfAccumGlassToGlass = 0.0f;
+	m_perfAccumGlassCount = 0;
 	m_perfAccumCount = 0;
 
-	// Initialize YUV double buffer
-	for (int i = 0; i < 2; i++)
+	// Initialize YUV presentation slots
+	for (int i = 0; i < CVideoPresentQueue::SLOTS; i++)
 		for (int p = 0; p < 3; p++)
 			m_yuvBuffer[i][p] = NULL;
 	m_yuvPitch[0] = m_yuvPitch[1] = m_yuvPitch[2] = 0;
-	m_yuvWriteIdx = 0;
-	m_yuvReadIdx = 0;
 	m_yuvReady = 0;
+	memset(&m_presentStats, 0, sizeof(m_presentStats));
 
 	// Initialize frame pacing (default 60fps target)
-	m_qpcLastNewFrame.QuadPart = 0;
 	m_targetFrameIntervalMs = 16.667;
 	m_displayFPS = 0.0f;
 	m_displayFrameCount = 0;
@@ -405,8 +397,9 @@ CSDLPlayer::~CSDLPlayer()
 		m_filePerfLog = NULL;
 	}
 
-	// Free YUV double buffers
-	for (int i = 0; i < 2; i++) {
+	// Free YUV presentation slots
+	m_presentQueue.clear();
+	for (int i = 0; i < CVideoPresentQueue::SLOTS; i++) {
 		for (int p = 0; p < 3; p++) {
 			if (m_yuvBuffer[i][p] != NULL) {
 				_aligned_free(m_yuvBuffer[i][p]);
@@ -417,7 +410,6 @@ CSDLPlayer::~CSDLPlayer()
 
 	unInit();
 
-	CloseHandle(m_mutexAudio);
 	CloseHandle(m_mutexVideo);
 	if (m_eventPinApproval != NULL) CloseHandle(m_eventPinApproval);
 	if (m_mutexPinApproval != NULL) CloseHandle(m_mutexPinApproval);
@@ -675,6 +667,20 @@ void CSDLPlayer::setServerName(const char* serverName)
 	}
 }
 
+bool CSDLPlayer::setAudioSink(const char* sinkName)
+{
+	if (_stricmp(sinkName, "device") == 0) {
+		m_audioSink = &m_sdlAudioSink;
+	} else if (_stricmp(sinkName, "null") == 0) {
+		m_audioSink = &m_nullAudioSink;
+	} else if (_stricmp(sinkName, "wav") == 0) {
+		m_audioSink = &m_wavAudioSink;
+	} else {
+		return false;
+	}
+	return true;
+}
+
 void CSDLPlayer::setConnected(bool connected, const char* deviceName)
 {
 	if (InterlockedCompareExchange(&m_shuttingDown, 0, 0) != 0) {
@@ -742,6 +748,8 @@ void CSDLPlayer::applyConnectionState(bool connected, const char* deviceName)
 	// pixel before changing session ownership so reconnecting at the same source
 	// resolution can never expose the previous sender's final frame.
 	clearSessionVideoFrame();
+	m_avSync.reset();
+	memset(&m_avSyncStats, 0, sizeof(m_avSyncStats));
 
 	if (m_bConnected && !connected) {
 		// Transitioning from connected to disconnected
@@ -774,15 +782,18 @@ void CSDLPlayer::applyConnectionState(bool connected, const char* deviceName)
 		memset(m_perfDisplayFps, 0, sizeof(m_perfDisplayFps));
 		memset(m_perfFrameTime, 0, sizeof(m_perfFrameTime));
 		memset(m_perfLatency, 0, sizeof(m_perfLatency));
+		memset(m_perfGlassToGlass, 0, sizeof(m_perfGlassToGlass));
 		memset(m_perfBitrate, 0, sizeof(m_perfBitrate));
 		memset(m_perfAudioQueue, 0, sizeof(m_perfAudioQueue));
+		memset(m_perfAvSkew, 0, sizeof(m_perfAvSkew));
 		m_perfIdx = 0;
 		m_perfAccumFrameTime = 0.0f;
 		m_perfAccumLatency = 0.0f;
+		m_perfAccumGlassToGlass = 0.0f;
+		m_perfAccumGlassCount = 0;
 		m_perfAccumCount = 0;
 		m_qpcPerfLastUpdate.QuadPart = 0;
 		m_qpcPerfLogStart.QuadPart = 0;
-		m_qpcLastNewFrame.QuadPart = 0;
 		m_displayFPS = 0.0f;
 		m_displayFrameCount = 0;
 		m_displayFpsStartTime = 0;
@@ -809,7 +820,9 @@ void CSDLPlayer::applyConnectionState(bool connected, const char* deviceName)
 			m_filePerfLog = fopen(logPath, "w");
 			if (m_filePerfLog) {
 				fprintf(m_filePerfLog,
-					"time_ms,frame_time_ms,source_fps,latency_ms,new_frame,video_w,video_h,bitrate_mbps,total_frames,dropped_frames,audio_queue,audio_underruns\n");
+					"time_ms,frame_time_ms,source_fps,latency_ms,new_frame,video_w,video_h,bitrate_mbps,total_frames,dropped_frames,audio_queue_ms,audio_underruns,"
+					"glass_to_glass_ms,playout_delay_ms,frames_late,frames_overflow,frames_repeated,"
+					"av_skew_ms,video_sync_delay_ms,audio_target_ms,audio_device_hz,audio_sender_hz\n");
 				fflush(m_filePerfLog);
 			}
 			m_qpcPerfLogStart.QuadPart = 0;
@@ -829,15 +842,18 @@ void CSDLPlayer::applyConnectionState(bool connected, const char* deviceName)
 		memset(m_perfDisplayFps, 0, sizeof(m_perfDisplayFps));
 		memset(m_perfFrameTime, 0, sizeof(m_perfFrameTime));
 		memset(m_perfLatency, 0, sizeof(m_perfLatency));
+		memset(m_perfGlassToGlass, 0, sizeof(m_perfGlassToGlass));
 		memset(m_perfBitrate, 0, sizeof(m_perfBitrate));
 		memset(m_perfAudioQueue, 0, sizeof(m_perfAudioQueue));
+		memset(m_perfAvSkew, 0, sizeof(m_perfAvSkew));
 		m_perfIdx = 0;
 		m_perfAccumFrameTime = 0.0f;
 		m_perfAccumLatency = 0.0f;
+		m_perfAccumGlassToGlass = 0.0f;
+		m_perfAccumGlassCount = 0;
 		m_perfAccumCount = 0;
 		m_qpcPerfLastUpdate.QuadPart = 0;
 		m_qpcPerfLogStart.QuadPart = 0;
-		m_qpcLastNewFrame.QuadPart = 0;
 		m_displayFPS = 0.0f;
 		m_displayFrameCount = 0;
 		m_displayFpsStartTime = 0;
@@ -986,12 +1002,13 @@ void CSDLPlayer::loopEvents()
 							m_videoHeight = height;
 						}
 
-						// Allocate YUV double buffers for the new video dimensions
+						// Allocate YUV presentation slots for the new video dimensions
 						{
 							CAutoLock oLock(m_mutexVideo, "allocYUVBuffers");
 
 							// Free old buffers
-							for (int i = 0; i < 2; i++) {
+							m_presentQueue.clear();
+							for (int i = 0; i < CVideoPresentQueue::SLOTS; i++) {
 								for (int p = 0; p < 3; p++) {
 									if (m_yuvBuffer[i][p] != NULL) {
 										_aligned_free(m_yuvBuffer[i][p]);
@@ -1006,7 +1023,7 @@ void CSDLPlayer::loopEvents()
 							m_yuvPitch[1] = ((uvWidth + 31) >> 5) << 5;    // U pitch
 							m_yuvPitch[2] = m_yuvPitch[1];                  // V pitch
 
-							for (int i = 0; i < 2; i++) {
+							for (int i = 0; i < CVideoPresentQueue::SLOTS; i++) {
 								m_yuvBuffer[i][0] = (uint8_t*)_aligned_malloc(m_yuvPitch[0] * height, 32);
 								m_yuvBuffer[i][1] = (uint8_t*)_aligned_malloc(m_yuvPitch[1] * uvHeight, 32);
 								m_yuvBuffer[i][2] = (uint8_t*)_aligned_malloc(m_yuvPitch[2] * uvHeight, 32);
@@ -1017,8 +1034,6 @@ void CSDLPlayer::loopEvents()
 								if (m_yuvBuffer[i][2]) memset(m_yuvBuffer[i][2], 128, m_yuvPitch[2] * uvHeight);
 							}
 
-							m_yuvWriteIdx = 0;
-							m_yuvReadIdx = 0;
 							m_yuvReady = 0;
 						}
 
@@ -1462,58 +1477,57 @@ void CSDLPlayer::loopEvents()
 			recreateVideoTexture();
 		}
 
-		// 2. Upload new YUV frame with FIXED-INTERVAL PACING
-		// Instead of uploading immediately (which mirrors bursty TCP delivery),
-		// only upload when the target frame interval has elapsed.
-		// This absorbs bursts: frames queue in double buffer, latest wins.
-		LONGLONG frameArrivalQpc = 0;  // For latency measurement
-		{
+		// 2. Upload the frame due at this refresh (PTS-DRIVEN PRESENTATION)
+		// Frames wait in the presentation queue until their sender timestamp
+		// plus the playout delay, so bursty TCP/WiFi delivery is shown at the
+		// cadence it was captured at rather than the one it arrived at.
+		LONGLONG frameArrivalNs = 0;  // For latency measurement
+		LONGLONG framePtsNs = 0;      // For glass-to-glass latency
+		if (m_videoTexture != NULL) {
 			LARGE_INTEGER qpcUploadCheck;
 			QueryPerformanceCounter(&qpcUploadCheck);
-			double msSinceLastNew = (m_qpcLastNewFrame.QuadPart > 0)
-				? (double)(qpcUploadCheck.QuadPart - m_qpcLastNewFrame.QuadPart) * 1000.0 / (double)m_qpcFreq.QuadPart
-				: m_targetFrameIntervalMs;  // First frame: always display immediately
 
-			// 90% tolerance to avoid missing frames due to timing jitter
-			bool intervalReady = !m_videoTextureHasFrame ||
-				(msSinceLastNew >= m_targetFrameIntervalMs * 0.90);
+			CAutoLock oLock(m_mutexVideo, "uploadVideoTexture");
+			LONGLONG refreshNs = (LONGLONG)(m_targetFrameIntervalMs * 1000000.0);
+			if (m_presentQueue.present(CVideoPresentQueue::qpcToNs(qpcUploadCheck.QuadPart, m_qpcFreq.QuadPart), refreshNs) >= 0) {
+				InterlockedExchange(&m_yuvReady, 1);
+			}
+			m_presentQueue.setSyncDelay(m_avSync.videoDelayNs());
+			m_presentQueue.getStats(&m_presentStats);
+			m_droppedFrames = m_presentStats.droppedLate + m_presentStats.droppedOverflow;
 
-			if (intervalReady && InterlockedCompareExchange(&m_yuvReady, 0, 0) == 1) {
-				CAutoLock oLock(m_mutexVideo, "uploadVideoTexture");
-				LONG readIdx = InterlockedCompareExchange(&m_yuvReadIdx, 0, 0);
-				if (readIdx >= 0 && readIdx <= 1 && m_videoTexture != NULL &&
-					m_yuvBuffer[readIdx][0] != NULL &&
-					m_yuvBuffer[readIdx][1] != NULL &&
-					m_yuvBuffer[readIdx][2] != NULL) {
+			if (InterlockedCompareExchange(&m_yuvReady, 0, 0) == 1) {
+				const Uint8* planes[3];
+				int pitches[3];
+				if (getLatestPlanes(planes, pitches)) {
 
-					// Capture frame arrival timestamp before upload
-					frameArrivalQpc = InterlockedCompareExchange64(&m_qpcFrameArrival, 0, 0);
+					// Capture frame timestamps before upload
+					frameArrivalNs = m_presentQueue.currentArrivalNs();
+					framePtsNs = m_presentQueue.currentPtsNs();
 
 					// Upload raw YUV planes to GPU (GPU shader does colorspace conversion + scaling)
 					int updateResult = SDL_UpdateYUVTexture(m_videoTexture, NULL,
-						m_yuvBuffer[readIdx][0], m_yuvPitch[0],
-						m_yuvBuffer[readIdx][1], m_yuvPitch[1],
-						m_yuvBuffer[readIdx][2], m_yuvPitch[2]);
+						planes[0], pitches[0],
+						planes[1], pitches[1],
+						planes[2], pitches[2]);
 					if (updateResult != 0) {
 						printf("SDL_UpdateYUVTexture failed: %s\n", SDL_GetError());
 						// Keep m_yuvReady set so this frame is retried next iteration.
-						frameArrivalQpc = 0;
+						frameArrivalNs = 0;
+						framePtsNs = 0;
 					} else {
 						m_videoTextureHasFrame = true;
 						// Clean-feed failures are deliberately isolated: the receiver must
 						// keep playing even if OBS output needs to recreate a texture.
 						if (m_cleanFeed.IsEnabled()) {
 							m_cleanFeed.UploadYUV(m_videoWidth, m_videoHeight,
-								m_yuvBuffer[readIdx][0], m_yuvPitch[0],
-								m_yuvBuffer[readIdx][1], m_yuvPitch[1],
-								m_yuvBuffer[readIdx][2], m_yuvPitch[2]);
+								planes[0], pitches[0],
+								planes[1], pitches[1],
+								planes[2], pitches[2]);
 						}
 						InterlockedExchange(&m_yuvReady, 0);
 						m_lastFrameTime = GetTickCount();
 
-						// Record when this new frame was displayed (for pacing)
-						QueryPerformanceCounter(&m_qpcLastNewFrame);
-
 						// Track display FPS (actual frames uploaded to GPU per second)
 						m_displayFrameCount++;
 						DWORD displayNow = SDL_GetTicks();
@@ -1603,36 +1617,43 @@ void CSDLPlayer::loopEvents()
 		if (m_bShowPerfGraphs && m_bConnected) {
 			float liveFrameTime = (m_perfAccumCount > 0) ? m_perfAccumFrameTime / (float)m_perfAccumCount : 0.0f;
 			float liveLatency = (m_perfAccumCount > 0) ? m_perfAccumLatency / (float)m_perfAccumCount : 0.0f;
+			float liveGlassToGlass = (m_perfAccumGlassCount > 0) ? m_perfAccumGlassToGlass / (float)m_perfAccumGlassCount : 0.0f;
 
-			int audioQueueNow = 0;
-			{
-				CAutoLock oLock(m_mutexAudio, "perfGraphAudioQ");
-				audioQueueNow = (int)m_queueAudio.size();
-			}
+			int audioQueueNow = getAudioDepthMs();
 
 			SPerfData perf = {};
 			perf.sourceFpsHistory = m_perfFps;
 			perf.displayFpsHistory = m_perfDisplayFps;
 			perf.frameTimeHistory = m_perfFrameTime;
 			perf.latencyHistory = m_perfLatency;
+			perf.glassToGlassHistory = m_perfGlassToGlass;
 			perf.bitrateHistory = m_perfBitrate;
 			perf.audioQueueHistory = m_perfAudioQueue;
+			perf.avSkewHistory = m_perfAvSkew;
 			perf.historySize = PERF_HISTORY;
 			perf.currentIdx = m_perfIdx;
 			perf.sourceFps = m_currentFPS;
 			perf.displayFps = m_displayFPS;
 			perf.frameTimeMs = liveFrameTime;
 			perf.latencyMs = liveLatency;
+			perf.glassToGlassMs = liveGlassToGlass;
+			perf.playoutDelayMs = (float)m_presentStats.playoutDelayMs;
+			perf.avSyncActive = m_avSyncStats.active;
+			perf.avSkewMs = m_avSyncStats.skewMs;
+			perf.audioTargetMs = m_audioStats.targetDepthMs;
 			perf.bitrateMbps = m_currentBitrateMbps;
 			perf.targetFps = (float)(1000.0 / m_targetFrameIntervalMs);
 			perf.videoWidth = m_videoWidth;
 			perf.videoHeight = m_videoHeight;
 			perf.totalFrames = m_totalFrames;
 			perf.droppedFrames = m_droppedFrames;
+			perf.framesLate = m_presentStats.droppedLate;
+			perf.framesOverflow = m_presentStats.droppedOverflow;
+			perf.framesRepeated = m_presentStats.repeated;
 			perf.totalBytes = m_totalBytes;
-			perf.audioUnderruns = m_audioUnderrunCount;
-			perf.audioDropped = m_audioDroppedFrames;
-			perf.audioQueueSize = audioQueueNow;
+			perf.audioUnderruns = m_audioStats.underruns;
+			perf.audioDropped = m_audioStats.dropped;
+			perf.audioQueueMs = audioQueueNow;
 			perf.connectionTimeSec = (m_connectionStartTime > 0) ? (float)(GetTickCount() - m_connectionStartTime) / 1000.0f : 0.0f;
 
 			m_imgui.RenderPerfGraphs(perf, &m_bShowPerfGraphs);
@@ -1681,9 +1702,10 @@ void CSDLPlayer::loopEvents()
 			m_perfAccumFrameTime += (float)frameTimeMs;
 
 			// Decode-to-display latency this frame
+			LONGLONG nowNs = CVideoPresentQueue::qpcToNs(qpcNow.QuadPart, m_qpcFreq.QuadPart);
 			double latencyMs = 0.0;
-			if (frameArrivalQpc > 0 && m_qpcFreq.QuadPart > 0) {
-				latencyMs = (double)(qpcNow.QuadPart - frameArrivalQpc) * 1000.0 / (double)m_qpcFreq.QuadPart;
+			if (frameArrivalNs > 0) {
+				latencyMs = (double)(nowNs - frameArrivalNs) / 1000000.0;
 				if (latencyMs >= 0.0 && latencyMs < 1000.0) {
 					m_perfAccumLatency += (float)latencyMs;
 				} else {
@@ -1692,6 +1714,22 @@ void CSDLPlayer::loopEvents()
 			}
 			m_perfAccumCount++;
 
+			// Glass-to-glass: sender timestamp to the present that showed it
+			double glassToGlassMs = 0.0;
+			if (framePtsNs > 0) {
+				glassToGlassMs = (double)(nowNs - framePtsNs) / 1000000.0;
+				if (glassToGlassMs > -1000.0 && glassToGlassMs < 1000.0) {
+					m_perfAccumGlassToGlass += (float)glassToGlassMs;
+					m_perfAccumGlassCount++;
+					m_avSync.onVideo(framePtsNs, nowNs);
+				} else {
+					glassToGlassMs = 0.0;
+				}
+			}
+			m_avSync.update(nowNs, getAudioDepthMs(), m_presentStats.syncDelayRoomNs);
+			m_avSync.getStats(&m_avSyncStats);
+			m_audioEngine.getStats(&m_audioStats);
+
 			// Initialize timer on first frame
 			if (m_qpcPerfLastUpdate.QuadPart == 0) {
 				m_qpcPerfLastUpdate = qpcNow;
@@ -1705,23 +1743,27 @@ void CSDLPlayer::loopEvents()
 					m_perfDisplayFps[m_perfIdx] = m_displayFPS;
 					m_perfFrameTime[m_perfIdx] = m_perfAccumFrameTime / (float)m_perfAccumCount;
 					m_perfLatency[m_perfIdx] = m_perfAccumLatency / (float)m_perfAccumCount;
+					m_perfGlassToGlass[m_perfIdx] = (m_perfAccumGlassCount > 0)
+						? m_perfAccumGlassToGlass / (float)m_perfAccumGlassCount : 0.0f;
 					m_perfBitrate[m_perfIdx] = m_currentBitrateMbps;
-					// Sample audio queue depth (with lock)
-					{
-						CAutoLock oLock(m_mutexAudio, "perfAudioQueue");
-						m_perfAudioQueue[m_perfIdx] = (float)m_queueAudio.size();
-					}
+					// Sample audio buffer depth
+					m_perfAudioQueue[m_perfIdx] = (float)getAudioDepthMs();
+					m_perfAvSkew[m_perfIdx] = m_avSyncStats.skewMs;
 				} else {
 					m_perfFps[m_perfIdx] = 0.0f;
 					m_perfDisplayFps[m_perfIdx] = 0.0f;
 					m_perfFrameTime[m_perfIdx] = 0.0f;
 					m_perfLatency[m_perfIdx] = 0.0f;
+					m_perfGlassToGlass[m_perfIdx] = 0.0f;
 					m_perfBitrate[m_perfIdx] = 0.0f;
 					m_perfAudioQueue[m_perfIdx] = 0.0f;
+					m_perfAvSkew[m_perfIdx] = 0.0f;
 				}
 				m_perfIdx = (m_perfIdx + 1) % PERF_HISTORY;
 				m_perfAccumFrameTime = 0.0f;
 				m_perfAccumLatency = 0.0f;
+				m_perfAccumGlassToGlass = 0.0f;
+				m_perfAccumGlassCount = 0;
 				m_perfAccumCount = 0;
 				m_qpcPerfLastUpdate = qpcNow;
 
@@ -1738,24 +1780,30 @@ void CSDLPlayer::loopEvents()
 				}
 				double timeSinceStartMs = (double)(qpcNow.QuadPart - m_qpcPerfLogStart.QuadPart) * 1000.0 / (double)m_qpcFreq.QuadPart;
 
-				int audioQueueSize = 0;
-				{
-					CAutoLock oLock(m_mutexAudio, "perfLog");
-					audioQueueSize = (int)m_queueAudio.size();
-				}
+				int audioQueueMs = getAudioDepthMs();
 
 				fprintf(m_filePerfLog,
-					"%.3f,%.3f,%.1f,%.3f,%d,%d,%d,%.2f,%llu,%llu,%d,%d\n",
+					"%.3f,%.3f,%.1f,%.3f,%d,%d,%d,%.2f,%llu,%llu,%d,%d,%.3f,%.3f,%llu,%llu,%llu,%.3f,%.3f,%d,%.2f,%.2f\n",
 					timeSinceStartMs,
 					frameTimeMs,
 					m_currentFPS,
 					latencyMs,
-					(frameArrivalQpc > 0) ? 1 : 0,
+					(frameArrivalNs > 0) ? 1 : 0,
 					m_videoWidth, m_videoHeight,
 					m_currentBitrateMbps,
 					m_totalFrames, m_droppedFrames,
-					audioQueueSize,
-					m_audioUnderrunCount);
+					audioQueueMs,
+					m_audioStats.underruns,
+					glassToGlassMs,
+					m_presentStats.playoutDelayMs,
+					m_presentStats.droppedLate,
+					m_presentStats.droppedOverflow,
+					m_presentStats.repeated,
+					m_avSyncStats.skewMs,
+					m_avSyncStats.videoDelayMs,
+					m_avSyncStats.audioTargetMs,
+					m_audioStats.deviceRateHz,
+					m_audioStats.senderRateHz);
 			}
 		}
 
@@ -1781,6 +1829,11 @@ void CSDLPlayer::loopEvents()
 		// Sync audio settings between player and UI
 		m_autoAdjustEnabled = m_imgui.IsAutoAdjustEnabled();
 		m_localVolume = (int)(m_imgui.GetLocalVolume() * SDL_MIX_MAXVOLUME);
+		// Both volumes in one gain; the engine applies it after the limiter
+		m_audioEngine.setGain(((float)m_audioVolume / (float)SDL_MIX_MAXVOLUME) *
+			((float)m_localVolume / (float)SDL_MIX_MAXVOLUME));
+		m_audioEngine.setLimiter(m_autoAdjustEnabled);
+		m_peakLevel = m_audioEngine.peakLevel();
 		m_imgui.SetDeviceVolume(m_deviceVolumeNormalized);
 		m_imgui.SetCurrentAudioLevel(m_peakLevel);
 
@@ -1841,8 +1894,9 @@ void CSDLPlayer::outputVideo(SFgVideoFrame* data)
 		// Fall through to copy this frame into the newly allocated buffers
 	}
 
-	// CALLBACK THREAD: Copy raw YUV420P planes into double buffer (fast memcpy)
-	// GPU does BT.709 conversion via shader during SDL_UpdateYUVTexture
+	// CALLBACK THREAD: Queue the frame for presentation, copying raw YUV420P
+	// planes into a free slot (fast memcpy). GPU does BT.709 conversion via
+	// shader during SDL_UpdateYUVTexture once the render thread finds it due.
 	{
 		CAutoLock oLock(m_mutexVideo, "outputVideo");
 
@@ -1850,69 +1904,74 @@ void CSDLPlayer::outputVideo(SFgVideoFrame* data)
 			return;
 		}
 
-		LONG writeIdx = InterlockedCompareExchange(&m_yuvWriteIdx, 0, 0);
-		if (writeIdx < 0 || writeIdx > 1 ||
-			m_yuvBuffer[writeIdx][0] == NULL ||
-			m_yuvBuffer[writeIdx][1] == NULL ||
-			m_yuvBuffer[writeIdx][2] == NULL) {
-			return;  // Buffers not allocated yet
-		}
+		// Record arrival timestamp for decode-to-display latency measurement
+		LARGE_INTEGER qpcNow;
+		QueryPerformanceCounter(&qpcNow);
+		LONGLONG arrivalNs = CVideoPresentQueue::qpcToNs(qpcNow.QuadPart, m_qpcFreq.QuadPart);
+		m_lastFramePTS = data->pts;
 
-		// Copy YUV planes from source data
-		const uint8_t* srcY = data->data;
-		const uint8_t* srcU = data->data + data->dataLen[0];
-		const uint8_t* srcV = data->data + data->dataLen[0] + data->dataLen[1];
+		if (data->flags & FG_VIDEO_FRAME_REFCOUNTED) {
+			// Keep a reference instead of copying; the render thread uploads
+			// straight from decoder memory once the frame is due
+			int slot = m_presentQueue.acquire();
+			data->retain(data->opaque);
+			m_presentQueue.commit(slot, data, (LONGLONG)data->pts, arrivalNs);
+		}
+		else {
+			int writeIdx = m_presentQueue.acquire();
+			if (m_yuvBuffer[writeIdx][0] == NULL ||
+				m_yuvBuffer[writeIdx][1] == NULL ||
+				m_yuvBuffer[writeIdx][2] == NULL) {
+				return;  // Buffers not allocated yet
+			}
 
-		const int yHeight = data->height;
-		const int uvHeight = (data->height + 1) / 2;
+			// Copy YUV planes from source data
+			const uint8_t* srcY = data->data;
+			const uint8_t* srcU = data->data + data->dataLen[0];
+			const uint8_t* srcV = data->data + data->dataLen[0] + data->dataLen[1];
 
-		// Y plane
-		{
-			const uint8_t* sp = srcY;
-			uint8_t* dp = m_yuvBuffer[writeIdx][0];
-			const int copyW = ((int)data->width < m_yuvPitch[0]) ? (int)data->width : m_yuvPitch[0];
-			for (int row = 0; row < yHeight; row++) {
-				memcpy(dp, sp, copyW);
-				sp += data->pitch[0];
-				dp += m_yuvPitch[0];
+			const int yHeight = data->height;
+			const int uvHeight = (data->height + 1) / 2;
+
+			// Y plane
+			{
+				const uint8_t* sp = srcY;
+				uint8_t* dp = m_yuvBuffer[writeIdx][0];
+				const int copyW = ((int)data->width < m_yuvPitch[0]) ? (int)data->width : m_yuvPitch[0];
+				for (int row = 0; row < yHeight; row++) {
+					memcpy(dp, sp, copyW);
+					sp += data->pitch[0];
+					dp += m_yuvPitch[0];
+				}
 			}
-		}
-		// U plane
-		{
-			const uint8_t* sp = srcU;
-			uint8_t* dp = m_yuvBuffer[writeIdx][1];
-			const int uvW = ((int)data->width + 1) / 2;
-			const int copyW = (uvW < m_yuvPitch[1]) ? uvW : m_yuvPitch[1];
-			for (int row = 0; row < uvHeight; row++) {
-				memcpy(dp, sp, copyW);
-				sp += data->pitch[1];
-				dp += m_yuvPitch[1];
+			// U plane
+			{
+				const uint8_t* sp = srcU;
+				uint8_t* dp = m_yuvBuffer[writeIdx][1];
+				const int uvW = ((int)data->width + 1) / 2;
+				const int copyW = (uvW < m_yuvPitch[1]) ? uvW : m_yuvPitch[1];
+				for (int row = 0; row < uvHeight; row++) {
+					memcpy(dp, sp, copyW);
+					sp += data->pitch[1];
+					dp += m_yuvPitch[1];
+				}
 			}
-		}
-		// V plane
-		{
-			const uint8_t* sp = srcV;
-			uint8_t* dp = m_yuvBuffer[writeIdx][2];
-			const int uvW = ((int)data->width + 1) / 2;
-			const int copyW = (uvW < m_yuvPitch[2]) ? uvW : m_yuvPitch[2];
-			for (int row = 0; row < uvHeight; row++) {
-				memcpy(dp, sp, copyW);
-				sp += data->pitch[2];
-				dp += m_yuvPitch[2];
+			// V plane
+			{
+				const uint8_t* sp = srcV;
+				uint8_t* dp = m_yuvBuffer[writeIdx][2];
+				const int uvW = ((int)data->width + 1) / 2;
+				const int copyW = (uvW < m_yuvPitch[2]) ? uvW : m_yuvPitch[2];
+				for (int row = 0; row < uvHeight; row++) {
+					memcpy(dp, sp, copyW);
+					sp += data->pitch[2];
+					dp += m_yuvPitch[2];
+				}
 			}
-		}
-
-		m_lastFramePTS = data->pts;
-
-		// Record arrival timestamp for decode-to-display latency measurement
-		LARGE_INTEGER qpcNow;
-		QueryPerformanceCounter(&qpcNow);
-		InterlockedExchange64(&m_qpcFrameArrival, qpcNow.QuadPart);
 
-		// Publish: make this buffer available for render thread
-		InterlockedExchange(&m_yuvReadIdx, writeIdx);
-		InterlockedExchange(&m_yuvWriteIdx, 1 - writeIdx);
-		InterlockedExchange(&m_yuvReady, 1);
+			// Publish: the render thread shows this slot once it is due
+			m_presentQueue.commit(writeIdx, NULL, (LONGLONG)data->pts, arrivalNs);
+		}
 	}
 
 	// Update statistics
@@ -1956,6 +2015,9 @@ void CSDLPlayer::outputAudio(SFgAudioFrame* data)
 	}
 
 	initAudio(data);
+	if (!m_bAudioInited) {
+		return;
+	}
 
 	if (m_bDumpAudio) {
 		if (m_fileWav != NULL) {
@@ -1963,108 +2025,27 @@ void CSDLPlayer::outputAudio(SFgAudioFrame* data)
 		}
 	}
 
-	SAudioFrame* dataClone = new SAudioFrame();
-	dataClone->pts = data->pts;
-
-	// Resample audio if needed (stream rate differs from system rate)
-	if (m_needsResampling && m_resampleBuffer && m_streamSampleRate > 0) {
-		// Linear interpolation resampling
-		int bytesPerSample = 2;  // 16-bit
-		int channels = data->channels;
-		int inSamples = data->dataLen / (channels * bytesPerSample);
-
-		// Keep the producer clock locked to the device clock. A fixed nominal
-		// ratio eventually drains or fills the queue because the two clocks are
-		// never exactly equal. Producing slightly more audio at low queue depths
-		// (and slightly less at high depths) keeps the queue near its target.
-		int queueDepth = 0;
-		{
-			CAutoLock oLock(m_mutexAudio, "resampleQueueDepth");
-			queueDepth = (int)m_queueAudio.size();
-		}
-		double queueError = (double)(AUDIO_QUEUE_TARGET_FRAMES - queueDepth);
-		m_resampleCorrection += queueError * AUDIO_RESAMPLE_INTEGRAL_GAIN;
-		if (m_resampleCorrection > AUDIO_RESAMPLE_MAX_CORRECTION) {
-			m_resampleCorrection = AUDIO_RESAMPLE_MAX_CORRECTION;
-		} else if (m_resampleCorrection < -AUDIO_RESAMPLE_MAX_CORRECTION) {
-			m_resampleCorrection = -AUDIO_RESAMPLE_MAX_CORRECTION;
-		}
-		double correction = m_resampleCorrection +
-			queueError * AUDIO_RESAMPLE_PROPORTIONAL_GAIN;
-		if (correction > AUDIO_RESAMPLE_MAX_CORRECTION) {
-			correction = AUDIO_RESAMPLE_MAX_CORRECTION;
-		} else if (correction < -AUDIO_RESAMPLE_MAX_CORRECTION) {
-			correction = -AUDIO_RESAMPLE_MAX_CORRECTION;
-		}
-		double ratio = ((double)m_systemSampleRate / (double)m_streamSampleRate) *
-			(1.0 + correction);
-
-		// Carry the fractional output count across calls instead of rounding each
-		// input frame independently, which introduces another persistent rate error.
-		double exactOutSamples = (double)inSamples * ratio + m_resamplePos;
-		int outSamples = (int)floor(exactOutSamples);
-		m_resamplePos = exactOutSamples - (double)outSamples;
-
-		// Ensure we have enough buffer space
-		int outBufferSize = outSamples * channels * bytesPerSample;
-		if (outBufferSize > m_resampleBufferSize) {
-			m_resampleBuffer = (uint8_t*)realloc(m_resampleBuffer, outBufferSize);
-			m_resampleBufferSize = outBufferSize;
-		}
-
-		// Perform linear interpolation resampling
-		Sint16* inPtr = (Sint16*)data->data;
-		Sint16* outPtr = (Sint16*)m_resampleBuffer;
-		double step = 1.0 / ratio;
-
-		for (int i = 0; i < outSamples; i++) {
-			double srcPos = i * step;
-			int srcIdx = (int)srcPos;
-			double frac = srcPos - srcIdx;
-
-			if (srcIdx >= inSamples - 1) {
-				srcIdx = inSamples - 2;
-				if (srcIdx < 0) srcIdx = 0;
-				frac = 1.0;
-			}
-
-			for (int ch = 0; ch < channels; ch++) {
-				Sint16 s1 = inPtr[srcIdx * channels + ch];
-				Sint16 s2 = (srcIdx + 1 < inSamples) ? inPtr[(srcIdx + 1) * channels + ch] : s1;
-				outPtr[i * channels + ch] = (Sint16)(s1 + (s2 - s1) * frac);
-			}
-		}
+	// Report when this packet will be heard: behind everything the engine
+	// holds, up to the device
+	if (data->localTimeNs > 0) {
+		m_avSync.onAudio((LONGLONG)data->localTimeNs, CAudioEngine::nowNs() + m_audioEngine.latencyNs());
+	}
+	m_audioEngine.setTargetDepthMs(m_avSync.audioTargetMs());
 
-		int convertedBytes = outSamples * channels * bytesPerSample;
-		dataClone->dataTotal = convertedBytes;
-		dataClone->dataLeft = convertedBytes;
-		dataClone->data = new uint8_t[convertedBytes];
-		memcpy(dataClone->data, m_resampleBuffer, convertedBytes);
+	// The engine thread resamples against the device clock and trims the
+	// depth to AUDIO_RING_MAX_MS; 16-bit input is converted on the way in
+	bool floatInput = (data->sampleFormat == FG_AUDIO_FORMAT_F32);
+	unsigned int frames = data->dataLen / (data->channels * (floatInput ? sizeof(float) : sizeof(Sint16)));
+	if (floatInput) {
+		m_audioEngine.write((const float*)data->data, frames, (LONGLONG)data->localTimeNs);
 	} else {
-		// No resampling needed, copy directly
-		dataClone->dataTotal = data->dataLen;
-		dataClone->dataLeft = data->dataLen;
-		dataClone->data = new uint8_t[data->dataLen];
-		memcpy(dataClone->data, data->data, data->dataLen);
+		m_audioEngine.write((const Sint16*)data->data, frames, (LONGLONG)data->localTimeNs);
 	}
+}
 
-	{
-		CAutoLock oLock(m_mutexAudio, "outputAudio");
-
-		// AUDIO QUEUE LIMITING: Prevent unbounded growth
-		while (m_queueAudio.size() >= AUDIO_QUEUE_MAX_FRAMES) {
-			SAudioFrame* oldFrame = m_queueAudio.front();
-			m_queueAudio.pop();
-			delete[] oldFrame->data;
-			delete oldFrame;
-			m_audioDroppedFrames++;
-		}
-
-		m_queueAudio.push(dataClone);
-
-		// Reset fade-out state when we have audio data
-		m_audioFadeOut = false;
-	}
+int CSDLPlayer::getAudioDepthMs() const
+{
+	return m_audioEngine.depthMs();
 }
 
 void CSDLPlayer::initVideo(int width, int height)
@@ -2318,20 +2299,24 @@ void CSDLPlayer::renderDuringNativeResize()
 	}
 
 	// The normal event loop is paused by Windows during a border drag. Upload
-	// the newest decoded frame here so resizing does not turn the video into a
+	// the frame due now here so resizing does not turn the video into a
 	// frozen screenshot.
-	if (m_videoTexture != NULL &&
-		InterlockedCompareExchange(&m_yuvReady, 0, 0) == 1) {
+	if (m_videoTexture != NULL) {
 		CAutoLock oLock(m_mutexVideo, "nativeResizeUpload");
-		LONG readIdx = InterlockedCompareExchange(&m_yuvReadIdx, 0, 0);
-		if (readIdx >= 0 && readIdx <= 1 &&
-			m_yuvBuffer[readIdx][0] != NULL &&
-			m_yuvBuffer[readIdx][1] != NULL &&
-			m_yuvBuffer[readIdx][2] != NULL &&
+		LARGE_INTEGER qpcNow;
+		QueryPerformanceCounter(&qpcNow);
+		if (m_presentQueue.present(CVideoPresentQueue::qpcToNs(qpcNow.QuadPart, m_qpcFreq.QuadPart),
+			(LONGLONG)(m_targetFrameIntervalMs * 1000000.0)) >= 0) {
+			InterlockedExchange(&m_yuvReady, 1);
+		}
+		const Uint8* planes[3];
+		int pitches[3];
+		if (InterlockedCompareExchange(&m_yuvReady, 0, 0) == 1 &&
+			getLatestPlanes(planes, pitches) &&
 			SDL_UpdateYUVTexture(m_videoTexture, NULL,
-				m_yuvBuffer[readIdx][0], m_yuvPitch[0],
-				m_yuvBuffer[readIdx][1], m_yuvPitch[1],
-				m_yuvBuffer[readIdx][2], m_yuvPitch[2]) == 0) {
+				planes[0], pitches[0],
+				planes[1], pitches[1],
+				planes[2], pitches[2]) == 0) {
 			m_videoTextureHasFrame = true;
 			InterlockedExchange(&m_yuvReady, 0);
 		}
@@ -2859,18 +2844,16 @@ bool CSDLPlayer::recreateVideoTexture()
 		return false;
 	}
 
-	LONG readIdx = InterlockedCompareExchange(&m_yuvReadIdx, 0, 0);
-	if (readIdx < 0 || readIdx > 1 ||
-		m_yuvBuffer[readIdx][0] == NULL ||
-		m_yuvBuffer[readIdx][1] == NULL ||
-		m_yuvBuffer[readIdx][2] == NULL) {
+	const Uint8* planes[3];
+	int pitches[3];
+	if (!getLatestPlanes(planes, pitches)) {
 		return false;
 	}
 
 	if (SDL_UpdateYUVTexture(m_videoTexture, NULL,
-		m_yuvBuffer[readIdx][0], m_yuvPitch[0],
-		m_yuvBuffer[readIdx][1], m_yuvPitch[1],
-		m_yuvBuffer[readIdx][2], m_yuvPitch[2]) != 0) {
+		planes[0], pitches[0],
+		planes[1], pitches[1],
+		planes[2], pitches[2]) != 0) {
 		printf("Initial SDL_UpdateYUVTexture failed: %s\n", SDL_GetError());
 		InterlockedExchange(&m_yuvReady, 1);
 		return false;
@@ -2890,18 +2873,42 @@ void CSDLPlayer::recreateCleanFeedTexture()
 	}
 
 	CAutoLock oLock(m_mutexVideo, "recreateCleanFeedTexture");
-	LONG readIdx = InterlockedCompareExchange(&m_yuvReadIdx, 0, 0);
-	if (readIdx < 0 || readIdx > 1 ||
-		m_yuvBuffer[readIdx][0] == NULL ||
-		m_yuvBuffer[readIdx][1] == NULL ||
-		m_yuvBuffer[readIdx][2] == NULL) {
+	const Uint8* planes[3];
+	int pitches[3];
+	if (!getLatestPlanes(planes, pitches)) {
 		return;
 	}
 
 	m_cleanFeed.UploadYUV(m_videoWidth, m_videoHeight,
-		m_yuvBuffer[readIdx][0], m_yuvPitch[0],
-		m_yuvBuffer[readIdx][1], m_yuvPitch[1],
-		m_yuvBuffer[readIdx][2], m_yuvPitch[2]);
+		planes[0], pitches[0],
+		planes[1], pitches[1],
+		planes[2], pitches[2]);
+}
+
+// Planes of the frame on screen: the retained decoder frame when the current
+// slot holds one, otherwise that slot's copy
+bool CSDLPlayer::getLatestPlanes(const Uint8* planes[3], int pitches[3])
+{
+	const SFgVideoFrame* refFrame = m_presentQueue.currentRefFrame();
+	if (refFrame != NULL) {
+		for (int p = 0; p < 3; p++) {
+			planes[p] = refFrame->planes[p];
+			pitches[p] = (int)refFrame->pitch[p];
+		}
+		return true;
+	}
+
+	int readIdx = m_presentQueue.current();
+	if (m_yuvBuffer[readIdx][0] == NULL ||
+		m_yuvBuffer[readIdx][1] == NULL ||
+		m_yuvBuffer[readIdx][2] == NULL) {
+		return false;
+	}
+	for (int p = 0; p < 3; p++) {
+		planes[p] = m_yuvBuffer[readIdx][p];
+		pitches[p] = m_yuvPitch[p];
+	}
+	return true;
 }
 
 void CSDLPlayer::syncScreenCastOutput()
@@ -3065,19 +3072,19 @@ void CSDLPlayer::resetZoom()
 void CSDLPlayer::clearSessionVideoFrame()
 {
 	CAutoLock oLock(m_mutexVideo, "clearSessionVideoFrame");
+	// The next sender has its own clock and network path: relearn the delay
+	m_presentQueue.resetSession();
+	memset(&m_presentStats, 0, sizeof(m_presentStats));
 	m_videoTextureHasFrame = false;
 	m_cleanFeed.InvalidateVideoTexture();
 	InterlockedExchange(&m_yuvReady, 0);
-	InterlockedExchange(&m_yuvWriteIdx, 0);
-	InterlockedExchange(&m_yuvReadIdx, 0);
-	InterlockedExchange64(&m_qpcFrameArrival, 0);
 
 	if (m_videoWidth <= 0 || m_videoHeight <= 0) {
 		return;
 	}
 
 	int uvHeight = (m_videoHeight + 1) / 2;
-	for (int i = 0; i < 2; ++i) {
+	for (int i = 0; i < CVideoPresentQueue::SLOTS; ++i) {
 		if (m_yuvBuffer[i][0] != NULL) {
 			memset(m_yuvBuffer[i][0], 0, m_yuvPitch[0] * m_videoHeight);
 		}
@@ -3101,8 +3108,9 @@ void CSDLPlayer::unInitVideo()
 	}
 	m_videoTextureHasFrame = false;
 
-	// Free YUV double buffers
-	for (int i = 0; i < 2; i++) {
+	// Free YUV presentation slots
+	m_presentQueue.clear();
+	for (int i = 0; i < CVideoPresentQueue::SLOTS; i++) {
 		for (int p = 0; p < 3; p++) {
 			if (m_yuvBuffer[i][p] != NULL) {
 				_aligned_free(m_yuvBuffer[i][p]);
@@ -3152,44 +3160,12 @@ void CSDLPlayer::initAudio(SFgAudioFrame* data)
 			}
 		}
 
-		m_streamSampleRate = data->sampleRate;
-		DWORD outputSampleRate = m_systemSampleRate;
-
-		// Set up audio resampler if stream rate differs from system rate
-		if (m_streamSampleRate != m_systemSampleRate) {
-			m_needsResampling = true;
-			m_resamplePos = 0.0;
-			m_resampleCorrection = 0.0;
-
-			// Allocate resample buffer (enough for 1 second of audio)
-			m_resampleBufferSize = m_systemSampleRate * data->channels * 2;
-			m_resampleBuffer = (uint8_t*)malloc(m_resampleBufferSize);
-
-			if (!m_resampleBuffer) {
-				m_needsResampling = false;
-				outputSampleRate = m_streamSampleRate;
-			}
-		}
-
-		SDL_AudioSpec wanted_spec, obtained_spec;
-		wanted_spec.freq = outputSampleRate;
-		wanted_spec.format = AUDIO_S16SYS;
-		wanted_spec.channels = (Uint8)data->channels;
-		wanted_spec.silence = 0;
-		wanted_spec.samples = AUDIO_BUFFER_SAMPLES;
-		wanted_spec.callback = sdlAudioCallback;
-		wanted_spec.userdata = this;
-
-		// SDL2: use SDL_OpenAudioDevice for device selection support
-		m_audioDeviceID = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &obtained_spec, 0);
-		if (m_audioDeviceID == 0)
-		{
-			printf("Cannot open audio: %s\n", SDL_GetError());
+		// The engine waits for AUDIO_RING_START_MS before the sink gets any
+		if (!m_audioEngine.start(m_audioSink, data->sampleRate, m_systemSampleRate, data->channels,
+			AUDIO_RESAMPLE_QUALITY, AUDIO_RING_MAX_MS, AUDIO_RING_START_MS)) {
 			return;
 		}
 
-		SDL_PauseAudioDevice(m_audioDeviceID, 1);
-
 		m_sAudioFmt.bitsPerSample = data->bitsPerSample;
 		m_sAudioFmt.channels = data->channels;
 		m_sAudioFmt.sampleRate = data->sampleRate;
@@ -3199,144 +3175,20 @@ void CSDLPlayer::initAudio(SFgAudioFrame* data)
 			m_fileWav = fopen("airplay-audio.wav", "wb");
 		}
 	}
-	int audioQueueDepth = 0;
-	{
-		CAutoLock oLock(m_mutexAudio, "initAudioQueueDepth");
-		audioQueueDepth = (int)m_queueAudio.size();
-	}
-	if (audioQueueDepth >= AUDIO_QUEUE_START_THRESHOLD) {
-		SDL_PauseAudioDevice(m_audioDeviceID, 0);
-	}
 }
 
 void CSDLPlayer::unInitAudio()
 {
-	if (m_audioDeviceID != 0) {
-		SDL_CloseAudioDevice(m_audioDeviceID);
-		m_audioDeviceID = 0;
-	}
+	// Closes the sink once the engine thread has stopped
+	m_audioEngine.stop();
 	m_bAudioInited = false;
 	memset(&m_sAudioFmt, 0, sizeof(m_sAudioFmt));
-
-	{
-		CAutoLock oLock(m_mutexAudio, "unInitAudio");
-		while (!m_queueAudio.empty())
-		{
-			SAudioFrame* pAudioFrame = m_queueAudio.front();
-			delete[] pAudioFrame->data;
-			delete pAudioFrame;
-			m_queueAudio.pop();
-		}
-	}
+	m_peakLevel = 0.0f;
 
 	if (m_fileWav != NULL) {
 		fclose(m_fileWav);
 		m_fileWav = NULL;
 	}
-
-	// Reset audio quality tracking
-	m_audioUnderrunCount = 0;
-	m_audioDroppedFrames = 0;
-	m_audioFadeOut = false;
-	m_audioFadeOutSamples = 0;
-
-	// Clean up audio resampler
-	if (m_resampleBuffer != NULL) {
-		free(m_resampleBuffer);
-		m_resampleBuffer = NULL;
-		m_resampleBufferSize = 0;
-	}
-	m_needsResampling = false;
-	m_resamplePos = 0.0;
-	m_resampleCorrection = 0.0;
-	m_streamSampleRate = 0;
-}
-
-void CSDLPlayer::sdlAudioCallback(void* userdata, Uint8* stream, int len)
-{
-	CSDLPlayer* pThis = (CSDLPlayer*)userdata;
-	int needLen = len;
-	int streamPos = 0;
-
-	// Initialize output buffer to silence
-	memset(stream, 0, len);
-
-	// Update normalized device volume for UI display
-	pThis->m_deviceVolumeNormalized = (float)pThis->m_audioVolume / (float)SDL_MIX_MAXVOLUME;
-
-	CAutoLock oLock(pThis->m_mutexAudio, "sdlAudioCallback");
-
-	// Check for underrun condition
-	if (pThis->m_queueAudio.empty()) {
-		pThis->m_audioUnderrunCount++;
-		pThis->m_audioFadeOut = true;
-		pThis->m_audioFadeOutSamples = 256;
-		pThis->m_peakLevel *= 0.95f;
-		return;
-	}
-
-	// Track peak level for this buffer
-	float bufferPeak = 0.0f;
-
-	// Process audio frames from queue
-	while (!pThis->m_queueAudio.empty() && needLen > 0)
-	{
-		SAudioFrame* pAudioFrame = pThis->m_queueAudio.front();
-		int pos = pAudioFrame->dataTotal - pAudioFrame->dataLeft;
-		int readLen = min((int)pAudioFrame->dataLeft, needLen);
-
-		Sint16* src = (Sint16*)(pAudioFrame->data + pos);
-		Sint16* dst = (Sint16*)(stream + streamPos);
-		int numSamples = readLen / 2;
-
-		int volume = pThis->m_audioVolume;
-		int localVol = pThis->m_localVolume;
-		for (int i = 0; i < numSamples; i++) {
-			int absSrc = (src[i] < 0) ? -src[i] : src[i];
-			float level = absSrc / 32768.0f;
-			if (level > bufferPeak) {
-				bufferPeak = level;
-			}
-
-			int sample = ((int)src[i] * volume) / SDL_MIX_MAXVOLUME;
-			sample = (sample * localVol) / SDL_MIX_MAXVOLUME;
-
-			if (pThis->m_audioFadeOut && pThis->m_audioFadeOutSamples > 0) {
-				int fadeProgress = 256 - pThis->m_audioFadeOutSamples;
-				sample = (sample * fadeProgress) / 256;
-				pThis->m_audioFadeOutSamples--;
-				if (pThis->m_audioFadeOutSamples <= 0) {
-					pThis->m_audioFadeOut = false;
-				}
-			}
-
-			if (sample > 32767) sample = 32767;
-			else if (sample < -32768) sample = -32768;
-
-			dst[i] = (Sint16)sample;
-		}
-
-		pAudioFrame->dataLeft -= readLen;
-		needLen -= readLen;
-		streamPos += readLen;
-
-		if (pAudioFrame->dataLeft <= 0) {
-			pThis->m_queueAudio.pop();
-			delete[] pAudioFrame->data;
-			delete pAudioFrame;
-		}
-	}
-
-	// Update peak level for UI display (with smoothing)
-	if (bufferPeak > pThis->m_peakLevel) {
-		pThis->m_peakLevel = bufferPeak;
-	} else {
-		pThis->m_peakLevel = pThis->m_peakLevel * 0.95f + bufferPeak * 0.05f;
-	}
-
-	if (needLen > 0) {
-		pThis->m_audioUnderrunCount++;
-	}
 }
 
 void CSDLPlayer::setVolume(float dbVolume)
@@ -3358,6 +3210,7 @@ void CSDLPlayer::setVolume(float dbVolume)
 	}
 
 	m_audioVolume = sdlVolume;
+	m_deviceVolumeNormalized = (float)sdlVolume / (float)SDL_MIX_MAXVOLUME;
 }
 
 void CSDLPlayer::showWindow()
@@ -6,19 +6,15 @@
 #include "SDL_syswm.h"
 #undef main
 #include "CAirServer.h"
+#include "CAudioEngine.h"
+#include "CAvSync.h"
 #include "CCleanFeedOutput.h"
 #include "CImGuiManager.h"
+#include "CNullAudioSink.h"
+#include "CSdlAudioSink.h"
+#include "CVideoPresentQueue.h"
+#include "CWavAudioSink.h"
 
-typedef void sdlAudioCallback(void* userdata, Uint8* stream, int len);
-
-typedef struct SAudioFrame {
-	unsigned long long pts;
-	unsigned int dataTotal;
-	unsigned int dataLeft;
-	unsigned char* data;
-} SAudioFrame;
-
-typedef std::queue<SAudioFrame*> SAudioFrameQueue;
 typedef std::queue<SFgVideoFrame*> SFgVideoFrameQueue;
 
 #define VIDEO_SIZE_CHANGED_CODE 1
@@ -38,6 +34,8 @@ public:
 	void unInit();
 	void loopEvents();
 	void setServerName(const char* serverName);
+	// "device" (the default), "null" or "wav"; before the first session
+	bool setAudioSink(const char* sinkName);
 	void setConnected(bool connected, const char* deviceName = NULL);
 	// Called from the receiver's network thread. It waits for the in-app
 	// allow/deny choice, then leaves the temporary PIN visible for the user.
@@ -50,7 +48,6 @@ public:
 	void unInitVideo();
 	void initAudio(SFgAudioFrame* data);
 	void unInitAudio();
-	static void sdlAudioCallback(void* userdata, Uint8* stream, int len);
 
 	// Audio volume control (volume in dB: 0.0 = max, -144.0 = mute)
 	void setVolume(float dbVolume);
@@ -92,7 +89,7 @@ public:
 
 	// Video statistics
 	unsigned long long m_totalFrames;       // Total frames received
-	unsigned long long m_droppedFrames;     // Frames dropped due to queue full
+	unsigned long long m_droppedFrames;     // Frames the presentation queue dropped, late or overflowing
 	DWORD m_fpsStartTime;                   // Start time for FPS calculation
 	unsigned int m_fpsFrameCount;           // Frame count for FPS calculation
 	float m_currentFPS;                     // Current FPS
@@ -107,44 +104,35 @@ public:
 
 	SFgAudioFrame m_sAudioFmt;
 	bool m_bAudioInited;
-	SAudioFrameQueue m_queueAudio;
-	HANDLE m_mutexAudio;
+	CAudioEngine m_audioEngine;         // Playout thread: outputAudio writes, it feeds the sink
+	CSdlAudioSink m_sdlAudioSink;
+	CNullAudioSink m_nullAudioSink;     // Headless: plays on the performance counter
+	CWavAudioSink m_wavAudioSink;       // Headless, recording the output to airplay-output.wav
+	IAudioSink* m_audioSink;            // One of the three
+	int getAudioDepthMs() const;        // Buffered audio, safe from any thread
 	HANDLE m_mutexVideo;
-	SDL_AudioDeviceID m_audioDeviceID;  // SDL2 audio device
 	volatile int m_audioVolume;  // SDL volume (0-128, where 128 = SDL_MIX_MAXVOLUME)
 	volatile int m_localVolume;  // Local volume from UI slider (0-128, SDL scale)
 
 	// Audio quality improvements
-	static const int AUDIO_BUFFER_SAMPLES = 1024;   // ~21ms at 48kHz (balanced latency/quality)
-	static const int AUDIO_QUEUE_MAX_FRAMES = 20;   // Max frames before dropping (~400ms buffer)
-	static const int AUDIO_QUEUE_TARGET_FRAMES = 8; // Closed-loop resampler target (~170ms at 48kHz)
-	static const int AUDIO_QUEUE_START_THRESHOLD = AUDIO_QUEUE_TARGET_FRAMES;
-	static constexpr double AUDIO_RESAMPLE_PROPORTIONAL_GAIN = 0.001; // 1000ppm per frame
-	static constexpr double AUDIO_RESAMPLE_INTEGRAL_GAIN = 0.0000005; // 0.5ppm per frame per packet
-	static constexpr double AUDIO_RESAMPLE_MAX_CORRECTION = 0.005; // Never alter pitch by more than 0.5%
-	int m_audioUnderrunCount;                       // Track underruns for diagnostics
-	int m_audioDroppedFrames;                       // Track dropped frames for diagnostics
-	bool m_audioFadeOut;                            // Fade out on underrun to prevent pops
-	int m_audioFadeOutSamples;                      // Remaining samples in fade-out
+	// Depths count the engine's stream ring and the sink queue together
+	static const int AUDIO_RING_MAX_MS = 400;       // Oldest audio is discarded beyond this depth
+	static const int AUDIO_RING_TARGET_MS = 100;    // What the engine's depth trim steers to, until underruns raise it
+	static const int AUDIO_RING_START_MS = AUDIO_RING_TARGET_MS;
+	static const int AUDIO_SYNC_MIN_TARGET_MS = 30 + CAudioEngine::SINK_QUEUE_MS;  // Lip sync never steers the depth below this
+	static const int AUDIO_SYNC_MAX_TARGET_MS = AUDIO_RING_MAX_MS - 100;
+	static const CAudioResampler::EQuality AUDIO_RESAMPLE_QUALITY = CAudioResampler::QUALITY_SINC32;
+	CAvSync m_avSync;                               // Steers the depth target and the video delay together
+	CAvSync::SStats m_avSyncStats;                  // Render thread snapshot
+	CAudioEngine::SStats m_audioStats;              // Render thread snapshot
 
 	// Audio resampling (for matching system device sample rate)
 	DWORD m_systemSampleRate;                       // System audio device sample rate
-	DWORD m_streamSampleRate;                       // Incoming stream sample rate
-	uint8_t* m_resampleBuffer;                      // Buffer for resampled audio
-	int m_resampleBufferSize;                       // Size of resample buffer
-	double m_resamplePos;                           // Fractional output sample carried between input frames
-	double m_resampleCorrection;                    // Learned sender/device clock correction
-	bool m_needsResampling;                         // Flag indicating resampling is needed
 
 	// Dynamic limiter (normalize loud sounds)
-	float m_limiterGain;                            // Current limiter gain (0.0 to 1.0)
 	float m_peakLevel;                              // Peak level for UI display (0.0 to 1.0)
 	float m_deviceVolumeNormalized;                 // Device volume normalized to 0.0-1.0 for UI
-	bool m_autoAdjustEnabled;                       // Normalize feature enabled
-	static constexpr float LIMITER_THRESHOLD = 0.5f;   // Start limiting above 50% level (more aggressive)
-	static constexpr float LIMITER_RATIO = 0.6f;       // Output level when limiting (60% = quieter)
-	static constexpr float LIMITER_ATTACK = 0.002f;    // Fast attack (2ms)
-	static constexpr float LIMITER_RELEASE = 0.100f;   // Slower release (100ms) for smoother sound
+	volatile bool m_autoAdjustEnabled;              // Normalize feature enabled
 
 	SDL_Event m_evtVideoSizeChange;
 
@@ -251,34 +239,40 @@ public:
 	bool m_bShowPerfGraphs;
 	LARGE_INTEGER m_qpcFreq;              // QueryPerformanceCounter frequency
 	LARGE_INTEGER m_qpcFrameStart;        // QPC at start of render frame
-	volatile LONGLONG m_qpcFrameArrival;  // QPC when latest frame arrived in outputVideo
 	static const int PERF_HISTORY = 30;   // 30 seconds of history (1 sample/sec)
 	float m_perfFps[PERF_HISTORY];            // Source FPS history (avg per second)
 	float m_perfDisplayFps[PERF_HISTORY];    // Display FPS history (actual GPU uploads per second)
 	float m_perfFrameTime[PERF_HISTORY];     // Render frame time in ms (avg per second)
 	float m_perfLatency[PERF_HISTORY];       // Decode-to-display latency in ms (avg per second)
+	float m_perfGlassToGlass[PERF_HISTORY];  // Sender timestamp to display in ms (avg per second)
 	float m_perfBitrate[PERF_HISTORY];       // Bitrate in Mbps (per second)
 	float m_perfAudioQueue[PERF_HISTORY];    // Audio queue depth in frames (sampled per second)
+	float m_perfAvSkew[PERF_HISTORY];        // Audio minus video latency in ms (sampled per second)
 	int m_perfIdx;                           // Current write index in circular buffers
 
 	// 1-second accumulators for perf graph sampling
 	LARGE_INTEGER m_qpcPerfLastUpdate;    // QPC when last perf sample was written
 	float m_perfAccumFrameTime;           // Accumulated frame times this second
 	float m_perfAccumLatency;             // Accumulated latency this second
+	float m_perfAccumGlassToGlass;        // Accumulated glass-to-glass latency this second
+	int m_perfAccumGlassCount;            // Presented frames with a sender timestamp this second
 	int m_perfAccumCount;                 // Number of frames accumulated this second
 
-	// Double-buffered YUV420P planes for lockless producer-consumer pattern
-	// Callback thread copies raw YUV planes into write buffer
-	// Main thread uploads to GPU via SDL_UpdateYUVTexture (GPU does BT.709 conversion)
-	uint8_t* m_yuvBuffer[2][3];      // [buffer_index][plane] - two sets of Y, U, V planes
+	// YUV420P planes, one set per presentation queue slot
+	// Callback thread copies raw YUV planes into the slot the queue hands out
+	// Main thread uploads the due slot via SDL_UpdateYUVTexture (GPU does BT.709 conversion)
+	uint8_t* m_yuvBuffer[CVideoPresentQueue::SLOTS][3];  // [slot][plane]
 	int m_yuvPitch[3];                // Pitches for each YUV plane (32-byte aligned)
-	volatile LONG m_yuvWriteIdx;      // Index of buffer being written by producer (0 or 1)
-	volatile LONG m_yuvReadIdx;       // Index of buffer ready for consumer (0 or 1)
-	volatile LONG m_yuvReady;         // Flag: 1 = new YUV frame available
+	volatile LONG m_yuvReady;         // Flag: 1 = current slot not yet uploaded
+	// Frames waiting for their presentation time. A slot holds either a copy in
+	// m_yuvBuffer or a retained decoder frame (FG_VIDEO_FRAME_REFCOUNTED)
+	// uploaded straight from decoder memory. Guarded by m_mutexVideo.
+	CVideoPresentQueue m_presentQueue;
+	CVideoPresentQueue::SStats m_presentStats;  // Render thread snapshot
+	bool getLatestPlanes(const Uint8* planes[3], int pitches[3]);  // Caller holds m_mutexVideo
 
 	// Frame pacing for smooth output (absorbs bursty TCP/WiFi delivery)
-	// Instead of displaying frames immediately on arrival (bursty), upload to GPU at fixed intervals
-	LARGE_INTEGER m_qpcLastNewFrame;    // QPC when last new frame was uploaded to GPU
+	// The render loop runs at a fixed interval and shows whichever queued frame is due
 	double m_targetFrameIntervalMs;      // Target display interval (16.67ms=60fps, 33.33ms=30fps)
 	float m_displayFPS;                  // Actual display FPS (frames uploaded to GPU per second)
 	unsigned int m_displayFrameCount;    // Counter for display FPS calculation
@@ -0,0 +1,67 @@
+#include "CSdlAudioSink.h"
+
+#include <stdio.h>
+
+CSdlAudioSink::CSdlAudioSink()
+	: m_deviceID(0)
+	, m_frameBytes(0)
+	, m_deviceFrames(0)
+{
+}
+
+CSdlAudioSink::~CSdlAudioSink()
+{
+	close();
+}
+
+bool CSdlAudioSink::open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames)
+{
+	close();
+
+	SDL_AudioSpec wanted_spec, obtained_spec;
+	SDL_zero(wanted_spec);
+	wanted_spec.freq = (int)sampleRate;
+	wanted_spec.format = AUDIO_F32SYS;
+	wanted_spec.channels = (Uint8)channels;
+	wanted_spec.samples = (Uint16)periodFrames;
+	wanted_spec.callback = NULL;  // Queued: the engine pushes
+
+	// No allowed changes: SDL converts to whatever the device really runs at
+	m_deviceID = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &obtained_spec, 0);
+	if (m_deviceID == 0) {
+		printf("Cannot open audio: %s\n", SDL_GetError());
+		return false;
+	}
+	m_frameBytes = channels * sizeof(float);
+	m_deviceFrames = obtained_spec.samples;
+
+	// An empty queue plays silence, so the device can run from the start
+	SDL_PauseAudioDevice(m_deviceID, 0);
+	return true;
+}
+
+void CSdlAudioSink::close()
+{
+	if (m_deviceID != 0) {
+		SDL_CloseAudioDevice(m_deviceID);
+		m_deviceID = 0;
+	}
+	m_frameBytes = 0;
+	m_deviceFrames = 0;
+}
+
+bool CSdlAudioSink::write(const float* samples, unsigned int frames)
+{
+	if (m_deviceID == 0) {
+		return false;
+	}
+	return SDL_QueueAudio(m_deviceID, samples, frames * m_frameBytes) == 0;
+}
+
+unsigned int CSdlAudioSink::queuedFrames()
+{
+	if (m_deviceID == 0) {
+		return 0;
+	}
+	return SDL_GetQueuedAudioSize(m_deviceID) / m_frameBytes;
+}
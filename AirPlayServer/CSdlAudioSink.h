@@ -0,0 +1,26 @@
+#pragma once
+
+#include "IAudioSink.h"
+#include "SDL.h"
+
+// The default output device through SDL's queue: no callback, the engine
+// writes with SDL_QueueAudio and SDL's device thread drains the queue at the
+// rate the hardware plays it.
+class CSdlAudioSink : public IAudioSink
+{
+public:
+	CSdlAudioSink();
+	~CSdlAudioSink();
+
+	bool open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames) override;
+	void close() override;
+	bool write(const float* samples, unsigned int frames) override;
+	unsigned int queuedFrames() override;
+	unsigned int deviceLatencyFrames() const override { return m_deviceFrames; }
+	const char* name() const override { return "device"; }
+
+private:
+	SDL_AudioDeviceID m_deviceID;
+	unsigned int m_frameBytes;
+	unsigned int m_deviceFrames;  // Buffer size SDL obtained
+};
@@ -0,0 +1,423 @@
+#include "CVideoCompositor.h"
+#include "CSDLPlayer.h"
+#include "CAutoLock.h"
+
+#include <math.h>
+
+CVideoCompositor::CVideoCompositor()
+	: m_pPlayer(NULL)
+	, m_nextOrder(0)
+	, m_canvasWidth(0)
+	, m_canvasHeight(0)
+	, m_pendingEncodedBytes(0)
+	, m_bDirty(false)
+	, m_bPendingKey(false)
+	, m_newestPts(0)
+	, m_hFlushThread(NULL)
+{
+	memset(&m_canvasFrame, 0, sizeof(SFgVideoFrame));
+	memset(&m_emitFrame, 0, sizeof(SFgVideoFrame));
+	QueryPerformanceFrequency(&m_qpcFreq);
+	m_qpcLastEmit.QuadPart = 0;
+	m_mutex = CreateMutex(NULL, FALSE, NULL);
+	m_emitMutex = CreateMutex(NULL, FALSE, NULL);
+
+	setCanvasSize(1920, 1080);
+
+	m_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	m_hDirtyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (m_hStopEvent != NULL && m_hDirtyEvent != NULL) {
+		m_hFlushThread = CreateThread(NULL, 0, flushThreadProc, this, 0, NULL);
+	}
+	if (m_hFlushThread == NULL) {
+		printf("Cannot start compositor flush thread, tiles show only as frames arrive\n");
+	}
+}
+
+CVideoCompositor::~CVideoCompositor()
+{
+	if (m_hFlushThread != NULL) {
+		SetEvent(m_hStopEvent);
+		WaitForSingleObject(m_hFlushThread, INFINITE);
+		CloseHandle(m_hFlushThread);
+	}
+	if (m_hStopEvent != NULL) {
+		CloseHandle(m_hStopEvent);
+	}
+	if (m_hDirtyEvent != NULL) {
+		CloseHandle(m_hDirtyEvent);
+	}
+	delete[] m_canvasFrame.data;
+	m_canvasFrame.data = NULL;
+	delete[] m_emitFrame.data;
+	m_emitFrame.data = NULL;
+	CloseHandle(m_mutex);
+	CloseHandle(m_emitMutex);
+}
+
+void CVideoCompositor::setPlayer(CSDLPlayer* pPlayer)
+{
+	CAutoLock oLock(m_mutex, "setPlayer");
+	m_pPlayer = pPlayer;
+}
+
+void CVideoCompositor::setCanvasSize(unsigned int width, unsigned int height)
+{
+	CAutoLock oLock(m_mutex, "setCanvasSize");
+	width &= ~1u;
+	height &= ~1u;
+	if (width < 2 || height < 2 ||
+		(width == m_canvasWidth && height == m_canvasHeight)) {
+		return;
+	}
+
+	delete[] m_canvasFrame.data;
+	m_canvasWidth = width;
+	m_canvasHeight = height;
+
+	const unsigned int ySize = width * height;
+	const unsigned int uvSize = (width / 2) * (height / 2);
+	m_canvasFrame.width = width;
+	m_canvasFrame.height = height;
+	m_canvasFrame.pitch[0] = width;
+	m_canvasFrame.pitch[1] = width / 2;
+	m_canvasFrame.pitch[2] = width / 2;
+	m_canvasFrame.dataLen[0] = ySize;
+	m_canvasFrame.dataLen[1] = uvSize;
+	m_canvasFrame.dataLen[2] = uvSize;
+	m_canvasFrame.dataTotalLen = ySize + uvSize * 2;
+	m_canvasFrame.data = new unsigned char[m_canvasFrame.dataTotalLen];
+
+	layoutTiles();
+}
+
+int CVideoCompositor::addSession(const char* remoteDeviceId, const char* remoteName)
+{
+	if (remoteDeviceId == NULL) {
+		return 0;
+	}
+
+	CAutoLock oLock(m_mutex, "addSession");
+	STileMap::iterator it = m_mapTiles.find(remoteDeviceId);
+	if (it != m_mapTiles.end()) {
+		it->second.name = remoteName ? remoteName : "";
+		return (int)m_mapTiles.size();
+	}
+
+	STile tile;
+	tile.order = m_nextOrder++;
+	tile.name = remoteName ? remoteName : "";
+	m_mapTiles[remoteDeviceId] = tile;
+	layoutTiles();
+	return (int)m_mapTiles.size();
+}
+
+int CVideoCompositor::removeSession(const char* remoteDeviceId, std::string* pRemainingName)
+{
+	CAutoLock oLock(m_mutex, "removeSession");
+	if (remoteDeviceId != NULL && m_mapTiles.erase(remoteDeviceId) > 0) {
+		layoutTiles();
+	}
+
+	if (pRemainingName != NULL) {
+		int latestOrder = -1;
+		pRemainingName->clear();
+		for (STileMap::iterator it = m_mapTiles.begin(); it != m_mapTiles.end(); ++it) {
+			if (it->second.order > latestOrder) {
+				latestOrder = it->second.order;
+				*pRemainingName = it->second.name;
+			}
+		}
+	}
+	return (int)m_mapTiles.size();
+}
+
+void CVideoCompositor::outputVideo(SFgVideoFrame* data, const char* remoteName, const char* remoteDeviceId)
+{
+	if (data == NULL || remoteDeviceId == NULL || data->width < 2 || data->height < 2) {
+		return;
+	}
+
+	// The player may block on a size change, so it is only called once the
+	// compositor lock is released; other sessions keep blitting meanwhile
+	CSDLPlayer* pPassThrough = NULL;
+	CSDLPlayer* pCanvasPlayer = NULL;
+	{
+		CAutoLock oLock(m_mutex, "outputVideo");
+		if (m_pPlayer == NULL) {
+			return;
+		}
+
+		STileMap::iterator it = m_mapTiles.find(remoteDeviceId);
+		if (it == m_mapTiles.end()) {
+			// Video can beat the connected callback; give the sender a tile anyway
+			STile tile;
+			tile.order = m_nextOrder++;
+			tile.name = remoteName ? remoteName : "";
+			m_mapTiles[remoteDeviceId] = tile;
+			layoutTiles();
+			it = m_mapTiles.find(remoteDeviceId);
+		}
+
+		if (m_mapTiles.size() == 1) {
+			// A lone sender keeps the full-resolution path
+			pPassThrough = m_pPlayer;
+		}
+		else {
+			blitTile(it->second, data);
+			m_pendingEncodedBytes += data->encodedDataLen;
+			m_bDirty = true;
+			m_bPendingKey = m_bPendingKey || data->isKey;
+			if (data->pts > m_newestPts) {
+				m_newestPts = data->pts;
+			}
+
+			// Every session updates its own tile; the player only needs the wall
+			// at display rate, not once per session frame
+			LARGE_INTEGER qpcNow;
+			QueryPerformanceCounter(&qpcNow);
+			double elapsedMs = (double)(qpcNow.QuadPart - m_qpcLastEmit.QuadPart) * 1000.0 / (double)m_qpcFreq.QuadPart;
+			if (elapsedMs >= EMIT_INTERVAL_MS && prepareCanvas(qpcNow)) {
+				pCanvasPlayer = m_pPlayer;
+			}
+			else if (m_hDirtyEvent != NULL) {
+				// Shown by the flush thread unless another frame gets there first
+				SetEvent(m_hDirtyEvent);
+			}
+		}
+	}
+
+	if (pPassThrough != NULL) {
+		pPassThrough->outputVideo(data);
+	}
+	if (pCanvasPlayer != NULL) {
+		deliverCanvas(pCanvasPlayer);
+	}
+}
+
+// Snapshots the wall into m_emitFrame, unless the player is still taking the
+// previous one. Must be called with m_mutex held; on success the caller owns
+// m_emitMutex and hands the snapshot over with deliverCanvas() after
+// releasing m_mutex.
+bool CVideoCompositor::prepareCanvas(LARGE_INTEGER qpcNow)
+{
+	if (WaitForSingleObject(m_emitMutex, 0) != WAIT_OBJECT_0) {
+		return false;
+	}
+	m_qpcLastEmit = qpcNow;
+
+	if (m_emitFrame.dataTotalLen != m_canvasFrame.dataTotalLen) {
+		delete[] m_emitFrame.data;
+		m_emitFrame.data = new unsigned char[m_canvasFrame.dataTotalLen];
+	}
+	unsigned char* emitData = m_emitFrame.data;
+	m_emitFrame = m_canvasFrame;
+	m_emitFrame.data = emitData;
+	memcpy(m_emitFrame.data, m_canvasFrame.data, m_canvasFrame.dataTotalLen);
+
+	m_emitFrame.pts = m_newestPts;
+	m_emitFrame.isKey = m_bPendingKey;
+	m_emitFrame.encodedDataLen = m_pendingEncodedBytes;
+	m_pendingEncodedBytes = 0;
+	m_bDirty = false;
+	m_bPendingKey = false;
+	m_newestPts = 0;
+	return true;
+}
+
+// Called without m_mutex, by the thread prepareCanvas() succeeded on
+void CVideoCompositor::deliverCanvas(CSDLPlayer* pPlayer)
+{
+	pPlayer->outputVideo(&m_emitFrame);
+	ReleaseMutex(m_emitMutex);
+}
+
+DWORD WINAPI CVideoCompositor::flushThreadProc(LPVOID param)
+{
+	((CVideoCompositor*)param)->runFlush();
+	return 0;
+}
+
+// Emits a wall left dirty by a frame that came inside the emit interval, so a
+// tile is not held back until some session sends again.
+void CVideoCompositor::runFlush()
+{
+	HANDLE waitHandles[2] = { m_hStopEvent, m_hDirtyEvent };
+	for (;;) {
+		if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+			break;
+		}
+
+		LONGLONG dueQpc;
+		{
+			CAutoLock oLock(m_mutex, "flushDue");
+			dueQpc = m_qpcLastEmit.QuadPart + m_qpcFreq.QuadPart * EMIT_INTERVAL_MS / 1000;
+		}
+		LARGE_INTEGER qpcNow;
+		QueryPerformanceCounter(&qpcNow);
+		if (dueQpc > qpcNow.QuadPart) {
+			DWORD waitMs = (DWORD)((dueQpc - qpcNow.QuadPart) * 1000 / m_qpcFreq.QuadPart) + 1;
+			if (WaitForSingleObject(m_hStopEvent, waitMs) == WAIT_OBJECT_0) {
+				break;
+			}
+		}
+
+		CSDLPlayer* pPlayer = NULL;
+		bool bBusy = false;
+		{
+			CAutoLock oLock(m_mutex, "flush");
+			if (!m_bDirty || m_pPlayer == NULL || m_mapTiles.size() < 2) {
+				continue;
+			}
+			QueryPerformanceCounter(&qpcNow);
+			if (prepareCanvas(qpcNow)) {
+				pPlayer = m_pPlayer;
+			}
+			else {
+				bBusy = true;
+			}
+		}
+		if (pPlayer != NULL) {
+			deliverCanvas(pPlayer);
+		}
+		else if (bBusy) {
+			// The player is still on the last wall; try again an interval later
+			if (WaitForSingleObject(m_hStopEvent, EMIT_INTERVAL_MS) == WAIT_OBJECT_0) {
+				break;
+			}
+			SetEvent(m_hDirtyEvent);
+		}
+	}
+}
+
+// Assigns grid slots in connection order and blanks the canvas. Must be called
+// with m_mutex held.
+void CVideoCompositor::layoutTiles()
+{
+	if (m_canvasFrame.data == NULL) {
+		return;
+	}
+	clearCanvas(0, 0, m_canvasWidth, m_canvasHeight);
+
+	const int count = (int)m_mapTiles.size();
+	if (count == 0) {
+		return;
+	}
+	const int cols = (int)ceil(sqrt((double)count));
+	const int rows = (count + cols - 1) / cols;
+	const int cellWidth = (m_canvasWidth / cols) & ~1;
+	const int cellHeight = (m_canvasHeight / rows) & ~1;
+
+	std::vector<STile*> ordered;
+	for (STileMap::iterator it = m_mapTiles.begin(); it != m_mapTiles.end(); ++it) {
+		STile* tile = &it->second;
+		std::vector<STile*>::iterator pos = ordered.begin();
+		while (pos != ordered.end() && (*pos)->order < tile->order) {
+			++pos;
+		}
+		ordered.insert(pos, tile);
+	}
+
+	for (int i = 0; i < count; i++) {
+		STile* tile = ordered[i];
+		tile->cellX = (i % cols) * cellWidth;
+		tile->cellY = (i / cols) * cellHeight;
+		tile->cellWidth = cellWidth;
+		tile->cellHeight = cellHeight;
+		tile->x = tile->cellX;
+		tile->y = tile->cellY;
+		tile->width = 0;
+		tile->height = 0;
+		// Force blitTile to fit the next frame into the new slot
+		tile->srcWidth = 0;
+		tile->srcHeight = 0;
+		tile->columnMap.clear();
+	}
+}
+
+void CVideoCompositor::clearCanvas(int x, int y, int width, int height)
+{
+	unsigned char* yPlane = m_canvasFrame.data;
+	unsigned char* uPlane = yPlane + m_canvasFrame.dataLen[0];
+	unsigned char* vPlane = uPlane + m_canvasFrame.dataLen[1];
+
+	for (int row = 0; row < height; row++) {
+		memset(yPlane + (y + row) * m_canvasFrame.pitch[0] + x, 0, width);
+	}
+	for (int row = 0; row < height / 2; row++) {
+		memset(uPlane + (y / 2 + row) * m_canvasFrame.pitch[1] + x / 2, 128, width / 2);
+		memset(vPlane + (y / 2 + row) * m_canvasFrame.pitch[2] + x / 2, 128, width / 2);
+	}
+}
+
+// Nearest-neighbour scale of one session frame into its tile. Must be called
+// with m_mutex held.
+void CVideoCompositor::blitTile(STile& tile, const SFgVideoFrame* frame)
+{
+	if (m_canvasFrame.data == NULL || tile.cellWidth < 2 || tile.cellHeight < 2) {
+		return;
+	}
+
+	if (tile.srcWidth != frame->width || tile.srcHeight != frame->height) {
+		// New source size (first frame or rotation): refit and blank the bars
+		clearCanvas(tile.cellX, tile.cellY, tile.cellWidth, tile.cellHeight);
+
+		double scale = (double)tile.cellWidth / frame->width;
+		if ((double)tile.cellHeight / frame->height < scale) {
+			scale = (double)tile.cellHeight / frame->height;
+		}
+		tile.width = ((int)(frame->width * scale)) & ~1;
+		tile.height = ((int)(frame->height * scale)) & ~1;
+		if (tile.width < 2 || tile.height < 2) {
+			return;
+		}
+		tile.x = tile.cellX + (((tile.cellWidth - tile.width) / 2) & ~1);
+		tile.y = tile.cellY + (((tile.cellHeight - tile.height) / 2) & ~1);
+		tile.columnMap.resize(tile.width);
+		for (int col = 0; col < tile.width; col++) {
+			tile.columnMap[col] = (int)((long long)col * frame->width / tile.width);
+		}
+		tile.srcWidth = frame->width;
+		tile.srcHeight = frame->height;
+	}
+	if (tile.width < 2 || tile.height < 2) {
+		return;
+	}
+
+	const int* columnMap = &tile.columnMap[0];
+	const unsigned char* srcY = frame->data;
+	const unsigned char* srcU = srcY + frame->dataLen[0];
+	const unsigned char* srcV = srcU + frame->dataLen[1];
+	if (frame->flags & FG_VIDEO_FRAME_REFCOUNTED) {
+		srcY = frame->planes[0];
+		srcU = frame->planes[1];
+		srcV = frame->planes[2];
+	}
+	unsigned char* dstY = m_canvasFrame.data;
+	unsigned char* dstU = dstY + m_canvasFrame.dataLen[0];
+	unsigned char* dstV = dstU + m_canvasFrame.dataLen[1];
+
+	for (int row = 0; row < tile.height; row++) {
+		const unsigned char* sp = srcY + (long long)row * frame->height / tile.height * frame->pitch[0];
+		unsigned char* dp = dstY + (tile.y + row) * m_canvasFrame.pitch[0] + tile.x;
+		for (int col = 0; col < tile.width; col++) {
+			dp[col] = sp[columnMap[col]];
+		}
+	}
+
+	const int uvHeight = tile.height / 2;
+	const int uvWidth = tile.width / 2;
+	const unsigned int srcUvHeight = (frame->height + 1) / 2;
+	for (int row = 0; row < uvHeight; row++) {
+		const long long srcRow = (long long)row * srcUvHeight / uvHeight;
+		const unsigned char* spU = srcU + srcRow * frame->pitch[1];
+		const unsigned char* spV = srcV + srcRow * frame->pitch[2];
+		unsigned char* dpU = dstU + (tile.y / 2 + row) * m_canvasFrame.pitch[1] + tile.x / 2;
+		unsigned char* dpV = dstV + (tile.y / 2 + row) * m_canvasFrame.pitch[2] + tile.x / 2;
+		for (int col = 0; col < uvWidth; col++) {
+			const int srcCol = columnMap[col * 2] >> 1;
+			dpU[col] = spU[srcCol];
+			dpV[col] = spV[srcCol];
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Windows.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "Airplay2Head.h"
+
+class CSDLPlayer;
+
+// Sink for decoded frames from concurrent mirroring sessions, keyed by device
+// ID. A single session passes straight through to the player; with several,
+// each one is letterboxed into its own tile of a canvas the player shows as
+// one video. Called from every session's decode thread; a flush thread shows
+// tiles that arrive between emits once the interval is up.
+class CVideoCompositor
+{
+public:
+	CVideoCompositor();
+	~CVideoCompositor();
+
+	void setPlayer(CSDLPlayer* pPlayer);
+	void setCanvasSize(unsigned int width, unsigned int height);
+
+	// Both return the number of sessions left on the wall. removeSession
+	// reports the name of the most recent remaining session, if any.
+	int addSession(const char* remoteDeviceId, const char* remoteName);
+	int removeSession(const char* remoteDeviceId, std::string* pRemainingName);
+	void outputVideo(SFgVideoFrame* data, const char* remoteName, const char* remoteDeviceId);
+
+private:
+	struct STile {
+		int order;                      // Connection order, decides the grid slot
+		std::string name;
+		int cellX, cellY, cellWidth, cellHeight;  // Grid slot inside the canvas
+		int x, y, width, height;        // Letterboxed, even-aligned picture in the slot
+		unsigned int srcWidth;          // Source size the column map was built for
+		unsigned int srcHeight;
+		std::vector<int> columnMap;     // Source luma column for each tile column
+	};
+	typedef std::map<std::string, STile> STileMap;
+
+	void layoutTiles();
+	void clearCanvas(int x, int y, int width, int height);
+	void blitTile(STile& tile, const SFgVideoFrame* frame);
+	bool prepareCanvas(LARGE_INTEGER qpcNow);
+	void deliverCanvas(CSDLPlayer* pPlayer);
+
+	static DWORD WINAPI flushThreadProc(LPVOID param);
+	void runFlush();
+
+	HANDLE m_mutex;
+	CSDLPlayer* m_pPlayer;
+	STileMap m_mapTiles;
+	int m_nextOrder;
+
+	unsigned int m_canvasWidth;
+	unsigned int m_canvasHeight;
+	SFgVideoFrame m_canvasFrame;    // I420 planes stored back to back in data
+	SFgVideoFrame m_emitFrame;      // Snapshot of the canvas the player is given
+	HANDLE m_emitMutex;             // Held from the snapshot until the player returns
+	unsigned int m_pendingEncodedBytes; // Payload bytes composited since the last emit
+	bool m_bDirty;                  // Tiles were blitted since the last emit
+	bool m_bPendingKey;             // One of them was a keyframe
+	unsigned long long m_newestPts; // Latest PTS among those tiles, 0 when unknown
+	LARGE_INTEGER m_qpcFreq;
+	LARGE_INTEGER m_qpcLastEmit;
+	HANDLE m_hFlushThread;
+	HANDLE m_hStopEvent;
+	HANDLE m_hDirtyEvent;           // Auto-reset, set when a blit is left unshown
+	static const int EMIT_INTERVAL_MS = 16;  // Composite at most at 60 fps
+};
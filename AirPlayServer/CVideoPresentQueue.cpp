@@ -0,0 +1,240 @@
+#include "CVideoPresentQueue.h"
+
+#include <string.h>
+#include <algorithm>
+
+// A timestamp further than this from the arrival time is a bad clock
+// mapping, not jitter; such frames are treated as having none
+static const LONGLONG PRESENT_MAX_TRANSIT_NS = 1000000000LL;
+// The delay never holds frames longer than this, however bad the network
+static const LONGLONG PRESENT_MAX_DELAY_NS = 100000000LL;
+// The delay grows at once when frames start arriving later, but only
+// shrinks this much per update so one quiet second does not undo it
+static const LONGLONG PRESENT_DELAY_DECAY_NS = 2000000LL;
+static const LONGLONG PRESENT_DELAY_UPDATE_NS = 1000000000LL;
+static const int PRESENT_MIN_TRANSIT_SAMPLES = 8;
+// Frame interval assumed until the stream shows its own. The estimate drops
+// to a shorter step at once and creeps up by this share of a longer one, so
+// a pause in a static screen does not make room a burst would overflow.
+static const LONGLONG PRESENT_DEFAULT_INTERVAL_NS = 1000000000LL / 60;
+static const LONGLONG PRESENT_MIN_INTERVAL_NS = 1000000LL;
+static const int PRESENT_INTERVAL_RISE_SHIFT = 4;
+
+CVideoPresentQueue::CVideoPresentQueue()
+{
+	memset(m_slots, 0, sizeof(m_slots));
+	m_current = 0;
+	m_head = 0;
+	m_count = 0;
+	resetSession();
+}
+
+CVideoPresentQueue::~CVideoPresentQueue()
+{
+	clear();
+}
+
+void CVideoPresentQueue::freeSlot(int slot)
+{
+	SSlot& s = m_slots[slot];
+	if (s.ref.opaque != NULL && s.ref.release != NULL) {
+		s.ref.release(s.ref.opaque);
+	}
+	memset(&s, 0, sizeof(SSlot));
+}
+
+void CVideoPresentQueue::clear()
+{
+	for (int i = 0; i < SLOTS; i++) {
+		freeSlot(i);
+	}
+	m_current = 0;
+	m_head = 0;
+	m_count = 0;
+}
+
+void CVideoPresentQueue::resetSession()
+{
+	clear();
+	memset(m_transit, 0, sizeof(m_transit));
+	m_transitIdx = 0;
+	m_transitCount = 0;
+	m_playoutDelayNs = 0;
+	m_syncDelayNs = 0;
+	m_lastPtsNs = 0;
+	m_frameIntervalNs = PRESENT_DEFAULT_INTERVAL_NS;
+	m_lastDelayUpdateNs = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+int CVideoPresentQueue::acquire()
+{
+	for (int slot = 0; slot < SLOTS; slot++) {
+		if (slot == m_current) {
+			continue;
+		}
+		bool queued = false;
+		for (int i = 0; i < m_count && !queued; i++) {
+			queued = m_waiting[(m_head + i) % SLOTS] == slot;
+		}
+		if (!queued) {
+			return slot;
+		}
+	}
+
+	// Every slot is on screen or waiting: the oldest waiting frame makes room
+	int slot = m_waiting[m_head];
+	m_head = (m_head + 1) % SLOTS;
+	m_count--;
+	freeSlot(slot);
+	m_stats.droppedOverflow++;
+	return slot;
+}
+
+void CVideoPresentQueue::commit(int slot, const SFgVideoFrame* refFrame, LONGLONG ptsNs, LONGLONG arrivalNs)
+{
+	SSlot& s = m_slots[slot];
+	freeSlot(slot);
+	if (refFrame != NULL) {
+		s.ref = *refFrame;
+	}
+	s.arrivalNs = arrivalNs;
+
+	LONGLONG transit = arrivalNs - ptsNs;
+	if (ptsNs > 0 && transit < PRESENT_MAX_TRANSIT_NS && transit > -PRESENT_MAX_TRANSIT_NS) {
+		s.ptsNs = ptsNs;
+		m_transit[m_transitIdx] = transit;
+		m_transitIdx = (m_transitIdx + 1) % TRANSIT_HISTORY;
+		if (m_transitCount < TRANSIT_HISTORY) {
+			m_transitCount++;
+		}
+
+		LONGLONG interval = ptsNs - m_lastPtsNs;
+		if (m_lastPtsNs > 0 && interval >= PRESENT_MIN_INTERVAL_NS && interval < PRESENT_MAX_TRANSIT_NS) {
+			if (interval < m_frameIntervalNs) {
+				m_frameIntervalNs = interval;
+			} else {
+				m_frameIntervalNs += (interval - m_frameIntervalNs) >> PRESENT_INTERVAL_RISE_SHIFT;
+			}
+		}
+		m_lastPtsNs = ptsNs;
+	}
+
+	m_waiting[(m_head + m_count) % SLOTS] = slot;
+	m_count++;
+}
+
+void CVideoPresentQueue::setSyncDelay(LONGLONG delayNs)
+{
+	LONGLONG room = syncDelayRoomNs();
+	m_syncDelayNs = (delayNs < room) ? delayNs : room;
+}
+
+// A frame waits about its total delay, so SLOTS - 1 waiting slots hold that
+// many frame intervals. One is kept free for frames that arrive in a burst.
+LONGLONG CVideoPresentQueue::syncDelayRoomNs() const
+{
+	LONGLONG room = (SLOTS - 2) * m_frameIntervalNs - m_playoutDelayNs;
+	return (room > 0) ? room : 0;
+}
+
+LONGLONG CVideoPresentQueue::dueNs(int slot) const
+{
+	const SSlot& s = m_slots[slot];
+	return (s.ptsNs > 0) ? s.ptsNs + m_playoutDelayNs + m_syncDelayNs : s.arrivalNs;
+}
+
+void CVideoPresentQueue::updatePlayoutDelay(LONGLONG nowNs, LONGLONG refreshNs)
+{
+	if (m_lastDelayUpdateNs != 0 && nowNs - m_lastDelayUpdateNs < PRESENT_DELAY_UPDATE_NS) {
+		return;
+	}
+	m_lastDelayUpdateNs = nowNs;
+	if (m_transitCount < PRESENT_MIN_TRANSIT_SAMPLES) {
+		return;
+	}
+
+	LONGLONG sorted[TRANSIT_HISTORY];
+	memcpy(sorted, m_transit, m_transitCount * sizeof(LONGLONG));
+	int p95 = m_transitCount * 95 / 100;
+	std::nth_element(sorted, sorted + p95, sorted + m_transitCount);
+
+	// present() takes frames up to half a refresh early, so that much more is
+	// needed for the late ones to be in by then. Negative only when the clock
+	// mapping runs ahead; the delay then absorbs the error instead of holding
+	// frames back until their timestamp.
+	LONGLONG target = sorted[p95] + refreshNs / 2;
+	if (target > PRESENT_MAX_DELAY_NS) {
+		target = PRESENT_MAX_DELAY_NS;
+	} else if (target < -PRESENT_MAX_DELAY_NS) {
+		target = -PRESENT_MAX_DELAY_NS;
+	}
+	if (target > m_playoutDelayNs) {
+		m_playoutDelayNs = target;
+	} else if (target < m_playoutDelayNs - PRESENT_DELAY_DECAY_NS) {
+		m_playoutDelayNs -= PRESENT_DELAY_DECAY_NS;
+	} else {
+		m_playoutDelayNs = target;
+	}
+}
+
+int CVideoPresentQueue::present(LONGLONG nowNs, LONGLONG refreshNs)
+{
+	updatePlayoutDelay(nowNs, refreshNs);
+
+	// The newest frame due by the middle of this refresh is shown; any older
+	// one due as well would only be on screen for no time at all
+	int chosen = -1;
+	LONGLONG chosenDue = 0;
+	while (m_count > 0) {
+		int slot = m_waiting[m_head];
+		LONGLONG due = dueNs(slot);
+		if (due > nowNs + refreshNs / 2) {
+			break;
+		}
+		m_head = (m_head + 1) % SLOTS;
+		m_count--;
+		if (chosen >= 0) {
+			freeSlot(chosen);
+			m_stats.droppedLate++;
+		}
+		chosen = slot;
+		chosenDue = due;
+	}
+	if (chosen < 0) {
+		return -1;
+	}
+
+	// A late frame left its predecessor on screen for the refreshes it missed
+	if (m_slots[chosen].ptsNs > 0 && refreshNs > 0 && nowNs - chosenDue > refreshNs) {
+		m_stats.repeated += (unsigned long long)((nowNs - chosenDue) / refreshNs);
+	}
+
+	if (m_current != chosen) {
+		freeSlot(m_current);
+	}
+	m_current = chosen;
+	m_stats.presented++;
+	return chosen;
+}
+
+const SFgVideoFrame* CVideoPresentQueue::currentRefFrame() const
+{
+	const SSlot& s = m_slots[m_current];
+	return (s.ref.opaque != NULL) ? &s.ref : NULL;
+}
+
+void CVideoPresentQueue::getStats(SStats* stats) const
+{
+	*stats = m_stats;
+	stats->playoutDelayMs = (double)(m_playoutDelayNs + m_syncDelayNs) / 1000000.0;
+	stats->syncDelayRoomNs = syncDelayRoomNs();
+}
+
+LONGLONG CVideoPresentQueue::qpcToNs(LONGLONG counter, LONGLONG frequency)
+{
+	if (frequency <= 0) {
+		return 0;
+	}
+	return (counter / frequency) * 1000000000LL + (counter % frequency) * 1000000000LL / frequency;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Windows.h>
+#include "Airplay2Head.h"
+
+// Decoded frames waiting for their presentation time, between outputVideo
+// (the producer) and the render loop (the consumer). The caller serializes
+// every call with m_mutexVideo. Frames live in SLOTS slots: the one on
+// screen and up to SLOTS - 1 waiting in arrival order. A slot holds either a
+// retained decoder frame or marks the caller's plane copy with the same index.
+//
+// A frame with a timestamp is due at that time plus the playout delay. The
+// delay follows the 95th percentile of how far behind their timestamps
+// frames arrive, so it covers network and decoder jitter and little more.
+// Frames without a timestamp are due on arrival, which is latest-wins.
+class CVideoPresentQueue
+{
+public:
+	static const int SLOTS = 8;
+
+	struct SStats {
+		unsigned long long presented;
+		unsigned long long droppedLate;      // Another frame became due at the same refresh
+		unsigned long long droppedOverflow;  // Every slot was in use when a frame arrived
+		unsigned long long repeated;         // Refreshes that kept the old frame because the next was late
+		double playoutDelayMs;               // Jitter delay plus the sync delay
+		LONGLONG syncDelayRoomNs;            // Largest sync delay the slots can hold on top of the jitter delay
+	};
+
+	CVideoPresentQueue();
+	~CVideoPresentQueue();
+
+	// Drops every waiting frame and releases the retained ones. Slot 0 is
+	// current afterwards, so the caller's copy in slot 0 is what shows.
+	void clear();
+	// clear(), and forget the learned delay and the counters for a new session
+	void resetSession();
+
+	// Producer. Slot to put the next frame in; when none is free the oldest
+	// waiting frame is dropped for it. Fill the slot, then commit it.
+	int acquire();
+	// refFrame is a retained frame the queue releases once done, or NULL when
+	// the caller copied the planes into its own buffers for this slot
+	void commit(int slot, const SFgVideoFrame* refFrame, LONGLONG ptsNs, LONGLONG arrivalNs);
+
+	// Held on top of the playout delay, to line video up with audio. Cut to
+	// syncDelayRoomNs(), past which frames would overflow the slots.
+	void setSyncDelay(LONGLONG delayNs);
+	LONGLONG syncDelayRoomNs() const;
+
+	// Consumer, once per refresh of refreshNs. Returns the slot to show from
+	// now on, or -1 to keep the current one.
+	int present(LONGLONG nowNs, LONGLONG refreshNs);
+
+	int current() const { return m_current; }
+	// The retained frame on screen, NULL when it is a copy
+	const SFgVideoFrame* currentRefFrame() const;
+	LONGLONG currentPtsNs() const { return m_slots[m_current].ptsNs; }
+	LONGLONG currentArrivalNs() const { return m_slots[m_current].arrivalNs; }
+	int waiting() const { return m_count; }
+	void getStats(SStats* stats) const;
+
+	// Same conversion the receiver uses for its timestamps
+	static LONGLONG qpcToNs(LONGLONG counter, LONGLONG frequency);
+
+private:
+	struct SSlot {
+		SFgVideoFrame ref;   // opaque is NULL for a copy
+		LONGLONG ptsNs;      // 0 when unknown
+		LONGLONG arrivalNs;
+	};
+
+	void freeSlot(int slot);
+	LONGLONG dueNs(int slot) const;
+	void updatePlayoutDelay(LONGLONG nowNs, LONGLONG refreshNs);
+
+	SSlot m_slots[SLOTS];
+	int m_current;
+	int m_waiting[SLOTS];   // Circular, oldest at m_head
+	int m_head;
+	int m_count;
+
+	// Arrival minus timestamp of recent frames
+	static const int TRANSIT_HISTORY = 128;
+	LONGLONG m_transit[TRANSIT_HISTORY];
+	int m_transitIdx;
+	int m_transitCount;
+	LONGLONG m_playoutDelayNs;
+	LONGLONG m_syncDelayNs;
+	LONGLONG m_lastPtsNs;
+	LONGLONG m_frameIntervalNs;  // Shortest recent timestamp step, what the slots fill at
+	LONGLONG m_lastDelayUpdateNs;
+
+	SStats m_stats;
+};
@@ -0,0 +1,97 @@
+#include "CWavAudioSink.h"
+
+#include <string.h>
+
+// RIFF sizes are 32-bit; recording stops short of that
+static const unsigned long long WAV_MAX_DATA_BYTES = 0xFFFFFFFFULL - 64;
+static const unsigned short WAVE_FORMAT_IEEE_FLOAT_TAG = 3;
+
+static void putLE16(unsigned char* p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static void putLE32(unsigned char* p, unsigned int v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+CWavAudioSink::CWavAudioSink(const char* path, double clockScale)
+	: CNullAudioSink(clockScale)
+	, m_file(NULL)
+	, m_dataBytes(0)
+{
+	strncpy(m_path, path, sizeof(m_path) - 1);
+	m_path[sizeof(m_path) - 1] = '\0';
+}
+
+CWavAudioSink::~CWavAudioSink()
+{
+	close();
+}
+
+void CWavAudioSink::writeHeader(unsigned int dataBytes)
+{
+	unsigned char header[44];
+	unsigned int blockAlign = m_channels * sizeof(float);
+	memcpy(header, "RIFF", 4);
+	putLE32(header + 4, 36 + dataBytes);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	putLE32(header + 16, 16);
+	putLE16(header + 20, WAVE_FORMAT_IEEE_FLOAT_TAG);
+	putLE16(header + 22, m_channels);
+	putLE32(header + 24, m_sampleRate);
+	putLE32(header + 28, m_sampleRate * blockAlign);
+	putLE16(header + 32, blockAlign);
+	putLE16(header + 34, 32);
+	memcpy(header + 36, "data", 4);
+	putLE32(header + 40, dataBytes);
+	fseek(m_file, 0, SEEK_SET);
+	fwrite(header, sizeof(header), 1, m_file);
+}
+
+bool CWavAudioSink::open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames)
+{
+	close();
+	if (!CNullAudioSink::open(sampleRate, channels, periodFrames)) {
+		return false;
+	}
+	m_file = fopen(m_path, "wb");
+	if (m_file == NULL) {
+		printf("Cannot create %s\n", m_path);
+		CNullAudioSink::close();
+		return false;
+	}
+	m_dataBytes = 0;
+	// Sizes are filled in by close()
+	writeHeader(0);
+	return true;
+}
+
+void CWavAudioSink::close()
+{
+	if (m_file != NULL) {
+		writeHeader((unsigned int)m_dataBytes);
+		fclose(m_file);
+		m_file = NULL;
+	}
+	CNullAudioSink::close();
+}
+
+bool CWavAudioSink::write(const float* samples, unsigned int frames)
+{
+	if (!CNullAudioSink::write(samples, frames)) {
+		return false;
+	}
+	unsigned int bytes = frames * m_channels * sizeof(float);
+	if (m_file != NULL && m_dataBytes + bytes <= WAV_MAX_DATA_BYTES) {
+		// The file is little-endian, as are the targets this builds for
+		fwrite(samples, bytes, 1, m_file);
+		m_dataBytes += bytes;
+	}
+	return true;
+}
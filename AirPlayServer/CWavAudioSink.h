@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdio.h>
+#include "CNullAudioSink.h"
+
+// The null device, also recording everything the engine sent it to a 32-bit
+// float WAV file: the output after resampling, limiter and volume, for
+// checking what would have been heard. The file is written from the engine
+// thread, so this is for testing, not for playback alongside a session.
+class CWavAudioSink : public CNullAudioSink
+{
+public:
+	explicit CWavAudioSink(const char* path = "airplay-output.wav", double clockScale = 1.0);
+	~CWavAudioSink();
+
+	bool open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames) override;
+	void close() override;
+	bool write(const float* samples, unsigned int frames) override;
+	const char* name() const override { return "wav"; }
+
+private:
+	void writeHeader(unsigned int dataBytes);
+
+	char m_path[MAX_PATH];
+	FILE* m_file;
+	unsigned long long m_dataBytes;
+};
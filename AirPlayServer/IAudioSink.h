@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Windows.h>
+
+// Where CAudioEngine pushes its finished float blocks. The engine writes
+// ahead of the device and polls queuedFrames() on its own deadline; how fast
+// the queue drains between polls is the device clock, so a sink only has to
+// report its queue honestly. Only the engine thread calls a sink once it is
+// open.
+class IAudioSink
+{
+public:
+	virtual ~IAudioSink() {}
+
+	// periodFrames is how often the device is expected to take audio
+	virtual bool open(unsigned int sampleRate, unsigned int channels, unsigned int periodFrames) = 0;
+	virtual void close() = 0;
+
+	// Interleaved float, full scale at 1.0. Returns false when the device is gone.
+	virtual bool write(const float* samples, unsigned int frames) = 0;
+	// Frames written but not yet taken by the device
+	virtual unsigned int queuedFrames() = 0;
+	// Frames the device holds beyond queuedFrames() before they are heard
+	virtual unsigned int deviceLatencyFrames() const = 0;
+	virtual const char* name() const = 0;
+};
@@ -2,18 +2,27 @@
 
 #define AIRPLAY_NAME_LEN 128
 
+// Decoded audio, interleaved. Channels are in WAV order, so 5.1 is
+// L R C LFE Ls Rs.
 typedef struct SFgAudioFrame {
 	unsigned long long pts;
+	unsigned long long localTimeNs;  // When the first sample belongs on the SFgVideoFrame.pts clock; 0 when unknown
 	unsigned int sampleRate;
 	unsigned short channels;
 	unsigned short bitsPerSample;
 	unsigned int dataLen;
 	unsigned char* data;
+	unsigned int sampleFormat;       // FG_AUDIO_FORMAT_*, see fgServerSetAudioSampleFormat
+	unsigned int frames;             // Samples per channel in data
 } SFgAudioFrame;
 
+// Audio sample formats for fgServerSetAudioSampleFormat
+#define FG_AUDIO_FORMAT_S16			0	// Signed 16-bit (default)
+#define FG_AUDIO_FORMAT_F32			1	// 32-bit float, full scale at 1.0
+
 // Decoded video frame
 typedef struct SFgVideoFrame {
-	unsigned long long pts;
+	unsigned long long pts;  // Sender presentation time on the local QueryPerformanceCounter clock, in ns; 0 when unknown
 	int isKey;
 	unsigned int width;
 	unsigned int height;
@@ -22,4 +31,67 @@ typedef struct SFgVideoFrame {
 	unsigned int dataTotalLen;
 	unsigned char* data;
 	unsigned int encodedDataLen;  // H.264 payload bytes that produced this decoded frame
+
+	// Set to FG_VIDEO_FRAME_REFCOUNTED when data is NULL and planes point into
+	// decoder memory instead, or to FG_VIDEO_FRAME_DEVICE when data and planes
+	// are NULL and surface is the decoder's GPU texture. Either is valid for the
+	// duration of the callback; call retain(opaque) to keep it longer and
+	// release(opaque) once done.
+	unsigned int flags;
+	unsigned char* planes[3];
+	void* opaque;
+	void (*retain)(void* opaque);
+	void (*release)(void* opaque);
+	void* surface;           // FG_VIDEO_FRAME_DEVICE: backend texture, e.g. an ID3D11Texture2D*
+	int surfaceIndex;        // Array slice of surface
 }SFgVideoFrame;
+
+// Video frame delivery modes for fgServerSetVideoFrameMode
+#define FG_VIDEO_FRAME_COPY			0	// data holds a private copy of all planes (default)
+#define FG_VIDEO_FRAME_REFCOUNTED	1	// planes reference the decoded frame, no copy
+#define FG_VIDEO_FRAME_DEVICE		2	// as REFCOUNTED, but GPU-decoded frames stay on the device
+
+// Decoder tuning for fgServerSetDecodeMode
+#define FG_DECODE_MODE_LATENCY		0	// Never delay output; frame threads only if one core falls behind (default)
+#define FG_DECODE_MODE_THROUGHPUT	1	// Frame threading on every stream, one frame of delay per extra thread
+
+// Threading a session's decoder ended up with
+#define FG_DECODE_THREADING_NONE	0
+#define FG_DECODE_THREADING_SLICE	1
+#define FG_DECODE_THREADING_FRAME	2
+
+// Per-session mirroring statistics
+typedef struct SFgSessionStats {
+	char remoteName[AIRPLAY_NAME_LEN];
+	char remoteDeviceId[AIRPLAY_NAME_LEN];
+	unsigned int width;
+	unsigned int height;
+	unsigned int decodeThreads;           // libavcodec threads granted by the admission limit
+	unsigned int queueDepth;              // Frames waiting for the decode thread
+	unsigned int queueCapacity;
+	unsigned long long framesReceived;
+	unsigned long long framesDecoded;
+	unsigned long long framesDropped;     // All frames that never reached the decoder
+	unsigned long long bytesReceived;
+	float decodeMs;                       // Smoothed avcodec time per frame
+	unsigned long long framesSkipped;     // Non-reference frames dropped over the latency budget
+	unsigned long long framesFlushed;     // Queued frames made stale by a newer IDR
+	unsigned int queueHighWater;          // Deepest the queue has been
+	float queueLatencyMs;                 // Age of the oldest queued frame at the last push
+	int decodeMode;                       // FG_DECODE_MODE_* the decoder was configured for
+	int decodeThreading;                  // FG_DECODE_THREADING_*
+	unsigned int decodeThreadCount;       // Threads libavcodec actually runs, at most decodeThreads
+	unsigned int slicesPerFrame;          // Slices in the last IDR, 0 before the first one
+	unsigned int decodeDelayFrames;       // Output delay added by frame threading
+	float decodeDelayMs;                  // The same at the measured frame interval
+	float inputFps;                       // Rate video frames arrive from the sender
+	unsigned long long audioPackets;      // RTP audio and resend datagrams received
+	float audioWakeupsPerSec;             // Audio receive thread wakeups with data pending
+	float audioSyscallsPerPacket;         // Receive calls per datagram, below 1 when batched
+	unsigned long long audioSocketDrops;  // Datagrams dropped on a full socket buffer, Linux only
+	unsigned long long audioPacketsLost;       // Played without having arrived
+	unsigned long long audioPacketsRecovered;  // Arrived in answer to a resend request
+	unsigned long long audioPacketsConcealed;  // Lost ones the decoder filled in instead of silence
+	unsigned long long audioPacketsLate;       // Arrived after their turn to play
+	unsigned long long audioResendRequests;    // Sent by the jitter buffer, see fgServerSetAudioLatency
+} SFgSessionStats;
@@ -38,3 +38,29 @@ AIRPLAYSERVER_API void* fgServerStartWithDisplay(const char serverName[AIRPLAY_N
 AIRPLAYSERVER_API void fgServerStop(void* handle);
 
 AIRPLAYSERVER_API float fgServerScale(void* handle, float fRatio);
+// FG_VIDEO_FRAME_COPY, FG_VIDEO_FRAME_REFCOUNTED or FG_VIDEO_FRAME_DEVICE. Scaled
+// output is always copied from system memory.
+AIRPLAYSERVER_API int fgServerSetVideoFrameMode(void* handle, int mode);
+// FG_DECODE_MODE_LATENCY or FG_DECODE_MODE_THROUGHPUT. Running sessions switch
+// at their next IDR.
+AIRPLAYSERVER_API int fgServerSetDecodeMode(void* handle, int mode);
+
+// Caps concurrent mirroring sessions; 0 picks a limit from the CPU core count.
+// Returns the limit now in effect.
+AIRPLAYSERVER_API int fgServerSetMaxSessions(void* handle, int maxSessions);
+// Audio jitter buffer for sessions that connect afterwards: lost packets are
+// requested again and waited for up to latencyMs, at most half the buffer
+// length. 0 (the default) plays audio as it arrives. Returns the value set.
+AIRPLAYSERVER_API int fgServerSetAudioLatency(void* handle, int latencyMs);
+// Audio reorder window for sessions that connect afterwards, in packets of
+// about 11 ms: a power of two from 32 to 1024, 0 for the default of 64. Audio
+// starts once prerollPackets are buffered, at most half the window.
+AIRPLAYSERVER_API void fgServerSetAudioBuffer(void* handle, int lengthPackets, int prerollPackets);
+// Decode audio of sessions that connect afterwards on a thread of its own
+// rather than the receive thread; outputAudio is then called from it.
+AIRPLAYSERVER_API void fgServerSetAudioDecodeThread(void* handle, int enabled);
+// Sample format outputAudio delivers for sessions that connect afterwards,
+// FG_AUDIO_FORMAT_*. Rate, channel count and frame size follow the stream.
+AIRPLAYSERVER_API void fgServerSetAudioSampleFormat(void* handle, int sampleFormat);
+// Fills up to maxCount entries and returns the number of active sessions written.
+AIRPLAYSERVER_API int fgServerGetSessionStats(void* handle, SFgSessionStats* stats, int maxCount);
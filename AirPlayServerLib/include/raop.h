@@ -48,6 +48,8 @@ struct raop_callbacks_s {
 	void  (*audio_set_coverart)(void *cls, void *session, const void *buffer, int buflen, const char* remoteName, const char* remoteDeviceId);
 	void  (*audio_remote_control_id)(void *cls, const char *dacp_id, const char *active_remote_header, const char* remoteName, const char* remoteDeviceId);
 	void  (*audio_set_progress)(void *cls, void *session, unsigned int start, unsigned int curr, unsigned int end, const char* remoteName, const char* remoteDeviceId);
+	/* Called from the audio receive thread about once a second */
+	void  (*audio_recv_stats)(void *cls, const audio_recv_stats_struct *stats, const char* remoteName, const char* remoteDeviceId);
 	/* Optional in-app approval before a protected connection receives its PIN. */
 	int (*pin_request)(void *cls, const char *remoteAddress, const char *pin);
 };
@@ -59,6 +61,27 @@ RAOP_API void raop_set_log_level(raop_t *raop, int level);
 RAOP_API void raop_set_log_callback(raop_t *raop, raop_log_callback_t callback, void *cls);
 RAOP_API void raop_set_password(raop_t *raop, const char *password);
 RAOP_API void raop_set_display_size(raop_t *raop, unsigned int width, unsigned int height);
+/* Lowers the number of senders accepted below the max_clients given to
+ * raop_init(), or raises it back up to that. Takes effect while running. */
+RAOP_API void raop_set_max_clients(raop_t *raop, int max_clients);
+/* Audio jitter buffer for sessions set up afterwards: lost packets are asked
+ * for again and waited for up to latency_ms, at most half the buffer length.
+ * 0, the default, plays packets as they arrive and conceals lost ones at once. */
+RAOP_API void raop_set_audio_latency(raop_t *raop, unsigned int latency_ms);
+/* Audio reorder window in packets of 480 frames (about 11 ms), rounded up to
+ * a power of two between 32 and 1024; 0 selects the default of 64. Playback
+ * of a new or flushed stream waits until preroll packets, at most half the
+ * window, are buffered. Applies to sessions set up afterwards. */
+RAOP_API void raop_set_audio_buffer(raop_t *raop, unsigned int length, unsigned int preroll);
+/* Decode audio on a thread of its own, so a slow decode or audio callback
+ * never holds up receiving and asking for resends. Decoded audio is then
+ * delivered from that thread. Off by default; applies to sessions set up
+ * afterwards. */
+RAOP_API void raop_set_audio_decode_thread(raop_t *raop, int enabled);
+/* Sample format of the PCM passed to audio_process, PCM_SAMPLE_FORMAT_S16
+ * (the default) or PCM_SAMPLE_FORMAT_F32. Channel count, rate and frame size
+ * follow the stream. Applies to sessions set up afterwards. */
+RAOP_API void raop_set_audio_sample_format(raop_t *raop, int sample_format);
 RAOP_API void raop_log(raop_t* raop, int level, const char* fmt, ...);
 RAOP_API void raop_set_port(raop_t *raop, unsigned short port);
 RAOP_API unsigned short raop_get_port(raop_t *raop);
@@ -69,6 +92,12 @@ RAOP_API void raop_stop(raop_t *raop);
 
 RAOP_API void raop_destroy(raop_t *raop);
 
+/* Mirror frames arrive in pooled buffers. A video_process callback that keeps
+ * h264_decode_struct::data past its return takes a reference on
+ * h264_decode_struct::buffer and releases it when done. */
+RAOP_API void raop_payload_retain(void *buffer);
+RAOP_API void raop_payload_release(void *buffer);
+
 #ifdef __cplusplus
 }
 #endif
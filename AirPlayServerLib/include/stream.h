@@ -7,6 +7,10 @@
 
 #include <stdint.h>
 
+/* Zeroed bytes guaranteed after h264_decode_struct::data when buffer is set,
+ * enough for libavcodec to parse the payload in place. */
+#define H264_DATA_PADDING_SIZE 64
+
 typedef struct {
     int nGOPIndex;
     int frame_type;
@@ -15,14 +19,53 @@ typedef struct {
     int data_len;
     unsigned int nTimeStamp;
     uint64_t pts;
+    /* When the frame is due on the local now_ns() clock, 0 until the
+     * sender clock is synced */
+    uint64_t local_time_ns;
+    /* Pooled payload owning data, or NULL when data is only valid during the
+     * video_process callback. See raop_payload_retain(). */
+    void *buffer;
 } h264_decode_struct;
 
+/* pcm_data_struct::sample_format */
+#define PCM_SAMPLE_FORMAT_S16 0  /* Signed 16-bit, native byte order */
+#define PCM_SAMPLE_FORMAT_F32 1  /* 32-bit float, full scale at 1.0 */
+
 typedef struct {
-    unsigned short *data;
+    /* Interleaved in the decoder's channel order, which for 5.1 is
+     * L R C LFE Ls Rs as in WAV files */
+    const void *data;
     int data_len;
     unsigned int pts;
+    /* When the first sample is due on the local now_ns() clock, 0 until
+     * the sender clock is synced */
+    uint64_t local_time_ns;
     uint32_t sample_rate;
     uint16_t channels;
     uint16_t bits_per_sample;
+    uint16_t sample_format;
+    /* Samples per channel in data */
+    uint32_t frames;
 } pcm_data_struct;
+
+/* Audio receive counters for one session, totals since the stream started
+ * and rates over the last reporting interval */
+typedef struct {
+    uint64_t wakeups;
+    uint64_t syscalls;
+    uint64_t packets;
+    /* Datagrams the kernel dropped because the receive buffer was full.
+     * Only Linux reports them (SO_RXQ_OVFL); stays 0 elsewhere. */
+    uint64_t socket_drops;
+    /* Jitter buffer: packets played without having arrived, those that
+     * came in answer to a resend request, lost ones the decoder concealed
+     * and ones that arrived after their turn */
+    uint64_t packets_lost;
+    uint64_t packets_recovered;
+    uint64_t packets_concealed;
+    uint64_t packets_late;
+    uint64_t resend_requests;
+    float wakeups_per_sec;
+    float syscalls_per_packet;
+} audio_recv_stats_struct;
 #endif //AIRPLAYSERVER_STREAM_H
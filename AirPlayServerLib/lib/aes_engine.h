@@ -0,0 +1,44 @@
+//
+// AES-128 CTR keystream engine with runtime selected backends.
+//
+
+#ifndef AES_ENGINE_H
+#define AES_ENGINE_H
+
+#include <stdint.h>
+
+typedef enum {
+    AES_ENGINE_AUTO = 0,
+    /* Portable table driven implementation */
+    AES_ENGINE_TTABLE,
+    /* AES-NI with SSE4.1, x86 only */
+    AES_ENGINE_AESNI
+} aes_engine_backend_t;
+
+typedef struct aes_engine_s aes_engine_t;
+
+struct aes_engine_s {
+    aes_engine_backend_t backend;
+    /* Expanded key as round key bytes and as big-endian words */
+    uint8_t round_key[176];
+    uint32_t round_words[44];
+    /* 128-bit big-endian counter split into host order halves */
+    uint64_t counter_hi;
+    uint64_t counter_lo;
+    void (*xcrypt_blocks)(aes_engine_t *engine, const uint8_t *in, uint8_t *out, int blocks);
+};
+
+int aes_engine_available(aes_engine_backend_t backend);
+const char *aes_engine_name(aes_engine_backend_t backend);
+
+/* Returns the backend actually selected, AES_ENGINE_AUTO picks the fastest
+ * one supported by the CPU and unavailable requests fall back to T-table. */
+aes_engine_backend_t aes_engine_init_ctr(aes_engine_t *engine, aes_engine_backend_t backend,
+                                         const uint8_t *key, const uint8_t *iv);
+
+/* XOR length bytes with the next keystream blocks, length must be a multiple
+ * of 16. in and out may be the same buffer. The counter advances exactly as
+ * the tiny-AES AES_CTR_xcrypt_buffer() one does. */
+void aes_engine_ctr_xcrypt(aes_engine_t *engine, const uint8_t *in, uint8_t *out, int length);
+
+#endif //AES_ENGINE_H
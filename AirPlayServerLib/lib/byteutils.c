@@ -42,6 +42,25 @@ uint64_t byteutils_read_int(unsigned char* b, int offset) {
 uint64_t byteutils_read_timeStamp(unsigned char* b, int offset) {
     return (byteutils_read_int(b, offset) * 1000000) + ((byteutils_read_int(b, offset + 4) * 1000000) / INT_32_MAX);
 }
+// NTP 32.32 fixed point to ns since 1970, the inverse of byteutils_put_ntp_ns
+uint64_t byteutils_read_ntp_ns(unsigned char* b, int offset) {
+    uint64_t seconds = byteutils_read_int(b, offset) - OFFSET_1900_TO_1970;
+    return seconds * 1000000000ULL + ((byteutils_read_int(b, offset + 4) * 1000000000ULL) >> 32);
+}
+// ns time to ntp
+void byteutils_put_ntp_ns(unsigned char* b, int offset, uint64_t time) {
+    uint64_t seconds = time / 1000000000ULL;
+    uint64_t fraction = ((time - seconds * 1000000000ULL) << 32) / 1000000000ULL;
+    seconds += OFFSET_1900_TO_1970;
+    b[offset++] = (uint8_t)(seconds >> 24);
+    b[offset++] = (uint8_t)(seconds >> 16);
+    b[offset++] = (uint8_t)(seconds >> 8);
+    b[offset++] = (uint8_t)(seconds >> 0);
+    b[offset++] = (uint8_t)(fraction >> 24);
+    b[offset++] = (uint8_t)(fraction >> 16);
+    b[offset++] = (uint8_t)(fraction >> 8);
+    b[offset++] = (uint8_t)(fraction >> 0);
+}
 // us time to ntp
 void byteutils_put_timeStamp(unsigned char* b, int offset, uint64_t time) {
 
@@ -66,73 +85,26 @@ void byteutils_put_timeStamp(unsigned char* b, int offset, uint64_t time) {
     //b[offset++] = (Math.random() * 255.0);
 }
 
+// Monotonic wall clock, the local time base for clock sync and scheduling.
+// On Windows this is QueryPerformanceCounter, which callers outside the
+// library can read to compare against it.
+uint64_t now_ns() {
 #ifdef WIN32
-// https://stackoverflow.com/questions/5404277/porting-clock-gettime-to-windows?r=SearchResults
-#define CLOCK_PROCESS_CPUTIME_ID 0
-LARGE_INTEGER
-getFILETIMEoffset()
-{
-    SYSTEMTIME s;
-    FILETIME f;
-    LARGE_INTEGER t;
-
-    s.wYear = 1970;
-    s.wMonth = 1;
-    s.wDay = 1;
-    s.wHour = 0;
-    s.wMinute = 0;
-    s.wSecond = 0;
-    s.wMilliseconds = 0;
-    SystemTimeToFileTime(&s, &f);
-    t.QuadPart = f.dwHighDateTime;
-    t.QuadPart <<= 32;
-    t.QuadPart |= f.dwLowDateTime;
-    return (t);
-}
-
-int
-clock_gettime(int X, struct timespec* tv)
-{
-    LARGE_INTEGER           t;
-    FILETIME            f;
-    double                  microseconds;
-    static LARGE_INTEGER    offset;
-    static double           frequencyToMicroseconds;
-    static int              initialized = 0;
-    static BOOL             usePerformanceCounter = 0;
-
-    if (!initialized) {
-        LARGE_INTEGER performanceFrequency;
-        initialized = 1;
-        usePerformanceCounter = QueryPerformanceFrequency(&performanceFrequency);
-        if (usePerformanceCounter) {
-            QueryPerformanceCounter(&offset);
-            frequencyToMicroseconds = (double)performanceFrequency.QuadPart / 1000000.;
-        }
-        else {
-            offset = getFILETIMEoffset();
-            frequencyToMicroseconds = 10.;
-        }
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
     }
-    if (usePerformanceCounter) QueryPerformanceCounter(&t);
-    else {
-        GetSystemTimeAsFileTime(&f);
-        t.QuadPart = f.dwHighDateTime;
-        t.QuadPart <<= 32;
-        t.QuadPart |= f.dwLowDateTime;
-    }
-
-    t.QuadPart -= offset.QuadPart;
-    microseconds = (double)t.QuadPart / frequencyToMicroseconds;
-    t.QuadPart = (LONGLONG)microseconds;
-    tv->tv_sec = (long)(t.QuadPart / 1000000);
-    tv->tv_nsec = t.QuadPart % 1000000;
-    return (0);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+#endif
 }
-#endif // WIN32
 
 uint64_t now_us() {
-    struct timespec time;
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
-    return (uint64_t)time.tv_sec * 10000000L + (uint64_t)(time.tv_nsec / 1000);
+    return now_ns() / 1000;
 }
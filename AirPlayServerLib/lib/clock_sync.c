@@ -0,0 +1,270 @@
+//
+// Sender to local clock mapping from NTP-style timing exchanges.
+//
+// Each exchange gives the four timestamps of one request/reply round trip.
+// The exchange with the smallest round trip in a short window had the least
+// queueing in it and gives the truest offset. A second order loop follows
+// that offset over time, so the rate difference between the two clocks is
+// tracked as well and the mapping stays right between exchanges.
+//
+// The mapping is published under a sequence counter: readers copy it without
+// a lock and retry in the rare case the timing thread was writing it.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "clock_sync.h"
+#include "threads.h"
+
+/* Exchanges the minimum round trip is taken over. At one exchange a second
+ * a changed network path is followed within a few seconds. */
+#define CLOCK_SYNC_WINDOW 8
+/* Steady loop gains: the share of an offset error corrected at once, and the
+ * share turned into a rate correction. Near critically damped. */
+#define CLOCK_SYNC_OFFSET_GAIN 0.15
+#define CLOCK_SYNC_DRIFT_GAIN 0.006
+/* Crystals are within tens of ppm of each other; more is noise */
+#define CLOCK_SYNC_MAX_DRIFT 0.0005
+/* An error this large is the sender clock being set, not noise */
+#define CLOCK_SYNC_STEP_NS 50000000LL
+/* A reply this late says nothing useful about the offset */
+#define CLOCK_SYNC_MAX_RTT_NS 1000000000LL
+
+typedef struct {
+	uint64_t local_ns;
+	int64_t offset_ns;
+	int64_t rtt_ns;
+} clock_sync_sample_t;
+
+typedef struct {
+	int synced;
+	/* Sender minus local is ref_offset_ns at ref_local_ns and changes by
+	 * drift for every local nanosecond after it */
+	uint64_t ref_local_ns;
+	int64_t ref_offset_ns;
+	double drift;
+	int64_t rtt_ns;
+	uint64_t exchanges;
+	uint64_t updates;
+} clock_sync_mapping_t;
+
+struct clock_sync_s {
+	logger_t *logger;
+	char name[32];
+
+	/* Only touched by the thread adding exchanges */
+	clock_sync_sample_t window[CLOCK_SYNC_WINDOW];
+	int window_count;
+	int window_next;
+	clock_sync_mapping_t state;
+
+	/* Copy of state for every other thread, seq is odd while it is written */
+	atomic_counter_t seq;
+	clock_sync_mapping_t published;
+};
+
+static void
+clock_sync_publish(clock_sync_t *clock_sync)
+{
+	ATOMIC_INC(clock_sync->seq);
+	memcpy(&clock_sync->published, &clock_sync->state, sizeof(clock_sync_mapping_t));
+	ATOMIC_INC(clock_sync->seq);
+}
+
+static void
+clock_sync_read(clock_sync_t *clock_sync, clock_sync_mapping_t *mapping)
+{
+	long seq;
+
+	for (;;) {
+		seq = ATOMIC_GET(clock_sync->seq);
+		if (!(seq & 1)) {
+			memcpy(mapping, &clock_sync->published, sizeof(clock_sync_mapping_t));
+			if (ATOMIC_GET(clock_sync->seq) == seq) {
+				return;
+			}
+		}
+	}
+}
+
+clock_sync_t *
+clock_sync_init(logger_t *logger, const char *name)
+{
+	clock_sync_t *clock_sync;
+
+	assert(logger);
+	assert(name);
+
+	clock_sync = calloc(1, sizeof(clock_sync_t));
+	if (!clock_sync) {
+		return NULL;
+	}
+	clock_sync->logger = logger;
+	strncpy(clock_sync->name, name, sizeof(clock_sync->name) - 1);
+	return clock_sync;
+}
+
+void
+clock_sync_destroy(clock_sync_t *clock_sync)
+{
+	free(clock_sync);
+}
+
+void
+clock_sync_reset(clock_sync_t *clock_sync)
+{
+	assert(clock_sync);
+
+	clock_sync->window_count = 0;
+	clock_sync->window_next = 0;
+	memset(&clock_sync->state, 0, sizeof(clock_sync->state));
+	clock_sync_publish(clock_sync);
+}
+
+int
+clock_sync_add_exchange(clock_sync_t *clock_sync, uint64_t t1, uint64_t t2,
+                        uint64_t t3, uint64_t t4)
+{
+	clock_sync_mapping_t *state;
+	clock_sync_sample_t *sample, *best;
+	int64_t rtt;
+	int i;
+
+	assert(clock_sync);
+	state = &clock_sync->state;
+
+	if (t4 < t1 || t3 < t2) {
+		return -1;
+	}
+	rtt = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+	if (rtt < 0 || rtt > CLOCK_SYNC_MAX_RTT_NS) {
+		return -1;
+	}
+	state->exchanges++;
+
+	sample = &clock_sync->window[clock_sync->window_next];
+	sample->local_ns = t4;
+	sample->offset_ns = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+	sample->rtt_ns = rtt;
+	clock_sync->window_next = (clock_sync->window_next + 1) % CLOCK_SYNC_WINDOW;
+	if (clock_sync->window_count < CLOCK_SYNC_WINDOW) {
+		clock_sync->window_count++;
+	}
+
+	best = &clock_sync->window[0];
+	for (i=1; i<clock_sync->window_count; i++) {
+		if (clock_sync->window[i].rtt_ns < best->rtt_ns) {
+			best = &clock_sync->window[i];
+		}
+	}
+	/* The best exchange was already used, keep following the drift */
+	if (state->synced && best->local_ns <= state->ref_local_ns) {
+		clock_sync_publish(clock_sync);
+		return 0;
+	}
+
+	if (!state->synced) {
+		state->synced = 1;
+		state->ref_offset_ns = best->offset_ns;
+		state->drift = 0.0;
+		logger_log(clock_sync->logger, LOGGER_INFO, "Clock %s synced, offset %lld us, round trip %lld us",
+		           clock_sync->name, (long long)(best->offset_ns / 1000), (long long)(best->rtt_ns / 1000));
+	} else {
+		int64_t elapsed = (int64_t)(best->local_ns - state->ref_local_ns);
+		double predicted = state->drift * elapsed;
+		double error = (double)(best->offset_ns - state->ref_offset_ns) - predicted;
+
+		if (error > CLOCK_SYNC_STEP_NS || error < -CLOCK_SYNC_STEP_NS) {
+			logger_log(clock_sync->logger, LOGGER_WARNING, "Clock %s stepped by %lld us",
+			           clock_sync->name, (long long)(error / 1000));
+			state->ref_offset_ns = best->offset_ns;
+			state->drift = 0.0;
+			/* Older exchanges measured the clock before the step */
+			clock_sync->window[0] = *best;
+			clock_sync->window_count = 1;
+			clock_sync->window_next = 1 % CLOCK_SYNC_WINDOW;
+			best = &clock_sync->window[0];
+		} else {
+			/* Start wide so the rate is found quickly, then narrow down to
+			 * the steady gains that average out the network noise */
+			double offset_gain = 2.0 / (state->updates + 2);
+			double drift_gain = 1.0 / (state->updates + 1);
+
+			if (offset_gain < CLOCK_SYNC_OFFSET_GAIN) {
+				offset_gain = CLOCK_SYNC_OFFSET_GAIN;
+			}
+			if (drift_gain < CLOCK_SYNC_DRIFT_GAIN) {
+				drift_gain = CLOCK_SYNC_DRIFT_GAIN;
+			}
+			state->ref_offset_ns += (int64_t)(predicted + offset_gain * error);
+			state->drift += drift_gain * error / elapsed;
+			if (state->drift > CLOCK_SYNC_MAX_DRIFT) {
+				state->drift = CLOCK_SYNC_MAX_DRIFT;
+			} else if (state->drift < -CLOCK_SYNC_MAX_DRIFT) {
+				state->drift = -CLOCK_SYNC_MAX_DRIFT;
+			}
+		}
+	}
+	state->ref_local_ns = best->local_ns;
+	state->rtt_ns = best->rtt_ns;
+	state->updates++;
+	clock_sync_publish(clock_sync);
+
+	logger_log(clock_sync->logger, LOGGER_DEBUG, "Clock %s offset %lld us, round trip %lld us, drift %.2f ppm",
+	           clock_sync->name, (long long)(state->ref_offset_ns / 1000),
+	           (long long)(state->rtt_ns / 1000), state->drift * 1000000.0);
+	return 1;
+}
+
+uint64_t
+clock_sync_sender_to_local_ns(clock_sync_t *clock_sync, uint64_t sender_ns)
+{
+	clock_sync_mapping_t mapping;
+	int64_t elapsed;
+
+	assert(clock_sync);
+
+	clock_sync_read(clock_sync, &mapping);
+	if (!mapping.synced) {
+		return 0;
+	}
+	/* Sender time minus the offset at the reference, then undo the drift
+	 * accumulated since */
+	elapsed = (int64_t)(sender_ns - mapping.ref_local_ns - (uint64_t)mapping.ref_offset_ns);
+	return mapping.ref_local_ns + (int64_t)(elapsed / (1.0 + mapping.drift));
+}
+
+uint64_t
+clock_sync_local_to_sender_ns(clock_sync_t *clock_sync, uint64_t local_ns)
+{
+	clock_sync_mapping_t mapping;
+	int64_t elapsed;
+
+	assert(clock_sync);
+
+	clock_sync_read(clock_sync, &mapping);
+	if (!mapping.synced) {
+		return 0;
+	}
+	elapsed = (int64_t)(local_ns - mapping.ref_local_ns);
+	return local_ns + mapping.ref_offset_ns + (int64_t)(mapping.drift * elapsed);
+}
+
+void
+clock_sync_get_stats(clock_sync_t *clock_sync, clock_sync_stats_t *stats)
+{
+	clock_sync_mapping_t mapping;
+
+	assert(clock_sync);
+	assert(stats);
+
+	clock_sync_read(clock_sync, &mapping);
+	stats->synced = mapping.synced;
+	stats->offset_ns = mapping.ref_offset_ns;
+	stats->rtt_ns = mapping.rtt_ns;
+	stats->drift_ppm = mapping.drift * 1000000.0;
+	stats->exchanges = mapping.exchanges;
+	stats->updates = mapping.updates;
+}
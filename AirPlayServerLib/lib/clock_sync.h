@@ -0,0 +1,44 @@
+//
+// Sender to local clock mapping from NTP-style timing exchanges.
+//
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include "logger.h"
+
+typedef struct clock_sync_s clock_sync_t;
+
+typedef struct {
+	int synced;
+	int64_t offset_ns;      /* Sender minus local at the last update */
+	int64_t rtt_ns;         /* Round trip of the exchange the update used */
+	double drift_ppm;       /* How much faster the sender clock runs */
+	uint64_t exchanges;     /* Exchanges seen since the last reset */
+	uint64_t updates;       /* Exchanges that moved the estimate */
+} clock_sync_stats_t;
+
+clock_sync_t *clock_sync_init(logger_t *logger, const char *name);
+void clock_sync_destroy(clock_sync_t *clock_sync);
+
+/* Forgets the estimate, for a new session on the same sender. Only call
+ * from the thread that adds exchanges. */
+void clock_sync_reset(clock_sync_t *clock_sync);
+
+/* One request/reply round trip: t1 when the request left and t4 when the
+ * reply arrived, both on the local now_ns() clock, t2 and t3 when the
+ * sender received and answered it, on the sender clock. Only one thread
+ * may add exchanges. Returns 1 when the mapping moved, 0 when the filter
+ * kept the previous one and -1 for an impossible exchange. */
+int clock_sync_add_exchange(clock_sync_t *clock_sync, uint64_t t1, uint64_t t2,
+                            uint64_t t3, uint64_t t4);
+
+/* Any thread, never blocks. Converts between sender and local now_ns()
+ * time; 0 until the first exchange has been added. */
+uint64_t clock_sync_sender_to_local_ns(clock_sync_t *clock_sync, uint64_t sender_ns);
+uint64_t clock_sync_local_to_sender_ns(clock_sync_t *clock_sync, uint64_t local_ns);
+
+void clock_sync_get_stats(clock_sync_t *clock_sync, clock_sync_stats_t *stats);
+
+#endif
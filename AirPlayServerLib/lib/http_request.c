@@ -137,6 +137,9 @@ on_message_complete(http_parser *parser)
 		(unsigned int)request->parser.http_major,
 		(unsigned int)request->parser.http_minor);
 	request->complete = 1;
+	/* Stop at the message boundary so pipelined data is left for the next
+	 * request; http_request_add_data() returns the bytes consumed. */
+	http_parser_pause(parser, 1);
 	return 0;
 }
 
@@ -214,7 +217,8 @@ int
 http_request_has_error(http_request_t *request)
 {
 	assert(request);
-	return (HTTP_PARSER_ERRNO(&request->parser) != HPE_OK);
+	return (HTTP_PARSER_ERRNO(&request->parser) != HPE_OK &&
+	        HTTP_PARSER_ERRNO(&request->parser) != HPE_PAUSED);
 }
 
 const char *
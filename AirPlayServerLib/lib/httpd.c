@@ -20,15 +20,45 @@
 #include "httpd.h"
 #include "netutils.h"
 #include "http_request.h"
+#include "reactor.h"
 #include "compat.h"
 #include "logger.h"
 
+/* Receive buffers start small and grow to the largest request burst */
+#define HTTPD_RECV_BUFFER_INITIAL 4096
+#define HTTPD_RECV_BUFFER_MAX (4 * 1024 * 1024)
+#define HTTPD_MAX_EVENTS 32
+/* Wait before accepting again after accept() ran out of descriptors or
+ * buffers; the edge-triggered listener is not reported again by itself */
+#define HTTPD_ACCEPT_RETRY_MS 100
+
+#ifdef MSG_NOSIGNAL
+#define HTTPD_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define HTTPD_SEND_FLAGS 0
+#endif
+
+#define HTTPD_WOULD_BLOCK(err) ((err) == SOCKET_ERRORNAME(EWOULDBLOCK) || (err) == SOCKET_ERRORNAME(EAGAIN))
+
 struct http_connection_s {
 	int connected;
 
 	int socket_fd;
 	void *user_data;
 	http_request_t *request;
+
+	/* Received bytes not yet consumed by the request parser */
+	char *recv_buf;
+	int recv_len;
+	int recv_size;
+
+	/* Response bytes waiting for the socket to accept them */
+	char *send_buf;
+	int send_pos;
+	int send_len;
+	int send_size;
+	/* Close once the write queue drains */
+	int close_after_send;
 };
 typedef struct http_connection_s http_connection_t;
 
@@ -38,11 +68,22 @@ struct httpd_s {
 
 	int max_connections;
 	int open_connections;
+	/* Connections accepted before pausing, at most max_connections */
+	int connection_limit;
 	http_connection_t *connections;
 
+	/* Readiness of the server and connection sockets */
+	reactor_t *reactor;
+	/* Server sockets are unregistered from reads while at connection_limit */
+	int accept_paused;
+	/* accept() failed with connections possibly left in the backlog */
+	int accept_retry;
+
 	/* These variables only edited mutex locked */
 	int running;
 	int joined;
+	/* Limit the thread applies to connection_limit on its next pass */
+	int pending_limit;
 	thread_handle_t thread;
 	mutex_handle_t run_mutex;
 
@@ -51,6 +92,10 @@ struct httpd_s {
 	int server_fd6;
 };
 
+static const netutils_socket_profile_t httpd_socket_profile = {
+	.nodelay = 1,
+};
+
 httpd_t *
 httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections)
 {
@@ -67,12 +112,21 @@ httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections)
 	}
 
 	httpd->max_connections = max_connections;
+	httpd->connection_limit = max_connections;
+	httpd->pending_limit = max_connections;
 	httpd->connections = calloc(max_connections, sizeof(http_connection_t));
 	if (!httpd->connections) {
 		free(httpd);
 		return NULL;
 	}
 
+	httpd->reactor = reactor_init(logger);
+	if (!httpd->reactor) {
+		free(httpd->connections);
+		free(httpd);
+		return NULL;
+	}
+
 	/* Use the logger provided */
 	httpd->logger = logger;
 
@@ -82,6 +136,9 @@ httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections)
 	/* Initial status joined */
 	httpd->running = 0;
 	httpd->joined = 1;
+	httpd->server_fd4 = -1;
+	httpd->server_fd6 = -1;
+	MUTEX_CREATE(httpd->run_mutex);
 
 	return httpd;
 }
@@ -92,14 +149,34 @@ httpd_destroy(httpd_t *httpd)
 	if (httpd) {
 		httpd_stop(httpd);
 
+		reactor_destroy(httpd->reactor);
+		MUTEX_DESTROY(httpd->run_mutex);
 		free(httpd->connections);
 		free(httpd);
 	}
 }
 
+static void
+httpd_set_accepting(httpd_t *httpd, int accepting)
+{
+	int events = accepting ? REACTOR_READ : 0;
+
+	if (httpd->accept_paused == !accepting) {
+		return;
+	}
+	httpd->accept_paused = !accepting;
+	if (httpd->server_fd4 != -1) {
+		reactor_modify(httpd->reactor, httpd->server_fd4, events);
+	}
+	if (httpd->server_fd6 != -1) {
+		reactor_modify(httpd->reactor, httpd->server_fd6, events);
+	}
+}
+
 static int
 httpd_add_connection(httpd_t *httpd, int fd, unsigned char *local, int local_len, unsigned char *remote, int remote_len)
 {
+	http_connection_t *connection;
 	void *user_data;
 	int i;
 
@@ -109,21 +186,33 @@ httpd_add_connection(httpd_t *httpd, int fd, unsigned char *local, int local_len
 		}
 	}
 	if (i == httpd->max_connections) {
-		/* This code should never be reached, we do not select server_fds when full */
+		/* This code should never be reached, accepting pauses when full */
 		logger_log(httpd->logger, LOGGER_INFO, "Max connections reached");
 		return -1;
 	}
+	connection = &httpd->connections[i];
+
+	if (netutils_set_nonblocking(fd) == -1 ||
+	    reactor_add(httpd->reactor, fd, REACTOR_READ, connection) == -1) {
+		logger_log(httpd->logger, LOGGER_ERR, "Error registering socket %d", fd);
+		return -1;
+	}
 
 	user_data = httpd->callbacks.conn_init(httpd->callbacks.opaque, local, local_len, remote, remote_len);
 	if (!user_data) {
 		logger_log(httpd->logger, LOGGER_ERR, "Error initializing HTTP request handler");
+		reactor_remove(httpd->reactor, fd);
 		return -1;
 	}
 
 	httpd->open_connections++;
-	httpd->connections[i].socket_fd = fd;
-	httpd->connections[i].connected = 1;
-	httpd->connections[i].user_data = user_data;
+	memset(connection, 0, sizeof(http_connection_t));
+	connection->socket_fd = fd;
+	connection->connected = 1;
+	connection->user_data = user_data;
+	if (httpd->open_connections >= httpd->connection_limit) {
+		httpd_set_accepting(httpd, 0);
+	}
 	return 0;
 }
 
@@ -141,7 +230,12 @@ httpd_accept_connection(httpd_t *httpd, int server_fd, int is_ipv6)
 	remote_saddrlen = sizeof(remote_saddr);
 	fd = accept(server_fd, (struct sockaddr *)&remote_saddr, &remote_saddrlen);
 	if (fd == -1) {
-		/* FIXME: Error happened */
+		int err = SOCKET_GET_ERROR();
+		if (HTTPD_WOULD_BLOCK(err) || err == SOCKET_ERRORNAME(ECONNABORTED)) {
+			/* Backlog drained, or the peer gave up before we got to it */
+			return 0;
+		}
+		logger_log(httpd->logger, LOGGER_DEBUG, "Error in accept: %d", err);
 		return -1;
 	}
 
@@ -150,7 +244,7 @@ httpd_accept_connection(httpd_t *httpd, int server_fd, int is_ipv6)
 	if (ret == -1) {
 		shutdown(fd, SHUT_RDWR);
 		closesocket(fd);
-		return 0;
+		return 1;
 	}
 
 	logger_log(httpd->logger, LOGGER_INFO, "Accepted %s client on socket %d",
@@ -162,11 +256,32 @@ httpd_accept_connection(httpd_t *httpd, int server_fd, int is_ipv6)
 	if (ret == -1) {
 		shutdown(fd, SHUT_RDWR);
 		closesocket(fd);
-		return 0;
 	}
 	return 1;
 }
 
+/* Accepts until the backlog is drained or the connections are full. A
+ * failure schedules a retry, and is only reported when it is not one. */
+static void
+httpd_accept_connections(httpd_t *httpd, int server_fd, int is_ipv6, int retrying)
+{
+	int ret = 1;
+
+	if (server_fd == -1) {
+		return;
+	}
+	while (ret == 1 && httpd->open_connections < httpd->connection_limit) {
+		ret = httpd_accept_connection(httpd, server_fd, is_ipv6);
+	}
+	if (ret == -1) {
+		if (!retrying) {
+			logger_log(httpd->logger, LOGGER_WARNING, "Error in accept, retrying every %d ms",
+			           HTTPD_ACCEPT_RETRY_MS);
+		}
+		httpd->accept_retry = 1;
+	}
+}
+
 static void
 httpd_remove_connection(httpd_t *httpd, http_connection_t *connection)
 {
@@ -175,169 +290,289 @@ httpd_remove_connection(httpd_t *httpd, http_connection_t *connection)
 		connection->request = NULL;
 	}
 	httpd->callbacks.conn_destroy(connection->user_data);
+	reactor_remove(httpd->reactor, connection->socket_fd);
 	shutdown(connection->socket_fd, SHUT_WR);
 	closesocket(connection->socket_fd);
+	free(connection->recv_buf);
+	free(connection->send_buf);
+	connection->recv_buf = NULL;
+	connection->send_buf = NULL;
 	connection->connected = 0;
 	httpd->open_connections--;
+	httpd_set_accepting(httpd, httpd->open_connections < httpd->connection_limit);
+}
+
+/* Send as much of the write queue as the socket takes without blocking.
+ * Returns 1 when the queue is empty, 0 when bytes remain, -1 on error. */
+static int
+httpd_flush_connection(httpd_t *httpd, http_connection_t *connection)
+{
+	while (connection->send_pos < connection->send_len) {
+		int ret = send(connection->socket_fd, connection->send_buf + connection->send_pos,
+		               connection->send_len - connection->send_pos, HTTPD_SEND_FLAGS);
+		if (ret == -1) {
+			int err = SOCKET_GET_ERROR();
+			if (HTTPD_WOULD_BLOCK(err)) {
+				return 0;
+			}
+			if (err == SOCKET_ERRORNAME(EINTR)) {
+				continue;
+			}
+			logger_log(httpd->logger, LOGGER_INFO, "Error in sending data");
+			return -1;
+		}
+		connection->send_pos += ret;
+	}
+	connection->send_pos = 0;
+	connection->send_len = 0;
+	return 1;
+}
+
+static int
+httpd_queue_response(httpd_t *httpd, http_connection_t *connection, const char *data, int datalen)
+{
+	int was_empty = (connection->send_len == 0);
+	int ret;
+
+	if (connection->send_len + datalen > connection->send_size) {
+		int size = connection->send_len + datalen;
+		char *send_buf = realloc(connection->send_buf, size);
+		if (!send_buf) {
+			return -1;
+		}
+		connection->send_buf = send_buf;
+		connection->send_size = size;
+	}
+	memcpy(connection->send_buf + connection->send_len, data, datalen);
+	connection->send_len += datalen;
+
+	ret = httpd_flush_connection(httpd, connection);
+	if (ret == 0 && was_empty) {
+		/* Socket buffer full, finish from the writable event */
+		reactor_modify(httpd->reactor, connection->socket_fd, REACTOR_READ | REACTOR_WRITE);
+	}
+	return ret;
+}
+
+/* Parse every complete request in the receive buffer and queue responses.
+ * Returns -1 when the connection has been removed. */
+static int
+httpd_process_requests(httpd_t *httpd, http_connection_t *connection)
+{
+	int offset = 0;
+
+	while (offset < connection->recv_len && !connection->close_after_send) {
+		int consumed;
+
+		/* If not in the middle of request, allocate one */
+		if (!connection->request) {
+			connection->request = http_request_init();
+			assert(connection->request);
+		}
+
+		/* Parse HTTP request from data read from connection */
+		consumed = http_request_add_data(connection->request, connection->recv_buf + offset,
+		                                 connection->recv_len - offset);
+		if (http_request_has_error(connection->request)) {
+			logger_log(httpd->logger, LOGGER_INFO, "Error in parsing: %s", http_request_get_error_name(connection->request));
+			httpd_remove_connection(httpd, connection);
+			return -1;
+		}
+		offset += consumed;
+
+		/* If request is finished, process and deallocate */
+		if (http_request_is_complete(connection->request)) {
+			http_response_t *response = NULL;
+			httpd->callbacks.conn_request(connection->user_data, connection->request, &response);
+			http_request_destroy(connection->request);
+			connection->request = NULL;
+
+			if (response) {
+				const char *data;
+				int datalen;
+
+				/* Get response data and datalen */
+				data = http_response_get_data(response, &datalen);
+				if (httpd_queue_response(httpd, connection, data, datalen) == -1) {
+					http_response_destroy(response);
+					httpd_remove_connection(httpd, connection);
+					return -1;
+				}
+				if (http_response_get_disconnect(response)) {
+					logger_log(httpd->logger, LOGGER_INFO, "Disconnecting on software request");
+					connection->close_after_send = 1;
+				}
+			} else {
+				logger_log(httpd->logger, LOGGER_INFO, "Didn't get response");
+			}
+			http_response_destroy(response);
+		} else if (consumed == 0) {
+			break;
+		} else {
+			logger_log(httpd->logger, LOGGER_DEBUG, "Request not complete, waiting for more data...");
+		}
+	}
+
+	/* Keep a partial pipelined request for the next read */
+	if (offset > 0) {
+		memmove(connection->recv_buf, connection->recv_buf + offset, connection->recv_len - offset);
+		connection->recv_len -= offset;
+	}
+	if (connection->close_after_send && connection->send_len == 0) {
+		httpd_remove_connection(httpd, connection);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+httpd_read_connection(httpd_t *httpd, http_connection_t *connection)
+{
+	/* Edge triggered: keep reading until the socket would block */
+	while (!connection->close_after_send) {
+		int closed = 0;
+		int filled = 0;
+
+		while (1) {
+			int ret;
+
+			if (connection->recv_len == connection->recv_size) {
+				int size = connection->recv_size ? connection->recv_size * 2 : HTTPD_RECV_BUFFER_INITIAL;
+				char *recv_buf;
+
+				if (size > HTTPD_RECV_BUFFER_MAX) {
+					/* Let the parser consume what we have first */
+					filled = 1;
+					break;
+				}
+				recv_buf = realloc(connection->recv_buf, size);
+				if (!recv_buf) {
+					filled = 1;
+					break;
+				}
+				connection->recv_buf = recv_buf;
+				connection->recv_size = size;
+			}
+
+			ret = recv(connection->socket_fd, connection->recv_buf + connection->recv_len,
+			           connection->recv_size - connection->recv_len, 0);
+			if (ret > 0) {
+				connection->recv_len += ret;
+				continue;
+			}
+			if (ret == 0) {
+				logger_log(httpd->logger, LOGGER_INFO, "Connection closed for socket %d", connection->socket_fd);
+				closed = 1;
+				break;
+			}
+			ret = SOCKET_GET_ERROR();
+			if (HTTPD_WOULD_BLOCK(ret)) {
+				break;
+			}
+			if (ret == SOCKET_ERRORNAME(EINTR)) {
+				continue;
+			}
+			logger_log(httpd->logger, LOGGER_INFO,
+				"Error receiving data on socket %d", connection->socket_fd);
+			closed = 1;
+			break;
+		}
+
+		if (connection->recv_len > 0 && httpd_process_requests(httpd, connection) == -1) {
+			return;
+		}
+		if (closed) {
+			httpd_remove_connection(httpd, connection);
+			return;
+		}
+		if (!filled) {
+			return;
+		}
+		if (connection->recv_len == connection->recv_size) {
+			logger_log(httpd->logger, LOGGER_INFO, "Request too large on socket %d", connection->socket_fd);
+			httpd_remove_connection(httpd, connection);
+			return;
+		}
+	}
+}
+
+static void
+httpd_write_connection(httpd_t *httpd, http_connection_t *connection)
+{
+	int ret = httpd_flush_connection(httpd, connection);
+	if (ret == -1) {
+		httpd_remove_connection(httpd, connection);
+	} else if (ret == 1) {
+		if (connection->close_after_send) {
+			httpd_remove_connection(httpd, connection);
+		} else {
+			reactor_modify(httpd->reactor, connection->socket_fd, REACTOR_READ);
+		}
+	}
 }
 
 static THREAD_RETVAL
 httpd_thread(void *arg)
 {
 	httpd_t *httpd = arg;
-	char buffer[1024];
+	reactor_event_t events[HTTPD_MAX_EVENTS];
 	int i;
 
 	assert(httpd);
 
+	logger_log(httpd->logger, LOGGER_DEBUG, "HTTP server waiting with %s", reactor_get_backend(httpd->reactor));
 	while (1) {
-		fd_set rfds;
-		struct timeval tv;
-		int nfds=0;
-		int ret;
+		int count;
 
 		MUTEX_LOCK(httpd->run_mutex);
 		if (!httpd->running) {
 			MUTEX_UNLOCK(httpd->run_mutex);
 			break;
 		}
-		MUTEX_UNLOCK(httpd->run_mutex);
-
-		/* Set timeout value to 5ms */
-		tv.tv_sec = 1;
-		tv.tv_usec = 5000;
-
-		/* Get the correct nfds value and set rfds */
-		FD_ZERO(&rfds);
-		if (httpd->open_connections < httpd->max_connections) {
-			if (httpd->server_fd4 != -1) {
-				FD_SET(httpd->server_fd4, &rfds);
-				if (nfds <= httpd->server_fd4) {
-					nfds = httpd->server_fd4+1;
-				}
-			}
-			if (httpd->server_fd6 != -1) {
-				FD_SET(httpd->server_fd6, &rfds);
-				if (nfds <= httpd->server_fd6) {
-					nfds = httpd->server_fd6+1;
-				}
-			}
-		}
-		for (i=0; i<httpd->max_connections; i++) {
-			int socket_fd;
-			if (!httpd->connections[i].connected) {
-				continue;
-			}
-			socket_fd = httpd->connections[i].socket_fd;
-			FD_SET(socket_fd, &rfds);
-			if (nfds <= socket_fd) {
-				nfds = socket_fd+1;
-			}
+		if (httpd->connection_limit != httpd->pending_limit) {
+			/* Existing connections stay open when the limit drops */
+			httpd->connection_limit = httpd->pending_limit;
+			httpd_set_accepting(httpd, httpd->open_connections < httpd->connection_limit);
 		}
+		MUTEX_UNLOCK(httpd->run_mutex);
 
-		ret = select(nfds, &rfds, NULL, NULL, &tv);
-		if (ret == 0) {
-			/* Timeout happened */
-			continue;
-		} else if (ret == -1) {
+		/* Idle connections cost nothing here, httpd_stop() wakes the wait */
+		count = reactor_wait(httpd->reactor, events, HTTPD_MAX_EVENTS,
+		                     httpd->accept_retry ? HTTPD_ACCEPT_RETRY_MS : -1);
+		if (count == -1) {
 			/* FIXME: Error happened */
-			logger_log(httpd->logger, LOGGER_INFO, "Error in select");
+			logger_log(httpd->logger, LOGGER_INFO, "Error in reactor wait");
 			break;
 		}
-
-		if (httpd->open_connections < httpd->max_connections &&
-		    httpd->server_fd4 != -1 && FD_ISSET(httpd->server_fd4, &rfds)) {
-			ret = httpd_accept_connection(httpd, httpd->server_fd4, 0);
-			if (ret == -1) {
-				break;
-			} else if (ret == 0) {
-				continue;
-			}
+		if (httpd->accept_retry) {
+			/* Closed connections may have freed what accept() lacked */
+			httpd->accept_retry = 0;
+			httpd_accept_connections(httpd, httpd->server_fd4, 0, 1);
+			httpd_accept_connections(httpd, httpd->server_fd6, 1, 1);
 		}
-		if (httpd->open_connections < httpd->max_connections &&
-		    httpd->server_fd6 != -1 && FD_ISSET(httpd->server_fd6, &rfds)) {
-			ret = httpd_accept_connection(httpd, httpd->server_fd6, 1);
-			if (ret == -1) {
-				break;
-			} else if (ret == 0) {
-				continue;
-			}
-		}
-		for (i=0; i<httpd->max_connections; i++) {
-			http_connection_t *connection = &httpd->connections[i];
 
-			if (!connection->connected) {
-				continue;
-			}
-			if (!FD_ISSET(connection->socket_fd, &rfds)) {
-				continue;
-			}
+		for (i=0; i<count; i++) {
+			http_connection_t *connection;
 
-			/* If not in the middle of request, allocate one */
-			if (!connection->request) {
-				connection->request = http_request_init();
-				assert(connection->request);
-			}
-
-			logger_log(httpd->logger, LOGGER_DEBUG, "Receiving on socket %d", connection->socket_fd);
-			ret = recv(connection->socket_fd, buffer, sizeof(buffer), 0);
-			if (ret == 0) {
-				logger_log(httpd->logger, LOGGER_INFO, "Connection closed for socket %d", connection->socket_fd);
-				httpd_remove_connection(httpd, connection);
-				continue;
-			}
-			if (ret < 0) {
-				logger_log(httpd->logger, LOGGER_INFO,
-					"Error receiving data on socket %d", connection->socket_fd);
-				httpd_remove_connection(httpd, connection);
+			if (events[i].fd == httpd->server_fd4 || events[i].fd == httpd->server_fd6) {
+				httpd_accept_connections(httpd, events[i].fd, events[i].fd == httpd->server_fd6, 0);
 				continue;
 			}
 
-			/* Parse HTTP request from data read from connection */
-			http_request_add_data(connection->request, buffer, ret);
-			if (http_request_has_error(connection->request)) {
-				logger_log(httpd->logger, LOGGER_INFO, "Error in parsing: %s", http_request_get_error_name(connection->request));
-				httpd_remove_connection(httpd, connection);
+			connection = events[i].data;
+			/* An earlier event in this batch may have closed it */
+			if (!connection->connected || connection->socket_fd != events[i].fd) {
 				continue;
 			}
-
-			/* If request is finished, process and deallocate */
-			if (http_request_is_complete(connection->request)) {
-				http_response_t *response = NULL;
-				httpd->callbacks.conn_request(connection->user_data, connection->request, &response);
-				http_request_destroy(connection->request);
-				connection->request = NULL;
-
-				if (response) {
-					const char *data;
-					int datalen;
-					int written;
-					int ret;
-
-					/* Get response data and datalen */
-					data = http_response_get_data(response, &datalen);
-
-					written = 0;
-					while (written < datalen) {
-						ret = send(connection->socket_fd, data+written, datalen-written, 0);
-						if (ret == -1) {
-							/* FIXME: Error happened */
-							logger_log(httpd->logger, LOGGER_INFO, "Error in sending data");
-							break;
-						}
-						written += ret;
-					}
-
-					if (http_response_get_disconnect(response)) {
-						logger_log(httpd->logger, LOGGER_INFO, "Disconnecting on software request");
-						httpd_remove_connection(httpd, connection);
-					}
-				} else {
-					logger_log(httpd->logger, LOGGER_INFO, "Didn't get response");
+			if (events[i].events & REACTOR_WRITE) {
+				httpd_write_connection(httpd, connection);
+				if (!connection->connected) {
+					continue;
 				}
-				http_response_destroy(response);
-			} else {
-				logger_log(httpd->logger, LOGGER_DEBUG, "Request not complete, waiting for more data...");
+			}
+			if (events[i].events & (REACTOR_READ | REACTOR_ERROR)) {
+				logger_log(httpd->logger, LOGGER_DEBUG, "Receiving on socket %d", connection->socket_fd);
+				httpd_read_connection(httpd, connection);
 			}
 		}
 	}
@@ -355,11 +590,13 @@ httpd_thread(void *arg)
 
 	/* Close server sockets since they are not used any more */
 	if (httpd->server_fd4 != -1) {
+		reactor_remove(httpd->reactor, httpd->server_fd4);
 		shutdown(httpd->server_fd4, SHUT_RDWR);
 		closesocket(httpd->server_fd4);
 		httpd->server_fd4 = -1;
 	}
 	if (httpd->server_fd6 != -1) {
+		reactor_remove(httpd->reactor, httpd->server_fd6);
 		shutdown(httpd->server_fd6, SHUT_RDWR);
 		closesocket(httpd->server_fd6);
 		httpd->server_fd6 = -1;
@@ -391,6 +628,8 @@ httpd_start(httpd_t *httpd, unsigned short *port)
 		MUTEX_UNLOCK(httpd->run_mutex);
 		return -1;
 	}
+	/* RTSP replies are small and latency bound, accepted sockets inherit this */
+	netutils_set_socket_profile(httpd->server_fd4, &httpd_socket_profile, NULL, httpd->logger, "RTSP");
 	httpd->server_fd6 = -1;/*= netutils_init_socket(port, 1, 0);
 	if (httpd->server_fd6 == -1) {
 		logger_log(httpd->logger, LOGGER_WARNING, "Error initialising IPv6 socket %d", SOCKET_GET_ERROR());
@@ -411,6 +650,23 @@ httpd_start(httpd_t *httpd, unsigned short *port)
 		MUTEX_UNLOCK(httpd->run_mutex);
 		return -2;
 	}
+	if (netutils_set_nonblocking(httpd->server_fd4) == -1 ||
+	    reactor_add(httpd->reactor, httpd->server_fd4, REACTOR_READ, NULL) == -1) {
+		logger_log(httpd->logger, LOGGER_ERR, "Error registering IPv4 socket");
+		closesocket(httpd->server_fd4);
+		httpd->server_fd4 = -1;
+		MUTEX_UNLOCK(httpd->run_mutex);
+		return -2;
+	}
+	if (httpd->server_fd6 != -1 &&
+	    (netutils_set_nonblocking(httpd->server_fd6) == -1 ||
+	     reactor_add(httpd->reactor, httpd->server_fd6, REACTOR_READ, NULL) == -1)) {
+		logger_log(httpd->logger, LOGGER_WARNING, "Error registering IPv6 socket, continuing without IPv6 support");
+		closesocket(httpd->server_fd6);
+		httpd->server_fd6 = -1;
+	}
+	httpd->accept_paused = 0;
+	httpd->accept_retry = 0;
 	logger_log(httpd->logger, LOGGER_INFO, "Initialized server socket(s)");
 
 	/* Set values correctly and create new thread */
@@ -422,6 +678,24 @@ httpd_start(httpd_t *httpd, unsigned short *port)
 	return 1;
 }
 
+void
+httpd_set_connection_limit(httpd_t *httpd, int limit)
+{
+	assert(httpd);
+
+	if (limit < 1) {
+		limit = 1;
+	} else if (limit > httpd->max_connections) {
+		limit = httpd->max_connections;
+	}
+	MUTEX_LOCK(httpd->run_mutex);
+	httpd->pending_limit = limit;
+	MUTEX_UNLOCK(httpd->run_mutex);
+
+	/* A raised limit resumes accepting without waiting for traffic */
+	reactor_wakeup(httpd->reactor);
+}
+
 int
 httpd_is_running(httpd_t *httpd)
 {
@@ -448,19 +722,11 @@ httpd_stop(httpd_t *httpd)
 	}
 	logger_log(httpd->logger, LOGGER_INFO, "Stopping server socket..., %d", httpd->thread);
 	httpd->running = 0;
-
-	if (httpd->server_fd4 != -1) {
-		shutdown(httpd->server_fd4, SHUT_RDWR);
-		closesocket(httpd->server_fd4);
-		httpd->server_fd4 = -1;
-	}
-	if (httpd->server_fd6 != -1) {
-		shutdown(httpd->server_fd6, SHUT_RDWR);
-		closesocket(httpd->server_fd6);
-		httpd->server_fd6 = -1;
-	}
 	MUTEX_UNLOCK(httpd->run_mutex);
 
+	/* The thread closes the server sockets once it leaves the wait */
+	reactor_wakeup(httpd->reactor);
+
 	THREAD_JOIN(httpd->thread);
 
 	logger_log(httpd->logger, LOGGER_INFO, "Stopping server socket[joined]...");
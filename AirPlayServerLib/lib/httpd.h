@@ -32,6 +32,10 @@ typedef struct httpd_callbacks_s httpd_callbacks_t;
 
 httpd_t *httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections);
 
+/* Accepts at most limit connections, up to the max_connections given to
+ * httpd_init(). Connections already open are kept when it drops. */
+void httpd_set_connection_limit(httpd_t *httpd, int limit);
+
 int httpd_is_running(httpd_t *httpd);
 
 int httpd_start(httpd_t *httpd, unsigned short *port);
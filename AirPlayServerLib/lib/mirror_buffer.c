@@ -10,7 +10,7 @@
 #include "raop_rtp.h"
 #include <stdint.h>
 #include "crypto/crypto.h"
-#include "aes.h"
+#include "aes_engine.h"
 #include "compat.h"
 #include "ed25519/sha512.h"
 #include <math.h>
@@ -20,7 +20,7 @@
 //#define DUMP_KEI_IV
 struct mirror_buffer_s {
     logger_t *logger;
-    struct AES_ctx aes_ctx;
+    aes_engine_t aes_engine;
     int nextDecryptCount;
     uint8_t og[16];
     /* AES key and IV */
@@ -69,7 +69,9 @@ mirror_buffer_init_aes(mirror_buffer_t *mirror_buffer, uint64_t streamConnection
     fclose(keyfile);
 #endif
     // needs to be initialized externally
-    AES_init_ctx_iv(&mirror_buffer->aes_ctx, decrypt_aeskey, decrypt_aesiv);
+    aes_engine_backend_t backend = aes_engine_init_ctr(&mirror_buffer->aes_engine, AES_ENGINE_AUTO,
+                                                       decrypt_aeskey, decrypt_aesiv);
+    logger_log(mirror_buffer->logger, LOGGER_DEBUG, "Mirror AES-CTR backend: %s", aes_engine_name(backend));
     mirror_buffer->nextDecryptCount = 0;
 }
 
@@ -102,10 +104,9 @@ void mirror_buffer_decrypt(mirror_buffer_t *mirror_buffer, unsigned char* input,
     }
     // process encrypted bytes
     int encryptlen = ((inputLen - mirror_buffer->nextDecryptCount) / 16) * 16;
-    // aes decrypt
-    AES_CTR_xcrypt_buffer(&mirror_buffer->aes_ctx, input + mirror_buffer->nextDecryptCount, encryptlen);
-    // copy to output
-    memcpy(output + mirror_buffer->nextDecryptCount, input + mirror_buffer->nextDecryptCount, encryptlen);
+    // aes decrypt straight into output
+    aes_engine_ctr_xcrypt(&mirror_buffer->aes_engine, input + mirror_buffer->nextDecryptCount,
+                          output + mirror_buffer->nextDecryptCount, encryptlen);
     int outputlength = mirror_buffer->nextDecryptCount + encryptlen;
     // process remaining length
     int restlen = (inputLen - mirror_buffer->nextDecryptCount) % 16;
@@ -114,7 +115,7 @@ void mirror_buffer_decrypt(mirror_buffer_t *mirror_buffer, unsigned char* input,
     if (restlen > 0) {
         memset(mirror_buffer->og, 0, 16);
         memcpy(mirror_buffer->og, input + reststart, restlen);
-        AES_CTR_xcrypt_buffer(&mirror_buffer->aes_ctx, mirror_buffer->og, 16);
+        aes_engine_ctr_xcrypt(&mirror_buffer->aes_engine, mirror_buffer->og, mirror_buffer->og, 16);
         for (int j = 0; j < restlen; j++) {
             output[reststart + j] = mirror_buffer->og[j];
         }
@@ -15,6 +15,7 @@ mirror_buffer_t *mirror_buffer_init( logger_t *logger,
         const unsigned char *aeskey,
         const unsigned char *ecdh_secret);
 void mirror_buffer_init_aes(mirror_buffer_t *mirror_buffer, uint64_t streamConnectionID);
+/* input and output may point to the same buffer to decrypt in place */
 void mirror_buffer_decrypt(mirror_buffer_t *raop_mirror, unsigned char* input, unsigned char* output, int datalen);
 void mirror_buffer_destroy(mirror_buffer_t *mirror_buffer);
 #endif //MIRROR_BUFFER_H
@@ -0,0 +1,194 @@
+//
+// Pooled, reference counted buffers for mirror video payloads.
+//
+// The mirror thread receives and decrypts each frame in one of these buffers
+// and hands it to video_process. A consumer that needs the bytes after the
+// callback returns (a decoder queue, an AVPacket) takes a reference instead
+// of copying. The last release puts the buffer back on the pool free list,
+// so steady-state streaming does not allocate per frame.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mirror_payload.h"
+#include "raop.h"
+#include "threads.h"
+#include "memalign.h"
+
+/* Free buffers kept for reuse; anything beyond this is released to the heap */
+#define MIRROR_PAYLOAD_POOL_MAX_FREE 8
+/* Capacity is rounded up so slowly growing frames still hit the free list */
+#define MIRROR_PAYLOAD_GRANULARITY (64 * 1024)
+#define MIRROR_PAYLOAD_ALIGNMENT 64
+
+struct mirror_payload_s {
+    mirror_payload_pool_t *pool;
+    mirror_payload_t *next;
+    atomic_counter_t refs;
+    int capacity;
+    unsigned char *data;
+};
+
+struct mirror_payload_pool_s {
+    logger_t *logger;
+    mutex_handle_t mutex;
+    /* One reference for the owner plus one for every payload handed out, so
+     * the pool outlives frames still held by the decoder after destroy. */
+    atomic_counter_t refs;
+    mirror_payload_t *free_list;
+    int free_count;
+    int allocated;
+};
+
+static void
+mirror_payload_free(mirror_payload_t *payload)
+{
+    ALIGNED_FREE(payload->data);
+    free(payload);
+}
+
+static void
+mirror_payload_pool_unref(mirror_payload_pool_t *pool)
+{
+    if (ATOMIC_DEC(pool->refs) != 0) {
+        return;
+    }
+    while (pool->free_list) {
+        mirror_payload_t *payload = pool->free_list;
+        pool->free_list = payload->next;
+        mirror_payload_free(payload);
+    }
+    MUTEX_DESTROY(pool->mutex);
+    free(pool);
+}
+
+mirror_payload_pool_t *
+mirror_payload_pool_init(logger_t *logger)
+{
+    mirror_payload_pool_t *pool;
+
+    pool = calloc(1, sizeof(mirror_payload_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->logger = logger;
+    pool->refs = 1;
+    MUTEX_CREATE(pool->mutex);
+    return pool;
+}
+
+void
+mirror_payload_pool_destroy(mirror_payload_pool_t *pool)
+{
+    if (pool) {
+        logger_log(pool->logger, LOGGER_DEBUG, "Mirror payload pool allocated %d buffers", pool->allocated);
+        mirror_payload_pool_unref(pool);
+    }
+}
+
+mirror_payload_t *
+mirror_payload_pool_get(mirror_payload_pool_t *pool, int size)
+{
+    mirror_payload_t *payload = NULL;
+    mirror_payload_t *evict = NULL;
+    mirror_payload_t **link;
+
+    assert(pool);
+    assert(size >= 0);
+
+    MUTEX_LOCK(pool->mutex);
+    for (link = &pool->free_list; *link; link = &(*link)->next) {
+        if ((*link)->capacity >= size) {
+            payload = *link;
+            *link = payload->next;
+            pool->free_count--;
+            break;
+        }
+    }
+    if (!payload && pool->free_list) {
+        /* Nothing large enough; drop one small buffer so the pool tracks
+         * the stream's frame size instead of growing without bound. */
+        evict = pool->free_list;
+        pool->free_list = evict->next;
+        pool->free_count--;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+
+    if (evict) {
+        mirror_payload_free(evict);
+    }
+    if (!payload) {
+        int capacity = (size + MIRROR_PAYLOAD_GRANULARITY - 1) / MIRROR_PAYLOAD_GRANULARITY * MIRROR_PAYLOAD_GRANULARITY;
+        if (capacity == 0) {
+            capacity = MIRROR_PAYLOAD_GRANULARITY;
+        }
+        payload = calloc(1, sizeof(mirror_payload_t));
+        if (!payload) {
+            return NULL;
+        }
+        ALIGNED_MALLOC(payload->data, MIRROR_PAYLOAD_ALIGNMENT, capacity + MIRROR_PAYLOAD_PADDING);
+        if (!payload->data) {
+            free(payload);
+            return NULL;
+        }
+        payload->pool = pool;
+        payload->capacity = capacity;
+        pool->allocated++;
+    }
+    payload->next = NULL;
+    payload->refs = 1;
+    memset(payload->data + size, 0, MIRROR_PAYLOAD_PADDING);
+    ATOMIC_INC(pool->refs);
+    return payload;
+}
+
+unsigned char *
+mirror_payload_data(mirror_payload_t *payload)
+{
+    assert(payload);
+    return payload->data;
+}
+
+void
+mirror_payload_retain(mirror_payload_t *payload)
+{
+    assert(payload);
+    ATOMIC_INC(payload->refs);
+}
+
+void
+mirror_payload_release(mirror_payload_t *payload)
+{
+    mirror_payload_pool_t *pool;
+
+    if (!payload || ATOMIC_DEC(payload->refs) != 0) {
+        return;
+    }
+    pool = payload->pool;
+    MUTEX_LOCK(pool->mutex);
+    if (pool->free_count < MIRROR_PAYLOAD_POOL_MAX_FREE) {
+        payload->next = pool->free_list;
+        pool->free_list = payload;
+        pool->free_count++;
+        payload = NULL;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    if (payload) {
+        mirror_payload_free(payload);
+    }
+    mirror_payload_pool_unref(pool);
+}
+
+void
+raop_payload_retain(void *buffer)
+{
+    mirror_payload_retain(buffer);
+}
+
+void
+raop_payload_release(void *buffer)
+{
+    mirror_payload_release(buffer);
+}
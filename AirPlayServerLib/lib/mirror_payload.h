@@ -0,0 +1,28 @@
+//
+// Pooled, reference counted buffers for mirror video payloads.
+//
+
+#ifndef MIRROR_PAYLOAD_H
+#define MIRROR_PAYLOAD_H
+
+#include "logger.h"
+#include "stream.h"
+
+/* Zeroed bytes kept after every payload so a decoder that reads ahead of the
+ * end of the bitstream can consume the buffer in place. */
+#define MIRROR_PAYLOAD_PADDING H264_DATA_PADDING_SIZE
+
+typedef struct mirror_payload_pool_s mirror_payload_pool_t;
+typedef struct mirror_payload_s mirror_payload_t;
+
+mirror_payload_pool_t *mirror_payload_pool_init(logger_t *logger);
+void mirror_payload_pool_destroy(mirror_payload_pool_t *pool);
+
+/* Returns a payload holding one reference with room for size bytes */
+mirror_payload_t *mirror_payload_pool_get(mirror_payload_pool_t *pool, int size);
+unsigned char *mirror_payload_data(mirror_payload_t *payload);
+
+void mirror_payload_retain(mirror_payload_t *payload);
+void mirror_payload_release(mirror_payload_t *payload);
+
+#endif //MIRROR_PAYLOAD_H
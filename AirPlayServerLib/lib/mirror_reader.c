@@ -0,0 +1,145 @@
+//
+// Buffered reader for the mirror TCP stream.
+//
+// Headers and small payloads are parsed out of one large buffer, so a burst
+// of frames costs one recv() per buffer fill instead of one per field. The
+// buffer is only refilled once it is empty, which keeps every read a single
+// contiguous copy without wrapping.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mirror_reader.h"
+#include "compat.h"
+
+struct mirror_reader_s {
+	unsigned char *buffer;
+	int size;
+	int start;
+	int end;
+	int fd;
+	unsigned int recv_count;
+};
+
+mirror_reader_t *
+mirror_reader_init(int size)
+{
+	mirror_reader_t *reader;
+
+	assert(size > 0);
+
+	reader = calloc(1, sizeof(mirror_reader_t));
+	if (!reader) {
+		return NULL;
+	}
+	reader->buffer = malloc(size);
+	if (!reader->buffer) {
+		free(reader);
+		return NULL;
+	}
+	reader->size = size;
+	reader->fd = -1;
+	return reader;
+}
+
+void
+mirror_reader_destroy(mirror_reader_t *reader)
+{
+	if (reader) {
+		free(reader->buffer);
+		free(reader);
+	}
+}
+
+void
+mirror_reader_reset(mirror_reader_t *reader, int fd)
+{
+	assert(reader);
+	reader->fd = fd;
+	reader->start = 0;
+	reader->end = 0;
+	reader->recv_count = 0;
+}
+
+unsigned int
+mirror_reader_get_recv_count(mirror_reader_t *reader)
+{
+	assert(reader);
+	return reader->recv_count;
+}
+
+/* Returns the bytes read, 0 when the socket would block or an error */
+static int
+mirror_reader_recv(mirror_reader_t *reader, unsigned char *dst, int length)
+{
+	int ret, error;
+
+	reader->recv_count++;
+	ret = recv(reader->fd, (char *)dst, length, 0);
+	if (ret > 0) {
+		return ret;
+	} else if (ret == 0) {
+		return MIRROR_READER_CLOSED;
+	}
+	error = SOCKET_GET_ERROR();
+	if (error == SOCKET_ERRORNAME(EAGAIN) || error == SOCKET_ERRORNAME(EWOULDBLOCK)) {
+		return 0;
+	}
+	return MIRROR_READER_ERROR;
+}
+
+int
+mirror_reader_read(mirror_reader_t *reader, unsigned char *dst, int length,
+                   wakeup_t *wakeup, int timeout_ms)
+{
+	int offset = 0;
+	int ret;
+
+	assert(reader);
+	assert(reader->fd != -1);
+	assert(length >= 0);
+
+	while (1) {
+		int count = reader->end - reader->start;
+		if (count > length - offset) {
+			count = length - offset;
+		}
+		memcpy(dst + offset, reader->buffer + reader->start, count);
+		reader->start += count;
+		offset += count;
+		if (offset == length) {
+			return 0;
+		}
+
+		/* The buffer is empty, refill it or bypass it for a large rest */
+		reader->start = 0;
+		reader->end = 0;
+		if (length - offset >= reader->size) {
+			ret = mirror_reader_recv(reader, dst + offset, length - offset);
+			if (ret > 0) {
+				offset += ret;
+				continue;
+			}
+		} else {
+			ret = mirror_reader_recv(reader, reader->buffer, reader->size);
+			if (ret > 0) {
+				reader->end = ret;
+				continue;
+			}
+		}
+		if (ret < 0) {
+			return ret;
+		}
+
+		ret = wakeup_wait(wakeup, reader->fd, timeout_ms);
+		if (ret == WAKEUP_WAIT_TIMEOUT) {
+			return MIRROR_READER_TIMEOUT;
+		} else if (ret == WAKEUP_WAIT_SIGNALLED) {
+			return MIRROR_READER_STOPPED;
+		} else if (ret != WAKEUP_WAIT_READY) {
+			return MIRROR_READER_ERROR;
+		}
+	}
+}
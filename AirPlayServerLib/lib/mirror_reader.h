@@ -0,0 +1,38 @@
+//
+// Buffered reader for the mirror TCP stream.
+//
+
+#ifndef MIRROR_READER_H
+#define MIRROR_READER_H
+
+#include "wakeup.h"
+
+/* Chunk pulled from the socket per recv() */
+#define MIRROR_READER_SIZE (256 * 1024)
+
+#define MIRROR_READER_CLOSED  (-1)
+#define MIRROR_READER_TIMEOUT (-2)
+#define MIRROR_READER_STOPPED (-3)
+#define MIRROR_READER_ERROR   (-4)
+
+typedef struct mirror_reader_s mirror_reader_t;
+
+mirror_reader_t *mirror_reader_init(int size);
+void mirror_reader_destroy(mirror_reader_t *reader);
+
+/* Starts a new connection and drops anything buffered from the last one.
+ * fd must be non-blocking. */
+void mirror_reader_reset(mirror_reader_t *reader, int fd);
+
+/* Fills dst with exactly length bytes. Buffered bytes are used first; the
+ * socket is read in chunks of the buffer size, or straight into dst when
+ * the rest is larger than that. Only waits when the socket has nothing
+ * pending, for up to timeout_ms each time (-1 waits forever), and gives up
+ * when the wakeup is signalled. Returns 0 or a MIRROR_READER_ error. */
+int mirror_reader_read(mirror_reader_t *reader, unsigned char *dst, int length,
+                       wakeup_t *wakeup, int timeout_ms);
+
+/* recv() calls made since the last reset */
+unsigned int mirror_reader_get_recv_count(mirror_reader_t *reader);
+
+#endif
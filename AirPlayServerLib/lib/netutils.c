@@ -17,6 +17,13 @@
 #include <assert.h>
 
 #include "compat.h"
+#include "netutils.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <netinet/ip.h>
+#endif
 
 int
 netutils_init()
@@ -164,6 +171,123 @@ netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp)
 	return -1;
 }
 
+int
+netutils_set_nonblocking(int fd)
+{
+#ifdef WIN32
+	u_long nonblocking = 1;
+	return ioctlsocket(fd, FIONBIO, &nonblocking);
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1) {
+		return -1;
+	}
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static int
+netutils_setsockopt_int(int fd, int level, int name, int value)
+{
+	return setsockopt(fd, level, name, (const char *)&value, sizeof(value));
+}
+
+static int
+netutils_getsockopt_int(int fd, int level, int name)
+{
+	int value = 0;
+	socklen_t len = sizeof(value);
+
+	if (getsockopt(fd, level, name, (char *)&value, &len) == -1) {
+		return -1;
+	}
+	return value;
+}
+
+int
+netutils_set_socket_profile(int fd, const netutils_socket_profile_t *profile,
+                            netutils_socket_profile_t *effective,
+                            logger_t *logger, const char *name)
+{
+	netutils_socket_profile_t actual;
+	int ret = 0;
+
+	assert(profile);
+
+	if (profile->rcvbuf > 0) {
+		if (netutils_setsockopt_int(fd, SOL_SOCKET, SO_RCVBUF, profile->rcvbuf) == -1) {
+			ret = -1;
+		}
+#ifdef SO_RCVBUFFORCE
+		/* Past net.core.rmem_max only with CAP_NET_ADMIN, harmless without */
+		if (netutils_getsockopt_int(fd, SOL_SOCKET, SO_RCVBUF) < profile->rcvbuf) {
+			netutils_setsockopt_int(fd, SOL_SOCKET, SO_RCVBUFFORCE, profile->rcvbuf);
+		}
+#endif
+	}
+#ifdef SO_BUSY_POLL
+	if (profile->busy_poll_us > 0 &&
+	    netutils_setsockopt_int(fd, SOL_SOCKET, SO_BUSY_POLL, profile->busy_poll_us) == -1) {
+		ret = -1;
+	}
+#endif
+	if (profile->nodelay &&
+	    netutils_setsockopt_int(fd, IPPROTO_TCP, TCP_NODELAY, 1) == -1) {
+		ret = -1;
+	}
+#ifdef TCP_QUICKACK
+	if (profile->quickack &&
+	    netutils_setsockopt_int(fd, IPPROTO_TCP, TCP_QUICKACK, 1) == -1) {
+		ret = -1;
+	}
+#endif
+	/* Windows accepts IP_TOS but only marks packets where QoS policy allows */
+	if (profile->dscp > 0 &&
+	    netutils_setsockopt_int(fd, IPPROTO_IP, IP_TOS, profile->dscp << 2) == -1) {
+		ret = -1;
+	}
+#ifdef SO_RXQ_OVFL
+	if (profile->rxq_ovfl &&
+	    netutils_setsockopt_int(fd, SOL_SOCKET, SO_RXQ_OVFL, 1) == -1) {
+		ret = -1;
+	}
+#endif
+
+	/* Read back what the kernel actually granted */
+	actual.rcvbuf = netutils_getsockopt_int(fd, SOL_SOCKET, SO_RCVBUF);
+#ifdef SO_BUSY_POLL
+	actual.busy_poll_us = netutils_getsockopt_int(fd, SOL_SOCKET, SO_BUSY_POLL);
+#else
+	actual.busy_poll_us = -1;
+#endif
+	actual.nodelay = profile->nodelay ? netutils_getsockopt_int(fd, IPPROTO_TCP, TCP_NODELAY) : 0;
+#ifdef TCP_QUICKACK
+	actual.quickack = profile->quickack ? netutils_getsockopt_int(fd, IPPROTO_TCP, TCP_QUICKACK) : 0;
+#else
+	actual.quickack = -1;
+#endif
+	actual.dscp = netutils_getsockopt_int(fd, IPPROTO_IP, IP_TOS);
+	if (actual.dscp > 0) {
+		actual.dscp >>= 2;
+	}
+#ifdef SO_RXQ_OVFL
+	actual.rxq_ovfl = netutils_getsockopt_int(fd, SOL_SOCKET, SO_RXQ_OVFL);
+#else
+	actual.rxq_ovfl = -1;
+#endif
+
+	if (logger) {
+		logger_log(logger, LOGGER_INFO,
+		           "Socket %s: rcvbuf %d (asked %d), busy_poll %d, nodelay %d, quickack %d, dscp %d, rxq_ovfl %d",
+		           name ? name : "", actual.rcvbuf, profile->rcvbuf, actual.busy_poll_us,
+		           actual.nodelay, actual.quickack, actual.dscp, actual.rxq_ovfl);
+	}
+	if (effective) {
+		*effective = actual;
+	}
+	return ret;
+}
+
 // src是ip地址
 int
 netutils_parse_address(int family, const char *src, void *dst, int dstlen)
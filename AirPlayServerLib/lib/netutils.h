@@ -15,11 +15,33 @@
 #ifndef NETUTILS_H
 #define NETUTILS_H
 
+#include "logger.h"
+
+/* Socket options a caller can ask for. Zero leaves the OS default, and
+ * options the platform lacks are skipped. */
+typedef struct {
+	int rcvbuf;         /* SO_RCVBUF in bytes */
+	int busy_poll_us;   /* SO_BUSY_POLL, Linux only; spins the receiving CPU */
+	int nodelay;        /* TCP_NODELAY */
+	int quickack;       /* TCP_QUICKACK, Linux only; not sticky, set again per connection */
+	int dscp;           /* DiffServ code point written to IP_TOS, e.g. 46 for EF */
+	int rxq_ovfl;       /* SO_RXQ_OVFL, Linux only; datagrams carry the drop count */
+} netutils_socket_profile_t;
+
 int netutils_init();
 void netutils_cleanup();
 
 int netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp);
 unsigned char *netutils_get_address(void *sockaddr, int *length);
 int netutils_parse_address(int family, const char *src, void *dst, int dstlen);
+int netutils_set_nonblocking(int fd);
+
+/* Applies the profile and logs the values the socket ended up with, which
+ * the OS may have capped. effective may be NULL; options that cannot be
+ * read back are -1 there. Returns -1 if an option could not be set, the
+ * socket stays usable either way. */
+int netutils_set_socket_profile(int fd, const netutils_socket_profile_t *profile,
+                                netutils_socket_profile_t *effective,
+                                logger_t *logger, const char *name);
 
 #endif
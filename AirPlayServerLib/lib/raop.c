@@ -58,6 +58,8 @@ struct raop_s {
 	int paired_client_key_count;
 	unsigned int display_width;
 	unsigned int display_height;
+	/* Audio buffering for sessions set up from now on */
+	raop_audio_config_t audio_config;
 
     unsigned short port;
 };
@@ -785,6 +787,7 @@ raop_init(int max_clients, raop_callbacks_t *callbacks)
 	raop->httpd = httpd;
 	raop->display_width = GLOBAL_DISPLAY_WIDTH;
 	raop->display_height = GLOBAL_DISPLAY_HEIGHT;
+	raop->audio_config.buffer_length = RAOP_BUFFER_DEFAULT_LENGTH;
 	return raop;
 }
 
@@ -865,6 +868,13 @@ raop_set_password(raop_t *raop, const char *password)
 	}
 }
 
+void
+raop_set_max_clients(raop_t *raop, int max_clients)
+{
+	assert(raop);
+	httpd_set_connection_limit(raop->httpd, max_clients);
+}
+
 void
 raop_set_display_size(raop_t *raop, unsigned int width, unsigned int height)
 {
@@ -873,6 +883,36 @@ raop_set_display_size(raop_t *raop, unsigned int width, unsigned int height)
 	raop->display_height = height > 0 ? height : GLOBAL_DISPLAY_HEIGHT;
 }
 
+void
+raop_set_audio_latency(raop_t *raop, unsigned int latency_ms)
+{
+	assert(raop);
+	raop->audio_config.latency_ms = latency_ms;
+}
+
+void
+raop_set_audio_buffer(raop_t *raop, unsigned int length, unsigned int preroll)
+{
+	assert(raop);
+	raop->audio_config.buffer_length = length > 0 ? length : RAOP_BUFFER_DEFAULT_LENGTH;
+	raop->audio_config.preroll = preroll;
+}
+
+void
+raop_set_audio_decode_thread(raop_t *raop, int enabled)
+{
+	assert(raop);
+	raop->audio_config.decode_thread = enabled ? 1 : 0;
+}
+
+void
+raop_set_audio_sample_format(raop_t *raop, int sample_format)
+{
+	assert(raop);
+	raop->audio_config.sample_format = (sample_format == PCM_SAMPLE_FORMAT_F32) ?
+		PCM_SAMPLE_FORMAT_F32 : PCM_SAMPLE_FORMAT_S16;
+}
+
 void raop_log(raop_t* raop, int level, const char* fmt, ...)
 {
 	static char buffer[4096];
@@ -21,16 +21,61 @@
 typedef struct raop_buffer_s raop_buffer_t;
 
 typedef int (*raop_resend_cb_t)(void *opaque, unsigned short seqno, unsigned short count);
+typedef uint64_t (*raop_buffer_clock_t)(void *opaque);
 
-raop_buffer_t *raop_buffer_init(logger_t *logger,
+/* Format of the PCM raop_buffer_decode returns, taken from the decoder's
+ * stream info after every frame */
+typedef struct {
+	uint32_t sample_rate;
+	uint16_t channels;
+	uint16_t bits_per_sample;
+	uint16_t sample_format;    /* PCM_SAMPLE_FORMAT_*, see stream.h */
+	uint32_t frames;           /* Samples per channel in the frame, fewer
+	                            * while the decoder's priming is cut */
+} raop_buffer_format_t;
+
+/* Packet loss counters since the buffer was created */
+typedef struct {
+	uint64_t lost;             /* Packets played without having arrived */
+	uint64_t recovered;        /* Packets that arrived after a resend request */
+	uint64_t concealed;        /* Lost packets the decoder filled in; the rest played as silence */
+	uint64_t late;             /* Packets that arrived after their turn */
+	uint64_t resend_requests;  /* Requests sent, each for one or more packets */
+} raop_buffer_stats_t;
+
+/* A zero latency_ms plays packets as they arrive and never asks for resends */
+raop_buffer_t *raop_buffer_init(logger_t *logger, const raop_audio_config_t *config,
                                 const unsigned char *aeskey,
                                 const unsigned char *aesiv,
 								const unsigned char *ecdh_secret);
 
+/* Configures the decoder for an AirPlay audioFormat bit from the stream
+ * SETUP. Formats it does not know keep the current one. Call under the lock
+ * shared with take; the decoding thread switches decoders at the next frame
+ * it decodes, so this is safe while audio is playing. */
+void raop_buffer_set_audio_format(raop_buffer_t *raop_buffer, uint64_t audio_format);
 int raop_buffer_queue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned short datalen, raop_callbacks_t *callbacks);
-const void *raop_buffer_dequeue(raop_buffer_t *raop_buffer, int *length, unsigned int* pts, int no_resend, 
-    uint32_t* sample_rate, uint16_t* channels, uint16_t* bits_per_sample);
+const void *raop_buffer_dequeue(raop_buffer_t *raop_buffer, int *length, unsigned int* pts, int no_resend,
+    raop_buffer_format_t *format);
+/* raop_buffer_dequeue in two steps. take moves the next playable entry out
+ * of the buffer and may share a lock with queue, flush and handle_resends;
+ * decode decrypts and decodes it outside that lock. One thread at a time
+ * takes and decodes; the concealed counter is its own. decode returns NULL
+ * for a frame with nothing to play, and pts is the sender timestamp of the
+ * first sample returned, with the decoder's delay taken off. */
+int raop_buffer_take(raop_buffer_t *raop_buffer, int no_resend);
+/* After take returns 0: whether packets are held back behind a missing one,
+ * so take must be tried again when its wait runs out even if nothing more
+ * arrives. Otherwise only a new packet can make anything playable. */
+int raop_buffer_is_waiting(raop_buffer_t *raop_buffer);
+const void *raop_buffer_decode(raop_buffer_t *raop_buffer, int *length, unsigned int* pts,
+    raop_buffer_format_t *format);
 void raop_buffer_handle_resends(raop_buffer_t *raop_buffer, raop_resend_cb_t resend_cb, void *opaque);
+/* Replaces now_us() as the clock of the resend and give-up deadlines, in
+ * microseconds, so a packet trace can be replayed faster than real time.
+ * NULL goes back to now_us(). */
+void raop_buffer_set_clock(raop_buffer_t *raop_buffer, raop_buffer_clock_t clock, void *opaque);
+void raop_buffer_get_stats(raop_buffer_t *raop_buffer, raop_buffer_stats_t *stats);
 void raop_buffer_flush(raop_buffer_t *raop_buffer, int next_seq);
 void raop_buffer_destroy(raop_buffer_t *raop_buffer);
 
@@ -27,6 +27,9 @@
 #include "byteutils.h"
 #include "mirror_buffer.h"
 #include "stream.h"
+#include "udp_batch.h"
+#include "wakeup.h"
+#include "clock_sync.h"
 
 #ifdef WIN32
 #include <WinSock2.h>
@@ -37,6 +40,38 @@
 
 #define NO_FLUSH (-42)
 
+/* Datagrams read per receive call, no more than the smallest reorder
+ * buffer so that a whole batch fits before it is dequeued */
+#define RAOP_BATCH_COUNT 32
+/* Audio and resend datagrams stay within one Ethernet MTU */
+#define RAOP_BATCH_PACKET_LEN 2048
+#define RAOP_STATS_INTERVAL_US 1000000
+
+/* Audio data and resends arrive in bursts after a network stall, give the
+ * kernel room for a few seconds of them. Busy polling is left off, it only
+ * helps blocking reads and costs a spinning core. */
+static const netutils_socket_profile_t raop_rtp_audio_profile = {
+    .rcvbuf = 1024 * 1024,
+    .dscp = 46,
+    .rxq_ovfl = 1,
+};
+/* Timing replies are tiny, only mark them as expedited */
+static const netutils_socket_profile_t raop_rtp_timing_profile = {
+    .dscp = 46,
+};
+/* Gap between timing requests, and how long a reply is waited for */
+#define RAOP_TIME_INTERVAL_MS 1000
+/* How often the decode thread looks for a missing packet past its deadline
+ * when no packet arrives to wake it; a fraction of a 480-frame packet */
+#define RAOP_DECODE_POLL_MS 5
+
+/* A sync packet: the frame stamped rtp is due at ntp_ns on the sender clock */
+typedef struct {
+    int valid;
+    uint32_t rtp;
+    uint64_t ntp_ns;
+} raop_rtp_sync_t;
+
 struct h264codec_s {
     unsigned char compatibility;
     short lengthofPPS;
@@ -87,11 +122,33 @@ struct raop_rtp_s {
     int flush;
     thread_handle_t thread;
     thread_handle_t thread_time;
+    thread_handle_t thread_decode;
     mutex_handle_t run_mutex;
-    mutex_handle_t time_mutex;
-    cond_handle_t time_cond;
     /* MUTEX LOCKED VARIABLES END */
 
+    /* Wakes the UDP thread for new events and at stop, the timing thread
+     * only at stop. The threads otherwise block on their sockets. The
+     * decode thread is woken for every batch of queued packets. */
+    wakeup_t *wakeup;
+    wakeup_t *time_wakeup;
+    wakeup_t *decode_wakeup;
+
+    /* With a decode thread the UDP thread only stores packets and asks for
+     * resends. buffer_mutex guards the buffer and the sync packet between
+     * the two; decoding happens outside it. */
+    int decode_thread;
+    mutex_handle_t buffer_mutex;
+
+    /* Sender clock, fed by the timing thread and read by the one playing */
+    clock_sync_t *clock;
+    /* Last sync packet, written by the UDP thread under buffer_mutex */
+    raop_rtp_sync_t sync;
+
+    /* How long a missing packet is waited for, and whether resends are
+     * asked for at all; the sender has to have told us its control port */
+    unsigned int latency_ms;
+    int no_resend;
+
     /* Remote control and timing ports */
     unsigned short control_rport;
     unsigned short timing_rport;
@@ -108,6 +165,19 @@ struct raop_rtp_s {
     struct sockaddr_storage control_saddr;
     socklen_t control_saddr_len;
     unsigned short control_seqnum;
+
+    /* Packet arena for the control and data sockets, used by the UDP thread */
+    udp_batch_t *batch;
+
+    /* Receive counters, only touched by the UDP thread */
+    audio_recv_stats_struct recv_stats;
+    uint64_t stats_time;
+    uint64_t stats_wakeups;
+    uint64_t stats_syscalls;
+    uint64_t stats_packets;
+    /* Latest SO_RXQ_OVFL counters, cumulative per socket */
+    long long control_drops;
+    long long data_drops;
 };
 
 static int
@@ -140,12 +210,14 @@ raop_rtp_parse_remote(raop_rtp_t *raop_rtp, const unsigned char *remote, int rem
 raop_rtp_t *
 raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, const unsigned char *remote, int remotelen,
         	  const char* remoteName, const char* remoteDeviceId,
-              const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret, unsigned short timing_rport)
+              const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret, unsigned short timing_rport,
+              const raop_audio_config_t *audio_config)
 {
     raop_rtp_t *raop_rtp;
 
     assert(logger);
     assert(callbacks);
+    assert(audio_config);
 
     raop_rtp = calloc(1, sizeof(raop_rtp_t));
     if (!raop_rtp) {
@@ -153,14 +225,24 @@ raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, const unsigned char
     }
     raop_rtp->logger = logger;
     raop_rtp->timing_rport = timing_rport;
+    raop_rtp->latency_ms = audio_config->latency_ms;
+    raop_rtp->decode_thread = audio_config->decode_thread;
 
     memcpy(&raop_rtp->callbacks, callbacks, sizeof(raop_callbacks_t));
-    raop_rtp->buffer = raop_buffer_init(logger, aeskey, aesiv, ecdh_secret);
+    raop_rtp->buffer = raop_buffer_init(logger, audio_config, aeskey, aesiv, ecdh_secret);
     if (!raop_rtp->buffer) {
         free(raop_rtp);
         return NULL;
     }
+    raop_rtp->batch = udp_batch_init(RAOP_BATCH_COUNT, RAOP_BATCH_PACKET_LEN);
+    if (!raop_rtp->batch) {
+        raop_buffer_destroy(raop_rtp->buffer);
+        free(raop_rtp);
+        return NULL;
+    }
     if (raop_rtp_parse_remote(raop_rtp, remote, remotelen) < 0) {
+		udp_batch_destroy(raop_rtp->batch);
+		raop_buffer_destroy(raop_rtp->buffer);
 		free(raop_rtp);
 		return NULL;
 	}
@@ -177,9 +259,23 @@ raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, const unsigned char
     raop_rtp->joined = 1;
     raop_rtp->flush = NO_FLUSH;
 
+    raop_rtp->wakeup = wakeup_init();
+    raop_rtp->time_wakeup = wakeup_init();
+    raop_rtp->decode_wakeup = wakeup_init();
+    raop_rtp->clock = clock_sync_init(logger, "audio");
+    if (!raop_rtp->wakeup || !raop_rtp->time_wakeup || !raop_rtp->decode_wakeup || !raop_rtp->clock) {
+        clock_sync_destroy(raop_rtp->clock);
+        wakeup_destroy(raop_rtp->wakeup);
+        wakeup_destroy(raop_rtp->time_wakeup);
+        wakeup_destroy(raop_rtp->decode_wakeup);
+        udp_batch_destroy(raop_rtp->batch);
+        raop_buffer_destroy(raop_rtp->buffer);
+        free(raop_rtp);
+        return NULL;
+    }
+
     MUTEX_CREATE(raop_rtp->run_mutex);
-    MUTEX_CREATE(raop_rtp->time_mutex);
-    COND_CREATE(raop_rtp->time_cond);
+    MUTEX_CREATE(raop_rtp->buffer_mutex);
     return raop_rtp;
 }
 
@@ -190,9 +286,13 @@ raop_rtp_destroy(raop_rtp_t *raop_rtp)
     if (raop_rtp) {
         raop_rtp_stop(raop_rtp);
         MUTEX_DESTROY(raop_rtp->run_mutex);
-        MUTEX_DESTROY(raop_rtp->time_mutex);
-        COND_DESTROY(raop_rtp->time_cond);
+        MUTEX_DESTROY(raop_rtp->buffer_mutex);
+        wakeup_destroy(raop_rtp->wakeup);
+        wakeup_destroy(raop_rtp->time_wakeup);
+        wakeup_destroy(raop_rtp->decode_wakeup);
+        clock_sync_destroy(raop_rtp->clock);
         raop_buffer_destroy(raop_rtp->buffer);
+        udp_batch_destroy(raop_rtp->batch);
         free(raop_rtp->metadata);
         free(raop_rtp->coverart);
         free(raop_rtp->dacp_id);
@@ -250,6 +350,13 @@ raop_rtp_init_sockets(raop_rtp_t *raop_rtp, int use_ipv6, int use_udp)
     if (csock == -1 || tsock == -1 || dsock == -1) {
         goto sockets_cleanup;
     }
+    netutils_set_socket_profile(csock, &raop_rtp_audio_profile, NULL, raop_rtp->logger, "audio control");
+    netutils_set_socket_profile(dsock, &raop_rtp_audio_profile, NULL, raop_rtp->logger, "audio data");
+    netutils_set_socket_profile(tsock, &raop_rtp_timing_profile, NULL, raop_rtp->logger, "audio timing");
+    /* The UDP thread reads until the socket would block */
+    if (netutils_set_nonblocking(csock) == -1 || netutils_set_nonblocking(dsock) == -1) {
+        goto sockets_cleanup;
+    }
 
     /* Set socket descriptors */
     raop_rtp->csock = csock;
@@ -339,7 +446,9 @@ raop_rtp_process_events(raop_rtp_t *raop_rtp, void *cb_data)
 
     /* Handle flush if requested */
     if (flush != NO_FLUSH) {
+        MUTEX_LOCK(raop_rtp->buffer_mutex);
         raop_buffer_flush(raop_rtp->buffer, flush);
+        MUTEX_UNLOCK(raop_rtp->buffer_mutex);
         if (raop_rtp->callbacks.audio_flush) {
             raop_rtp->callbacks.audio_flush(raop_rtp->callbacks.cls, cb_data, raop_rtp->remoteName, raop_rtp->remoteDeviceId);
         }
@@ -386,12 +495,14 @@ raop_rtp_thread_time(void *arg)
     struct sockaddr_storage saddr;
     socklen_t saddrlen;
     unsigned char packet[128];
-    unsigned int packetlen;
+    int packetlen;
     unsigned char time[32]={0x80,0xd2,0x00,0x07,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
             ,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
     };
-    uint64_t base = now_us();
-    uint64_t rec_pts = 0;
+    uint64_t t1, t4;
+    int ret;
+
+    clock_sync_reset(raop_rtp->clock);
     while (1) {
         MUTEX_LOCK(raop_rtp->run_mutex);
         if (!raop_rtp->running) {
@@ -399,150 +510,361 @@ raop_rtp_thread_time(void *arg)
             break;
         }
         MUTEX_UNLOCK(raop_rtp->run_mutex);
-        uint64_t send_time = now_us() - base + rec_pts;
-
-        byteutils_put_timeStamp(time, 24, send_time);
+        t1 = now_ns();
+        byteutils_put_ntp_ns(time, 24, t1);
         logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_time send time 32 bytes, port = %d", raop_rtp->timing_rport);
         struct sockaddr_in *addr = (struct sockaddr_in *)&raop_rtp->remote_saddr;
         addr->sin_port = htons(raop_rtp->timing_rport);
         int sendlen = sendto(raop_rtp->tsock, (char *)time, sizeof(time), 0, (struct sockaddr *) &raop_rtp->remote_saddr, raop_rtp->remote_saddr_len);
         logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_time sendlen = %d", sendlen);
 
+        /* Wait for the reply; a lost one is asked for again */
+        ret = wakeup_wait(raop_rtp->time_wakeup, raop_rtp->tsock, RAOP_TIME_INTERVAL_MS);
+        if (ret == WAKEUP_WAIT_TIMEOUT) {
+            continue;
+        } else if (ret != WAKEUP_WAIT_READY) {
+            break;
+        }
+
         saddrlen = sizeof(saddr);
         packetlen = recvfrom(raop_rtp->tsock, (char *)packet, sizeof(packet), 0,
                              (struct sockaddr *)&saddr, &saddrlen);
+        t4 = now_ns();
         int type_t = packet[1] & ~0x80;
         logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_time receive time type_t 0x%02x, packetlen = %d", type_t, packetlen);
-        if (type_t == 0x53) {
-
+        /* A late reply to an earlier request echoes an older origin */
+        if (packetlen >= 32 && type_t == 0x53 && memcmp(packet + 8, time + 24, 8) == 0) {
+            uint64_t receive_ns = byteutils_read_ntp_ns(packet, 16);
+            uint64_t transmit_ns = byteutils_read_ntp_ns(packet, 24);
+            clock_sync_add_exchange(raop_rtp->clock, t1, receive_ns, transmit_ns, t4);
         }
-        uint64_t Origin_Timestamp = byteutils_read_timeStamp(packet, 8);
-        uint64_t Receive_Timestamp = byteutils_read_timeStamp(packet, 16);
-        uint64_t Transmit_Timestamp = byteutils_read_timeStamp(packet, 24);
 
-        rec_pts = Receive_Timestamp;
-
-        struct timeval now;
-        struct timespec outtime;
-        MUTEX_LOCK(raop_rtp->time_mutex);
-        gettimeofday(&now, NULL);
-        outtime.tv_sec = now.tv_sec + 1;  // Reduced from 3 to 1 second for faster timeout
-        outtime.tv_nsec = now.tv_usec * 1000;
-        int ret = pthread_cond_timedwait(&raop_rtp->time_cond, &raop_rtp->time_mutex, &outtime);
-        MUTEX_UNLOCK(raop_rtp->time_mutex);
+        /* Sleep until the next request, stop cuts the interval short */
+        if (wakeup_wait(raop_rtp->time_wakeup, -1, RAOP_TIME_INTERVAL_MS) != WAKEUP_WAIT_TIMEOUT) {
+            break;
+        }
     }
 
     logger_log(raop_rtp->logger, LOGGER_INFO, "Exiting UDP raop_rtp_thread_time thread");
     return 0;
 }
 
+/* Local time the frame stamped rtp is due, 0 until both a sync packet and
+ * a timing reply have arrived */
+static uint64_t
+raop_rtp_get_local_time(raop_rtp_t *raop_rtp, const raop_rtp_sync_t *sync, uint32_t rtp, uint32_t sample_rate)
+{
+    int64_t frames;
+
+    if (!sync->valid || sample_rate == 0) {
+        return 0;
+    }
+    frames = (int32_t)(rtp - sync->rtp);
+    return clock_sync_sender_to_local_ns(raop_rtp->clock,
+            sync->ntp_ns + (uint64_t)(frames * 1000000000LL / sample_rate));
+}
+
+static void
+raop_rtp_update_drops(raop_rtp_t *raop_rtp, long long *drops, int count)
+{
+    /* The counter rides on every datagram, the newest one is enough */
+    udp_packet_t *packet = udp_batch_get_packet(raop_rtp->batch, count-1);
+
+    if (packet->drops >= 0 && packet->drops != *drops) {
+        *drops = packet->drops;
+        raop_rtp->recv_stats.socket_drops = raop_rtp->control_drops + raop_rtp->data_drops;
+    }
+}
+
+/* Hands every playable frame to the callback. Only the buffer is touched
+ * under buffer_mutex; the decode and the callback run outside it, so the
+ * UDP thread can keep storing packets meanwhile. Returns whether packets
+ * are left waiting for a missing one. */
+static int
+raop_rtp_play_audio(raop_rtp_t *raop_rtp)
+{
+    const void *audiobuf;
+    int audiobuflen;
+    unsigned int pts = 0;
+    raop_buffer_format_t format;
+    raop_rtp_sync_t sync;
+    int taken;
+    int waiting = 0;
+
+    /* Decode all frames in queue */
+    for (;;) {
+        pcm_data_struct pcm_data;
+
+        MUTEX_LOCK(raop_rtp->buffer_mutex);
+        taken = raop_buffer_take(raop_rtp->buffer, raop_rtp->no_resend);
+        if (!taken) {
+            waiting = raop_buffer_is_waiting(raop_rtp->buffer);
+        }
+        sync = raop_rtp->sync;
+        MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+        if (!taken) {
+            break;
+        }
+        audiobuf = raop_buffer_decode(raop_rtp->buffer, &audiobuflen, &pts, &format);
+        if (!audiobuf) {
+            continue;
+        }
+        pcm_data.data_len = audiobuflen;
+        pcm_data.data = audiobuf;
+        pcm_data.pts = pts;
+        pcm_data.local_time_ns = raop_rtp_get_local_time(raop_rtp, &sync, pts, format.sample_rate);
+        pcm_data.sample_rate = format.sample_rate;
+        pcm_data.channels = format.channels;
+        pcm_data.bits_per_sample = format.bits_per_sample;
+        pcm_data.sample_format = format.sample_format;
+        pcm_data.frames = format.frames;
+        raop_rtp->callbacks.audio_process(raop_rtp->callbacks.cls, &pcm_data, raop_rtp->remoteName, raop_rtp->remoteDeviceId);
+    }
+    return waiting;
+}
+
+/* Packets were stored: play what became playable, then ask for what is
+ * still missing */
+static void
+raop_rtp_audio_queued(raop_rtp_t *raop_rtp)
+{
+    if (raop_rtp->decode_thread) {
+        wakeup_signal(raop_rtp->decode_wakeup);
+    } else {
+        raop_rtp_play_audio(raop_rtp);
+    }
+    if (!raop_rtp->no_resend) {
+        MUTEX_LOCK(raop_rtp->buffer_mutex);
+        raop_buffer_handle_resends(raop_rtp->buffer, raop_rtp_resend_callback, raop_rtp);
+        MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+    }
+}
+
+static void
+raop_rtp_receive_control(raop_rtp_t *raop_rtp)
+{
+    int count, syscalls, resent, i;
+
+    do {
+        count = udp_batch_recv(raop_rtp->batch, raop_rtp->csock, &syscalls);
+        raop_rtp->recv_stats.syscalls += syscalls;
+        if (count <= 0) {
+            break;
+        }
+        raop_rtp->recv_stats.packets += count;
+        raop_rtp_update_drops(raop_rtp, &raop_rtp->control_drops, count);
+
+        resent = 0;
+        MUTEX_LOCK(raop_rtp->buffer_mutex);
+        for (i=0; i<count; i++) {
+            udp_packet_t *packet = udp_batch_get_packet(raop_rtp->batch, i);
+            int type_c;
+
+            if (packet->len < 4) {
+                continue;
+            }
+            memcpy(&raop_rtp->control_saddr, &packet->saddr, packet->saddrlen);
+            raop_rtp->control_saddr_len = packet->saddrlen;
+            type_c = packet->data[1] & ~0x80;
+            logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp type_c 0x%02x, packetlen = %d", type_c, packet->len);
+            if (type_c == 0x56 && packet->len > 16) {
+                /* A resent packet behind a 4-byte header; header-only ones
+                 * are no-data markers as on the data socket */
+                int ret = raop_buffer_queue(raop_rtp->buffer, packet->data+4, packet->len-4, &raop_rtp->callbacks);
+                assert(ret >= 0);
+                resent++;
+
+            } else if (type_c == 0x54 && packet->len >= 20) {
+                raop_rtp->sync.rtp = (uint32_t)byteutils_read_int(packet->data, 4);
+                raop_rtp->sync.ntp_ns = byteutils_read_ntp_ns(packet->data, 8);
+                raop_rtp->sync.valid = 1;
+            } else {
+                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp unknown packet");
+            }
+        }
+        MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+        /* A resend may be what the buffer was waiting for */
+        if (resent > 0) {
+            raop_rtp_audio_queued(raop_rtp);
+        }
+    } while (count == udp_batch_get_size(raop_rtp->batch));
+}
+
+static void
+raop_rtp_receive_data(raop_rtp_t *raop_rtp)
+{
+    int count, syscalls, queued, i;
+
+    do {
+        count = udp_batch_recv(raop_rtp->batch, raop_rtp->dsock, &syscalls);
+        raop_rtp->recv_stats.syscalls += syscalls;
+        if (count <= 0) {
+            break;
+        }
+        raop_rtp->recv_stats.packets += count;
+        raop_rtp_update_drops(raop_rtp, &raop_rtp->data_drops, count);
+
+        /* Queue the whole batch, then decode whatever became playable */
+        queued = 0;
+        MUTEX_LOCK(raop_rtp->buffer_mutex);
+        for (i=0; i<count; i++) {
+            udp_packet_t *packet = udp_batch_get_packet(raop_rtp->batch, i);
+
+            /* A 12-byte packet contains only the RTP header. Senders use it
+             * as a no-data marker while changing routes; decoding it can
+             * feed an empty access unit into FDK-AAC. */
+            if (packet->len > 12) {
+                int buf_ret = raop_buffer_queue(raop_rtp->buffer, packet->data, packet->len, &raop_rtp->callbacks);
+                assert(buf_ret >= 0);
+                queued++;
+            }
+        }
+        MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+        if (queued > 0) {
+            raop_rtp_audio_queued(raop_rtp);
+        }
+    } while (count == udp_batch_get_size(raop_rtp->batch));
+}
+
+static void
+raop_rtp_report_stats(raop_rtp_t *raop_rtp)
+{
+    audio_recv_stats_struct *stats = &raop_rtp->recv_stats;
+    raop_buffer_stats_t buffer_stats;
+    uint64_t now = now_us();
+    uint64_t elapsed = now - raop_rtp->stats_time;
+    uint64_t packets;
+
+    if (elapsed < RAOP_STATS_INTERVAL_US) {
+        return;
+    }
+    MUTEX_LOCK(raop_rtp->buffer_mutex);
+    raop_buffer_get_stats(raop_rtp->buffer, &buffer_stats);
+    MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+    stats->packets_lost = buffer_stats.lost;
+    stats->packets_recovered = buffer_stats.recovered;
+    stats->packets_concealed = buffer_stats.concealed;
+    stats->packets_late = buffer_stats.late;
+    stats->resend_requests = buffer_stats.resend_requests;
+    packets = stats->packets - raop_rtp->stats_packets;
+    stats->wakeups_per_sec = (float)(stats->wakeups - raop_rtp->stats_wakeups) * 1000000.0f / elapsed;
+    stats->syscalls_per_packet = packets > 0 ?
+            (float)(stats->syscalls - raop_rtp->stats_syscalls) / packets : 0.0f;
+    raop_rtp->stats_time = now;
+    raop_rtp->stats_wakeups = stats->wakeups;
+    raop_rtp->stats_syscalls = stats->syscalls;
+    raop_rtp->stats_packets = stats->packets;
+
+    if (raop_rtp->callbacks.audio_recv_stats) {
+        raop_rtp->callbacks.audio_recv_stats(raop_rtp->callbacks.cls, stats, raop_rtp->remoteName, raop_rtp->remoteDeviceId);
+    }
+}
+
 static THREAD_RETVAL
 raop_rtp_thread_udp(void *arg)
 {
     raop_rtp_t *raop_rtp = arg;
     logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp");
-    unsigned char packet[RAOP_PACKET_LEN];
-    unsigned int packetlen;
-    struct sockaddr_storage saddr;
-    socklen_t saddrlen;
     assert(raop_rtp);
 
+    memset(&raop_rtp->recv_stats, 0, sizeof(raop_rtp->recv_stats));
+    raop_rtp->stats_time = now_us();
+    raop_rtp->stats_wakeups = 0;
+    raop_rtp->stats_syscalls = 0;
+    raop_rtp->stats_packets = 0;
+    raop_rtp->control_drops = 0;
+    raop_rtp->data_drops = 0;
+    MUTEX_LOCK(raop_rtp->buffer_mutex);
+    raop_rtp->sync.valid = 0;
+    MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+    logger_log(raop_rtp->logger, LOGGER_INFO, "Audio receive uses %s, %d packets per batch",
+               udp_batch_get_backend(raop_rtp->batch), udp_batch_get_size(raop_rtp->batch));
+
     while(1) {
         fd_set rfds;
         struct timeval tv;
+        int wakeup_fd = wakeup_get_fd(raop_rtp->wakeup);
         int nfds, ret;
 
-        /* Check if we are still running and process callbacks */
-        if (raop_rtp_process_events(raop_rtp, NULL)) {
-            break;
-        }
-
-        /* Set timeout value to 1ms (reduced from 5ms for lower latency) */
-        tv.tv_sec = 0;
-        tv.tv_usec = 1000;
+        /* Block until there is data or an event; the timeout only paces
+         * the stats report while the sender is quiet */
+        tv.tv_sec = RAOP_STATS_INTERVAL_US / 1000000;
+        tv.tv_usec = RAOP_STATS_INTERVAL_US % 1000000;
 
         /* Get the correct nfds value */
         nfds = raop_rtp->csock+1;
         if (raop_rtp->dsock >= nfds)
             nfds = raop_rtp->dsock+1;
+        if (wakeup_fd >= nfds)
+            nfds = wakeup_fd+1;
 
         /* Set rfds and call select */
         FD_ZERO(&rfds);
         FD_SET(raop_rtp->csock, &rfds);
         FD_SET(raop_rtp->dsock, &rfds);
-
+        FD_SET(wakeup_fd, &rfds);
 
         ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
-            continue;
-        } else if (ret == -1) {
+        if (ret == -1) {
             /* FIXME: Error happened */
             break;
         }
+        if (ret > 0 && FD_ISSET(wakeup_fd, &rfds)) {
+            wakeup_drain(raop_rtp->wakeup);
+        }
 
-        if (FD_ISSET(raop_rtp->csock, &rfds)) {
-           saddrlen = sizeof(saddr);
-           packetlen = recvfrom(raop_rtp->csock, (char *)packet, sizeof(packet), 0,
-                                (struct sockaddr *)&saddr, &saddrlen);
-
-            memcpy(&raop_rtp->control_saddr, &saddr, saddrlen);
-            raop_rtp->control_saddr_len = saddrlen;
-            int type_c = packet[1] & ~0x80;
-            logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp type_c 0x%02x, packetlen = %d", type_c, packetlen);
-            if (type_c == 0x56) {
-                int ret = raop_buffer_queue(raop_rtp->buffer, packet+4, packetlen-4, &raop_rtp->callbacks);
-                assert(ret >= 0);
+        /* Check if we are still running and process callbacks. This comes
+         * first so a flush applies before the packets that follow it. */
+        if (raop_rtp_process_events(raop_rtp, NULL)) {
+            break;
+        }
+        raop_rtp_report_stats(raop_rtp);
 
-            } else if (type_c == 0x54) {
+        if (ret == 0 || (!FD_ISSET(raop_rtp->csock, &rfds) && !FD_ISSET(raop_rtp->dsock, &rfds))) {
+            continue;
+        }
+        raop_rtp->recv_stats.wakeups++;
 
-            } else {
-                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp unknown packet");
-            }
+        /* Drain both sockets completely, one events round-trip per wakeup */
+        if (FD_ISSET(raop_rtp->csock, &rfds)) {
+            raop_rtp_receive_control(raop_rtp);
         }
         if (FD_ISSET(raop_rtp->dsock, &rfds)) {
-            saddrlen = sizeof(saddr);
-            packetlen = recvfrom(raop_rtp->dsock, (char *)packet, sizeof(packet), 0,
-                                 (struct sockaddr *)&saddr, &saddrlen);
-            // rtp payload type
-            int type_d = packet[1] & ~0x80;
-            //logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp type_d 0x%02x, packetlen = %d", type_d, packetlen);
+            raop_rtp_receive_data(raop_rtp);
+        }
+    }
+    logger_log(raop_rtp->logger, LOGGER_INFO, "Exiting UDP raop_rtp_thread_udp thread");
+    return 0;
+}
 
-            /* A 12-byte packet contains only the RTP header. Senders use it
-             * as a no-data marker while changing routes; decoding it can
-             * feed an empty access unit into FDK-AAC. */
-            if (packetlen > 12) {
-                int no_resend = 1;  // ULTRA-LOW LATENCY: Force immediate playback, bypass buffering wait (was: raop_rtp->control_rport == 0)
-                int buf_ret;
-                const void *audiobuf;
-                int audiobuflen;
-                unsigned int pts;
-                uint32_t sample_rate = 0;
-                uint16_t channels = 0;
-                uint16_t bits_per_sample = 0;
-
-                buf_ret = raop_buffer_queue(raop_rtp->buffer, packet, packetlen, &raop_rtp->callbacks);
-                assert(buf_ret >= 0);
-                /* Decode all frames in queue */
-                while ((audiobuf = raop_buffer_dequeue(raop_rtp->buffer, &audiobuflen, &pts, no_resend, &sample_rate, &channels, &bits_per_sample))) {
-                    pcm_data_struct pcm_data;
-                    pcm_data.data_len = audiobuflen;
-                    pcm_data.data = audiobuf;
-                    pcm_data.pts = pts;
-                    pcm_data.sample_rate = sample_rate;
-                    pcm_data.channels = channels;
-                    pcm_data.bits_per_sample = bits_per_sample;
-                    raop_rtp->callbacks.audio_process(raop_rtp->callbacks.cls, &pcm_data, raop_rtp->remoteName, raop_rtp->remoteDeviceId);
-                }
-                /* Handle possible resend requests */
-                if (!no_resend) {
-                    raop_buffer_handle_resends(raop_rtp->buffer, raop_rtp_resend_callback, raop_rtp);
-                }
-            }
+/* Plays the packets the UDP thread stores. With resends it also wakes on
+ * its own while packets wait for a missing one, as that is given up at its
+ * deadline whether or not anything arrives; otherwise it blocks. */
+static THREAD_RETVAL
+raop_rtp_thread_decode(void *arg)
+{
+    raop_rtp_t *raop_rtp = arg;
+    int timeout_ms = -1;
+    assert(raop_rtp);
 
+    while (1) {
+        MUTEX_LOCK(raop_rtp->run_mutex);
+        if (!raop_rtp->running) {
+            MUTEX_UNLOCK(raop_rtp->run_mutex);
+            break;
+        }
+        MUTEX_UNLOCK(raop_rtp->run_mutex);
+
+        if (wakeup_wait(raop_rtp->decode_wakeup, -1, timeout_ms) == WAKEUP_WAIT_SIGNALLED) {
+            wakeup_drain(raop_rtp->decode_wakeup);
+        }
+        if (raop_rtp_play_audio(raop_rtp) && !raop_rtp->no_resend) {
+            timeout_ms = RAOP_DECODE_POLL_MS;
+        } else {
+            timeout_ms = -1;
         }
     }
-    logger_log(raop_rtp->logger, LOGGER_INFO, "Exiting UDP raop_rtp_thread_udp thread");
+    logger_log(raop_rtp->logger, LOGGER_INFO, "Exiting raop_rtp_thread_decode thread");
     return 0;
 }
 
@@ -563,6 +885,12 @@ raop_rtp_start_audio(raop_rtp_t *raop_rtp, int use_udp, unsigned short control_r
 
     /* Initialize ports and sockets */
     raop_rtp->control_rport = control_rport;
+    raop_rtp->no_resend = (raop_rtp->latency_ms == 0 || control_rport == 0);
+    /* Resends can be asked for before the first control packet tells us
+     * where the sender sends them from */
+    memcpy(&raop_rtp->control_saddr, &raop_rtp->remote_saddr, raop_rtp->remote_saddr_len);
+    raop_rtp->control_saddr_len = raop_rtp->remote_saddr_len;
+    ((struct sockaddr_in *)&raop_rtp->control_saddr)->sin_port = htons(control_rport);
     //raop_rtp->timing_rport = timing_rport;
     if (raop_rtp->remote_saddr.ss_family == AF_INET6) {
         use_ipv6 = 1;
@@ -576,15 +904,37 @@ raop_rtp_start_audio(raop_rtp_t *raop_rtp, int use_udp, unsigned short control_r
     if (control_lport) *control_lport = raop_rtp->control_lport;
     if (timing_lport) *timing_lport = raop_rtp->timing_lport;
     if (data_lport) *data_lport = raop_rtp->data_lport;
+    if (raop_rtp->no_resend) {
+        logger_log(raop_rtp->logger, LOGGER_INFO, "Audio plays packets as they arrive, no resends");
+    } else {
+        logger_log(raop_rtp->logger, LOGGER_INFO, "Audio waits up to %u ms for resends", raop_rtp->latency_ms);
+    }
     /* Create the thread and initialize running values */
     raop_rtp->running = 1;
     raop_rtp->joined = 0;
+    wakeup_drain(raop_rtp->wakeup);
+    wakeup_drain(raop_rtp->time_wakeup);
+    wakeup_drain(raop_rtp->decode_wakeup);
 
     THREAD_CREATE(raop_rtp->thread, raop_rtp_thread_udp, raop_rtp);
     THREAD_CREATE(raop_rtp->thread_time, raop_rtp_thread_time, raop_rtp);
+    if (raop_rtp->decode_thread) {
+        logger_log(raop_rtp->logger, LOGGER_INFO, "Audio decodes on its own thread");
+        THREAD_CREATE(raop_rtp->thread_decode, raop_rtp_thread_decode, raop_rtp);
+    }
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
+void
+raop_rtp_set_audio_format(raop_rtp_t *raop_rtp, uint64_t audio_format)
+{
+    assert(raop_rtp);
+
+    MUTEX_LOCK(raop_rtp->buffer_mutex);
+    raop_buffer_set_audio_format(raop_rtp->buffer, audio_format);
+    MUTEX_UNLOCK(raop_rtp->buffer_mutex);
+}
+
 void
 raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume)
 {
@@ -601,6 +951,7 @@ raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume)
     raop_rtp->volume = volume;
     raop_rtp->volume_changed = 1;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -622,6 +973,7 @@ raop_rtp_set_metadata(raop_rtp_t *raop_rtp, const char *data, int datalen)
     raop_rtp->metadata = metadata;
     raop_rtp->metadata_len = datalen;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -643,6 +995,7 @@ raop_rtp_set_coverart(raop_rtp_t *raop_rtp, const char *data, int datalen)
     raop_rtp->coverart = coverart;
     raop_rtp->coverart_len = datalen;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -659,6 +1012,7 @@ raop_rtp_remote_control_id(raop_rtp_t *raop_rtp, const char *dacp_id, const char
     raop_rtp->dacp_id = strdup(dacp_id);
     raop_rtp->active_remote_header = strdup(active_remote_header);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -673,6 +1027,7 @@ raop_rtp_set_progress(raop_rtp_t *raop_rtp, unsigned int start, unsigned int cur
     raop_rtp->progress_end = end;
     raop_rtp->progress_changed = 1;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -684,6 +1039,7 @@ raop_rtp_flush(raop_rtp_t *raop_rtp, int next_seq)
     MUTEX_LOCK(raop_rtp->run_mutex);
     raop_rtp->flush = next_seq;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    wakeup_signal(raop_rtp->wakeup);
 }
 
 void
@@ -706,14 +1062,15 @@ raop_rtp_stop(raop_rtp_t *raop_rtp)
     raop_rtp->running = 0;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 
-    /* Join the thread */
+    /* Wake and join the threads */
+    wakeup_signal(raop_rtp->wakeup);
+    wakeup_signal(raop_rtp->time_wakeup);
+    wakeup_signal(raop_rtp->decode_wakeup);
     THREAD_JOIN(raop_rtp->thread);
-
-    MUTEX_LOCK(raop_rtp->time_mutex);
-    COND_SIGNAL(raop_rtp->time_cond);
-    MUTEX_UNLOCK(raop_rtp->time_mutex);
-
     THREAD_JOIN(raop_rtp->thread_time);
+    if (raop_rtp->decode_thread) {
+        THREAD_JOIN(raop_rtp->thread_decode);
+    }
     
     if (raop_rtp->csock != -1) {
         closesocket(raop_rtp->csock);
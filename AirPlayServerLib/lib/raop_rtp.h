@@ -23,17 +23,32 @@
 #define RAOP_AESKEY_LEN 16
 #define RAOP_PACKET_LEN 32768
 
+/* Reorder window when nothing else is configured, about 700 ms */
+#define RAOP_BUFFER_DEFAULT_LENGTH 64
+
 typedef struct raop_rtp_s raop_rtp_t;
 typedef struct h264codec_s h264codec_t;
 
+/* Audio receive settings, fixed for the life of a session */
+typedef struct {
+    unsigned int buffer_length;  /* Reorder window in packets, rounded up to a power of two */
+    unsigned int preroll;        /* Packets buffered before playback starts */
+    unsigned int latency_ms;     /* How long a missing packet is waited for, 0 never */
+    int decode_thread;           /* Decode on a thread of its own, not the receive thread */
+    int sample_format;           /* PCM_SAMPLE_FORMAT_* handed to audio_process */
+} raop_audio_config_t;
+
 
 raop_rtp_t *raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, const unsigned char *remote, int remotelen,
                           const char* remoteName, const char* remoteDeviceId,
-                          const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret, unsigned short timing_rport);
+                          const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret, unsigned short timing_rport,
+                          const raop_audio_config_t *audio_config);
 
 void raop_rtp_start_audio(raop_rtp_t *raop_rtp, int use_udp, unsigned short control_rport, unsigned short timing_rport,
                      unsigned short *control_lport, unsigned short *timing_lport, unsigned short *data_lport);
 
+/* The audioFormat of the stream SETUP, before raop_rtp_start_audio */
+void raop_rtp_set_audio_format(raop_rtp_t *raop_rtp, uint64_t audio_format);
 void raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume);
 void raop_rtp_set_metadata(raop_rtp_t *raop_rtp, const char *data, int datalen);
 void raop_rtp_set_coverart(raop_rtp_t *raop_rtp, const char *data, int datalen);
@@ -16,7 +16,11 @@
 #include "logger.h"
 #include "byteutils.h"
 #include "mirror_buffer.h"
+#include "mirror_payload.h"
 #include "stream.h"
+#include "wakeup.h"
+#include "mirror_reader.h"
+#include "clock_sync.h"
 
 #ifdef WIN32
 #include <WinSock2.h>
@@ -46,6 +50,8 @@ struct raop_rtp_mirror_s {
 
     /* Buffer to handle all resends */
     mirror_buffer_t *buffer;
+    /* Recycled frame buffers shared with the video_process consumer */
+    mirror_payload_pool_t *payload_pool;
 
     raop_rtp_mirror_t *mirror;
     /* Remote address as sockaddr */
@@ -56,7 +62,8 @@ struct raop_rtp_mirror_s {
 
     /* MUTEX LOCKED VARIABLES START */
     /* These variables only edited mutex locked */
-    int running;
+    /* Read without the lock by the worker threads */
+    atomic_counter_t running;
     int joined;
     int stop_in_progress;
 
@@ -66,10 +73,12 @@ struct raop_rtp_mirror_s {
     // For thread_mirror exit unexpeced.
     thread_handle_t thread_exit_exception;
     mutex_handle_t run_mutex;
-
-    mutex_handle_t time_mutex;
-    cond_handle_t time_cond;
     /* MUTEX LOCKED VARIABLES END */
+
+    /* Signalled once by stop so both threads leave their blocking waits */
+    wakeup_t *wakeup;
+    /* Sender clock, fed by the timing thread and read by the mirror thread */
+    clock_sync_t *clock;
     int mirror_data_sock, mirror_time_sock;
 
     unsigned short mirror_data_lport;
@@ -78,59 +87,31 @@ struct raop_rtp_mirror_s {
 };
 
 #define MIRROR_READ_TIMEOUT_MS 3000
+/* Gap between timing requests, and how long a reply is waited for */
+#define MIRROR_TIME_INTERVAL_MS 1000
 #define MIRROR_MAX_PAYLOAD_SIZE (64 * 1024 * 1024)
 
 /* Read one complete protocol field without allowing a half-delivered TCP frame
  * to block the mirror thread forever. Network-path changes (notably enabling a
  * VPN on the sender) can leave an established socket with no more bytes. */
 static int
-mirror_recv_exact(raop_rtp_mirror_t *mirror, int socket_fd,
+mirror_recv_exact(raop_rtp_mirror_t *mirror, mirror_reader_t *reader,
     unsigned char *buffer, int length)
 {
-    int offset = 0;
+    int ret;
 
-    if (mirror == NULL || socket_fd == -1 || buffer == NULL || length < 0) {
+    if (mirror == NULL || reader == NULL || buffer == NULL || length < 0) {
         return -1;
     }
-    while (offset < length) {
-        fd_set rfds;
-        struct timeval timeout;
-        int ready;
-        int received;
-        int running;
-
-        MUTEX_LOCK(mirror->run_mutex);
-        running = mirror->running;
-        MUTEX_UNLOCK(mirror->run_mutex);
-        if (!running) {
-            return -1;
-        }
-
-        FD_ZERO(&rfds);
-        FD_SET(socket_fd, &rfds);
-        timeout.tv_sec = MIRROR_READ_TIMEOUT_MS / 1000;
-        timeout.tv_usec = (MIRROR_READ_TIMEOUT_MS % 1000) * 1000;
-        ready = select(socket_fd + 1, &rfds, NULL, NULL, &timeout);
-        if (ready == 0) {
-            logger_log(mirror->logger, LOGGER_WARNING,
-                "Mirror TCP read timed out after %d ms", MIRROR_READ_TIMEOUT_MS);
-            return -1;
-        }
-        if (ready < 0) {
-            logger_log(mirror->logger, LOGGER_WARNING,
-                "Mirror TCP select failed");
-            return -1;
-        }
-
-        received = recv(socket_fd, (char *)buffer + offset, length - offset, 0);
-        if (received <= 0) {
-            logger_log(mirror->logger, LOGGER_INFO,
-                received == 0 ? "Mirror TCP socket closed" : "Mirror TCP receive failed");
-            return -1;
-        }
-        offset += received;
+    ret = mirror_reader_read(reader, buffer, length, mirror->wakeup, MIRROR_READ_TIMEOUT_MS);
+    if (ret == MIRROR_READER_TIMEOUT) {
+        logger_log(mirror->logger, LOGGER_WARNING,
+            "Mirror TCP read timed out after %d ms", MIRROR_READ_TIMEOUT_MS);
+    } else if (ret == MIRROR_READER_CLOSED || ret == MIRROR_READER_ERROR) {
+        logger_log(mirror->logger, LOGGER_INFO,
+            ret == MIRROR_READER_CLOSED ? "Mirror TCP socket closed" : "Mirror TCP receive failed");
     }
-    return 0;
+    return ret == 0 ? 0 : -1;
 }
 
 static void
@@ -152,6 +133,18 @@ mirror_enable_keepalive(int socket_fd)
 #endif
 }
 
+/* The mirror stream is a bulk TCP flow with bursts at every keyframe. Acks
+ * go out right away so the sender's window keeps opening. */
+static const netutils_socket_profile_t mirror_data_profile = {
+    .rcvbuf = 4 * 1024 * 1024,
+    .nodelay = 1,
+    .quickack = 1,
+    .dscp = 34,
+};
+static const netutils_socket_profile_t mirror_timing_profile = {
+    .dscp = 46,
+};
+
 static int
 raop_rtp_parse_remote(raop_rtp_mirror_t *raop_rtp_mirror, const unsigned char *remote, int remotelen)
 {
@@ -202,7 +195,20 @@ raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *call
         free(raop_rtp_mirror);
         return NULL;
     }
-    if (raop_rtp_parse_remote(raop_rtp_mirror, remote, remotelen) < 0) {
+    raop_rtp_mirror->payload_pool = mirror_payload_pool_init(logger);
+    if (!raop_rtp_mirror->payload_pool) {
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        free(raop_rtp_mirror);
+        return NULL;
+    }
+    raop_rtp_mirror->wakeup = wakeup_init();
+    raop_rtp_mirror->clock = clock_sync_init(logger, "mirror");
+    if (!raop_rtp_mirror->wakeup || !raop_rtp_mirror->clock ||
+        raop_rtp_parse_remote(raop_rtp_mirror, remote, remotelen) < 0) {
+        clock_sync_destroy(raop_rtp_mirror->clock);
+        wakeup_destroy(raop_rtp_mirror->wakeup);
+        mirror_payload_pool_destroy(raop_rtp_mirror->payload_pool);
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
         free(raop_rtp_mirror);
         return NULL;
     }
@@ -221,8 +227,6 @@ raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *call
     raop_rtp_mirror->flush = NO_FLUSH;
 
     MUTEX_CREATE(raop_rtp_mirror->run_mutex);
-    MUTEX_CREATE(raop_rtp_mirror->time_mutex);
-    COND_CREATE(raop_rtp_mirror->time_cond);
     return raop_rtp_mirror;
 }
 
@@ -243,77 +247,55 @@ raop_rtp_mirror_thread_time(void *arg)
     struct sockaddr_storage saddr;
     socklen_t saddrlen;
     unsigned char packet[128];
-    unsigned int packetlen;
+    int packetlen;
     int first = 0;
     unsigned char time[48]={35,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
-    uint64_t base = now_us();
-    uint64_t rec_pts = 0;
+    uint64_t t1, t4;
+
+    clock_sync_reset(raop_rtp_mirror->clock);
     while (1) {
-        MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-        if (!raop_rtp_mirror->running) {
-            MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
+        if (!ATOMIC_GET(raop_rtp_mirror->running)) {
             break;
         }
-        MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
-        uint64_t send_time = now_us() - base + rec_pts;
-
-        byteutils_put_timeStamp(time, 40, send_time);
+        t1 = now_ns();
+        byteutils_put_ntp_ns(time, 40, t1);
         logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror_thread_time send time 48 bytes, port = %d", raop_rtp_mirror->mirror_timing_rport);
         struct sockaddr_in *addr = (struct sockaddr_in *)&raop_rtp_mirror->remote_saddr;
         addr->sin_port = htons(raop_rtp_mirror->mirror_timing_rport);
         int sendlen = sendto(raop_rtp_mirror->mirror_time_sock, (char *)time, sizeof(time), 0, (struct sockaddr *) &raop_rtp_mirror->remote_saddr, raop_rtp_mirror->remote_saddr_len);
         logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror_thread_time sendlen = %d", sendlen);
 
-        fd_set rfds;
-        struct timeval tv;
-        int nfds, ret;
-        /* Set timeout value to 1ms (reduced from 5ms for lower latency) */
-        tv.tv_sec = 0;
-        tv.tv_usec = 1000;
-
-        /* Get the correct nfds value and set rfds */
-        FD_ZERO(&rfds);
-        FD_SET(raop_rtp_mirror->mirror_time_sock, &rfds);
-        nfds = raop_rtp_mirror->mirror_time_sock + 1;
-        ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
-            sleepms(10);  // Reduced from 1000ms to 10ms to minimize video latency
+        /* Wait for the reply; a lost one is asked for again */
+        int ret = wakeup_wait(raop_rtp_mirror->wakeup, raop_rtp_mirror->mirror_time_sock, MIRROR_TIME_INTERVAL_MS);
+        if (ret == WAKEUP_WAIT_TIMEOUT) {
             continue;
+        } else if (ret != WAKEUP_WAIT_READY) {
+            break;
         }
 
         saddrlen = sizeof(saddr);
         packetlen = recvfrom(raop_rtp_mirror->mirror_time_sock, (char *)packet, sizeof(packet), 0,
                              (struct sockaddr *)&saddr, &saddrlen);
+        t4 = now_ns();
         logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror_thread_time receive time packetlen = %d", packetlen);
         // 16-24 The time when the system clock was last set or updated
-        uint64_t Reference_Timestamp = byteutils_read_timeStamp(packet, 16);
         // 24-32 Local time of sender when NTP request leaves sender. T1
-        uint64_t Origin_Timestamp = byteutils_read_timeStamp(packet, 24);
         // 32-40 Local time of receiver when NTP request arrives at receiver. T2
-        uint64_t Receive_Timestamp = byteutils_read_timeStamp(packet, 32);
         // 40-48 Transmit Timestamp: Local time of responder when response leaves responder. T3
-        uint64_t Transmit_Timestamp = byteutils_read_timeStamp(packet, 40);
-
-        // FIXME: Let's just write it simply for now
-        rec_pts = Receive_Timestamp;
+        // A late reply to an earlier request echoes an older T1
+        if (packetlen >= 48 && memcmp(packet + 24, time + 40, 8) == 0) {
+            uint64_t receive_ns = byteutils_read_ntp_ns(packet, 32);
+            uint64_t transmit_ns = byteutils_read_ntp_ns(packet, 40);
+            clock_sync_add_exchange(raop_rtp_mirror->clock, t1, receive_ns, transmit_ns, t4);
+        }
 
         if (first == 0) {
             first++;
         } else {
-            struct timeval now;
-            struct timespec outtime;
-#ifndef WIN32
-            MUTEX_LOCK(raop_rtp_mirror->time_mutex);
-#endif // !WIN32
-            gettimeofday(&now, NULL);
-            outtime.tv_sec = now.tv_sec + 1;  // Reduced from 3 to 1 second for faster timeout
-            outtime.tv_nsec = now.tv_usec * 1000;
-            int ret = pthread_cond_timedwait(&raop_rtp_mirror->time_cond, &raop_rtp_mirror->time_mutex, &outtime);
-#ifndef WIN32
-            MUTEX_UNLOCK(raop_rtp_mirror->time_mutex);
-#endif // !WIN32
-            //sleepms(3000);
+            /* Sleep until the next request, stop cuts the interval short */
+            if (wakeup_wait(raop_rtp_mirror->wakeup, -1, MIRROR_TIME_INTERVAL_MS) != WAKEUP_WAIT_TIMEOUT) {
+                break;
+            }
         }
     }
     logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Exiting UDP raop_rtp_mirror_thread_time thread");
@@ -337,6 +319,7 @@ static THREAD_RETVAL
 raop_rtp_mirror_thread(void *arg)
 {
     raop_rtp_mirror_t *raop_rtp_mirror = arg;
+    mirror_reader_t *reader;
     int stream_fd = -1;
     unsigned char packet[128];
     memset(packet, 0 , 128);
@@ -346,6 +329,11 @@ raop_rtp_mirror_thread(void *arg)
     assert(raop_rtp_mirror);
 
     int exceptionExit = 0;
+    reader = mirror_reader_init(MIRROR_READER_SIZE);
+    if (!reader) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "Could not allocate the mirror stream reader");
+        exceptionExit = 1;
+    }
 #ifdef DUMP_H264
     // C decrypted
     FILE* file = fopen("demo.h264", "wb");
@@ -354,43 +342,28 @@ raop_rtp_mirror_thread(void *arg)
 
     FILE* file_len = fopen("demo.len", "wb");
 #endif
-    while (1) {
-        fd_set rfds;
-        struct timeval tv;
-        int nfds, ret;
-        MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-        if (!raop_rtp_mirror->running) {
-            MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
+    while (!exceptionExit) {
+        int ret;
+        if (!ATOMIC_GET(raop_rtp_mirror->running)) {
             break;
         }
-        MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
-        /* Set timeout value to 1ms (reduced from 5ms for lower latency) */
-        tv.tv_sec = 0;
-        tv.tv_usec = 1000;
 
-        /* Get the correct nfds value and set rfds */
-        FD_ZERO(&rfds);
         if (stream_fd == -1) {
-            FD_SET(raop_rtp_mirror->mirror_data_sock, &rfds);
-            nfds = raop_rtp_mirror->mirror_data_sock+1;
-        } else {
-            FD_SET(stream_fd, &rfds);
-            nfds = stream_fd+1;
-        }
-        ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
-            continue;
-        } else if (ret == -1) {
-            /* FIXME: Error happened */
-            logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Error in select");
-            exceptionExit = 1;
-            break;
-        }
-        if (stream_fd == -1 && FD_ISSET(raop_rtp_mirror->mirror_data_sock, &rfds)) {
             struct sockaddr_storage saddr;
             socklen_t saddrlen;
 
+            /* Block on the listening socket until the sender connects. Only
+             * stop signals the wakeup. */
+            ret = wakeup_wait(raop_rtp_mirror->wakeup, raop_rtp_mirror->mirror_data_sock, -1);
+            if (ret == WAKEUP_WAIT_SIGNALLED) {
+                continue;
+            } else if (ret == -1) {
+                /* FIXME: Error happened */
+                logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Error in select");
+                exceptionExit = 1;
+                break;
+            }
+
             logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Accepting client");
             saddrlen = sizeof(saddr);
             stream_fd = accept(raop_rtp_mirror->mirror_data_sock, (struct sockaddr *)&saddr, &saddrlen);
@@ -401,31 +374,35 @@ raop_rtp_mirror_thread(void *arg)
                 break;
             }
             mirror_enable_keepalive(stream_fd);
-        }
-        if (stream_fd != -1 && FD_ISSET(stream_fd, &rfds)) {
-            // packetlen initially 0
-            ret = recv(stream_fd, packet + readstart, 4 - readstart, 0);
-            if (ret == 0) {
+            /* Quick ack is reset by the stack, set the profile on the
+             * connection too */
+            netutils_set_socket_profile(stream_fd, &mirror_data_profile, NULL, raop_rtp_mirror->logger, "mirror stream");
+            netutils_set_nonblocking(stream_fd);
+            mirror_reader_reset(reader, stream_fd);
+        } else {
+            /* The next packet may be a long time coming, but once it has
+             * started the rest of it must follow */
+            ret = mirror_reader_read(reader, packet, 4, raop_rtp_mirror->wakeup, -1);
+            if (ret == MIRROR_READER_STOPPED) {
+                continue;
+            } else if (ret == MIRROR_READER_CLOSED) {
                 /* TCP socket closed */
                 logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "TCP socket closed");
                 exceptionExit = 1;
                 break;
-            } else if (ret == -1) {
+            } else if (ret != 0) {
                 /* FIXME: Error happened */
                 logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Error in recv");
                 exceptionExit = 1;
                 break;
             }
-            readstart += ret;
-            if (readstart < 4) {
-                continue;
-            }
+            readstart = 4;
             if ((packet[0] == 80 && packet[1] == 79 && packet[2] == 83 && packet[3] == 84) || (packet[0] == 71 && packet[1] == 69 && packet[2] == 84)) {
                 // POST or GET
                 logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "handle http data");
             } else {
                 // normal data block
-                if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
+                if (mirror_recv_exact(raop_rtp_mirror, reader,
                     packet + readstart, 128 - readstart) != 0) {
                     exceptionExit = 1;
                     break;
@@ -451,25 +428,31 @@ raop_rtp_mirror_thread(void *arg)
                     } else {
                         pts =  ntptopts(payloadntp) - pts_base;
                     }
-                    // this is encrypted data
-                    unsigned char* payload_in = malloc(payloadsize);
-                    unsigned char* payload = malloc(payloadsize);
+                    // this is encrypted data, received and decrypted in one pooled
+                    // buffer that the consumer may keep without copying
+                    mirror_payload_t* frame = mirror_payload_pool_get(raop_rtp_mirror->payload_pool, payloadsize);
+                    if (frame == NULL) {
+                        logger_log(raop_rtp_mirror->logger, LOGGER_ERR,
+                            "Could not allocate mirror payload of %d bytes", payloadsize);
+                        exceptionExit = 1;
+                        break;
+                    }
+                    unsigned char* payload = mirror_payload_data(frame);
                     readstart = 0;
-                    if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
-                        payload_in, payloadsize) != 0) {
-                        free(payload_in);
-                        free(payload);
+                    if (mirror_recv_exact(raop_rtp_mirror, reader,
+                        payload, payloadsize) != 0) {
+                        mirror_payload_release(frame);
                         exceptionExit = 1;
                         break;
                     }
                     readstart = payloadsize;
                     //logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "readstart = %d", readstart);
 #ifdef DUMP_H264
-                    fwrite(payload_in, payloadsize, 1, file_source);
+                    fwrite(payload, payloadsize, 1, file_source);
                     fwrite(&readstart, sizeof(readstart), 1, file_len);
 #endif
                     // decrypt data
-                    mirror_buffer_decrypt(raop_rtp_mirror->buffer, payload_in, payload, payloadsize);
+                    mirror_buffer_decrypt(raop_rtp_mirror->buffer, payload, payload, payloadsize);
                     int nalu_size = 0;
                     int nalu_num = 0;
                     while (nalu_size < payloadsize) {
@@ -496,9 +479,12 @@ raop_rtp_mirror_thread(void *arg)
                     h264_data.data = payload;
                     h264_data.frame_type = 1;
                     h264_data.pts = pts;
+                    /* Frame times are NTP on the sender clock, without the 1900 epoch */
+                    h264_data.local_time_ns = clock_sync_sender_to_local_ns(raop_rtp_mirror->clock,
+                        ntptopts(payloadntp) * 1000);
+                    h264_data.buffer = frame;
                     raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, &h264_data, raop_rtp_mirror->remoteName, raop_rtp_mirror->remoteDeviceId);
-                    free(payload_in);
-                    free(payload);
+                    mirror_payload_release(frame);
                 } else if ((payloadtype & 255) == 1) {
                     float mWidthSource = byteutils_get_float(packet, 40);
                     float mHeightSource = byteutils_get_float(packet, 44);
@@ -519,7 +505,7 @@ raop_rtp_mirror_thread(void *arg)
                     // sps_pps this data is not encrypted
                     unsigned char* payload = malloc(payloadsize);
                     readstart = 0;
-                    if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
+                    if (mirror_recv_exact(raop_rtp_mirror, reader,
                         payload, payloadsize) != 0) {
                         free(payload);
                         exceptionExit = 1;
@@ -564,6 +550,8 @@ raop_rtp_mirror_thread(void *arg)
                         h264_data.data = sps_pps;
                         h264_data.frame_type = 0;
                         h264_data.pts = 0;
+                        h264_data.local_time_ns = 0;
+                        h264_data.buffer = NULL;
                         raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, &h264_data, raop_rtp_mirror->remoteName, raop_rtp_mirror->remoteDeviceId);
                         free(sps_pps);
                     }
@@ -574,7 +562,7 @@ raop_rtp_mirror_thread(void *arg)
                     readstart = 0;
                     if (payloadsize > 0) {
                         unsigned char* payload_in = malloc(payloadsize);
-						if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
+						if (mirror_recv_exact(raop_rtp_mirror, reader,
 							payload_in, payloadsize) != 0) {
 							free(payload_in);
 							exceptionExit = 1;
@@ -587,7 +575,7 @@ raop_rtp_mirror_thread(void *arg)
                     readstart = 0;
                     if (payloadsize > 0) {
                         unsigned char* payload_in = malloc(payloadsize);
-						if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
+						if (mirror_recv_exact(raop_rtp_mirror, reader,
 							payload_in, payloadsize) != 0) {
 							free(payload_in);
 							exceptionExit = 1;
@@ -600,7 +588,7 @@ raop_rtp_mirror_thread(void *arg)
                     readstart = 0;
                     if (payloadsize > 0) {
                         unsigned char* payload_in = malloc(payloadsize);
-						if (mirror_recv_exact(raop_rtp_mirror, stream_fd,
+						if (mirror_recv_exact(raop_rtp_mirror, reader,
 							payload_in, payloadsize) != 0) {
 							free(payload_in);
 							exceptionExit = 1;
@@ -620,6 +608,7 @@ raop_rtp_mirror_thread(void *arg)
     if (stream_fd != -1) {
         closesocket(stream_fd);
     }
+    mirror_reader_destroy(reader);
     if (exceptionExit) {
         if (raop_rtp_mirror->thread_exit_exception != NULL) {
             logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Exiting exception thread[1]");
@@ -666,8 +655,9 @@ raop_rtp_start_mirror(raop_rtp_mirror_t *raop_rtp_mirror, int use_udp, unsigned
     if (mirror_data_lport) *mirror_data_lport = raop_rtp_mirror->mirror_data_lport;
 
     /* Create the thread and initialize running values */
-    raop_rtp_mirror->running = 1;
+    ATOMIC_SET(raop_rtp_mirror->running, 1);
     raop_rtp_mirror->joined = 0;
+    wakeup_drain(raop_rtp_mirror->wakeup);
 
     THREAD_CREATE(raop_rtp_mirror->thread_mirror, raop_rtp_mirror_thread, raop_rtp_mirror);
     THREAD_CREATE(raop_rtp_mirror->thread_time, raop_rtp_mirror_thread_time, raop_rtp_mirror);
@@ -698,11 +688,13 @@ void raop_rtp_mirror_stop(raop_rtp_mirror_t *raop_rtp_mirror) {
         return;
     }
     raop_rtp_mirror->stop_in_progress = 1;
-    raop_rtp_mirror->running = 0;
+    ATOMIC_SET(raop_rtp_mirror->running, 0);
     mirror_data_sock = raop_rtp_mirror->mirror_data_sock;
     mirror_time_sock = raop_rtp_mirror->mirror_time_sock;
     MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
 
+    wakeup_signal(raop_rtp_mirror->wakeup);
+
     /* Keep the shared descriptors valid until the workers have left FD_SET,
      * but close local snapshots to wake any pending socket operation. */
     if (mirror_data_sock != -1) {
@@ -712,14 +704,6 @@ void raop_rtp_mirror_stop(raop_rtp_mirror_t *raop_rtp_mirror) {
         closesocket(mirror_time_sock);
     }
 
-#ifndef WIN32
-    MUTEX_LOCK(raop_rtp_mirror->time_mutex);
-#endif // !WIN32
-    COND_SIGNAL(raop_rtp_mirror->time_cond);
-#ifndef WIN32
-    MUTEX_UNLOCK(raop_rtp_mirror->time_mutex);
-#endif // !WIN32
-
     logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Join mirror thread");
     THREAD_JOIN(raop_rtp_mirror->thread_mirror);
 
@@ -765,9 +749,10 @@ void raop_rtp_mirror_destroy(raop_rtp_mirror_t *raop_rtp_mirror) {
             logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "Exception thread exit");
         }
         MUTEX_DESTROY(raop_rtp_mirror->run_mutex);
-        MUTEX_DESTROY(raop_rtp_mirror->time_mutex);
-        COND_DESTROY(raop_rtp_mirror->time_cond);
+        wakeup_destroy(raop_rtp_mirror->wakeup);
+        clock_sync_destroy(raop_rtp_mirror->clock);
         mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        mirror_payload_pool_destroy(raop_rtp_mirror->payload_pool);
         free(raop_rtp_mirror);
     }
 }
@@ -786,6 +771,10 @@ raop_rtp_init_mirror_sockets(raop_rtp_mirror_t *raop_rtp_mirror, int use_ipv6)
         goto sockets_cleanup;
     }
 
+    /* The receive buffer must be set before listen to size the window */
+    netutils_set_socket_profile(dsock, &mirror_data_profile, NULL, raop_rtp_mirror->logger, "mirror data");
+    netutils_set_socket_profile(tsock, &mirror_timing_profile, NULL, raop_rtp_mirror->logger, "mirror timing");
+
     /* Listen to the data socket if using TCP */
     if (listen(dsock, 1) < 0)
         goto sockets_cleanup;
@@ -0,0 +1,401 @@
+//
+// Socket readiness reactor: epoll on Linux, select() elsewhere.
+//
+// Waiting costs nothing while every registered socket is idle; there is no
+// periodic timeout. On epoll a wait only touches ready descriptors, and each
+// one carries its registration, so dispatch needs no lookup. The select()
+// fallback still scans the registrations but builds the sets from a compact
+// array instead of a fixed slot table. Adding, modifying and removing find
+// a descriptor through a hash table rather than a scan.
+//
+
+/* Windows fd_set is a counted array, raise its 64 socket default */
+#if defined(WIN32) && !defined(FD_SETSIZE)
+#define FD_SETSIZE 1024
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "reactor.h"
+#include "wakeup.h"
+#include "compat.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define REACTOR_USE_EPOLL
+#endif
+
+typedef struct reactor_entry_s reactor_entry_t;
+
+struct reactor_entry_s {
+	int fd;
+	int events;
+	void *data;
+
+	/* Position in the compact array, for O(1) removal */
+	int index;
+	/* Next registration in the same hash bucket */
+	reactor_entry_t *next;
+};
+
+struct reactor_s {
+	logger_t *logger;
+
+	/* Registrations stay put; epoll keeps pointers to them */
+	reactor_entry_t **entries;
+	int entry_count;
+	int entry_size;
+
+	/* Descriptor lookup, as many buckets as entries has room for */
+	reactor_entry_t **buckets;
+
+	wakeup_t *wakeup;
+#ifdef REACTOR_USE_EPOLL
+	int epoll_fd;
+#endif
+};
+
+/* Windows socket handles are multiples of four, fold the low bits in */
+static unsigned int
+reactor_bucket(reactor_t *reactor, int fd)
+{
+	unsigned int hash = (unsigned int)fd;
+
+	return (hash ^ (hash >> 2)) & (unsigned int)(reactor->entry_size - 1);
+}
+
+static reactor_entry_t *
+reactor_find(reactor_t *reactor, int fd)
+{
+	reactor_entry_t *entry;
+
+	if (!reactor->buckets) {
+		return NULL;
+	}
+	entry = reactor->buckets[reactor_bucket(reactor, fd)];
+	while (entry && entry->fd != fd) {
+		entry = entry->next;
+	}
+	return entry;
+}
+
+/* Doubles the entry array and rehashes into twice the buckets */
+static int
+reactor_grow(reactor_t *reactor)
+{
+	int size = reactor->entry_size ? reactor->entry_size * 2 : 16;
+	reactor_entry_t **entries;
+	reactor_entry_t **buckets;
+	int i;
+
+	entries = realloc(reactor->entries, size * sizeof(reactor_entry_t *));
+	if (!entries) {
+		return -1;
+	}
+	reactor->entries = entries;
+	buckets = calloc(size, sizeof(reactor_entry_t *));
+	if (!buckets) {
+		return -1;
+	}
+	free(reactor->buckets);
+	reactor->buckets = buckets;
+	reactor->entry_size = size;
+
+	for (i=0; i<reactor->entry_count; i++) {
+		reactor_entry_t *entry = reactor->entries[i];
+		unsigned int bucket = reactor_bucket(reactor, entry->fd);
+
+		entry->next = buckets[bucket];
+		buckets[bucket] = entry;
+	}
+	return 0;
+}
+
+#ifdef REACTOR_USE_EPOLL
+/* entry is NULL for the wakeup descriptor */
+static int
+reactor_epoll_ctl(reactor_t *reactor, int op, int fd, int events, reactor_entry_t *entry)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLET;
+	if (events & REACTOR_READ) {
+		ev.events |= EPOLLIN | EPOLLRDHUP;
+	}
+	if (events & REACTOR_WRITE) {
+		ev.events |= EPOLLOUT;
+	}
+	ev.data.ptr = entry;
+	return epoll_ctl(reactor->epoll_fd, op, fd, &ev);
+}
+#endif
+
+reactor_t *
+reactor_init(logger_t *logger)
+{
+	reactor_t *reactor;
+
+	reactor = calloc(1, sizeof(reactor_t));
+	if (!reactor) {
+		return NULL;
+	}
+	reactor->logger = logger;
+	reactor->wakeup = wakeup_init();
+	if (!reactor->wakeup) {
+		free(reactor);
+		return NULL;
+	}
+#ifdef REACTOR_USE_EPOLL
+	reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor->epoll_fd == -1 ||
+	    reactor_epoll_ctl(reactor, EPOLL_CTL_ADD, wakeup_get_fd(reactor->wakeup), REACTOR_READ, NULL) == -1) {
+		if (reactor->epoll_fd != -1) {
+			close(reactor->epoll_fd);
+		}
+		wakeup_destroy(reactor->wakeup);
+		free(reactor);
+		return NULL;
+	}
+#endif
+	return reactor;
+}
+
+void
+reactor_destroy(reactor_t *reactor)
+{
+	if (reactor) {
+		int i;
+
+#ifdef REACTOR_USE_EPOLL
+		close(reactor->epoll_fd);
+#endif
+		wakeup_destroy(reactor->wakeup);
+		for (i=0; i<reactor->entry_count; i++) {
+			free(reactor->entries[i]);
+		}
+		free(reactor->entries);
+		free(reactor->buckets);
+		free(reactor);
+	}
+}
+
+const char *
+reactor_get_backend(reactor_t *reactor)
+{
+	(void)reactor;
+#ifdef REACTOR_USE_EPOLL
+	return "epoll";
+#else
+	return "select";
+#endif
+}
+
+int
+reactor_add(reactor_t *reactor, int fd, int events, void *data)
+{
+	reactor_entry_t *entry;
+	unsigned int bucket;
+
+	assert(reactor);
+	assert(fd != -1);
+
+	if (reactor_find(reactor, fd)) {
+		return -1;
+	}
+#if !defined(REACTOR_USE_EPOLL)
+	/* Windows counts sockets, POSIX indexes a bitmap by descriptor */
+#if defined(WIN32)
+	if (reactor->entry_count + 1 >= FD_SETSIZE) {
+#else
+	if (fd >= FD_SETSIZE) {
+#endif
+		logger_log(reactor->logger, LOGGER_WARNING, "Socket %d exceeds select() capacity", fd);
+		return -1;
+	}
+#endif
+	if (reactor->entry_count == reactor->entry_size && reactor_grow(reactor) == -1) {
+		return -1;
+	}
+	entry = malloc(sizeof(reactor_entry_t));
+	if (!entry) {
+		return -1;
+	}
+	entry->fd = fd;
+	entry->events = events;
+	entry->data = data;
+#ifdef REACTOR_USE_EPOLL
+	if (reactor_epoll_ctl(reactor, EPOLL_CTL_ADD, fd, events, entry) == -1) {
+		free(entry);
+		return -1;
+	}
+#endif
+	entry->index = reactor->entry_count;
+	reactor->entries[reactor->entry_count++] = entry;
+	bucket = reactor_bucket(reactor, fd);
+	entry->next = reactor->buckets[bucket];
+	reactor->buckets[bucket] = entry;
+	return 0;
+}
+
+int
+reactor_modify(reactor_t *reactor, int fd, int events)
+{
+	reactor_entry_t *entry;
+
+	assert(reactor);
+
+	entry = reactor_find(reactor, fd);
+	if (!entry) {
+		return -1;
+	}
+#ifdef REACTOR_USE_EPOLL
+	/* Modifying also re-arms the edge, so readiness that arrived while the
+	 * interest was off is reported again */
+	if (reactor_epoll_ctl(reactor, EPOLL_CTL_MOD, fd, events, entry) == -1) {
+		return -1;
+	}
+#endif
+	entry->events = events;
+	return 0;
+}
+
+void
+reactor_remove(reactor_t *reactor, int fd)
+{
+	reactor_entry_t **link;
+	reactor_entry_t *entry;
+	reactor_entry_t *last;
+
+	assert(reactor);
+
+	if (!reactor->buckets) {
+		return;
+	}
+	link = &reactor->buckets[reactor_bucket(reactor, fd)];
+	while (*link && (*link)->fd != fd) {
+		link = &(*link)->next;
+	}
+	entry = *link;
+	if (!entry) {
+		return;
+	}
+#ifdef REACTOR_USE_EPOLL
+	/* Events already returned were copied out, nothing refers to entry */
+	epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+	*link = entry->next;
+	last = reactor->entries[--reactor->entry_count];
+	reactor->entries[entry->index] = last;
+	last->index = entry->index;
+	free(entry);
+}
+
+int
+reactor_wait(reactor_t *reactor, reactor_event_t *events, int max_events, int timeout_ms)
+{
+	int count = 0;
+	int i;
+
+	assert(reactor);
+	assert(events);
+	assert(max_events > 0);
+
+#ifdef REACTOR_USE_EPOLL
+	{
+		struct epoll_event ready[64];
+		int nready;
+
+		if (max_events > 64) {
+			max_events = 64;
+		}
+		nready = epoll_wait(reactor->epoll_fd, ready, max_events, timeout_ms);
+		if (nready == -1) {
+			return errno == EINTR ? 0 : -1;
+		}
+		for (i=0; i<nready; i++) {
+			reactor_entry_t *entry = ready[i].data.ptr;
+
+			if (!entry) {
+				wakeup_drain(reactor->wakeup);
+				continue;
+			}
+			events[count].fd = entry->fd;
+			events[count].data = entry->data;
+			events[count].events = 0;
+			if (ready[i].events & (EPOLLIN | EPOLLRDHUP)) {
+				events[count].events |= REACTOR_READ;
+			}
+			if (ready[i].events & EPOLLOUT) {
+				events[count].events |= REACTOR_WRITE;
+			}
+			if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+				events[count].events |= REACTOR_ERROR;
+			}
+			count++;
+		}
+	}
+#else
+	{
+		int wakeup_fd = wakeup_get_fd(reactor->wakeup);
+		fd_set rfds, wfds;
+		struct timeval tv;
+		int nfds = wakeup_fd + 1;
+		int ret;
+
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(wakeup_fd, &rfds);
+		for (i=0; i<reactor->entry_count; i++) {
+			reactor_entry_t *entry = reactor->entries[i];
+			if (entry->events & REACTOR_READ) {
+				FD_SET(entry->fd, &rfds);
+			}
+			if (entry->events & REACTOR_WRITE) {
+				FD_SET(entry->fd, &wfds);
+			}
+			if (entry->events && nfds <= entry->fd) {
+				nfds = entry->fd + 1;
+			}
+		}
+		if (timeout_ms >= 0) {
+			tv.tv_sec = timeout_ms / 1000;
+			tv.tv_usec = (timeout_ms % 1000) * 1000;
+		}
+		ret = select(nfds, &rfds, &wfds, NULL, timeout_ms >= 0 ? &tv : NULL);
+		if (ret == -1) {
+			return SOCKET_GET_ERROR() == SOCKET_ERRORNAME(EINTR) ? 0 : -1;
+		}
+		if (FD_ISSET(wakeup_fd, &rfds)) {
+			wakeup_drain(reactor->wakeup);
+		}
+		for (i=0; i<reactor->entry_count && count<max_events; i++) {
+			reactor_entry_t *entry = reactor->entries[i];
+			int ready = 0;
+
+			if ((entry->events & REACTOR_READ) && FD_ISSET(entry->fd, &rfds)) {
+				ready |= REACTOR_READ;
+			}
+			if ((entry->events & REACTOR_WRITE) && FD_ISSET(entry->fd, &wfds)) {
+				ready |= REACTOR_WRITE;
+			}
+			if (ready) {
+				events[count].fd = entry->fd;
+				events[count].events = ready;
+				events[count].data = entry->data;
+				count++;
+			}
+		}
+	}
+#endif
+	return count;
+}
+
+void
+reactor_wakeup(reactor_t *reactor)
+{
+	assert(reactor);
+	wakeup_signal(reactor->wakeup);
+}
@@ -0,0 +1,39 @@
+//
+// Socket readiness reactor: epoll on Linux, select() elsewhere.
+//
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "logger.h"
+
+#define REACTOR_READ  0x01
+#define REACTOR_WRITE 0x02
+/* Reported only: error or hangup, the next recv/send returns the cause */
+#define REACTOR_ERROR 0x04
+
+typedef struct reactor_s reactor_t;
+
+typedef struct {
+	int fd;
+	int events;
+	void *data;
+} reactor_event_t;
+
+reactor_t *reactor_init(logger_t *logger);
+void reactor_destroy(reactor_t *reactor);
+
+const char *reactor_get_backend(reactor_t *reactor);
+
+/* Registered descriptors must be non-blocking: readiness is edge triggered
+ * on epoll, so handlers read and write until the call would block. */
+int reactor_add(reactor_t *reactor, int fd, int events, void *data);
+int reactor_modify(reactor_t *reactor, int fd, int events);
+void reactor_remove(reactor_t *reactor, int fd);
+
+/* Blocks until a descriptor is ready, reactor_wakeup() is called or
+ * timeout_ms passes (-1 waits forever). Returns the number of events. */
+int reactor_wait(reactor_t *reactor, reactor_event_t *events, int max_events, int timeout_ms);
+void reactor_wakeup(reactor_t *reactor);
+
+#endif
@@ -42,6 +42,13 @@ typedef HANDLE cond_handle_t;
 
 int pthread_cond_timedwait(cond_handle_t* __cond, mutex_handle_t* __mutex, const struct timespec* __timeout);
 
+typedef volatile LONG atomic_counter_t;
+
+#define ATOMIC_INC(counter) InterlockedIncrement(&(counter))
+#define ATOMIC_DEC(counter) InterlockedDecrement(&(counter))
+#define ATOMIC_GET(counter) InterlockedCompareExchange(&(counter), 0, 0)
+#define ATOMIC_SET(counter, value) InterlockedExchange(&(counter), (value))
+
 #else /* Use pthread library */
 
 #include <pthread.h>
@@ -69,6 +76,13 @@ typedef pthread_cond_t cond_handle_t;
 #define COND_SIGNAL(handle) pthread_cond_signal(&(handle))
 #define COND_DESTROY(handle) pthread_cond_destroy(&(handle))
 
+typedef volatile long atomic_counter_t;
+
+#define ATOMIC_INC(counter) __sync_add_and_fetch(&(counter), 1)
+#define ATOMIC_DEC(counter) __sync_sub_and_fetch(&(counter), 1)
+#define ATOMIC_GET(counter) __sync_add_and_fetch(&(counter), 0)
+#define ATOMIC_SET(counter, value) do { __sync_synchronize(); (counter) = (value); __sync_synchronize(); } while (0)
+
 #endif
 
 #endif /* THREADS_H */
@@ -0,0 +1,213 @@
+//
+// Batched datagram receive into a preallocated packet arena.
+//
+// Linux reads a whole batch with one recvmmsg() call. Elsewhere, or when the
+// kernel lacks recvmmsg(), packets are read one recvfrom() at a time until
+// the socket would block, which still drains the socket in one wakeup.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "udp_batch.h"
+
+#if defined(__linux__)
+#include <sys/uio.h>
+#include <stdint.h>
+#define UDP_BATCH_USE_RECVMMSG
+/* Room for the SO_RXQ_OVFL drop counter */
+#define UDP_BATCH_CONTROL_LEN CMSG_SPACE(sizeof(uint32_t))
+#endif
+
+struct udp_batch_s {
+	unsigned char *arena;
+	udp_packet_t *packets;
+	int count;
+	int packet_size;
+#ifdef UDP_BATCH_USE_RECVMMSG
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	unsigned char *controls;
+	int use_recvmmsg;
+#endif
+};
+
+udp_batch_t *
+udp_batch_init(int count, int packet_size)
+{
+	udp_batch_t *batch;
+	int i;
+
+	assert(count > 0);
+	assert(packet_size > 0);
+
+	batch = calloc(1, sizeof(udp_batch_t));
+	if (!batch) {
+		return NULL;
+	}
+	batch->count = count;
+	batch->packet_size = packet_size;
+	batch->arena = malloc((size_t)count * packet_size);
+	batch->packets = calloc(count, sizeof(udp_packet_t));
+	if (!batch->arena || !batch->packets) {
+		udp_batch_destroy(batch);
+		return NULL;
+	}
+	for (i=0; i<count; i++) {
+		batch->packets[i].data = batch->arena + (size_t)i * packet_size;
+	}
+
+#ifdef UDP_BATCH_USE_RECVMMSG
+	batch->msgs = calloc(count, sizeof(struct mmsghdr));
+	batch->iovs = calloc(count, sizeof(struct iovec));
+	batch->controls = calloc(count, UDP_BATCH_CONTROL_LEN);
+	if (!batch->msgs || !batch->iovs || !batch->controls) {
+		udp_batch_destroy(batch);
+		return NULL;
+	}
+	for (i=0; i<count; i++) {
+		batch->iovs[i].iov_base = batch->packets[i].data;
+		batch->iovs[i].iov_len = packet_size;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = &batch->packets[i].saddr;
+		batch->msgs[i].msg_hdr.msg_control = batch->controls + (size_t)i * UDP_BATCH_CONTROL_LEN;
+	}
+	batch->use_recvmmsg = 1;
+#endif
+	return batch;
+}
+
+void
+udp_batch_destroy(udp_batch_t *batch)
+{
+	if (batch) {
+#ifdef UDP_BATCH_USE_RECVMMSG
+		free(batch->msgs);
+		free(batch->iovs);
+		free(batch->controls);
+#endif
+		free(batch->packets);
+		free(batch->arena);
+		free(batch);
+	}
+}
+
+int
+udp_batch_get_size(udp_batch_t *batch)
+{
+	assert(batch);
+	return batch->count;
+}
+
+const char *
+udp_batch_get_backend(udp_batch_t *batch)
+{
+	assert(batch);
+#ifdef UDP_BATCH_USE_RECVMMSG
+	if (batch->use_recvmmsg) {
+		return "recvmmsg";
+	}
+#endif
+	return "recvfrom";
+}
+
+static int
+udp_batch_would_block(int error)
+{
+	return error == SOCKET_ERRORNAME(EAGAIN) || error == SOCKET_ERRORNAME(EWOULDBLOCK);
+}
+
+#ifdef UDP_BATCH_USE_RECVMMSG
+static long long
+udp_batch_get_drops(struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	uint32_t drops;
+
+#ifdef SO_RXQ_OVFL
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+			return drops;
+		}
+	}
+#endif
+	return -1;
+}
+
+static int
+udp_batch_recvmmsg(udp_batch_t *batch, int fd)
+{
+	int ret, i;
+
+	for (i=0; i<batch->count; i++) {
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		batch->msgs[i].msg_hdr.msg_controllen = UDP_BATCH_CONTROL_LEN;
+	}
+	ret = recvmmsg(fd, batch->msgs, batch->count, MSG_DONTWAIT, NULL);
+	if (ret == -1) {
+		return udp_batch_would_block(errno) ? 0 : -1;
+	}
+	for (i=0; i<ret; i++) {
+		batch->packets[i].len = batch->msgs[i].msg_len;
+		batch->packets[i].saddrlen = batch->msgs[i].msg_hdr.msg_namelen;
+		batch->packets[i].drops = udp_batch_get_drops(&batch->msgs[i].msg_hdr);
+	}
+	return ret;
+}
+#endif
+
+int
+udp_batch_recv(udp_batch_t *batch, int fd, int *syscalls)
+{
+	udp_packet_t *packet;
+	int received = 0;
+	int ret;
+
+	assert(batch);
+	assert(syscalls);
+
+	*syscalls = 0;
+#ifdef UDP_BATCH_USE_RECVMMSG
+	if (batch->use_recvmmsg) {
+		*syscalls = 1;
+		ret = udp_batch_recvmmsg(batch, fd);
+		if (ret != -1 || errno != ENOSYS) {
+			return ret;
+		}
+		batch->use_recvmmsg = 0;
+	}
+#endif
+
+	while (received < batch->count) {
+		packet = &batch->packets[received];
+		packet->saddrlen = sizeof(packet->saddr);
+		ret = recvfrom(fd, (char *)packet->data, batch->packet_size, 0,
+		               (struct sockaddr *)&packet->saddr, &packet->saddrlen);
+		(*syscalls)++;
+		if (ret < 0) {
+			if (received > 0 || udp_batch_would_block(SOCKET_GET_ERROR())) {
+				break;
+			}
+			return -1;
+		}
+		packet->len = ret;
+		packet->drops = -1;
+		received++;
+	}
+	return received;
+}
+
+udp_packet_t *
+udp_batch_get_packet(udp_batch_t *batch, int index)
+{
+	assert(batch);
+	assert(index >= 0 && index < batch->count);
+	return &batch->packets[index];
+}
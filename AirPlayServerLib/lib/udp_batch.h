@@ -0,0 +1,37 @@
+//
+// Batched datagram receive into a preallocated packet arena.
+//
+
+#ifndef UDP_BATCH_H
+#define UDP_BATCH_H
+
+#include "compat.h"
+
+typedef struct {
+	unsigned char *data;
+	int len;
+	struct sockaddr_storage saddr;
+	socklen_t saddrlen;
+	/* SO_RXQ_OVFL count of datagrams the socket has dropped so far, -1
+	 * when the socket does not report it */
+	long long drops;
+} udp_packet_t;
+
+typedef struct udp_batch_s udp_batch_t;
+
+/* Arena of count packet buffers of packet_size bytes each, allocated once */
+udp_batch_t *udp_batch_init(int count, int packet_size);
+void udp_batch_destroy(udp_batch_t *batch);
+
+int udp_batch_get_size(udp_batch_t *batch);
+const char *udp_batch_get_backend(udp_batch_t *batch);
+
+/* Reads the datagrams already pending on a non-blocking socket into the
+ * arena, up to its size, without waiting for more. Returns how many were
+ * read, 0 when none was pending or -1 on error; *syscalls is set to the
+ * receive calls that took. A full batch means more may still be pending.
+ * Packets stay valid until the next call. */
+int udp_batch_recv(udp_batch_t *batch, int fd, int *syscalls);
+udp_packet_t *udp_batch_get_packet(udp_batch_t *batch, int index);
+
+#endif
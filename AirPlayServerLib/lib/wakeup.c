@@ -0,0 +1,180 @@
+//
+// Cross-thread wakeup descriptor for blocking socket loops.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wakeup.h"
+#include "netutils.h"
+#include "compat.h"
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+/* Linux uses one eventfd for both ends, other POSIX systems a pipe. Windows
+ * select() only accepts sockets, so there it is a loopback UDP socket that
+ * is connected to itself. */
+struct wakeup_s {
+	int read_fd;
+	int write_fd;
+};
+
+#if defined(WIN32)
+static int
+wakeup_init_socket(wakeup_t *wakeup)
+{
+	struct sockaddr_in saddr;
+	socklen_t saddrlen = sizeof(saddr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd == -1) {
+		return -1;
+	}
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	saddr.sin_port = 0;
+	if (bind(fd, (struct sockaddr *)&saddr, sizeof(saddr)) == -1 ||
+	    getsockname(fd, (struct sockaddr *)&saddr, &saddrlen) == -1 ||
+	    connect(fd, (struct sockaddr *)&saddr, saddrlen) == -1 ||
+	    netutils_set_nonblocking(fd) == -1) {
+		closesocket(fd);
+		return -1;
+	}
+	wakeup->read_fd = fd;
+	wakeup->write_fd = fd;
+	return 0;
+}
+#endif
+
+wakeup_t *
+wakeup_init()
+{
+	wakeup_t *wakeup;
+	int ret;
+
+	wakeup = calloc(1, sizeof(wakeup_t));
+	if (!wakeup) {
+		return NULL;
+	}
+#if defined(WIN32)
+	ret = wakeup_init_socket(wakeup);
+#elif defined(__linux__)
+	wakeup->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	wakeup->write_fd = wakeup->read_fd;
+	ret = wakeup->read_fd == -1 ? -1 : 0;
+#else
+	{
+		int fds[2];
+		ret = pipe(fds);
+		if (ret == 0) {
+			netutils_set_nonblocking(fds[0]);
+			netutils_set_nonblocking(fds[1]);
+			wakeup->read_fd = fds[0];
+			wakeup->write_fd = fds[1];
+		}
+	}
+#endif
+	if (ret == -1) {
+		free(wakeup);
+		return NULL;
+	}
+	return wakeup;
+}
+
+void
+wakeup_destroy(wakeup_t *wakeup)
+{
+	if (wakeup) {
+#if defined(WIN32)
+		closesocket(wakeup->read_fd);
+#else
+		if (wakeup->write_fd != wakeup->read_fd) {
+			close(wakeup->write_fd);
+		}
+		close(wakeup->read_fd);
+#endif
+		free(wakeup);
+	}
+}
+
+int
+wakeup_get_fd(wakeup_t *wakeup)
+{
+	assert(wakeup);
+	return wakeup->read_fd;
+}
+
+void
+wakeup_signal(wakeup_t *wakeup)
+{
+	assert(wakeup);
+#if defined(WIN32)
+	send(wakeup->write_fd, "w", 1, 0);
+#elif defined(__linux__)
+	{
+		uint64_t value = 1;
+		if (write(wakeup->write_fd, &value, sizeof(value)) < 0) {
+			/* Counter saturated, the descriptor is readable anyway */
+		}
+	}
+#else
+	if (write(wakeup->write_fd, "w", 1) < 0) {
+		/* Pipe full, the descriptor is readable anyway */
+	}
+#endif
+}
+
+void
+wakeup_drain(wakeup_t *wakeup)
+{
+	char buffer[64];
+
+	assert(wakeup);
+#if defined(WIN32)
+	while (recv(wakeup->read_fd, buffer, sizeof(buffer), 0) > 0);
+#elif defined(__linux__)
+	/* One read resets the eventfd counter */
+	if (read(wakeup->read_fd, buffer, sizeof(uint64_t)) < 0) {
+		/* Nothing pending */
+	}
+#else
+	while (read(wakeup->read_fd, buffer, sizeof(buffer)) > 0);
+#endif
+}
+
+int
+wakeup_wait(wakeup_t *wakeup, int fd, int timeout_ms)
+{
+	fd_set rfds;
+	struct timeval tv;
+	int nfds, ret;
+
+	assert(wakeup);
+
+	FD_ZERO(&rfds);
+	FD_SET(wakeup->read_fd, &rfds);
+	nfds = wakeup->read_fd + 1;
+	if (fd != -1) {
+		FD_SET(fd, &rfds);
+		if (fd >= nfds) {
+			nfds = fd + 1;
+		}
+	}
+	if (timeout_ms >= 0) {
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+	}
+	ret = select(nfds, &rfds, NULL, NULL, timeout_ms >= 0 ? &tv : NULL);
+	if (ret <= 0) {
+		return ret == 0 ? WAKEUP_WAIT_TIMEOUT : -1;
+	}
+	if (FD_ISSET(wakeup->read_fd, &rfds)) {
+		return WAKEUP_WAIT_SIGNALLED;
+	}
+	return WAKEUP_WAIT_READY;
+}
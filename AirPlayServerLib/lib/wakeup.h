@@ -0,0 +1,32 @@
+//
+// Cross-thread wakeup descriptor for blocking socket loops.
+//
+
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+/* A descriptor that can be waited on next to sockets and made readable from
+ * another thread, so worker loops can block without a polling timeout. */
+typedef struct wakeup_s wakeup_t;
+
+wakeup_t *wakeup_init();
+void wakeup_destroy(wakeup_t *wakeup);
+
+/* Descriptor to add to select() read sets or a reactor */
+int wakeup_get_fd(wakeup_t *wakeup);
+
+void wakeup_signal(wakeup_t *wakeup);
+/* Consume pending signals so the descriptor stops being readable */
+void wakeup_drain(wakeup_t *wakeup);
+
+#define WAKEUP_WAIT_TIMEOUT   0
+#define WAKEUP_WAIT_READY     1
+#define WAKEUP_WAIT_SIGNALLED 2
+
+/* Blocks until fd is readable, the wakeup is signalled or timeout_ms passes
+ * (-1 waits forever). fd may be -1 to wait for the signal alone. A signal
+ * is reported ahead of a ready fd and is left pending. Returns one of the
+ * WAKEUP_WAIT_ values, or -1 when select() fails. */
+int wakeup_wait(wakeup_t *wakeup, int fd, int timeout_ms);
+
+#endif
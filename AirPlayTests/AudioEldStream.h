@@ -0,0 +1,42 @@
+#pragma once
+
+#include "FgTest.h"
+
+// The recorded stream data\audio_eld.rtp: AAC-ELD 44100 stereo, 200 RTP
+// packets encrypted under the session keys below (tools\make_audio_eld.c
+// wrote it). Shared by the audio buffer tests and benchmarks.
+
+// Must match tools\make_audio_eld.c
+static const unsigned char s_audioEldAesKey[16] = {
+	0x6b, 0x1f, 0x53, 0xa0, 0x2c, 0x97, 0x3e, 0x44, 0xd1, 0x08, 0x7a, 0xee, 0x25, 0x90, 0x6c, 0x13
+};
+static const unsigned char s_audioEldAesIv[16] = {
+	0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78, 0x87, 0x96, 0xa5, 0xb4, 0xc3, 0xd2, 0xe1, 0xf0
+};
+static const unsigned char s_audioEldEcdh[32] = {
+	0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+	0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87, 0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e, 0x0f
+};
+
+#define AUDIO_FORMAT_ELD_44100_STEREO (1ULL << 24)
+#define AUDIO_ELD_FRAME_SAMPLES 480
+
+// One vector per RTP packet, in sequence order
+static inline bool readAudioEldPackets(std::vector<std::vector<unsigned char> >& packets)
+{
+	std::vector<unsigned char> data;
+	if (!fgTestReadFile("audio_eld.rtp", data)) {
+		return false;
+	}
+	size_t pos = 0;
+	while (pos + 2 <= data.size()) {
+		size_t length = data[pos] | (data[pos + 1] << 8);
+		pos += 2;
+		if (length < 12 || pos + length > data.size()) {
+			return false;
+		}
+		packets.push_back(std::vector<unsigned char>(data.begin() + pos, data.begin() + pos + length));
+		pos += length;
+	}
+	return pos == data.size() && !packets.empty();
+}
@@ -0,0 +1,140 @@
+#include "FgTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static SFgTest* s_pTests = NULL;
+static SFgTest** s_ppTestsTail = &s_pTests;
+
+// Registration order is file order within a translation unit; keep it so the
+// output reads the same from run to run
+CFgTestRegistrar::CFgTestRegistrar(SFgTest* pTest)
+{
+	*s_ppTestsTail = pTest;
+	s_ppTestsTail = &pTest->next;
+}
+
+std::string fgTestDataPath(const char* name)
+{
+	std::string path;
+	const char* dir = getenv("FG_TEST_DATA");
+	if (dir != NULL && dir[0] != '\0') {
+		path = dir;
+	}
+	else {
+		// The data sits next to this source file
+		path = __FILE__;
+		size_t slash = path.find_last_of("\\/");
+		path = (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+		path += "data";
+	}
+	if (!path.empty() && path[path.size() - 1] != '\\' && path[path.size() - 1] != '/') {
+		path += '\\';
+	}
+	return path + name;
+}
+
+bool fgTestReadFile(const char* name, std::vector<unsigned char>& data)
+{
+	std::string path = fgTestDataPath(name);
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (fp == NULL) {
+		printf("  cannot open %s\n", path.c_str());
+		return false;
+	}
+	data.clear();
+	unsigned char buffer[4096];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(fp);
+	return true;
+}
+
+unsigned int fgTestCrc32(const unsigned char* data, size_t size, unsigned int crc)
+{
+	static unsigned int s_table[256];
+	if (s_table[1] == 0) {
+		for (unsigned int i = 0; i < 256; i++) {
+			unsigned int c = i;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			s_table[i] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = s_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+double fgTestNowMs()
+{
+	static LARGE_INTEGER s_qpcFreq;
+	if (s_qpcFreq.QuadPart == 0) {
+		QueryPerformanceFrequency(&s_qpcFreq);
+	}
+	LARGE_INTEGER qpcNow;
+	QueryPerformanceCounter(&qpcNow);
+	return (double)qpcNow.QuadPart * 1000.0 / (double)s_qpcFreq.QuadPart;
+}
+
+static bool isSelected(const SFgTest* pTest, int argc, char* argv[], bool bBench)
+{
+	bool bNamed = false;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			continue;
+		}
+		bNamed = true;
+		if (strcmp(argv[i], pTest->name) == 0) {
+			return true;
+		}
+	}
+	return !bNamed && (!pTest->isBench || bBench);
+}
+
+int main(int argc, char* argv[])
+{
+	bool bBench = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--list") == 0) {
+			for (SFgTest* pTest = s_pTests; pTest != NULL; pTest = pTest->next) {
+				printf("%s%s\n", pTest->name, pTest->isBench ? " (bench)" : "");
+			}
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench") == 0) {
+			bBench = true;
+		}
+	}
+
+	int nRun = 0;
+	int nFailed = 0;
+	for (SFgTest* pTest = s_pTests; pTest != NULL; pTest = pTest->next) {
+		if (!isSelected(pTest, argc, argv, bBench)) {
+			continue;
+		}
+		printf("[ RUN    ] %s\n", pTest->name);
+		fflush(stdout);
+		int failures = 0;
+		double startMs = fgTestNowMs();
+		pTest->run(&failures);
+		printf("[ %s ] %s (%.0f ms)\n", failures ? "FAILED" : "    OK", pTest->name, fgTestNowMs() - startMs);
+		fflush(stdout);
+		nRun++;
+		if (failures) {
+			nFailed++;
+		}
+	}
+
+	if (nRun == 0) {
+		printf("No test matched\n");
+		return 1;
+	}
+	printf("%d of %d passed\n", nRun - nFailed, nRun);
+	return nFailed ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Minimal test registry for AirPlayTests.exe. Tests fail through FG_CHECK;
+// benchmarks print their figures and fail only when their output is wrong.
+// Run with no arguments for every test, --bench to include the benchmarks,
+// or name tests and benchmarks to run just those.
+
+typedef void (*PFN_FG_TEST)(int* pFailures);
+
+typedef struct SFgTest {
+	const char* name;
+	PFN_FG_TEST run;
+	bool isBench;
+	SFgTest* next;
+} SFgTest;
+
+class CFgTestRegistrar
+{
+public:
+	CFgTestRegistrar(SFgTest* pTest);
+};
+
+#define FG_TEST_DEFINE(name, bench) \
+	static void name(int* pFailures); \
+	static SFgTest s_test_##name = { #name, name, bench, NULL }; \
+	static CFgTestRegistrar s_registrar_##name(&s_test_##name); \
+	static void name(int* pFailures)
+
+#define FG_TEST(name) FG_TEST_DEFINE(name, false)
+#define FG_BENCH(name) FG_TEST_DEFINE(name, true)
+
+#define FG_CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			(*pFailures)++; \
+			printf("  %s(%d): check failed: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+// Stops the test when a check it cannot go on without fails
+#define FG_REQUIRE(cond, ...) \
+	do { \
+		int failuresBefore = *pFailures; \
+		FG_CHECK(cond, __VA_ARGS__); \
+		if (*pFailures != failuresBefore) { \
+			return; \
+		} \
+	} while (0)
+
+// Path of a file in AirPlayTests\data, or in FG_TEST_DATA when that is set
+std::string fgTestDataPath(const char* name);
+bool fgTestReadFile(const char* name, std::vector<unsigned char>& data);
+
+unsigned int fgTestCrc32(const unsigned char* data, size_t size, unsigned int crc = 0);
+
+// QueryPerformanceCounter time in milliseconds
+double fgTestNowMs();
@@ -0,0 +1,105 @@
+#include "FgTest.h"
+#include "CAudioEngine.h"
+#include "CNullAudioSink.h"
+
+#include <math.h>
+
+// CAudioEngine against device clocks that are off, without sound hardware.
+// Two engines play through CNullAudioSink, one 100 ppm fast and one 100 ppm
+// slow, both fed by one synthetic sender: 44100 Hz stereo in 352-frame
+// packets, written as the real clock reaches them and stamped with an exact
+// sender timeline. Once the device loop has settled, each engine must
+// measure its own device rate and the sender rate, and it must play the
+// whole run without an underrun or a drop.
+
+#define ENGINE_STREAM_RATE 44100
+#define ENGINE_DEVICE_RATE 48000
+#define ENGINE_CHANNELS 2
+#define ENGINE_PACKET_FRAMES 352		// An ALAC packet
+#define ENGINE_PPM 100
+#define ENGINE_RUN_MS 25000
+#define ENGINE_SETTLE_MS 15000			// The rates are averaged over the rest of the run
+#define ENGINE_MAX_DEPTH_MS 500
+#define ENGINE_START_DEPTH_MS 100
+#define ENGINE_TARGET_DEPTH_MS 150
+// The device loop smooths the sink's period-sized steps over tens of
+// seconds. Averaged over the end of the run, its estimate was still up to
+// 30 ppm off on a loaded machine, so the limit is wide and the fast and slow
+// device must also be told apart.
+#define ENGINE_DEVICE_TOLERANCE_PPM 50
+#define ENGINE_SENDER_TOLERANCE_HZ 0.5
+
+FG_TEST(audio_engine_null_sink_drift)
+{
+	const double scales[2] = { 1.0 + ENGINE_PPM * 1e-6, 1.0 - ENGINE_PPM * 1e-6 };
+	CNullAudioSink sinks[2] = { CNullAudioSink(scales[0]), CNullAudioSink(scales[1]) };
+	CAudioEngine engines[2];
+	for (int e = 0; e < 2; e++) {
+		FG_REQUIRE(engines[e].start(&sinks[e], ENGINE_STREAM_RATE, ENGINE_DEVICE_RATE, ENGINE_CHANNELS,
+			CAudioResampler::QUALITY_SINC32, ENGINE_MAX_DEPTH_MS, ENGINE_START_DEPTH_MS), "cannot start engine %d", e);
+		engines[e].setTargetDepthMs(ENGINE_TARGET_DEPTH_MS);
+	}
+
+	// A 1 kHz tone, a packet at a time as the sender clock reaches it
+	std::vector<Sint16> packet(ENGINE_PACKET_FRAMES * ENGINE_CHANNELS);
+	unsigned long long produced = 0;
+	double deviceHzSum[2] = { 0, 0 };
+	double senderHzSum[2] = { 0, 0 };
+	int samples = 0;
+	LONGLONG startNs = CAudioEngine::nowNs();
+	LONGLONG timelineNs = startNs + ENGINE_TARGET_DEPTH_MS * 1000000LL;
+	for (;;) {
+		LONGLONG elapsedNs = CAudioEngine::nowNs() - startNs;
+		if (elapsedNs >= ENGINE_RUN_MS * 1000000LL) {
+			break;
+		}
+		unsigned long long due = (unsigned long long)(elapsedNs * ENGINE_STREAM_RATE / 1000000000LL);
+		while (produced + ENGINE_PACKET_FRAMES <= due) {
+			for (unsigned int n = 0; n < ENGINE_PACKET_FRAMES; n++) {
+				Sint16 v = (Sint16)(8000.0 * sin(2 * 3.14159265358979 * 1000.0 * (double)(produced + n) / ENGINE_STREAM_RATE));
+				packet[n * 2] = v;
+				packet[n * 2 + 1] = v;
+			}
+			LONGLONG packetNs = timelineNs + (LONGLONG)(produced * 1000000000ULL / ENGINE_STREAM_RATE);
+			for (int e = 0; e < 2; e++) {
+				engines[e].write(&packet[0], ENGINE_PACKET_FRAMES, packetNs);
+			}
+			produced += ENGINE_PACKET_FRAMES;
+		}
+		if (elapsedNs >= ENGINE_SETTLE_MS * 1000000LL) {
+			for (int e = 0; e < 2; e++) {
+				CAudioEngine::SStats stats;
+				engines[e].getStats(&stats);
+				deviceHzSum[e] += stats.deviceRateHz;
+				senderHzSum[e] += stats.senderRateHz;
+			}
+			samples++;
+		}
+		Sleep(5);
+	}
+	FG_REQUIRE(samples > 0, "the run ended before the rates settled");
+
+	double measuredHz[2];
+	for (int e = 0; e < 2; e++) {
+		CAudioEngine::SStats stats;
+		engines[e].getStats(&stats);
+		engines[e].stop();
+		measuredHz[e] = deviceHzSum[e] / samples;
+		double senderHz = senderHzSum[e] / samples;
+		double deviceHz = ENGINE_DEVICE_RATE * scales[e];
+		double deviceErrorPpm = (measuredHz[e] - deviceHz) / deviceHz * 1e6;
+		printf("  device %+d ppm: measured %.2f Hz (%+.1f ppm off), sender %.2f Hz, ratio %.6f, depth %d ms, "
+			"%d underruns, %d drops\n", e == 0 ? ENGINE_PPM : -ENGINE_PPM, measuredHz[e], deviceErrorPpm, senderHz,
+			stats.ratio, stats.depthMs, stats.underruns, stats.dropped);
+		FG_CHECK(fabs(deviceErrorPpm) <= ENGINE_DEVICE_TOLERANCE_PPM, "engine %d: device rate %.2f Hz, %.2f Hz expected",
+			e, measuredHz[e], deviceHz);
+		FG_CHECK(fabs(senderHz - ENGINE_STREAM_RATE) <= ENGINE_SENDER_TOLERANCE_HZ,
+			"engine %d: sender rate %.2f Hz, %d Hz expected", e, senderHz, ENGINE_STREAM_RATE);
+		FG_CHECK(stats.underruns == 0, "engine %d: %d underruns", e, stats.underruns);
+		FG_CHECK(stats.dropped == 0, "engine %d: %d drops", e, stats.dropped);
+		FG_CHECK(stats.firstAudibleMs >= 0, "engine %d: nothing was heard", e);
+	}
+	double separationPpm = (measuredHz[0] - measuredHz[1]) / ENGINE_DEVICE_RATE * 1e6;
+	FG_CHECK(separationPpm >= ENGINE_PPM, "the fast device measured only %.1f ppm faster than the slow one",
+		separationPpm);
+}
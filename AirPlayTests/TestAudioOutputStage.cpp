@@ -0,0 +1,143 @@
+#include "FgTest.h"
+#include "CAudioOutputStage.h"
+
+#include <math.h>
+#include <string.h>
+
+// CAudioOutputStage: exact gain and delay with the limiter off, a burst held
+// under the limiter curve with it on, and the cost per frame against the
+// per-sample loop sdlAudioCallback ran before the stage. That loop worked on
+// 16-bit samples, so it is timed on those; the stage works on float, and the
+// device conversion it leaves to SDL is not counted.
+
+#define STAGE_RATE 48000
+#define STAGE_CHANNELS 2
+#define STAGE_BLOCK_FRAMES 512			// CAudioEngine::DEVICE_PERIOD_FRAMES
+#define STAGE_BENCH_SECONDS 2
+#define STAGE_BENCH_REPEATS 20
+#define STAGE_LEGACY_MAX_VOLUME 128		// SDL_MIX_MAXVOLUME
+
+// The old callback's loop: peak meter, two integer volumes, clamping
+static void legacyOutputLoop(const short* src, short* dst, int count, int volume, int localVolume, float* pPeak)
+{
+	float peak = *pPeak;
+	for (int i = 0; i < count; i++) {
+		int absSrc = (src[i] < 0) ? -src[i] : src[i];
+		float level = absSrc / 32768.0f;
+		if (level > peak) {
+			peak = level;
+		}
+		int sample = ((int)src[i] * volume) / STAGE_LEGACY_MAX_VOLUME;
+		sample = (sample * localVolume) / STAGE_LEGACY_MAX_VOLUME;
+		if (sample > 32767) sample = 32767;
+		else if (sample < -32768) sample = -32768;
+		dst[i] = (short)sample;
+	}
+	*pPeak = peak;
+}
+
+// Music-like stereo: two tones with a slow swell, peaking near full scale
+static void makeProgramme(std::vector<float>& samples, unsigned int frames)
+{
+	samples.resize(frames * STAGE_CHANNELS);
+	for (unsigned int n = 0; n < frames; n++) {
+		double t = (double)n / STAGE_RATE;
+		double level = 0.45 + 0.5 * sin(2 * 3.14159265358979 * 0.7 * t) * sin(2 * 3.14159265358979 * 0.7 * t);
+		samples[n * 2] = (float)(level * sin(2 * 3.14159265358979 * 440.0 * t));
+		samples[n * 2 + 1] = (float)(level * sin(2 * 3.14159265358979 * 660.0 * t + 1.0));
+	}
+}
+
+FG_TEST(audio_output_stage_gain_and_delay)
+{
+	CAudioOutputStage stage;
+	FG_REQUIRE(stage.init(STAGE_RATE, STAGE_CHANNELS), "cannot set up the output stage");
+	const unsigned int delay = stage.lookaheadFrames();
+	std::vector<float> in;
+	makeProgramme(in, STAGE_RATE / 4);
+	std::vector<float> out = in;
+	for (unsigned int f = 0; f < out.size() / STAGE_CHANNELS; f += STAGE_BLOCK_FRAMES) {
+		unsigned int frames = (unsigned int)(out.size() / STAGE_CHANNELS) - f;
+		frames = frames < STAGE_BLOCK_FRAMES ? frames : STAGE_BLOCK_FRAMES;
+		stage.process(&out[f * STAGE_CHANNELS], frames, 0.5f, false);
+	}
+	size_t wrong = 0;
+	for (size_t i = 0; i < out.size(); i++) {
+		float expected = i < delay * STAGE_CHANNELS ? 0.0f : in[i - delay * STAGE_CHANNELS] * 0.5f;
+		wrong += out[i] != expected;
+	}
+	FG_CHECK(wrong == 0, "%d of %d samples are not the input delayed by %u frames at half gain", (int)wrong,
+		(int)out.size(), delay);
+
+	// A burst out of silence: the gain is down by the time it plays, and
+	// stays near the static curve
+	const float burst = 0.977f;
+	const float curve = CAudioOutputStage::LIMITER_THRESHOLD +
+		(burst - CAudioOutputStage::LIMITER_THRESHOLD) * CAudioOutputStage::LIMITER_RATIO;
+	stage.reset();
+	std::vector<float> block(STAGE_BLOCK_FRAMES * STAGE_CHANNELS, 0.0f);
+	float loudest = 0.0f;
+	for (int b = 0; b < 40; b++) {
+		for (unsigned int n = 0; n < STAGE_BLOCK_FRAMES; n++) {
+			float v = b < 2 ? 0.0f : burst * (float)sin(2 * 3.14159265358979 * 1000.0 * (b * STAGE_BLOCK_FRAMES + n) / STAGE_RATE);
+			block[n * 2] = v;
+			block[n * 2 + 1] = v;
+		}
+		stage.process(&block[0], STAGE_BLOCK_FRAMES, 1.0f, true);
+		for (size_t i = 0; i < block.size(); i++) {
+			loudest = fabsf(block[i]) > loudest ? fabsf(block[i]) : loudest;
+		}
+	}
+	printf("  a %.3f burst plays at %.3f; the static curve gives %.3f\n", burst, loudest, curve);
+	FG_CHECK(loudest <= curve * 1.01f, "the limited burst peaks at %.3f, over the %.3f curve", loudest, curve);
+	FG_CHECK(loudest >= curve * 0.95f, "the limited burst peaks at %.3f, well under the %.3f curve", loudest, curve);
+}
+
+FG_BENCH(audio_output_stage_throughput)
+{
+	const unsigned int frames = STAGE_RATE * STAGE_BENCH_SECONDS;
+	const unsigned int blocks = frames / STAGE_BLOCK_FRAMES;
+	const unsigned long long total = (unsigned long long)blocks * STAGE_BLOCK_FRAMES * STAGE_BENCH_REPEATS;
+	std::vector<float> programme;
+	makeProgramme(programme, frames);
+	std::vector<short> programme16(programme.size());
+	for (size_t i = 0; i < programme.size(); i++) {
+		programme16[i] = (short)floorf(programme[i] * 32767.0f + 0.5f);
+	}
+
+	// Volume 100 of 128 and the local volume at 96 of 128
+	std::vector<short> out16(STAGE_BLOCK_FRAMES * STAGE_CHANNELS);
+	float legacyPeak = 0.0f;
+	double startMs = fgTestNowMs();
+	for (int r = 0; r < STAGE_BENCH_REPEATS; r++) {
+		for (unsigned int b = 0; b < blocks; b++) {
+			legacyOutputLoop(&programme16[b * STAGE_BLOCK_FRAMES * STAGE_CHANNELS], &out16[0],
+				STAGE_BLOCK_FRAMES * STAGE_CHANNELS, 100, 96, &legacyPeak);
+		}
+	}
+	double legacyNs = (fgTestNowMs() - startMs) * 1e6 / total;
+	printf("  %-26s %5.2f ns per frame\n", "old per-sample loop:", legacyNs);
+
+	const float gain = (100.0f / STAGE_LEGACY_MAX_VOLUME) * (96.0f / STAGE_LEGACY_MAX_VOLUME);
+	for (int limit = 0; limit < 2; limit++) {
+		CAudioOutputStage stage;
+		FG_REQUIRE(stage.init(STAGE_RATE, STAGE_CHANNELS), "cannot set up the output stage");
+		std::vector<float> block(STAGE_BLOCK_FRAMES * STAGE_CHANNELS);
+		float stagePeak = 0.0f;
+		double elapsedMs = 0;
+		for (int r = 0; r < STAGE_BENCH_REPEATS; r++) {
+			for (unsigned int b = 0; b < blocks; b++) {
+				// The copy stands for the resampler writing the block
+				memcpy(&block[0], &programme[b * STAGE_BLOCK_FRAMES * STAGE_CHANNELS], block.size() * sizeof(float));
+				startMs = fgTestNowMs();
+				stage.process(&block[0], STAGE_BLOCK_FRAMES, gain, limit != 0);
+				elapsedMs += fgTestNowMs() - startMs;
+				stagePeak = stage.blockPeak() > stagePeak ? stage.blockPeak() : stagePeak;
+			}
+		}
+		printf("  %-26s %5.2f ns per frame\n", limit ? "stage, limiter on:" : "stage, limiter off:",
+			elapsedMs * 1e6 / total);
+		// Both meters read the programme, to the 16-bit step
+		FG_CHECK(fabsf(stagePeak - legacyPeak) < 2.0f / 32768, "peak %.5f, the old loop's %.5f", stagePeak, legacyPeak);
+	}
+}
@@ -0,0 +1,152 @@
+#include "FgTest.h"
+#include "AudioEldStream.h"
+#include "stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "logger.h"
+#include "raop_buffer.h"
+#include "crypto/crypto.h"
+#include "sha512.h"
+}
+
+// Packets per second through the audio receive path, replaying the recorded
+// stream data\audio_eld.rtp over and over with its sequence numbers and
+// timestamps carried on. Three figures:
+// - queue and take, what the receive thread does per packet
+// - queue, take and decode, the whole path with decryption and AAC-ELD
+// - the packet decryption alone, once with the key schedule built and the
+//   buffer allocated per packet as raop_buffer_queue did before the session
+//   kept them, once the way it is done now
+// Every replayed packet must play, and both decryptions must agree.
+
+#define QUEUE_BENCH_ROUNDS 250			// Of the 200 recorded packets
+#define QUEUE_BENCH_DECODE_ROUNDS 25
+#define QUEUE_BENCH_PACKET_LEN 2048
+
+// A recorded packet as it is sent again in replay round round
+static void replayPacket(const std::vector<unsigned char>& recorded, int round, int count,
+	std::vector<unsigned char>& packet)
+{
+	packet = recorded;
+	unsigned short seqnum = (unsigned short)(((packet[2] << 8) | packet[3]) + round * count);
+	unsigned int timestamp = ((unsigned int)packet[4] << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+	timestamp += (unsigned int)(round * count * AUDIO_ELD_FRAME_SAMPLES);
+	packet[2] = (unsigned char)(seqnum >> 8);
+	packet[3] = (unsigned char)seqnum;
+	packet[4] = (unsigned char)(timestamp >> 24);
+	packet[5] = (unsigned char)(timestamp >> 16);
+	packet[6] = (unsigned char)(timestamp >> 8);
+	packet[7] = (unsigned char)timestamp;
+}
+
+// Queues rounds replays and returns the packets that played, decoded or not
+static int replay(const std::vector<std::vector<unsigned char> >& recorded, int rounds, bool decode, double* pElapsedMs)
+{
+	logger_t* logger = logger_init();
+	raop_audio_config_t config = { 64, 0, 0, 0, PCM_SAMPLE_FORMAT_S16 };
+	raop_buffer_t* buffer = raop_buffer_init(logger, &config, s_audioEldAesKey, s_audioEldAesIv, s_audioEldEcdh);
+	if (buffer == NULL) {
+		logger_destroy(logger);
+		return 0;
+	}
+	raop_buffer_set_audio_format(buffer, AUDIO_FORMAT_ELD_44100_STEREO);
+
+	// Rewritten up front, so the timing is the buffer's alone
+	int count = (int)recorded.size();
+	std::vector<std::vector<unsigned char> > packets(rounds * count);
+	for (int i = 0; i < rounds * count; i++) {
+		replayPacket(recorded[i % count], i / count, count, packets[i]);
+	}
+
+	int played = 0;
+	double startMs = fgTestNowMs();
+	for (size_t i = 0; i < packets.size(); i++) {
+		raop_buffer_queue(buffer, &packets[i][0], (unsigned short)packets[i].size(), NULL);
+		while (raop_buffer_take(buffer, 0)) {
+			if (decode) {
+				int length = 0;
+				unsigned int pts = 0;
+				raop_buffer_format_t format;
+				raop_buffer_decode(buffer, &length, &pts, &format);
+			}
+			played++;
+		}
+	}
+	*pElapsedMs = fgTestNowMs() - startMs;
+
+	raop_buffer_destroy(buffer);
+	logger_destroy(logger);
+	return played;
+}
+
+FG_BENCH(raop_buffer_queue_throughput)
+{
+	std::vector<std::vector<unsigned char> > recorded;
+	FG_REQUIRE(readAudioEldPackets(recorded), "cannot read %s", fgTestDataPath("audio_eld.rtp").c_str());
+	int count = (int)recorded.size();
+
+	double elapsedMs = 0;
+	int played = replay(recorded, QUEUE_BENCH_ROUNDS, false, &elapsedMs);
+	printf("  %-34s %9.0f packets/s\n", "queue and take:", played * 1000.0 / elapsedMs);
+	FG_CHECK(played == QUEUE_BENCH_ROUNDS * count, "%d of %d packets played", played, QUEUE_BENCH_ROUNDS * count);
+
+	played = replay(recorded, QUEUE_BENCH_DECODE_ROUNDS, true, &elapsedMs);
+	printf("  %-34s %9.0f packets/s\n", "queue, take and decode:", played * 1000.0 / elapsedMs);
+	FG_CHECK(played == QUEUE_BENCH_DECODE_ROUNDS * count, "%d of %d packets played", played,
+		QUEUE_BENCH_DECODE_ROUNDS * count);
+
+	// The session key, derived as raop_buffer_init_key_iv does
+	unsigned char key[64];
+	sha512_context sha;
+	sha512_init(&sha);
+	sha512_update(&sha, s_audioEldAesKey, 16);
+	sha512_update(&sha, s_audioEldEcdh, 32);
+	sha512_final(&sha, key);
+
+	unsigned int crcPerPacket = 0;
+	double startMs = fgTestNowMs();
+	for (int round = 0; round < QUEUE_BENCH_ROUNDS; round++) {
+		for (int i = 0; i < count; i++) {
+			const std::vector<unsigned char>& packet = recorded[i];
+			int payloadLen = (int)packet.size() - 12;
+			AES_CTX aes;
+			AES_set_key(&aes, key, s_audioEldAesIv, AES_MODE_128);
+			AES_convert_key(&aes);
+			unsigned char* plain = (unsigned char*)malloc(QUEUE_BENCH_PACKET_LEN);
+			memset(plain, 0, QUEUE_BENCH_PACKET_LEN);
+			AES_cbc_decrypt(&aes, &packet[12], plain, payloadLen / 16 * 16);
+			if (round == 0) {
+				crcPerPacket = fgTestCrc32(plain, payloadLen / 16 * 16, crcPerPacket);
+			}
+			free(plain);
+		}
+	}
+	double perPacketMs = fgTestNowMs() - startMs;
+
+	unsigned int crcPerSession = 0;
+	AES_CTX session;
+	AES_set_key(&session, key, s_audioEldAesIv, AES_MODE_128);
+	AES_convert_key(&session);
+	unsigned char plain[QUEUE_BENCH_PACKET_LEN];
+	startMs = fgTestNowMs();
+	for (int round = 0; round < QUEUE_BENCH_ROUNDS; round++) {
+		for (int i = 0; i < count; i++) {
+			const std::vector<unsigned char>& packet = recorded[i];
+			int payloadLen = (int)packet.size() - 12;
+			memcpy(session.iv, s_audioEldAesIv, AES_IV_SIZE);
+			AES_cbc_decrypt(&session, &packet[12], plain, payloadLen / 16 * 16);
+			if (round == 0) {
+				crcPerSession = fgTestCrc32(plain, payloadLen / 16 * 16, crcPerSession);
+			}
+		}
+	}
+	double perSessionMs = fgTestNowMs() - startMs;
+
+	int decrypted = QUEUE_BENCH_ROUNDS * count;
+	printf("  %-34s %9.0f packets/s\n", "decrypt, key set up per packet:", decrypted * 1000.0 / perPacketMs);
+	printf("  %-34s %9.0f packets/s\n", "decrypt, key set up per session:", decrypted * 1000.0 / perSessionMs);
+	FG_CHECK(crcPerPacket == crcPerSession, "the decryptions differ: crc %08x against %08x", crcPerPacket, crcPerSession);
+}
@@ -0,0 +1,124 @@
+#include "FgTest.h"
+#include "AudioEldStream.h"
+#include "stream.h"
+
+#include <string.h>
+
+extern "C" {
+#include "logger.h"
+#include "raop_buffer.h"
+}
+
+// Reordering in the audio receive path must not change what is heard. The
+// recorded stream data\audio_eld.rtp, AAC-ELD 44100 stereo, is queued into
+// raop_buffer with its packets shuffled within fixed windows and drained
+// after every packet, as the receive thread does. The decoded PCM and
+// timestamps must match those of the same stream queued in order, to the byte.
+
+typedef struct SAudioRun {
+	std::vector<unsigned char> pcm;
+	std::vector<unsigned int> pts;		// Of every frame that played
+	raop_buffer_stats_t stats;
+} SAudioRun;
+
+static void drain(raop_buffer_t* buffer, SAudioRun* pRun)
+{
+	while (raop_buffer_take(buffer, 0)) {
+		int length = 0;
+		unsigned int pts = 0;
+		raop_buffer_format_t format;
+		const unsigned char* pcm = (const unsigned char*)raop_buffer_decode(buffer, &length, &pts, &format);
+		if (pcm != NULL) {
+			pRun->pcm.insert(pRun->pcm.end(), pcm, pcm + length);
+			pRun->pts.push_back(pts);
+		}
+	}
+}
+
+// window 1 queues in order. The windows are well inside the resend wait, so
+// the buffer holds a missing packet until the shuffle delivers it.
+static bool runShuffled(const std::vector<std::vector<unsigned char> >& packets, int window,
+	unsigned long long seed, SAudioRun* pRun)
+{
+	std::vector<size_t> order(packets.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	// Fisher-Yates within each window, with xorshift64 so every C runtime
+	// shuffles alike. The first packet stays first: the buffer starts at
+	// whichever packet arrives first, and anything older is late by then.
+	for (size_t start = 1; window > 1 && start < order.size(); start += window) {
+		size_t count = order.size() - start < (size_t)window ? order.size() - start : (size_t)window;
+		for (size_t j = count - 1; j > 0; j--) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			size_t k = (size_t)(seed % (j + 1));
+			size_t t = order[start + j];
+			order[start + j] = order[start + k];
+			order[start + k] = t;
+		}
+	}
+
+	logger_t* logger = logger_init();
+	raop_audio_config_t config = { 64, 0, 1000, 0, PCM_SAMPLE_FORMAT_S16 };
+	raop_buffer_t* buffer = raop_buffer_init(logger, &config, s_audioEldAesKey, s_audioEldAesIv, s_audioEldEcdh);
+	if (buffer == NULL) {
+		logger_destroy(logger);
+		return false;
+	}
+	raop_buffer_set_audio_format(buffer, AUDIO_FORMAT_ELD_44100_STEREO);
+	for (size_t i = 0; i < order.size(); i++) {
+		std::vector<unsigned char> packet = packets[order[i]];
+		raop_buffer_queue(buffer, &packet[0], (unsigned short)packet.size(), NULL);
+		drain(buffer, pRun);
+	}
+	raop_buffer_get_stats(buffer, &pRun->stats);
+	raop_buffer_destroy(buffer);
+	logger_destroy(logger);
+	return true;
+}
+
+FG_TEST(raop_buffer_shuffled_arrival_decodes_alike)
+{
+	std::vector<std::vector<unsigned char> > packets;
+	FG_REQUIRE(readAudioEldPackets(packets), "cannot read %s", fgTestDataPath("audio_eld.rtp").c_str());
+
+	SAudioRun reference;
+	FG_REQUIRE(runShuffled(packets, 1, 0, &reference), "cannot create the audio buffer");
+	// Every packet plays, less the frame the decoder's priming takes up
+	FG_REQUIRE(reference.pts.size() + 1 >= packets.size() && reference.pts.size() <= packets.size(),
+		"%d of %d packets played in order", (int)reference.pts.size(), (int)packets.size());
+	FG_REQUIRE(reference.stats.lost == 0 && reference.stats.concealed == 0,
+		"in order: %llu lost, %llu concealed", (unsigned long long)reference.stats.lost,
+		(unsigned long long)reference.stats.concealed);
+	long long energy = 0;
+	for (size_t i = 0; i + 1 < reference.pcm.size(); i += 2) {
+		short sample = (short)(reference.pcm[i] | (reference.pcm[i + 1] << 8));
+		energy += sample < 0 ? -sample : sample;
+	}
+	FG_REQUIRE(energy > 0, "the stream decodes to silence; check the key and the audio format");
+	printf("  in order: %d frames, %d PCM bytes, crc %08x\n", (int)reference.pts.size(),
+		(int)reference.pcm.size(), fgTestCrc32(&reference.pcm[0], reference.pcm.size()));
+
+	const int windows[] = { 2, 3, 4, 8, 16 };
+	for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+		for (unsigned long long seed = 1; seed <= 3; seed++) {
+			SAudioRun run;
+			FG_REQUIRE(runShuffled(packets, windows[w], seed * 0x9E3779B97F4A7C15ull, &run),
+				"cannot create the audio buffer");
+			size_t differ = 0;
+			while (differ < run.pcm.size() && differ < reference.pcm.size() && run.pcm[differ] == reference.pcm[differ]) {
+				differ++;
+			}
+			FG_CHECK(run.pcm.size() == reference.pcm.size() && differ == run.pcm.size(),
+				"window %d seed %d: %d PCM bytes, first difference at byte %d", windows[w], (int)seed,
+				(int)run.pcm.size(), (int)differ);
+			FG_CHECK(run.pts == reference.pts, "window %d seed %d: timestamps differ", windows[w], (int)seed);
+			FG_CHECK(run.stats.lost == 0 && run.stats.concealed == 0 && run.stats.late == 0,
+				"window %d seed %d: %llu lost, %llu concealed, %llu late", windows[w], (int)seed,
+				(unsigned long long)run.stats.lost, (unsigned long long)run.stats.concealed,
+				(unsigned long long)run.stats.late);
+		}
+	}
+}
@@ -0,0 +1,214 @@
+#include "FgTest.h"
+#include "stream.h"
+
+#include <map>
+#include <string.h>
+
+extern "C" {
+#include "logger.h"
+#include "raop_buffer.h"
+}
+
+// Soak of the audio reorder buffer across its runtime settings. One lossy,
+// jittered sender trace is replayed on a simulated clock through every
+// combination of window length, pre-roll and resend wait, and the table of
+// underruns against latency is printed. Resends come back through the
+// callback like the sender's, some of them lost too. Packets are taken and
+// not decoded: decoding does not change when they play.
+
+#define SOAK_PACKETS 10000
+#define SOAK_PACKET_US 10884		// 480 samples at 44100 Hz
+#define SOAK_TICK_US 1000			// How often the receive thread wakes
+#define SOAK_JITTER_US 30000		// Uniform network delay on top of the send time
+#define SOAK_BURST_CHANCE 0.01		// Per packet; bursts lose 1 to 3 packets, about 2% overall
+#define SOAK_RESEND_LOSS 0.2
+#define SOAK_RESEND_MIN_US 4000		// Round trip of a resend
+#define SOAK_RESEND_MAX_US 8000
+
+typedef struct SSoakSetting {
+	unsigned int length;
+	unsigned int preroll;
+	unsigned int latencyMs;
+} SSoakSetting;
+
+typedef struct SSoakResult {
+	int played;
+	int underruns;
+	double meanLatencyMs;
+	double maxLatencyMs;
+	raop_buffer_stats_t stats;
+} SSoakResult;
+
+typedef struct SSoakState {
+	uint64_t nowUs;
+	unsigned long long rng;
+	std::multimap<uint64_t, int> arrivals;	// Arrival time to sequence number
+} SSoakState;
+
+static double soakUniform(SSoakState* pState)
+{
+	unsigned long long x = pState->rng;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	pState->rng = x;
+	return ((x >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static uint64_t soakClock(void* opaque)
+{
+	return ((SSoakState*)opaque)->nowUs;
+}
+
+static int soakResend(void* opaque, unsigned short seqno, unsigned short count)
+{
+	SSoakState* pState = (SSoakState*)opaque;
+	for (unsigned short i = 0; i < count; i++) {
+		if (soakUniform(pState) >= SOAK_RESEND_LOSS) {
+			uint64_t delay = SOAK_RESEND_MIN_US + (uint64_t)(soakUniform(pState) * (SOAK_RESEND_MAX_US - SOAK_RESEND_MIN_US));
+			pState->arrivals.insert(std::make_pair(pState->nowUs + delay, (int)(unsigned short)(seqno + i)));
+		}
+	}
+	return 0;
+}
+
+static uint64_t sendTimeUs(int k)
+{
+	return 1000000 + (uint64_t)k * SOAK_PACKET_US;
+}
+
+static bool runSoak(const SSoakSetting* pSetting, SSoakResult* pResult)
+{
+	SSoakState state;
+	state.nowUs = 0;
+	state.rng = 0x2545F4914F6CDD1Dull;
+
+	// The same trace for every setting: bursts of loss, the rest delayed
+	int burst = 0;
+	for (int k = 0; k < SOAK_PACKETS; k++) {
+		if (burst > 0) {
+			burst--;
+			continue;
+		}
+		if (k > 0 && soakUniform(&state) < SOAK_BURST_CHANCE) {
+			burst = (int)(soakUniform(&state) * 3);
+			continue;
+		}
+		state.arrivals.insert(std::make_pair(sendTimeUs(k) + (uint64_t)(soakUniform(&state) * SOAK_JITTER_US), k));
+	}
+
+	logger_t* logger = logger_init();
+	raop_audio_config_t config = { pSetting->length, pSetting->preroll, pSetting->latencyMs, 0, PCM_SAMPLE_FORMAT_S16 };
+	raop_buffer_t* buffer = raop_buffer_init(logger, &config, (const unsigned char*)"0123456789abcdef",
+		(const unsigned char*)"0123456789abcdef", (const unsigned char*)"0123456789abcdef0123456789abcdef");
+	if (buffer == NULL) {
+		logger_destroy(logger);
+		return false;
+	}
+	raop_buffer_set_clock(buffer, soakClock, &state);
+
+	// Packet k is the k-th taken. The player starts on the first, then wants
+	// one every SOAK_PACKET_US; one that is not ready in time is an underrun,
+	// and the rest play that much later.
+	memset(pResult, 0, sizeof(SSoakResult));
+	uint64_t playUs = 0;
+	double sumLatencyUs = 0;
+	unsigned char packet[12 + 32];
+	for (state.nowUs = sendTimeUs(0); pResult->played < SOAK_PACKETS; state.nowUs += SOAK_TICK_US) {
+		if (state.nowUs > sendTimeUs(SOAK_PACKETS) + 10000000) {
+			break;
+		}
+		while (!state.arrivals.empty() && state.arrivals.begin()->first <= state.nowUs) {
+			int seqnum = state.arrivals.begin()->second;
+			unsigned int timestamp = (unsigned int)seqnum * 480;
+			state.arrivals.erase(state.arrivals.begin());
+			memset(packet, 0, sizeof(packet));
+			packet[0] = 0x80;
+			packet[1] = 0x60;
+			packet[2] = (unsigned char)(seqnum >> 8);
+			packet[3] = (unsigned char)seqnum;
+			packet[4] = (unsigned char)(timestamp >> 24);
+			packet[5] = (unsigned char)(timestamp >> 16);
+			packet[6] = (unsigned char)(timestamp >> 8);
+			packet[7] = (unsigned char)timestamp;
+			raop_buffer_queue(buffer, packet, sizeof(packet), NULL);
+		}
+		while (raop_buffer_take(buffer, 0)) {
+			int k = pResult->played++;
+			uint64_t dueUs = playUs + SOAK_PACKET_US;
+			if (k == 0) {
+				playUs = state.nowUs;
+			} else if (state.nowUs > dueUs) {
+				pResult->underruns++;
+				playUs = state.nowUs;
+			} else {
+				playUs = dueUs;
+			}
+			double latencyUs = (double)(playUs - sendTimeUs(k));
+			sumLatencyUs += latencyUs;
+			if (latencyUs > pResult->maxLatencyMs * 1000) {
+				pResult->maxLatencyMs = latencyUs / 1000;
+			}
+		}
+		raop_buffer_handle_resends(buffer, soakResend, &state);
+	}
+	pResult->meanLatencyMs = pResult->played ? sumLatencyUs / pResult->played / 1000 : 0;
+	raop_buffer_get_stats(buffer, &pResult->stats);
+
+	raop_buffer_destroy(buffer);
+	logger_destroy(logger);
+	return true;
+}
+
+FG_TEST(raop_buffer_soak_lossy_trace)
+{
+	const unsigned int lengths[] = { 32, 64, 256 };
+	const unsigned int prerolls[] = { 0, 4, 16 };
+	const unsigned int latencies[] = { 0, 50, 150 };
+	const int nLengths = sizeof(lengths) / sizeof(lengths[0]);
+	const int nPrerolls = sizeof(prerolls) / sizeof(prerolls[0]);
+	const int nLatencies = sizeof(latencies) / sizeof(latencies[0]);
+	SSoakResult results[3][3][3];
+
+	printf("  %6s %7s %6s | %9s %6s %9s %11s %10s\n",
+		"length", "preroll", "wait", "underruns", "lost", "recovered", "latency ms", "max ms");
+	for (int l = 0; l < nLengths; l++) {
+		for (int p = 0; p < nPrerolls; p++) {
+			for (int w = 0; w < nLatencies; w++) {
+				SSoakSetting setting = { lengths[l], prerolls[p], latencies[w] };
+				SSoakResult* pResult = &results[l][p][w];
+				FG_REQUIRE(runSoak(&setting, pResult), "cannot create the audio buffer");
+				printf("  %6u %7u %6u | %9d %6llu %9llu %11.1f %10.1f\n",
+					setting.length, setting.preroll, setting.latencyMs, pResult->underruns,
+					(unsigned long long)pResult->stats.lost, (unsigned long long)pResult->stats.recovered,
+					pResult->meanLatencyMs, pResult->maxLatencyMs);
+				// Every packet plays once, arrived or not; a flush would skip some
+				FG_CHECK(pResult->played == SOAK_PACKETS, "length %u preroll %u wait %u: %d of %d played",
+					setting.length, setting.preroll, setting.latencyMs, pResult->played, SOAK_PACKETS);
+			}
+		}
+	}
+
+	for (int l = 0; l < nLengths; l++) {
+		for (int p = 0; p < nPrerolls; p++) {
+			const SSoakResult* pNoWait = &results[l][p][0];
+			const SSoakResult* pWait = &results[l][p][nLatencies - 1];
+			// Waiting for resends must save packets, and cost latency for it
+			FG_CHECK(pWait->stats.lost * 4 < pNoWait->stats.lost,
+				"length %u preroll %u: %llu lost with a %u ms wait, %llu without", lengths[l], prerolls[p],
+				(unsigned long long)pWait->stats.lost, latencies[nLatencies - 1], (unsigned long long)pNoWait->stats.lost);
+			FG_CHECK(pWait->stats.recovered > 0, "length %u preroll %u: nothing recovered", lengths[l], prerolls[p]);
+			FG_CHECK(pWait->meanLatencyMs > pNoWait->meanLatencyMs, "length %u preroll %u: %.1f ms with a wait, %.1f without",
+				lengths[l], prerolls[p], pWait->meanLatencyMs, pNoWait->meanLatencyMs);
+		}
+	}
+	for (int l = 0; l < nLengths; l++) {
+		for (int w = 0; w < nLatencies; w++) {
+			// A deeper pre-roll trades latency for fewer underruns
+			const SSoakResult* pShallow = &results[l][0][w];
+			const SSoakResult* pDeep = &results[l][nPrerolls - 1][w];
+			FG_CHECK(pDeep->underruns <= pShallow->underruns, "length %u wait %u: %d underruns with pre-roll %u, %d with %u",
+				lengths[l], latencies[w], pDeep->underruns, prerolls[nPrerolls - 1], pShallow->underruns, prerolls[0]);
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#include "FgTest.h"
+
+#include <math.h>
+
+extern "C" {
+#include "logger.h"
+#include "clock_sync.h"
+}
+
+// Drives clock_sync with synthetic timing exchanges: a sender clock with a
+// known skew and offset, and exponential queueing on both legs. No sockets.
+
+typedef struct SClockCase {
+	double skewPpm;
+	double jitterMs;		// Mean of the exponential queueing per leg
+	int stepAt;				// Exchange at which the sender clock jumps 2 s, -1 for none
+	double maxMeanErrorUs;
+	double maxErrorUs;
+	double maxDriftErrorPpm;
+} SClockCase;
+
+typedef struct SClockResult {
+	double meanErrorUs;
+	double maxErrorUs;
+	double driftPpm;
+} SClockResult;
+
+// xorshift64, so the run is the same with every C runtime
+static double uniform(unsigned long long* pState)
+{
+	unsigned long long x = *pState;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*pState = x;
+	return ((x >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static void runClockCase(const SClockCase* pCase, SClockResult* pResult)
+{
+	const double senderBaseNs = 3.9e18;
+	const double localBaseNs = 5e12;
+	const double wireNs = 1e6;
+	const double turnaroundNs = 50e3;
+	const int exchanges = 600;
+	unsigned long long rng = 0x9E3779B97F4A7C15ull;
+
+	logger_t* logger = logger_init();
+	clock_sync_t* clockSync = clock_sync_init(logger, "test");
+
+	double stepNs = 0;
+	double sumErrorNs = 0;
+	double maxErrorNs = 0;
+	int measured = 0;
+	for (int k = 0; k < exchanges; k++) {
+		if (k == pCase->stepAt) {
+			stepNs = 2e9;
+		}
+		double rate = 1.0 + pCase->skewPpm * 1e-6;
+		double t = k * 1e9;
+		double d1 = wireNs - pCase->jitterMs * 1e6 * log(uniform(&rng));
+		double d2 = wireNs - pCase->jitterMs * 1e6 * log(uniform(&rng));
+		uint64_t t1 = (uint64_t)(localBaseNs + t);
+		uint64_t t2 = (uint64_t)(senderBaseNs + stepNs + (t + d1) * rate);
+		uint64_t t3 = (uint64_t)(senderBaseNs + stepNs + (t + d1 + turnaroundNs) * rate);
+		uint64_t t4 = (uint64_t)(localBaseNs + t + d1 + turnaroundNs + d2);
+		clock_sync_add_exchange(clockSync, t1, t2, t3, t4);
+
+		// Map a sender time half a second on, as a frame between exchanges
+		double tc = t + 0.5e9;
+		uint64_t senderNs = (uint64_t)(senderBaseNs + stepNs + tc * rate);
+		double errorNs = (double)(int64_t)(clock_sync_sender_to_local_ns(clockSync, senderNs) - (uint64_t)(localBaseNs + tc));
+
+		// Skip the first minute, and the minute after a step, while the loop settles
+		bool settled = k >= 60 && (pCase->stepAt < 0 || k < pCase->stepAt || k > pCase->stepAt + 60);
+		if (settled) {
+			sumErrorNs += fabs(errorNs);
+			maxErrorNs = fmax(maxErrorNs, fabs(errorNs));
+			measured++;
+		}
+	}
+
+	clock_sync_stats_t stats;
+	clock_sync_get_stats(clockSync, &stats);
+	pResult->meanErrorUs = sumErrorNs / measured / 1e3;
+	pResult->maxErrorUs = maxErrorNs / 1e3;
+	pResult->driftPpm = stats.drift_ppm;
+
+	clock_sync_destroy(clockSync);
+	logger_destroy(logger);
+}
+
+// The skew cases share one noise sequence, so their errors should match: the
+// loop must follow any constant skew equally well. Bounds hold for this seed;
+// across seeds the 2 ms mean error spreads to about 400 us at the 95th
+// percentile.
+FG_TEST(clock_sync_tracks_skewed_sender)
+{
+	const SClockCase cases[] = {
+		//  skew  jitter step  mean   max   drift
+		{    0.0,  2.0,   -1,  170,  1000,  10 },
+		{  100.0,  2.0,   -1,  170,  1000,  10 },
+		{  -50.0,  2.0,   -1,  170,  1000,  10 },
+		{   30.0,  0.2,   -1,   15,   100,   1 },
+		{  100.0,  2.0,  300,  250,  1500,  10 },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const SClockCase* pCase = &cases[i];
+		SClockResult result;
+		runClockCase(pCase, &result);
+		printf("  skew %+6.1f ppm, jitter %.1f ms, step %4d: mean error %6.1f us, max %7.1f us, drift %+7.2f ppm\n",
+			pCase->skewPpm, pCase->jitterMs, pCase->stepAt, result.meanErrorUs, result.maxErrorUs, result.driftPpm);
+		FG_CHECK(result.meanErrorUs <= pCase->maxMeanErrorUs, "case %d mean error %.1f us", (int)i, result.meanErrorUs);
+		FG_CHECK(result.maxErrorUs <= pCase->maxErrorUs, "case %d max error %.1f us", (int)i, result.maxErrorUs);
+		FG_CHECK(fabs(result.driftPpm - pCase->skewPpm) <= pCase->maxDriftErrorPpm,
+			"case %d drift %.2f ppm for a %.1f ppm skew", (int)i, result.driftPpm, pCase->skewPpm);
+	}
+}
@@ -0,0 +1,155 @@
+#include "FgTest.h"
+#include "stream.h"
+
+#include <winternl.h>
+
+extern "C" {
+#include "logger.h"
+#include "netutils.h"
+#include "raop_rtp.h"
+#include "raop_rtp_mirror.h"
+}
+
+// An idle connected session must leave its worker threads blocked: the
+// mirror, audio and timing loops wait on their sockets and a wakeup, not on
+// a polling timeout. Sessions are started against a loopback "sender" whose
+// timing port takes requests and never answers, nothing else is sent, and
+// the context switches of the whole process are counted over a few seconds.
+// Each session's stop must also return promptly.
+
+#define IDLE_SETTLE_MS 500
+#define IDLE_MEASURE_MS 2000
+// Each blocked loop still wakes about once a second for timing or stats;
+// polling loops woke about a thousand times a second each
+#define IDLE_MAX_SWITCHES_PER_SEC 20.0
+#define IDLE_MAX_STOP_MS 250.0
+
+// SYSTEM_THREAD_INFORMATION, with the field winternl.h leaves reserved named
+typedef struct SFgThreadInformation {
+	LARGE_INTEGER kernelTime;
+	LARGE_INTEGER userTime;
+	LARGE_INTEGER createTime;
+	ULONG waitTime;
+	PVOID startAddress;
+	CLIENT_ID clientId;
+	LONG priority;
+	LONG basePriority;
+	ULONG contextSwitches;
+	ULONG threadState;
+	ULONG waitReason;
+} SFgThreadInformation;
+
+typedef NTSTATUS (NTAPI* PFN_NT_QUERY_SYSTEM_INFORMATION)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+
+// Context switches of every thread in this process since it started. Threads
+// that have exited drop out, so compare counts taken while the same threads run.
+static bool processContextSwitches(unsigned long long* pCount)
+{
+	static PFN_NT_QUERY_SYSTEM_INFORMATION pfnQuery = (PFN_NT_QUERY_SYSTEM_INFORMATION)
+		GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtQuerySystemInformation");
+	if (pfnQuery == NULL) {
+		return false;
+	}
+
+	std::vector<unsigned char> info(1 << 20);
+	ULONG needed = 0;
+	NTSTATUS status;
+	while ((status = pfnQuery(SystemProcessInformation, &info[0], (ULONG)info.size(), &needed)) == (NTSTATUS)0xC0000004L) {
+		info.resize(needed > info.size() ? needed + 65536 : info.size() * 2);
+	}
+	if (status < 0) {
+		return false;
+	}
+
+	HANDLE processId = (HANDLE)(ULONG_PTR)GetCurrentProcessId();
+	size_t offset = 0;
+	for (;;) {
+		const SYSTEM_PROCESS_INFORMATION* pProcess = (const SYSTEM_PROCESS_INFORMATION*)&info[offset];
+		if (pProcess->UniqueProcessId == processId) {
+			const SFgThreadInformation* pThreads = (const SFgThreadInformation*)(pProcess + 1);
+			*pCount = 0;
+			for (ULONG i = 0; i < pProcess->NumberOfThreads; i++) {
+				*pCount += pThreads[i].contextSwitches;
+			}
+			return true;
+		}
+		if (pProcess->NextEntryOffset == 0) {
+			return false;
+		}
+		offset += pProcess->NextEntryOffset;
+	}
+}
+
+static bool measureSwitchesPerSec(double* pRate)
+{
+	unsigned long long before, after;
+	Sleep(IDLE_SETTLE_MS);
+	if (!processContextSwitches(&before)) {
+		return false;
+	}
+	double startMs = fgTestNowMs();
+	Sleep(IDLE_MEASURE_MS);
+	if (!processContextSwitches(&after)) {
+		return false;
+	}
+	*pRate = (after - before) * 1000.0 / (fgTestNowMs() - startMs);
+	return true;
+}
+
+FG_TEST(idle_session_threads_block)
+{
+	static const unsigned char s_key[32] = { 0 };
+	const unsigned char remote[4] = { 127, 0, 0, 1 };
+
+	FG_REQUIRE(netutils_init() == 0, "cannot start Winsock");
+	logger_t* logger = logger_init();
+	raop_callbacks_t callbacks;
+	memset(&callbacks, 0, sizeof(callbacks));
+
+	// The sender's timing and control ports: open, so the requests are not
+	// bounced back as errors, and never read
+	unsigned short senderPort = 0;
+	int senderSock = netutils_init_socket(&senderPort, 0, 1);
+	FG_REQUIRE(senderSock != -1, "cannot open the sender socket");
+
+	double baseline = 0;
+	FG_REQUIRE(measureSwitchesPerSec(&baseline), "cannot read the context switch counts");
+	printf("  no session:    %6.1f context switches/s\n", baseline);
+
+	raop_rtp_mirror_t* mirror = raop_rtp_mirror_init(logger, &callbacks, remote, sizeof(remote),
+		"idle", "idle", s_key, s_key, senderPort);
+	FG_REQUIRE(mirror != NULL, "cannot create the mirror session");
+	unsigned short timingPort = 0, dataPort = 0;
+	raop_rtp_start_mirror(mirror, 1, senderPort, &timingPort, &dataPort);
+	double mirrorRate = 0;
+	FG_CHECK(measureSwitchesPerSec(&mirrorRate), "cannot read the context switch counts");
+	double startMs = fgTestNowMs();
+	raop_rtp_mirror_stop(mirror);
+	double mirrorStopMs = fgTestNowMs() - startMs;
+	raop_rtp_mirror_destroy(mirror);
+	printf("  idle mirror:   %6.1f context switches/s, stop took %.1f ms\n", mirrorRate, mirrorStopMs);
+	FG_CHECK(mirrorRate - baseline <= IDLE_MAX_SWITCHES_PER_SEC, "idle mirror session: %.1f switches/s over the baseline",
+		mirrorRate - baseline);
+	FG_CHECK(mirrorStopMs <= IDLE_MAX_STOP_MS, "mirror stop took %.1f ms", mirrorStopMs);
+
+	raop_audio_config_t config = { RAOP_BUFFER_DEFAULT_LENGTH, 0, 100, 1, PCM_SAMPLE_FORMAT_S16 };
+	raop_rtp_t* audio = raop_rtp_init(logger, &callbacks, remote, sizeof(remote), "idle", "idle",
+		s_key, s_key + 16, s_key, senderPort, &config);
+	FG_REQUIRE(audio != NULL, "cannot create the audio session");
+	unsigned short controlPort = 0, audioTimingPort = 0, audioDataPort = 0;
+	raop_rtp_start_audio(audio, 1, senderPort, senderPort, &controlPort, &audioTimingPort, &audioDataPort);
+	double audioRate = 0;
+	FG_CHECK(measureSwitchesPerSec(&audioRate), "cannot read the context switch counts");
+	startMs = fgTestNowMs();
+	raop_rtp_stop(audio);
+	double audioStopMs = fgTestNowMs() - startMs;
+	raop_rtp_destroy(audio);
+	printf("  idle audio:    %6.1f context switches/s, stop took %.1f ms\n", audioRate, audioStopMs);
+	FG_CHECK(audioRate - baseline <= IDLE_MAX_SWITCHES_PER_SEC, "idle audio session: %.1f switches/s over the baseline",
+		audioRate - baseline);
+	FG_CHECK(audioStopMs <= IDLE_MAX_STOP_MS, "audio stop took %.1f ms", audioStopMs);
+
+	closesocket(senderSock);
+	logger_destroy(logger);
+	netutils_cleanup();
+}
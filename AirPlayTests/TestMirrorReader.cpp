@@ -0,0 +1,199 @@
+#include "FgTest.h"
+
+#include <string.h>
+
+extern "C" {
+#include "netutils.h"
+#include "wakeup.h"
+#include "mirror_reader.h"
+}
+
+// Loopback throughput of the mirror TCP reader. A writer thread sends
+// synthetic mirror packets as fast as loopback takes them, 128-byte headers
+// with 200 KB key frames among 10 KB frames, and the reader parses them the
+// way raop_rtp_mirror does: the 4-byte length, the rest of the header, the
+// payload. The same stream is also read field by field with a select() and
+// recv() for each, as the mirror thread did before the buffered reader.
+// Every payload is compared against what was sent.
+
+#define MIRROR_BENCH_FRAMES 20000
+#define MIRROR_BENCH_KEY_INTERVAL 30
+#define MIRROR_BENCH_KEY_SIZE (200 * 1024)
+#define MIRROR_BENCH_FRAME_SIZE (10 * 1024)
+#define MIRROR_BENCH_HEADER 128
+
+typedef struct SMirrorWriter {
+	int fd;
+	const unsigned char* pattern;	// MIRROR_BENCH_KEY_SIZE + 256 bytes
+	bool ok;
+} SMirrorWriter;
+
+static int frameSize(int frame)
+{
+	return frame % MIRROR_BENCH_KEY_INTERVAL == 0 ? MIRROR_BENCH_KEY_SIZE : MIRROR_BENCH_FRAME_SIZE;
+}
+
+static bool sendAll(int fd, const unsigned char* data, int length)
+{
+	while (length > 0) {
+		int ret = send(fd, (const char*)data, length, 0);
+		if (ret <= 0) {
+			return false;
+		}
+		data += ret;
+		length -= ret;
+	}
+	return true;
+}
+
+static DWORD WINAPI mirrorWriterProc(LPVOID lpParam)
+{
+	SMirrorWriter* pWriter = (SMirrorWriter*)lpParam;
+	unsigned char header[MIRROR_BENCH_HEADER];
+	pWriter->ok = true;
+	for (int frame = 0; frame < MIRROR_BENCH_FRAMES && pWriter->ok; frame++) {
+		int size = frameSize(frame);
+		memset(header, 0, sizeof(header));
+		header[0] = (unsigned char)size;
+		header[1] = (unsigned char)(size >> 8);
+		header[2] = (unsigned char)(size >> 16);
+		header[3] = (unsigned char)(size >> 24);
+		header[4] = frame % MIRROR_BENCH_KEY_INTERVAL == 0 ? 1 : 0;
+		pWriter->ok = sendAll(pWriter->fd, header, sizeof(header)) &&
+			sendAll(pWriter->fd, pWriter->pattern + (frame & 0xff), size);
+	}
+	return 0;
+}
+
+// The loopback pair: fds[0] is the sender's end, fds[1] the receiver's
+static bool openLoopback(int fds[2])
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int addrLen = sizeof(addr);
+
+	int listener = (int)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == -1) {
+		return false;
+	}
+	bool ok = bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+		getsockname(listener, (struct sockaddr*)&addr, &addrLen) == 0 &&
+		listen(listener, 1) == 0;
+	fds[0] = ok ? (int)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) : -1;
+	ok = fds[0] != -1 && connect(fds[0], (struct sockaddr*)&addr, sizeof(addr)) == 0;
+	fds[1] = ok ? (int)accept(listener, NULL, NULL) : -1;
+	closesocket(listener);
+	if (fds[1] == -1) {
+		if (fds[0] != -1) {
+			closesocket(fds[0]);
+		}
+		return false;
+	}
+	return true;
+}
+
+// The mirror thread's reads before the buffered reader: wait, then recv
+static bool readFieldExact(int fd, unsigned char* dst, int length, unsigned int* pRecvCount)
+{
+	while (length > 0) {
+		fd_set rfds;
+		struct timeval tv = { 5, 0 };
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		if (select(fd + 1, &rfds, NULL, NULL, &tv) <= 0) {
+			return false;
+		}
+		(*pRecvCount)++;
+		int ret = recv(fd, (char*)dst, length, 0);
+		if (ret <= 0) {
+			return false;
+		}
+		dst += ret;
+		length -= ret;
+	}
+	return true;
+}
+
+static void runMirrorRead(bool buffered, const unsigned char* pattern, int* pFailures)
+{
+	int fds[2] = { -1, -1 };
+	FG_REQUIRE(openLoopback(fds), "cannot open a loopback connection");
+	netutils_set_nonblocking(fds[1]);
+
+	wakeup_t* wakeup = wakeup_init();
+	mirror_reader_t* reader = mirror_reader_init(MIRROR_READER_SIZE);
+	std::vector<unsigned char> payload(MIRROR_BENCH_KEY_SIZE);
+	FG_REQUIRE(wakeup != NULL && reader != NULL, "cannot create the reader");
+	mirror_reader_reset(reader, fds[1]);
+
+	SMirrorWriter writer = { fds[0], pattern, false };
+	double startMs = fgTestNowMs();
+	HANDLE hWriter = CreateThread(NULL, 0, mirrorWriterProc, &writer, 0, NULL);
+
+	unsigned char header[MIRROR_BENCH_HEADER];
+	unsigned int fieldRecvs = 0;
+	long long bytes = 0;
+	int frame = 0;
+	int mismatched = 0;
+	bool ok = true;
+	while (ok && frame < MIRROR_BENCH_FRAMES) {
+		int size = 0;
+		if (buffered) {
+			ok = mirror_reader_read(reader, header, 4, wakeup, 5000) == 0 &&
+				mirror_reader_read(reader, header + 4, MIRROR_BENCH_HEADER - 4, wakeup, 5000) == 0;
+		} else {
+			ok = readFieldExact(fds[1], header, 4, &fieldRecvs) &&
+				readFieldExact(fds[1], header + 4, MIRROR_BENCH_HEADER - 4, &fieldRecvs);
+		}
+		if (ok) {
+			size = header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24);
+			ok = size == frameSize(frame);
+		}
+		if (ok) {
+			ok = buffered ? mirror_reader_read(reader, &payload[0], size, wakeup, 5000) == 0 :
+				readFieldExact(fds[1], &payload[0], size, &fieldRecvs);
+		}
+		if (ok) {
+			if (memcmp(&payload[0], pattern + (frame & 0xff), size) != 0) {
+				mismatched++;
+			}
+			bytes += MIRROR_BENCH_HEADER + size;
+			frame++;
+		}
+	}
+	double elapsedMs = fgTestNowMs() - startMs;
+
+	closesocket(fds[1]);
+	WaitForSingleObject(hWriter, INFINITE);
+	CloseHandle(hWriter);
+	closesocket(fds[0]);
+
+	unsigned int recvs = buffered ? mirror_reader_get_recv_count(reader) : fieldRecvs;
+	printf("  %-14s %d frames, %.0f MB in %.3f s: %7.0f Mbit/s, %.2f recv() per frame\n",
+		buffered ? "buffered:" : "field by field:", frame, bytes / 1e6, elapsedMs / 1000,
+		bytes * 8 / 1e3 / elapsedMs, (double)recvs / (frame > 0 ? frame : 1));
+	FG_CHECK(ok && frame == MIRROR_BENCH_FRAMES && writer.ok, "the stream broke off at frame %d", frame);
+	FG_CHECK(mismatched == 0, "%d payloads differ from what was sent", mismatched);
+
+	mirror_reader_destroy(reader);
+	wakeup_destroy(wakeup);
+}
+
+FG_BENCH(mirror_reader_loopback_throughput)
+{
+	FG_REQUIRE(netutils_init() == 0, "cannot start Winsock");
+	std::vector<unsigned char> pattern(MIRROR_BENCH_KEY_SIZE + 256);
+	unsigned long long rng = 0x9E3779B97F4A7C15ull;
+	for (size_t i = 0; i < pattern.size(); i++) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		pattern[i] = (unsigned char)(rng >> 32);
+	}
+
+	runMirrorRead(true, &pattern[0], pFailures);
+	runMirrorRead(false, &pattern[0], pFailures);
+	netutils_cleanup();
+}
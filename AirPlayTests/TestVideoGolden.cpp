@@ -0,0 +1,153 @@
+#include "FgTest.h"
+#include "IVideoDecoder.h"
+#include "Airplay2Def.h"
+#include "stream.h"
+
+#include <string.h>
+
+// Golden-frame conformance of the decoder backends. data\mirror_pcm.h264 is a
+// mirror stream of I_PCM and P_Skip macroblocks with a resolution change, so
+// the decoded samples are exact; tools\make_mirror_golden.py wrote it and the
+// per-plane CRCs in data\mirror_pcm.golden from the same PCM source.
+
+typedef struct SGoldenFrame {
+	int width;
+	int height;
+	unsigned int crc[3];
+} SGoldenFrame;
+
+static bool readGoldens(std::vector<SGoldenFrame>& goldens)
+{
+	std::vector<unsigned char> text;
+	if (!fgTestReadFile("mirror_pcm.golden", text)) {
+		return false;
+	}
+	text.push_back('\0');
+
+	char* context = NULL;
+	for (char* line = strtok_s((char*)&text[0], "\r\n", &context); line != NULL; line = strtok_s(NULL, "\r\n", &context)) {
+		SGoldenFrame golden;
+		int frame;
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%d %d %d %x %x %x", &frame, &golden.width, &golden.height,
+			&golden.crc[0], &golden.crc[1], &golden.crc[2]) != 6 || frame != (int)goldens.size()) {
+			return false;
+		}
+		goldens.push_back(golden);
+	}
+	return !goldens.empty();
+}
+
+// Start code offsets of the NAL units in an Annex-B stream
+static std::vector<size_t> findNalUnits(const std::vector<unsigned char>& stream)
+{
+	std::vector<size_t> starts;
+	for (size_t i = 0; i + 3 <= stream.size(); i++) {
+		if (stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1) {
+			starts.push_back((i > 0 && stream[i - 1] == 0) ? i - 1 : i);
+			i += 2;
+		}
+	}
+	return starts;
+}
+
+static void checkPicture(const SFgDecodedPicture* pPicture, const SGoldenFrame* pGolden, int frame, int* pFailures)
+{
+	FG_CHECK(pPicture->width == pGolden->width && pPicture->height == pGolden->height,
+		"frame %d is %dx%d, expected %dx%d", frame, pPicture->width, pPicture->height, pGolden->width, pGolden->height);
+	FG_CHECK(pPicture->pts == frame, "frame %d came out with pts %lld", frame, pPicture->pts);
+	if (pPicture->width != pGolden->width || pPicture->height != pGolden->height) {
+		return;
+	}
+	for (int plane = 0; plane < 3; plane++) {
+		int width = plane ? pPicture->width / 2 : pPicture->width;
+		int height = plane ? pPicture->height / 2 : pPicture->height;
+		unsigned int crc = 0;
+		for (int row = 0; row < height; row++) {
+			crc = fgTestCrc32(pPicture->planes[plane] + row * pPicture->pitch[plane], width, crc);
+		}
+		FG_CHECK(crc == pGolden->crc[plane], "frame %d plane %d crc %08x, expected %08x", frame, plane, crc, pGolden->crc[plane]);
+	}
+}
+
+// Feeds the stream the way FgAirplayChannel does: SPS/PPS open the decoder,
+// every slice is one access unit, and each send drains all ready pictures
+FG_TEST(video_golden_frames)
+{
+	std::vector<SGoldenFrame> goldens;
+	std::vector<unsigned char> stream;
+	FG_REQUIRE(readGoldens(goldens), "cannot read mirror_pcm.golden");
+	FG_REQUIRE(fgTestReadFile("mirror_pcm.h264", stream), "cannot read mirror_pcm.h264");
+
+	IVideoDecoder* pDecoder = createVideoDecoder(NULL);
+	FG_REQUIRE(pDecoder != NULL, "no decoder backend");
+	printf("  backend %s\n", pDecoder->name());
+
+	SFgDecoderConfig config;
+	memset(&config, 0, sizeof(config));
+	config.threading = FG_DECODE_THREADING_NONE;
+	config.threadCount = 1;
+
+	std::vector<size_t> starts = findNalUnits(stream);
+	std::vector<unsigned char> codecConfig;
+	int sent = 0;
+	int decoded = 0;
+	for (size_t i = 0; i < starts.size(); i++) {
+		size_t end = (i + 1 < starts.size()) ? starts[i + 1] : stream.size();
+		const unsigned char* nal = &stream[starts[i]];
+		int size = (int)(end - starts[i]);
+		int nalType = nal[(nal[2] == 1) ? 3 : 4] & 0x1F;
+
+		if (nalType == 7 || nalType == 8) {
+			if (nalType == 7) {
+				codecConfig.clear();
+			}
+			codecConfig.insert(codecConfig.end(), nal, nal + size);
+			continue;
+		}
+		if (!codecConfig.empty()) {
+			// A new SPS/PPS reopens the decoder, as a mirror resolution change does
+			FG_REQUIRE(pDecoder->open(&codecConfig[0], (int)codecConfig.size(), &config) >= 0, "open failed");
+			codecConfig.clear();
+		}
+
+		std::vector<unsigned char> padded(nal, nal + size);
+		padded.resize(size + H264_DATA_PADDING_SIZE, 0);
+		SFgH264Data data;
+		memset(&data, 0, sizeof(data));
+		data.data = &padded[0];
+		data.size = size;
+		data.pts = sent++;
+
+		int ret;
+		do {
+			ret = pDecoder->sendPacket(&data);
+			FG_REQUIRE(ret >= 0, "sendPacket failed on access unit %d", sent - 1);
+
+			SFgDecodedPicture picture;
+			int got;
+			while ((got = pDecoder->receivePicture(&picture)) > 0) {
+				if (picture.surfaceType != FG_SURFACE_SYSTEM) {
+					SFgDecodedPicture systemPicture;
+					int downloaded = pDecoder->download(&picture, &systemPicture);
+					picture.release(picture.opaque);
+					FG_REQUIRE(downloaded >= 0, "download failed");
+					picture = systemPicture;
+				}
+				if (decoded < (int)goldens.size()) {
+					checkPicture(&picture, &goldens[decoded], decoded, pFailures);
+				}
+				picture.release(picture.opaque);
+				decoded++;
+			}
+			FG_REQUIRE(got == 0, "receivePicture failed after access unit %d", sent - 1);
+		} while (ret == FG_DECODE_AGAIN);
+	}
+	pDecoder->close();
+	delete pDecoder;
+
+	FG_CHECK(sent == (int)goldens.size(), "stream has %d pictures, goldens %d", sent, (int)goldens.size());
+	FG_CHECK(decoded == (int)goldens.size(), "decoded %d of %d pictures", decoded, (int)goldens.size());
+}
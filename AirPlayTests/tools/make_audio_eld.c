@@ -0,0 +1,148 @@
+/*
+ * Writes the recorded audio stream the shuffle-order test plays: AAC-ELD
+ * 44100 stereo, the screen mirroring format, encoded with the fdk-aac
+ * encoder under AirPlayServerLib and encrypted as a sender does it, AES-128
+ * CBC from the session IV for every packet with the tail left in the clear.
+ * The session key is the fixed one AudioEldStream.h sets up.
+ *
+ * The source is two tones gliding against each other with a slow tremolo,
+ * so that no two frames decode alike.
+ *
+ * File layout, one record per RTP packet in sequence order:
+ *   uint16 little-endian packet length, then the packet, 12-byte RTP header first
+ *
+ * Build from the repository root, against the library sources:
+ *   cc -O2 -IAirPlayServerLib/lib -IAirPlayServerLib/lib/crypto
+ *      -IAirPlayServerLib/lib/ed25519 -IAirPlayServerLib/lib/fdk-aac/libAACenc/include
+ *      -IAirPlayServerLib/lib/fdk-aac/libSYS/include
+ *      AirPlayTests/tools/make_audio_eld.c AirPlayServerLib/lib/crypto/aes.c
+ *      AirPlayServerLib/lib/ed25519/sha512.c -lfdk-aac -lm -o make_audio_eld
+ *
+ * Usage: make_audio_eld [output_file]   (default: AirPlayTests/data/audio_eld.rtp)
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "crypto.h"
+#include "sha512.h"
+#include "aacenc_lib.h"
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define FRAME_SIZE 480
+#define PACKETS 200
+#define FIRST_SEQNUM 65400		/* Wraps past 65535 part way through */
+#define FIRST_TIMESTAMP 0xFFFE0000u
+
+/* Must match AudioEldStream.h */
+static const unsigned char s_aeskey[16] = {
+	0x6b, 0x1f, 0x53, 0xa0, 0x2c, 0x97, 0x3e, 0x44, 0xd1, 0x08, 0x7a, 0xee, 0x25, 0x90, 0x6c, 0x13
+};
+static const unsigned char s_aesiv[16] = {
+	0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78, 0x87, 0x96, 0xa5, 0xb4, 0xc3, 0xd2, 0xe1, 0xf0
+};
+static const unsigned char s_ecdh[32] = {
+	0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+	0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87, 0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e, 0x0f
+};
+
+int main(int argc, char* argv[])
+{
+	const char* path = argc > 1 ? argv[1] : "AirPlayTests/data/audio_eld.rtp";
+	HANDLE_AACENCODER encoder;
+	AACENC_InfoStruct info;
+	unsigned char key[64];
+	sha512_context sha;
+	AES_CTX aes;
+	FILE* file;
+	long pos = 0;
+	int seq = 0;
+	double phase[2] = { 0, 0 };
+
+	/* The audio key is the first half of SHA-512(aeskey | ecdh secret) */
+	sha512_init(&sha);
+	sha512_update(&sha, s_aeskey, 16);
+	sha512_update(&sha, s_ecdh, 32);
+	sha512_final(&sha, key);
+	AES_set_key(&aes, key, s_aesiv, AES_MODE_128);
+
+	if (aacEncOpen(&encoder, 0, CHANNELS) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_AOT, AOT_ER_AAC_ELD) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_SAMPLERATE, SAMPLE_RATE) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_CHANNELMODE, MODE_2) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_GRANULE_LENGTH, FRAME_SIZE) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_TRANSMUX, TT_MP4_RAW) != AACENC_OK ||
+	    aacEncoder_SetParam(encoder, AACENC_BITRATE, 128000) != AACENC_OK ||
+	    aacEncEncode(encoder, NULL, NULL, NULL, NULL) != AACENC_OK ||
+	    aacEncInfo(encoder, &info) != AACENC_OK || info.frameLength != FRAME_SIZE) {
+		fprintf(stderr, "Cannot set up the AAC-ELD encoder\n");
+		return 1;
+	}
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return 1;
+	}
+
+	while (seq < PACKETS) {
+		short pcm[FRAME_SIZE * CHANNELS];
+		unsigned char packet[12 + 2048];
+		unsigned char plain[2048];
+		void* inBufs[] = { pcm };
+		INT inIds[] = { IN_AUDIO_DATA }, inSizes[] = { sizeof(pcm) }, inElSizes[] = { sizeof(short) };
+		void* outBufs[] = { plain };
+		INT outIds[] = { OUT_BITSTREAM_DATA }, outSizes[] = { sizeof(plain) }, outElSizes[] = { 1 };
+		AACENC_BufDesc inDesc = { 1, inBufs, inIds, inSizes, inElSizes };
+		AACENC_BufDesc outDesc = { 1, outBufs, outIds, outSizes, outElSizes };
+		AACENC_InArgs inArgs = { FRAME_SIZE * CHANNELS, 0 };
+		AACENC_OutArgs outArgs;
+		int i, encrypted, length;
+		unsigned short seqnum;
+		unsigned int timestamp;
+
+		for (i = 0; i < FRAME_SIZE; i++, pos++) {
+			double t = (double)pos / SAMPLE_RATE;
+			double level = 9000 * (1.0 + 0.5 * sin(2 * M_PI * 3.0 * t));
+			phase[0] += 2 * M_PI * (440.0 + 220.0 * t) / SAMPLE_RATE;
+			phase[1] += 2 * M_PI * (1320.0 - 300.0 * t) / SAMPLE_RATE;
+			pcm[i * 2] = (short)(level * sin(phase[0]));
+			pcm[i * 2 + 1] = (short)(level * sin(phase[1]));
+		}
+		if (aacEncEncode(encoder, &inDesc, &outDesc, &inArgs, &outArgs) != AACENC_OK) {
+			fprintf(stderr, "Encoding failed\n");
+			return 1;
+		}
+		if (outArgs.numOutBytes == 0) {
+			continue;
+		}
+
+		seqnum = (unsigned short)(FIRST_SEQNUM + seq);
+		timestamp = FIRST_TIMESTAMP + (unsigned int)seq * FRAME_SIZE;
+		packet[0] = 0x80;
+		packet[1] = 0x60;
+		packet[2] = (unsigned char)(seqnum >> 8);
+		packet[3] = (unsigned char)seqnum;
+		packet[4] = (unsigned char)(timestamp >> 24);
+		packet[5] = (unsigned char)(timestamp >> 16);
+		packet[6] = (unsigned char)(timestamp >> 8);
+		packet[7] = (unsigned char)timestamp;
+		memset(packet + 8, 0x5a, 4);
+
+		encrypted = outArgs.numOutBytes / 16 * 16;
+		memcpy(aes.iv, s_aesiv, sizeof(s_aesiv));
+		AES_cbc_encrypt(&aes, plain, packet + 12, encrypted);
+		memcpy(packet + 12 + encrypted, plain + encrypted, outArgs.numOutBytes - encrypted);
+
+		length = 12 + outArgs.numOutBytes;
+		fputc(length & 0xff, file);
+		fputc(length >> 8, file);
+		fwrite(packet, 1, length, file);
+		seq++;
+	}
+	fclose(file);
+	aacEncClose(&encoder);
+	printf("Wrote %d packets to %s\n", seq, path);
+	return 0;
+}
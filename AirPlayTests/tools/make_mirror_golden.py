@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+#
+# Writes the recorded mirror stream the golden-frame test decodes, and its
+# goldens. The stream is Baseline H.264 built only from I_PCM and P_Skip
+# macroblocks with the deblocking filter off, so every decoded sample is known
+# exactly from the PCM source below; the goldens come from that source, not
+# from any decoder.
+#
+# Layout, one access unit per line of the golden file:
+#   64x48:  SPS/PPS, IDR, 3 P frames that replace a few macroblocks each
+#   48x64:  SPS/PPS, IDR, 2 P frames, the resolution change mid-stream
+#
+# Usage: make_mirror_golden.py [output_dir]   (default: ../data)
+
+import os
+import sys
+import zlib
+
+
+class BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def u(self, n, value):
+        for i in range(n - 1, -1, -1):
+            self.bits.append((value >> i) & 1)
+
+    def ue(self, value):
+        value += 1
+        n = value.bit_length()
+        self.u(n - 1, 0)
+        self.u(n, value)
+
+    def se(self, value):
+        self.ue(2 * value - 1 if value > 0 else -2 * value)
+
+    def align_zero(self):
+        while len(self.bits) % 8:
+            self.bits.append(0)
+
+    def trailing(self):
+        self.bits.append(1)
+        self.align_zero()
+
+    def bytes(self):
+        assert len(self.bits) % 8 == 0
+        out = bytearray()
+        for i in range(0, len(self.bits), 8):
+            byte = 0
+            for bit in self.bits[i:i + 8]:
+                byte = (byte << 1) | bit
+            out.append(byte)
+        return bytes(out)
+
+
+def nal(ref_idc, nal_type, rbsp):
+    # Emulation prevention: no 00 00 0x (x <= 3) inside the payload
+    out = bytearray([(ref_idc << 5) | nal_type])
+    zeros = 0
+    for byte in rbsp:
+        if zeros >= 2 and byte <= 3:
+            out.append(3)
+            zeros = 0
+        out.append(byte)
+        zeros = zeros + 1 if byte == 0 else 0
+    return b"\x00\x00\x00\x01" + bytes(out)
+
+
+def sps(width, height):
+    w = BitWriter()
+    w.u(8, 66)          # profile_idc: Baseline
+    w.u(8, 0xC0)        # constraint_set0_flag, constraint_set1_flag
+    w.u(8, 30)          # level_idc
+    w.ue(0)             # seq_parameter_set_id
+    w.ue(0)             # log2_max_frame_num_minus4
+    w.ue(2)             # pic_order_cnt_type: output in decode order
+    w.ue(1)             # max_num_ref_frames
+    w.u(1, 0)           # gaps_in_frame_num_value_allowed_flag
+    w.ue(width // 16 - 1)
+    w.ue(height // 16 - 1)
+    w.u(1, 1)           # frame_mbs_only_flag
+    w.u(1, 1)           # direct_8x8_inference_flag
+    w.u(1, 0)           # frame_cropping_flag
+    w.u(1, 0)           # vui_parameters_present_flag
+    w.trailing()
+    return nal(3, 7, w.bytes())
+
+
+def pps():
+    w = BitWriter()
+    w.ue(0)             # pic_parameter_set_id
+    w.ue(0)             # seq_parameter_set_id
+    w.u(1, 0)           # entropy_coding_mode_flag: CAVLC
+    w.u(1, 0)           # bottom_field_pic_order_in_frame_present_flag
+    w.ue(0)             # num_slice_groups_minus1
+    w.ue(0)             # num_ref_idx_l0_default_active_minus1
+    w.ue(0)             # num_ref_idx_l1_default_active_minus1
+    w.u(1, 0)           # weighted_pred_flag
+    w.u(2, 0)           # weighted_bipred_idc
+    w.se(0)             # pic_init_qp_minus26
+    w.se(0)             # pic_init_qs_minus26
+    w.se(0)             # chroma_qp_index_offset
+    w.u(1, 1)           # deblocking_filter_control_present_flag
+    w.u(1, 0)           # constrained_intra_pred_flag
+    w.u(1, 0)           # redundant_pic_cnt_present_flag
+    w.trailing()
+    return nal(3, 8, w.bytes())
+
+
+def pcm_macroblock(w, planes, width, mbx, mby):
+    w.align_zero()      # pcm_alignment_zero_bit
+    y, cb, cr = planes
+    for row in range(16):
+        start = (mby * 16 + row) * width + mbx * 16
+        w.u(128, int.from_bytes(bytes(y[start:start + 16]), "big"))
+    for plane in (cb, cr):
+        for row in range(8):
+            start = (mby * 8 + row) * (width // 2) + mbx * 8
+            w.u(64, int.from_bytes(bytes(plane[start:start + 8]), "big"))
+
+
+def idr_slice(planes, width, height, idr_pic_id):
+    w = BitWriter()
+    w.ue(0)             # first_mb_in_slice
+    w.ue(7)             # slice_type: I, whole picture
+    w.ue(0)             # pic_parameter_set_id
+    w.u(4, 0)           # frame_num
+    w.ue(idr_pic_id)
+    w.u(1, 0)           # no_output_of_prior_pics_flag
+    w.u(1, 0)           # long_term_reference_flag
+    w.se(0)             # slice_qp_delta
+    w.ue(1)             # disable_deblocking_filter_idc
+    for mby in range(height // 16):
+        for mbx in range(width // 16):
+            w.ue(25)    # mb_type: I_PCM
+            pcm_macroblock(w, planes, width, mbx, mby)
+    w.trailing()
+    return nal(3, 5, w.bytes())
+
+
+def p_slice(planes, width, height, frame_num, coded):
+    w = BitWriter()
+    w.ue(0)             # first_mb_in_slice
+    w.ue(5)             # slice_type: P, whole picture
+    w.ue(0)             # pic_parameter_set_id
+    w.u(4, frame_num)
+    w.u(1, 0)           # num_ref_idx_active_override_flag
+    w.u(1, 0)           # ref_pic_list_modification_flag_l0
+    w.u(1, 0)           # adaptive_ref_pic_marking_mode_flag
+    w.se(0)             # slice_qp_delta
+    w.ue(1)             # disable_deblocking_filter_idc
+    mbs = (width // 16) * (height // 16)
+    skip = 0
+    for addr in range(mbs):
+        if addr not in coded:
+            skip += 1
+            continue
+        w.ue(skip)      # mb_skip_run
+        skip = 0
+        w.ue(5 + 25)    # mb_type: I_PCM in a P slice
+        pcm_macroblock(w, planes, width, addr % (width // 16), addr // (width // 16))
+    if skip:
+        w.ue(skip)
+    w.trailing()
+    return nal(2, 1, w.bytes())
+
+
+def pattern(width, height, seed):
+    # Gradients plus a per-seed twist; no zero samples, older decoders
+    # rejected them in PCM
+    y = bytearray(width * height)
+    for j in range(height):
+        for i in range(width):
+            y[j * width + i] = 1 + (i * 3 + j * 5 + seed * 37 + ((i ^ j) & 7) * 11) % 255
+    cw, ch = width // 2, height // 2
+    cb = bytearray(cw * ch)
+    cr = bytearray(cw * ch)
+    for j in range(ch):
+        for i in range(cw):
+            cb[j * cw + i] = 1 + (i * 7 + seed * 13) % 255
+            cr[j * cw + i] = 1 + (j * 9 + seed * 29 + i) % 255
+    return [y, cb, cr]
+
+
+def paste_macroblock(dst, src, width, addr):
+    mbx, mby = addr % (width // 16), addr // (width // 16)
+    for row in range(16):
+        start = (mby * 16 + row) * width + mbx * 16
+        dst[0][start:start + 16] = src[0][start:start + 16]
+    for p in (1, 2):
+        for row in range(8):
+            start = (mby * 8 + row) * (width // 2) + mbx * 8
+            dst[p][start:start + 8] = src[p][start:start + 8]
+
+
+def crc(plane):
+    return zlib.crc32(bytes(plane)) & 0xFFFFFFFF
+
+
+def main():
+    out_dir = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "data")
+    stream = bytearray()
+    golden = ["# frame width height crc32(Y) crc32(U) crc32(V) over the visible planes, rows packed"]
+    frame = 0
+    seed = 0
+
+    # (width, height, [macroblocks re-coded by each P frame])
+    segments = [
+        (64, 48, [[0, 5], [3, 4, 11], []]),
+        (48, 64, [[1, 6, 7], [11]]),
+    ]
+    for segment, (width, height, p_frames) in enumerate(segments):
+        stream += sps(width, height) + pps()
+        picture = pattern(width, height, seed)
+        stream += idr_slice(picture, width, height, segment)
+        golden.append("%d %d %d %08x %08x %08x" % (frame, width, height, crc(picture[0]), crc(picture[1]), crc(picture[2])))
+        frame += 1
+        for frame_num, coded in enumerate(p_frames, 1):
+            seed += 1
+            source = pattern(width, height, seed)
+            for addr in coded:
+                paste_macroblock(picture, source, width, addr)
+            stream += p_slice(source, width, height, frame_num, set(coded))
+            golden.append("%d %d %d %08x %08x %08x" % (frame, width, height, crc(picture[0]), crc(picture[1]), crc(picture[2])))
+            frame += 1
+        seed += 1
+
+    with open(os.path.join(out_dir, "mirror_pcm.h264"), "wb") as f:
+        f.write(stream)
+    with open(os.path.join(out_dir, "mirror_pcm.golden"), "w", newline="\n") as f:
+        f.write("\n".join(golden) + "\n")
+
+
+if __name__ == "__main__":
+    main()
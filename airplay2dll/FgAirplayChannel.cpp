@@ -1,24 +1,97 @@
 #include "FgAirplayChannel.h"
 #include "CAutoLock.h"
+#include "raop.h"
 
-FgAirplayChannel::FgAirplayChannel(IAirServerCallback* pCallback)
+// Gaps longer than this are the sender idling on a static screen, not its frame rate
+#define FG_FRAME_INTERVAL_MAX_US 200000
+// Frames in a row decoding near the frame interval before latency mode adds a frame thread
+#define FG_BEHIND_FRAMES 60
+
+// Classifies an Annex-B access unit by its first slice: whether it is an IDR
+// and whether later frames may reference it (nal_ref_idc != 0)
+static void classifyAccessUnit(const unsigned char* data, int size, int* isIdr, int* isRef)
+{
+	*isIdr = 0;
+	*isRef = 1;
+	for (int i = 0; i + 3 < size; i++) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			int nalType = data[i + 3] & 0x1f;
+			if (nalType == 1 || nalType == 5) {
+				*isIdr = (nalType == 5);
+				*isRef = (data[i + 3] & 0x60) != 0;
+				return;
+			}
+			i += 3;
+		}
+	}
+}
+
+FgAirplayChannel::FgAirplayChannel(IAirServerCallback* pCallback, const char* remoteName,
+	const char* remoteDeviceId, int nDecodeThreads)
 : m_nRef(1)
 , m_pCallback(pCallback)
-, m_pCodec(NULL)
-, m_pCodecCtx(NULL)
+, m_strRemoteName(remoteName ? remoteName : "")
+, m_strRemoteDeviceId(remoteDeviceId ? remoteDeviceId : "")
+, m_pDecoder(createVideoDecoder(NULL))
 , m_pSwsCtx(NULL)
-, m_bCodecOpened(false)
+, m_nDecodeThreads(nDecodeThreads > 0 ? nDecodeThreads : 1)
+, m_bConfigChanged(false)
+, m_nConfigMode(FG_DECODE_MODE_LATENCY)
+, m_nSlices(0)
+, m_bBehind(false)
+, m_nBehindFrames(0)
+, m_nLastEnqueueQpc(0)
+, m_nFrameIntervalUs(0)
+, m_nDecodeMode(FG_DECODE_MODE_LATENCY)
+, m_hDecodeThread(NULL)
+, m_bQuit(0)
+, m_nNextSeq(0)
+, m_bWaitKey(false)
+, m_bSkipNonRef(false)
+, m_bConfigPending(false)
+, m_nFlushSeq(0)
+, m_nFramesReceived(0)
+, m_nBytesReceived(0)
+, m_nFramesDecoded(0)
+, m_nFramesDropped(0)
+, m_nFramesSkipped(0)
+, m_nFramesFlushed(0)
+, m_nQueueHighWater(0)
+, m_nQueueLatencyUs(0)
+, m_nDecodeUs(0)
+, m_nAudioPackets(0)
+, m_nAudioWakeupsMilli(0)
+, m_nAudioSyscallsMilli(0)
+, m_nAudioSocketDrops(0)
+, m_nAudioPacketsLost(0)
+, m_nAudioPacketsRecovered(0)
+, m_nAudioPacketsConcealed(0)
+, m_nAudioPacketsLate(0)
+, m_nAudioResendRequests(0)
 , m_fScaleRatio(1.0f)
+, m_nFrameMode(FG_VIDEO_FRAME_COPY)
 {
 	memset(&m_sVideoFrameOri, 0, sizeof(SFgVideoFrame));
 	memset(&m_sVideoFrameScale, 0, sizeof(SFgVideoFrame));
+	memset(&m_sStreamInfo, 0, sizeof(SFgH264StreamInfo));
+	memset(&m_sDecoderConfig, 0, sizeof(SFgDecoderConfig));
+	memset(&m_sPendingConfig, 0, sizeof(SFgH264Data));
+	QueryPerformanceFrequency(&m_qpcFreq);
 
 	m_mutexAudio = CreateMutex(NULL, FALSE, NULL);
 	m_mutexVideo = CreateMutex(NULL, FALSE, NULL);
+	m_mutexQueue = CreateMutex(NULL, FALSE, NULL);
+	m_hQueueEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 }
 
 FgAirplayChannel::~FgAirplayChannel()
 {
+	stopDecodeThread();
+	if (m_bConfigPending) {
+		freeH264Data(&m_sPendingConfig);
+		m_bConfigPending = false;
+	}
+
 	m_pCallback = NULL;
 	if (m_sVideoFrameOri.data)
 	{
@@ -31,10 +104,19 @@ FgAirplayChannel::~FgAirplayChannel()
 		m_sVideoFrameScale.data = NULL;
 	}
 
-	unInitFFmpeg();
+	closeDecoder();
+	delete m_pDecoder;
+	m_pDecoder = NULL;
+	if (m_pSwsCtx)
+	{
+		sws_freeContext(m_pSwsCtx);
+		m_pSwsCtx = NULL;
+	}
 
 	CloseHandle(m_mutexAudio);
 	CloseHandle(m_mutexVideo);
+	CloseHandle(m_mutexQueue);
+	CloseHandle(m_hQueueEvent);
 }
 
 long FgAirplayChannel::addRef()
@@ -54,53 +136,356 @@ long FgAirplayChannel::release()
 	return (m_nRef > 1 ? m_nRef : 1);
 }
 
-int FgAirplayChannel::initFFmpeg(const void* privatedata, int privatedatalen) {
-	if (m_pCodec == NULL) {
-		m_pCodec = avcodec_find_decoder(AV_CODEC_ID_H264);
-		m_pCodecCtx = avcodec_alloc_context3(m_pCodec);
+bool FgAirplayChannel::startDecodeThread()
+{
+	CAutoLock oLock(m_mutexQueue, "startDecodeThread");
+	if (m_hDecodeThread != NULL) {
+		return true;
 	}
-	if (m_pCodec == NULL) {
-		return -1;
+	InterlockedExchange(&m_bQuit, 0);
+	m_hDecodeThread = CreateThread(NULL, 0, decodeThreadProc, this, 0, NULL);
+	return m_hDecodeThread != NULL;
+}
+
+void FgAirplayChannel::stopDecodeThread()
+{
+	CAutoLock oLock(m_mutexQueue, "stopDecodeThread");
+	InterlockedExchange(&m_bQuit, 1);
+	if (m_hDecodeThread != NULL) {
+		SetEvent(m_hQueueEvent);
+		WaitForSingleObject(m_hDecodeThread, INFINITE);
+		CloseHandle(m_hDecodeThread);
+		m_hDecodeThread = NULL;
 	}
 
-	m_pCodecCtx->extradata = (uint8_t*)av_malloc(privatedatalen);
-	m_pCodecCtx->extradata_size = privatedatalen;
-	memcpy(m_pCodecCtx->extradata, privatedata, privatedatalen);
-	m_pCodecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+	// With the decode thread gone this is the only consumer
+	SFgH264Data data;
+	while (m_h264Queue.pop(data)) {
+		freeH264Data(&data);
+	}
+}
 
-	// LOW LATENCY with good performance
-	m_pCodecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;  // Low latency mode - output frames immediately
-	// Note: NOT using AV_CODEC_FLAG2_FAST - keep full deblocking for clean video
-	m_pCodecCtx->thread_count = 4;                   // Multi-threaded decoding
-	m_pCodecCtx->thread_type = FF_THREAD_SLICE;     // Slice-based threading (lower latency than frame)
+void FgAirplayChannel::countDropped(volatile LONGLONG* pReason)
+{
+	InterlockedIncrement64(&m_nFramesDropped);
+	if (pReason != NULL) {
+		InterlockedIncrement64(pReason);
+	}
+}
 
-	int res = avcodec_open2(m_pCodecCtx, m_pCodec, NULL);
-	if (res < 0)
-	{
-		printf("Failed to initialize decoder\n");
-		return -1;
+// Called on the receive thread, the ring's only producer. Payload-backed frames
+// are queued by reference, anything else is copied since the caller's data
+// dies with the callback.
+//
+// Drop policy: once the oldest queued frame is older than the latency budget,
+// non-reference frames are skipped until the next IDR, and that IDR makes
+// every video frame queued ahead of it stale. Reference frames are only lost
+// when the ring is full, after which nothing decodes cleanly until an IDR. A
+// codec config the full ring turns away is held and queued ahead of that IDR.
+bool FgAirplayChannel::pushH264Data(const SFgH264Data* data)
+{
+	if (InterlockedCompareExchange(&m_bQuit, 0, 0) != 0) {
+		return false;
 	}
 
-	m_bCodecOpened = true;
+	InterlockedIncrement64(&m_nFramesReceived);
+	InterlockedExchangeAdd64(&m_nBytesReceived, data->size);
+
+	LARGE_INTEGER qpcNow;
+	QueryPerformanceCounter(&qpcNow);
+
+	SFgH264Data entry = *data;
+	entry.is_idr = 0;
+	entry.is_ref = 1;
+	entry.seq = m_nNextSeq++;
+	entry.enqueue_qpc = qpcNow.QuadPart;
 
+	SFgH264Data oldest;
+	LONGLONG latencyUs = 0;
+	if (m_h264Queue.peekOldest(oldest)) {
+		latencyUs = (qpcNow.QuadPart - oldest.enqueue_qpc) * 1000000 / m_qpcFreq.QuadPart;
+	}
+	InterlockedExchange(&m_nQueueLatencyUs, (LONG)latencyUs);
+	const bool overBudget = latencyUs > FG_H264_LATENCY_BUDGET_MS * 1000;
+
+	// Codec config always goes through; it is tiny and the decoder needs it
+	if (!entry.is_key) {
+		classifyAccessUnit(entry.data, entry.size, &entry.is_idr, &entry.is_ref);
+		if (entry.is_idr) {
+			// The SPS/PPS this IDR refers to must be queued ahead of it
+			if (m_bConfigPending) {
+				if (!m_h264Queue.push(m_sPendingConfig)) {
+					countDropped(NULL);
+					return false;
+				}
+				m_bConfigPending = false;
+			}
+			if (overBudget || m_bWaitKey || m_bSkipNonRef) {
+				InterlockedExchange(&m_nFlushSeq, entry.seq);
+			}
+			m_bWaitKey = false;
+			m_bSkipNonRef = false;
+		}
+		else if (m_bWaitKey) {
+			countDropped(NULL);
+			return false;
+		}
+		else {
+			if (overBudget) {
+				m_bSkipNonRef = true;
+			}
+			if (m_bSkipNonRef && !entry.is_ref) {
+				countDropped(&m_nFramesSkipped);
+				return false;
+			}
+		}
+	}
+
+	if (entry.buffer != NULL) {
+		raop_payload_retain(entry.buffer);
+	}
+	else {
+		entry.data = new unsigned char[data->size + H264_DATA_PADDING_SIZE];
+		memcpy(entry.data, data->data, data->size);
+		memset(entry.data + data->size, 0, H264_DATA_PADDING_SIZE);
+	}
+	if (!m_h264Queue.push(entry)) {
+		countDropped(NULL);
+		if (entry.is_key) {
+			// Only the newest SPS/PPS matters; it goes in ahead of the next IDR
+			if (m_bConfigPending) {
+				freeH264Data(&m_sPendingConfig);
+			}
+			m_sPendingConfig = entry;
+			m_bConfigPending = true;
+		}
+		else {
+			freeH264Data(&entry);
+		}
+		// Frames after a lost config or frame cannot decode until an IDR
+		m_bWaitKey = true;
+		return false;
+	}
+	if (entry.is_key && m_bConfigPending) {
+		// Superseded by the config that just went in
+		freeH264Data(&m_sPendingConfig);
+		m_bConfigPending = false;
+	}
+
+	LONG depth = (LONG)m_h264Queue.size();
+	if (depth > m_nQueueHighWater) {
+		InterlockedExchange(&m_nQueueHighWater, depth);
+	}
+	SetEvent(m_hQueueEvent);
+
+	return true;
+}
+
+void FgAirplayChannel::getStats(SFgSessionStats* pStats)
+{
+	memset(pStats, 0, sizeof(SFgSessionStats));
+	strncpy_s(pStats->remoteName, sizeof(pStats->remoteName), m_strRemoteName.c_str(), _TRUNCATE);
+	strncpy_s(pStats->remoteDeviceId, sizeof(pStats->remoteDeviceId), m_strRemoteDeviceId.c_str(), _TRUNCATE);
+	pStats->width = m_sVideoFrameOri.width;
+	pStats->height = m_sVideoFrameOri.height;
+	pStats->decodeThreads = m_nDecodeThreads;
+	pStats->queueDepth = m_h264Queue.size();
+	pStats->queueCapacity = m_h264Queue.capacity();
+	pStats->framesReceived = InterlockedCompareExchange64(&m_nFramesReceived, 0, 0);
+	pStats->framesDecoded = InterlockedCompareExchange64(&m_nFramesDecoded, 0, 0);
+	pStats->framesDropped = InterlockedCompareExchange64(&m_nFramesDropped, 0, 0);
+	pStats->bytesReceived = InterlockedCompareExchange64(&m_nBytesReceived, 0, 0);
+	pStats->decodeMs = InterlockedCompareExchange(&m_nDecodeUs, 0, 0) / 1000.0f;
+	pStats->framesSkipped = InterlockedCompareExchange64(&m_nFramesSkipped, 0, 0);
+	pStats->framesFlushed = InterlockedCompareExchange64(&m_nFramesFlushed, 0, 0);
+	pStats->queueHighWater = InterlockedCompareExchange(&m_nQueueHighWater, 0, 0);
+	pStats->queueLatencyMs = InterlockedCompareExchange(&m_nQueueLatencyUs, 0, 0) / 1000.0f;
+	pStats->decodeMode = m_nConfigMode;
+	pStats->decodeThreading = m_sDecoderConfig.threading;
+	pStats->decodeThreadCount = m_sDecoderConfig.threadCount;
+	pStats->slicesPerFrame = m_nSlices;
+	pStats->decodeDelayFrames = m_sDecoderConfig.delayFrames;
+	LONG intervalUs = m_nFrameIntervalUs;
+	if (intervalUs > 0) {
+		pStats->decodeDelayMs = m_sDecoderConfig.delayFrames * intervalUs / 1000.0f;
+		pStats->inputFps = 1000000.0f / intervalUs;
+	}
+	pStats->audioPackets = InterlockedCompareExchange64(&m_nAudioPackets, 0, 0);
+	pStats->audioWakeupsPerSec = InterlockedCompareExchange(&m_nAudioWakeupsMilli, 0, 0) / 1000.0f;
+	pStats->audioSyscallsPerPacket = InterlockedCompareExchange(&m_nAudioSyscallsMilli, 0, 0) / 1000.0f;
+	pStats->audioSocketDrops = InterlockedCompareExchange64(&m_nAudioSocketDrops, 0, 0);
+	pStats->audioPacketsLost = InterlockedCompareExchange64(&m_nAudioPacketsLost, 0, 0);
+	pStats->audioPacketsRecovered = InterlockedCompareExchange64(&m_nAudioPacketsRecovered, 0, 0);
+	pStats->audioPacketsConcealed = InterlockedCompareExchange64(&m_nAudioPacketsConcealed, 0, 0);
+	pStats->audioPacketsLate = InterlockedCompareExchange64(&m_nAudioPacketsLate, 0, 0);
+	pStats->audioResendRequests = InterlockedCompareExchange64(&m_nAudioResendRequests, 0, 0);
+}
+
+void FgAirplayChannel::setAudioRecvStats(const audio_recv_stats_struct* stats)
+{
+	InterlockedExchange64(&m_nAudioPackets, (LONGLONG)stats->packets);
+	InterlockedExchange(&m_nAudioWakeupsMilli, (LONG)(stats->wakeups_per_sec * 1000.0f));
+	InterlockedExchange(&m_nAudioSyscallsMilli, (LONG)(stats->syscalls_per_packet * 1000.0f));
+	InterlockedExchange64(&m_nAudioSocketDrops, (LONGLONG)stats->socket_drops);
+	InterlockedExchange64(&m_nAudioPacketsLost, (LONGLONG)stats->packets_lost);
+	InterlockedExchange64(&m_nAudioPacketsRecovered, (LONGLONG)stats->packets_recovered);
+	InterlockedExchange64(&m_nAudioPacketsConcealed, (LONGLONG)stats->packets_concealed);
+	InterlockedExchange64(&m_nAudioPacketsLate, (LONGLONG)stats->packets_late);
+	InterlockedExchange64(&m_nAudioResendRequests, (LONGLONG)stats->resend_requests);
+}
+
+void FgAirplayChannel::freeH264Data(SFgH264Data* data)
+{
+	if (data->buffer != NULL) {
+		raop_payload_release(data->buffer);
+	}
+	else {
+		delete[] data->data;
+	}
+}
+
+DWORD WINAPI FgAirplayChannel::decodeThreadProc(LPVOID lpParam)
+{
+	FgAirplayChannel* pChannel = (FgAirplayChannel*)lpParam;
+	pChannel->decodeLoop();
 	return 0;
 }
 
-void FgAirplayChannel::unInitFFmpeg()
+void FgAirplayChannel::decodeLoop()
 {
-	CAutoLock oLock(m_mutexVideo, "unInitFFmpeg");
-	if (m_pCodecCtx)
-	{
-		if (m_pCodecCtx->extradata) {
-			av_freep(&m_pCodecCtx->extradata);
+	LONG decodeUs = 0;
+
+	while (InterlockedCompareExchange(&m_bQuit, 0, 0) == 0) {
+		SFgH264Data data;
+		if (!m_h264Queue.pop(data)) {
+			WaitForSingleObject(m_hQueueEvent, INFINITE);
+			continue;
+		}
+
+		// A newer IDR is already queued: anything before it is wasted work
+		if (!data.is_key && (LONG)(data.seq - InterlockedCompareExchange(&m_nFlushSeq, 0, 0)) < 0) {
+			freeH264Data(&data);
+			countDropped(&m_nFramesFlushed);
+			continue;
+		}
+
+		LARGE_INTEGER qpcStart, qpcEnd;
+		QueryPerformanceCounter(&qpcStart);
+		// Late non-reference frames can go without breaking later ones
+		if (!data.is_key && !data.is_ref &&
+			(qpcStart.QuadPart - data.enqueue_qpc) * 1000 / m_qpcFreq.QuadPart > FG_H264_LATENCY_BUDGET_MS) {
+			freeH264Data(&data);
+			countDropped(&m_nFramesSkipped);
+			continue;
+		}
+
+		int ret = decodeH264Data(&data);
+		QueryPerformanceCounter(&qpcEnd);
+		freeH264Data(&data);
+
+		if (ret >= 0) {
+			InterlockedIncrement64(&m_nFramesDecoded);
+		}
+		LONG elapsedUs = (LONG)((qpcEnd.QuadPart - qpcStart.QuadPart) * 1000000 / m_qpcFreq.QuadPart);
+		decodeUs = (decodeUs == 0) ? elapsedUs : (decodeUs * 7 + elapsedUs) / 8;
+		InterlockedExchange(&m_nDecodeUs, decodeUs);
+		if (!data.is_key) {
+			trackThroughput(&data, decodeUs);
 		}
-		avcodec_free_context(&m_pCodecCtx);
-		m_pCodecCtx = NULL;
 	}
-	if (m_pSwsCtx)
-	{
-		sws_freeContext(m_pSwsCtx);
-		m_pSwsCtx = NULL;
+}
+
+// Decode thread only. Measures the sender's frame rate and flags a
+// single-threaded latency-mode decoder that spends nearly the whole frame
+// interval decoding; configureDecoder then moves it to frame threading at the
+// next IDR.
+void FgAirplayChannel::trackThroughput(const SFgH264Data* data, LONG decodeUs)
+{
+	if (m_nLastEnqueueQpc != 0) {
+		LONG gapUs = (LONG)((data->enqueue_qpc - m_nLastEnqueueQpc) * 1000000 / m_qpcFreq.QuadPart);
+		if (gapUs > 0 && gapUs < FG_FRAME_INTERVAL_MAX_US) {
+			m_nFrameIntervalUs = (m_nFrameIntervalUs == 0) ? gapUs : (m_nFrameIntervalUs * 15 + gapUs) / 16;
+		}
+	}
+	m_nLastEnqueueQpc = data->enqueue_qpc;
+
+	if (m_bBehind || m_nFrameIntervalUs == 0 || m_nDecodeThreads < 2 ||
+		m_sDecoderConfig.threading != FG_DECODE_THREADING_NONE) {
+		return;
+	}
+	if ((LONGLONG)decodeUs * 10 < (LONGLONG)m_nFrameIntervalUs * 9) {
+		m_nBehindFrames = 0;
+	}
+	else if (++m_nBehindFrames >= FG_BEHIND_FRAMES) {
+		m_bBehind = true;
+	}
+}
+
+// Decode thread only. Senders repeat the SPS/PPS; only a different one is
+// applied, when the next IDR arrives.
+void FgAirplayChannel::setCodecConfig(const unsigned char* data, int size)
+{
+	if (size <= 0 || (m_vecCodecConfig.size() == (size_t)size &&
+		memcmp(&m_vecCodecConfig[0], data, size) == 0)) {
+		return;
+	}
+	m_vecCodecConfig.assign(data, data + size);
+	if (!fgParseH264Config(data, size, &m_sStreamInfo)) {
+		memset(&m_sStreamInfo, 0, sizeof(SFgH264StreamInfo));
+	}
+	m_bConfigChanged = true;
+	m_bBehind = false;
+	m_nBehindFrames = 0;
+}
+
+// Opens the decoder on the first picture after the codec config, and reopens
+// it at an IDR when the stream, its slice layout, the decode mode or the
+// throughput verdict asks for different threading. An IDR needs no earlier
+// references, so nothing is lost by starting a fresh decoder there.
+int FgAirplayChannel::configureDecoder(SFgH264Data* data)
+{
+	if (m_pDecoder == NULL) {
+		return -1;
+	}
+	const bool bOpen = m_pDecoder->isOpen();
+	if (m_vecCodecConfig.empty() || (bOpen && !data->is_idr)) {
+		return 0;
+	}
+
+	m_nSlices = fgCountSlices(data->data, data->size);
+	int mode = InterlockedCompareExchange(&m_nDecodeMode, 0, 0);
+	SFgDecoderConfig config;
+	fgChooseDecoderConfig(&m_sStreamInfo, m_nSlices, m_nDecodeThreads, mode, m_bBehind, &config);
+	m_nConfigMode = mode;
+	if (bOpen && !m_bConfigChanged &&
+		memcmp(&config, &m_sDecoderConfig, sizeof(SFgDecoderConfig)) == 0) {
+		return 0;
+	}
+
+	m_sDecoderConfig = config;
+	m_bConfigChanged = false;
+	int ret = m_pDecoder->open(&m_vecCodecConfig[0], (int)m_vecCodecConfig.size(), &m_sDecoderConfig);
+
+	if (m_pCallback != NULL) {
+		static const char* threadingNames[] = { "no", "slice", "frame" };
+		char msg[512];
+		sprintf_s(msg, sizeof(msg),
+			"Mirror decoder for %s: %s, %dx%d profile %d level %d, %d slice(s), %s threading x%d, %d frame(s) delay, %s mode%s",
+			m_strRemoteName.c_str(), m_pDecoder->name(), m_sStreamInfo.width, m_sStreamInfo.height,
+			m_sStreamInfo.profileIdc, m_sStreamInfo.levelIdc, m_nSlices,
+			threadingNames[config.threading], config.threadCount, config.delayFrames,
+			mode == FG_DECODE_MODE_THROUGHPUT ? "throughput" : "latency",
+			ret < 0 ? " (open failed)" : "");
+		m_pCallback->log(ret < 0 ? RAOP_LOG_WARNING : RAOP_LOG_INFO, msg);
+	}
+	return ret;
+}
+
+void FgAirplayChannel::closeDecoder()
+{
+	CAutoLock oLock(m_mutexVideo, "closeDecoder");
+	if (m_pDecoder != NULL) {
+		m_pDecoder->close();
 	}
 }
 
@@ -110,83 +495,169 @@ float FgAirplayChannel::setScale(float fRatio)
 	return m_fScaleRatio;
 }
 
-int FgAirplayChannel::decodeH264Data(SFgH264Data* data, const char* remoteName, const char* remoteDeviceId) {
+void FgAirplayChannel::setFrameMode(int nFrameMode)
+{
+	InterlockedExchange(&m_nFrameMode, nFrameMode);
+}
+
+void FgAirplayChannel::setDecodeMode(int nDecodeMode)
+{
+	InterlockedExchange(&m_nDecodeMode, nDecodeMode);
+}
+
+int FgAirplayChannel::decodeH264Data(SFgH264Data* data) {
 	int ret = 0;
-	// ULTRA-LOW LATENCY: Initialize decoder on first keyframe, but don't drop P-frames
+	if (data->is_key) {
+		setCodecConfig(data->data, data->size);
+		return 0;
+	}
+	// ULTRA-LOW LATENCY: Open the decoder on the first picture after the codec
+	// config, even a P-frame, rather than waiting for an I-frame
 	// Note: This may cause brief visual artifacts until first I-frame, but eliminates 2-5s wait
-	if (data->is_key && !m_bCodecOpened) {
-		ret = initFFmpeg(data->data, data->size);
-		if (ret < 0) {
-			return ret;
-		}
+	ret = configureDecoder(data);
+	if (ret < 0) {
+		return ret;
 	}
-	if (!m_bCodecOpened) {
+	if (!m_pDecoder->isOpen()) {
 		return 0;  // Still need codec to be opened before any decoding
 	}
 
-	AVPacket pkt1, * packet = &pkt1;
-	int frameFinished;
-	AVFrame* pFrame;
+	// A full decoder gives pictures back before it takes the next packet
+	for (;;) {
+		int sendRet = m_pDecoder->sendPacket(data);
+		if (sendRet < 0) {
+			return sendRet;
+		}
 
-	pFrame = av_frame_alloc();
+		int pictures = 0;
+		SFgDecodedPicture picture;
+		while ((ret = m_pDecoder->receivePicture(&picture)) > 0) {
+			pictures++;
+			if (picture.surfaceType != FG_SURFACE_SYSTEM && !isDeviceOutput()) {
+				// Copy mode and scaling work on system memory
+				SFgDecodedPicture systemPicture;
+				int downloadRet = m_pDecoder->download(&picture, &systemPicture);
+				picture.release(picture.opaque);
+				if (downloadRet < 0) {
+					return downloadRet;
+				}
+				picture = systemPicture;
+			}
 
-	av_new_packet(packet, data->size);
-	memcpy(packet->data, data->data, data->size);
+			outputPicture(&picture, (unsigned int)data->size);
+			picture.release(picture.opaque);
+		}
+		if (ret < 0) {
+			return ret;
+		}
+		if (sendRet != FG_DECODE_AGAIN) {
+			return 0;
+		}
+		if (pictures == 0) {
+			// Full but nothing to drain: the backend is wedged
+			return -1;
+		}
+	}
+}
 
-	ret = avcodec_send_packet(this->m_pCodecCtx, packet);
-	frameFinished = avcodec_receive_frame(this->m_pCodecCtx, pFrame);
+bool FgAirplayChannel::isScaled() const
+{
+	return m_fScaleRatio < 0.9999f || m_fScaleRatio > 1.0001f;
+}
 
-	av_packet_unref(packet);
+// Whether device surfaces can go to the consumer as they are
+bool FgAirplayChannel::isDeviceOutput()
+{
+	return !isScaled() && InterlockedCompareExchange(&m_nFrameMode, 0, 0) == FG_VIDEO_FRAME_DEVICE;
+}
 
-	// Did we get a video frame?
-	if (frameFinished == 0)
+void FgAirplayChannel::outputPicture(const SFgDecodedPicture* pPicture, unsigned int encodedDataLen)
+{
+	bool bScale = isScaled();
+	LONG nFrameMode = InterlockedCompareExchange(&m_nFrameMode, 0, 0);
+	// Device pictures only get here when isDeviceOutput() let them through
+	if (pPicture->surfaceType == FG_SURFACE_DEVICE || (!bScale && nFrameMode != FG_VIDEO_FRAME_COPY))
 	{
-		if (m_sVideoFrameOri.width != pFrame->width ||
-			m_sVideoFrameOri.height != pFrame->height) {
-			if (m_sVideoFrameOri.data)
-			{
-				delete[] m_sVideoFrameOri.data;
-				m_sVideoFrameOri.data = NULL;
+		// Hand out the decoder's own planes or surface; the consumer retains
+		// them if it needs them after the callback
+		m_sVideoFrameOri.width = pPicture->width;
+		m_sVideoFrameOri.height = pPicture->height;
+
+		SFgVideoFrame sFrame;
+		memset(&sFrame, 0, sizeof(SFgVideoFrame));
+		sFrame.width = pPicture->width;
+		sFrame.height = pPicture->height;
+		sFrame.pts = pPicture->pts;
+		sFrame.isKey = pPicture->isKey;
+		sFrame.encodedDataLen = encodedDataLen;
+		if (pPicture->surfaceType == FG_SURFACE_DEVICE) {
+			sFrame.flags = FG_VIDEO_FRAME_DEVICE;
+			sFrame.surface = pPicture->surface;
+			sFrame.surfaceIndex = pPicture->surfaceIndex;
+		}
+		else {
+			for (int i = 0; i < 3; i++) {
+				int planeHeight = (i == 0) ? pPicture->height : (pPicture->height + 1) >> 1;
+				sFrame.planes[i] = pPicture->planes[i];
+				sFrame.pitch[i] = pPicture->pitch[i];
+				sFrame.dataLen[i] = pPicture->pitch[i] * planeHeight;
 			}
+			sFrame.dataTotalLen = sFrame.dataLen[0] + sFrame.dataLen[1] + sFrame.dataLen[2];
+			sFrame.flags = FG_VIDEO_FRAME_REFCOUNTED;
 		}
+		sFrame.opaque = pPicture->opaque;
+		sFrame.retain = pPicture->retain;
+		sFrame.release = pPicture->release;
 
-		m_sVideoFrameOri.width = pFrame->width;
-		m_sVideoFrameOri.height = pFrame->height;
-		m_sVideoFrameOri.pts = pFrame->pts;
-		m_sVideoFrameOri.isKey = pFrame->key_frame;
-		int ySize = pFrame->linesize[0] * pFrame->height;
-		int uSize = pFrame->linesize[1] * pFrame->height >> 1;
-		int vSize = pFrame->linesize[2] * pFrame->height >> 1;
-		m_sVideoFrameOri.dataTotalLen = ySize + uSize + vSize;
-		m_sVideoFrameOri.encodedDataLen = (unsigned int)data->size;
-		m_sVideoFrameOri.dataLen[0] = ySize;
-		m_sVideoFrameOri.dataLen[1] = uSize;
-		m_sVideoFrameOri.dataLen[2] = vSize;
-		if (!m_sVideoFrameOri.data)
+		if (m_pCallback != NULL)
 		{
-			m_sVideoFrameOri.data = new uint8_t[m_sVideoFrameOri.dataTotalLen];
+			m_pCallback->outputVideo(&sFrame, m_strRemoteName.c_str(), m_strRemoteDeviceId.c_str());
 		}
-		memcpy(m_sVideoFrameOri.data, pFrame->data[0], ySize);
-		memcpy(m_sVideoFrameOri.data + ySize, pFrame->data[1], uSize);
-		memcpy(m_sVideoFrameOri.data + ySize + uSize, pFrame->data[2], vSize);
-		m_sVideoFrameOri.pitch[0] = pFrame->linesize[0];
-		m_sVideoFrameOri.pitch[1] = pFrame->linesize[1];
-		m_sVideoFrameOri.pitch[2] = pFrame->linesize[2];
+		return;
+	}
 
-		if (m_pCallback != NULL)
+	if (m_sVideoFrameOri.width != pPicture->width ||
+		m_sVideoFrameOri.height != pPicture->height) {
+		if (m_sVideoFrameOri.data)
 		{
-			if (m_fScaleRatio < 0.9999f || m_fScaleRatio > 1.0001f) {
-				scaleH264Data(&m_sVideoFrameOri);
-				m_pCallback->outputVideo(&m_sVideoFrameScale, remoteName, remoteDeviceId);
-			}
-			else {
-				m_pCallback->outputVideo(&m_sVideoFrameOri, remoteName, remoteDeviceId);
-			}
+			delete[] m_sVideoFrameOri.data;
+			m_sVideoFrameOri.data = NULL;
 		}
 	}
-	av_frame_free(&pFrame);
 
-	return 0;
+	m_sVideoFrameOri.width = pPicture->width;
+	m_sVideoFrameOri.height = pPicture->height;
+	m_sVideoFrameOri.pts = pPicture->pts;
+	m_sVideoFrameOri.isKey = pPicture->isKey;
+	int ySize = pPicture->pitch[0] * pPicture->height;
+	int uSize = pPicture->pitch[1] * pPicture->height >> 1;
+	int vSize = pPicture->pitch[2] * pPicture->height >> 1;
+	m_sVideoFrameOri.dataTotalLen = ySize + uSize + vSize;
+	m_sVideoFrameOri.encodedDataLen = encodedDataLen;
+	m_sVideoFrameOri.dataLen[0] = ySize;
+	m_sVideoFrameOri.dataLen[1] = uSize;
+	m_sVideoFrameOri.dataLen[2] = vSize;
+	if (!m_sVideoFrameOri.data)
+	{
+		m_sVideoFrameOri.data = new uint8_t[m_sVideoFrameOri.dataTotalLen];
+	}
+	memcpy(m_sVideoFrameOri.data, pPicture->planes[0], ySize);
+	memcpy(m_sVideoFrameOri.data + ySize, pPicture->planes[1], uSize);
+	memcpy(m_sVideoFrameOri.data + ySize + uSize, pPicture->planes[2], vSize);
+	m_sVideoFrameOri.pitch[0] = pPicture->pitch[0];
+	m_sVideoFrameOri.pitch[1] = pPicture->pitch[1];
+	m_sVideoFrameOri.pitch[2] = pPicture->pitch[2];
+
+	if (m_pCallback != NULL)
+	{
+		if (bScale) {
+			scaleH264Data(&m_sVideoFrameOri);
+			m_pCallback->outputVideo(&m_sVideoFrameScale, m_strRemoteName.c_str(), m_strRemoteDeviceId.c_str());
+		}
+		else {
+			m_pCallback->outputVideo(&m_sVideoFrameOri, m_strRemoteName.c_str(), m_strRemoteDeviceId.c_str());
+		}
+	}
 }
 
 int FgAirplayChannel::scaleH264Data(SFgVideoFrame* pSrcFrame)
@@ -1,10 +1,13 @@
 #pragma once
-#include <queue>
+#include <string>
+#include <vector>
 #include "Airplay2Head.h"
+#include "FgSpscRing.h"
+#include "IVideoDecoder.h"
+#include "stream.h"
 
 extern "C"
 {
-#include <libavcodec/avcodec.h>
 	//#include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/time.h>
@@ -14,51 +17,116 @@ extern "C"
 #include <libswscale/swscale.h>
 }
 
-// H264 data for decoding
-typedef struct SFgH264Data {
-	int pts;
-	int size;
-	int is_key;
-	int width;
-	int height;
-	unsigned char* data;
-}SFgH264Data;
+// Frames buffered between the receive thread and the decode thread
+#define FG_H264_QUEUE_CAPACITY 32
+// Queue age beyond which the decoder is treated as falling behind
+#define FG_H264_LATENCY_BUDGET_MS 100
 
-typedef std::queue<SFgH264Data*> FgH264DataQueue;
+typedef FgSpscRing<SFgH264Data, FG_H264_QUEUE_CAPACITY> FgH264DataQueue;
 
 
 class FgAirplayChannel
 {
 public:
-	FgAirplayChannel(IAirServerCallback* pCallback);
+	FgAirplayChannel(IAirServerCallback* pCallback, const char* remoteName,
+		const char* remoteDeviceId, int nDecodeThreads);
 	~FgAirplayChannel();
 
 public:
 	long addRef();
 	long release();
 
-	int initFFmpeg(const void* privatedata, int privatedatalen);
-	void unInitFFmpeg();
+	// The decode thread owns the codec; frames are handed over with pushH264Data
+	bool startDecodeThread();
+	void stopDecodeThread();
+	bool pushH264Data(const SFgH264Data* data);
+	void getStats(SFgSessionStats* pStats);
+	void setAudioRecvStats(const audio_recv_stats_struct* stats);
+
+	void closeDecoder();
 	float setScale(float fRatio);
-	int decodeH264Data(SFgH264Data* data, const char* remoteName, const char* remoteDeviceId);
+	void setFrameMode(int nFrameMode);
+	void setDecodeMode(int nDecodeMode);
+	int decodeH264Data(SFgH264Data* data);
 	int scaleH264Data(SFgVideoFrame* ppFrame);
 
+protected:
+	static DWORD WINAPI decodeThreadProc(LPVOID lpParam);
+	void decodeLoop();
+	void freeH264Data(SFgH264Data* data);
+	void countDropped(volatile LONGLONG* pReason);
+	void setCodecConfig(const unsigned char* data, int size);
+	int configureDecoder(SFgH264Data* data);
+	bool isScaled() const;
+	bool isDeviceOutput();
+	void outputPicture(const SFgDecodedPicture* pPicture, unsigned int encodedDataLen);
+	void trackThroughput(const SFgH264Data* data, LONG decodeUs);
+
 protected:
 	long m_nRef;
 
 	FgH264DataQueue			m_h264Queue;
 	IAirServerCallback*		m_pCallback;
+	std::string				m_strRemoteName;
+	std::string				m_strRemoteDeviceId;
 
-	AVCodec*				m_pCodec;
-	AVCodecContext*			m_pCodecCtx;
+	IVideoDecoder*			m_pDecoder;
 	SwsContext*				m_pSwsCtx;
-	bool					m_bCodecOpened;
+	int						m_nDecodeThreads;	// Thread budget; the decoder config may use fewer
+
+	// Decode thread state for choosing the decoder threading
+	std::vector<unsigned char>	m_vecCodecConfig;	// Last SPS/PPS packet, the decoder extradata
+	SFgH264StreamInfo		m_sStreamInfo;
+	bool					m_bConfigChanged;	// New SPS/PPS not yet applied to the decoder
+	SFgDecoderConfig		m_sDecoderConfig;	// Configuration the open decoder runs with
+	int						m_nConfigMode;		// Decode mode m_sDecoderConfig was chosen for
+	int						m_nSlices;			// Slices in the last IDR
+	bool					m_bBehind;			// Latency mode could not keep up single-threaded
+	int						m_nBehindFrames;
+	LONGLONG				m_nLastEnqueueQpc;
+	LONG					m_nFrameIntervalUs;	// Smoothed gap between sender frames
+	volatile LONG			m_nDecodeMode;		// FG_DECODE_MODE_*, applied at the next IDR
 
 	void*					m_mutexAudio;
 	void*					m_mutexVideo;
+	void*					m_mutexQueue;		// Serializes starting and stopping the decode thread
+	HANDLE					m_hQueueEvent;
+	HANDLE					m_hDecodeThread;
+	volatile LONG			m_bQuit;
+	LARGE_INTEGER			m_qpcFreq;
+
+	// Receive thread state
+	LONG					m_nNextSeq;
+	bool					m_bWaitKey;			// Ring overflowed: drop everything until the next IDR
+	bool					m_bSkipNonRef;		// Over budget: drop non-reference frames until the next IDR
+	SFgH264Data				m_sPendingConfig;	// Newest SPS/PPS the full ring turned away
+	bool					m_bConfigPending;
+	// Written by the receive thread, read by the decode thread
+	volatile LONG			m_nFlushSeq;		// Video frames queued before this IDR are stale
+
+	// Counters shared by both threads, published through getStats()
+	volatile LONGLONG		m_nFramesReceived;
+	volatile LONGLONG		m_nBytesReceived;
+	volatile LONGLONG		m_nFramesDecoded;
+	volatile LONGLONG		m_nFramesDropped;
+	volatile LONGLONG		m_nFramesSkipped;
+	volatile LONGLONG		m_nFramesFlushed;
+	volatile LONG			m_nQueueHighWater;
+	volatile LONG			m_nQueueLatencyUs;
+	volatile LONG			m_nDecodeUs;
+	// Reported by the audio receive thread, rates in thousandths
+	volatile LONGLONG		m_nAudioPackets;
+	volatile LONG			m_nAudioWakeupsMilli;
+	volatile LONG			m_nAudioSyscallsMilli;
+	volatile LONGLONG		m_nAudioSocketDrops;
+	volatile LONGLONG		m_nAudioPacketsLost;
+	volatile LONGLONG		m_nAudioPacketsRecovered;
+	volatile LONGLONG		m_nAudioPacketsConcealed;
+	volatile LONGLONG		m_nAudioPacketsLate;
+	volatile LONGLONG		m_nAudioResendRequests;
 
 	SFgVideoFrame			m_sVideoFrameOri;
 	SFgVideoFrame			m_sVideoFrameScale;
 	float					m_fScaleRatio;
+	volatile LONG			m_nFrameMode;		// FG_VIDEO_FRAME_*
 };
-
@@ -2,6 +2,7 @@
 #include "Airplay2Head.h"
 #include "stream.h"
 #include <map>
+#include <set>
 #include <string>
 
 #include "dnssd.h"
@@ -11,6 +12,12 @@
 
 typedef std::map<std::string, FgAirplayChannel*> FgAirplayChannelMap;
 
+// Upper bound for the session limit, one tile each in a 3x3 wall
+#define FG_MAX_SESSIONS 9
+// RAOP connections allowed beyond the session limit, so refused senders can
+// still finish their handshake while the admitted ones stay connected
+#define FG_REFUSED_CONNECTIONS 4
+
 class FgAirplayServer
 {
 public:
@@ -23,10 +30,19 @@ public:
 		unsigned int displayWidth, unsigned int displayHeight);
 	void stop();
 	float setScale(float fRatio);
+	int setVideoFrameMode(int nFrameMode);
+	int setDecodeMode(int nDecodeMode);
+	int setMaxSessions(int maxSessions);
+	int setAudioLatency(int latencyMs);
+	void setAudioBuffer(int lengthPackets, int prerollPackets);
+	void setAudioDecodeThread(int enabled);
+	void setAudioSampleFormat(int sampleFormat);
+	int getSessionStats(SFgSessionStats* stats, int maxCount);
 
 protected:
 	void clearChannels();
-	FgAirplayChannel* getChannel(const char* remoteDeviceId);
+	FgAirplayChannel* getChannel(const char* remoteName, const char* remoteDeviceId);
+	bool isRejected(const char* remoteDeviceId);
 
 	static void connected(void* cls, const char* remoteName, const char* remoteDeviceId);
 	static void disconnected(void* cls, const char* remoteName, const char* remoteDeviceId);
@@ -38,6 +54,7 @@ protected:
 	static void audio_process(void* cls, pcm_data_struct* data, const char* remoteName, const char* remoteDeviceId);
 	static void audio_flush(void* cls, void* session, const char* remoteName, const char* remoteDeviceId);
 	static void audio_destroy(void* cls, void* session, const char* remoteName, const char* remoteDeviceId);
+	static void audio_recv_stats(void* cls, const audio_recv_stats_struct* stats, const char* remoteName, const char* remoteDeviceId);
 	static void video_process(void* cls, h264_decode_struct* data, const char* remoteName, const char* remoteDeviceId);
 	static int pin_request(void* cls, const char* remoteAddress, const char* pin);
 	static void log_callback(void* cls, int level, const char* msg);
@@ -60,5 +77,19 @@ protected:
 	void*					m_mutexMap;
 
 	float					m_fScaleRatio;
+	int						m_nFrameMode;
+	int						m_nDecodeMode;
+	int						m_nAudioLatencyMs;	// Jitter buffer wait for new audio sessions, 0 for none
+	int						m_nAudioBufferLength;	// Reorder window in packets, 0 for the library default
+	int						m_nAudioPreroll;
+	bool					m_bAudioDecodeThread;	// Decode audio off the receive thread
+	int						m_nAudioSampleFormat;	// FG_AUDIO_FORMAT_* for new audio sessions
 	FgAirplayChannelMap		m_mapChannel;
+
+	// Admission: sessions beyond m_nMaxSessions are refused so that every
+	// admitted decoder keeps m_nDecodeThreads of the available cores
+	int						m_nCpuCores;
+	int						m_nMaxSessions;
+	int						m_nDecodeThreads;
+	std::set<std::string>	m_setRejected;
 };
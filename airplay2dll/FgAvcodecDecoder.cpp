@@ -0,0 +1,191 @@
+#include "FgAvcodecDecoder.h"
+#include "Airplay2Head.h"
+#include "raop.h"
+
+static_assert(H264_DATA_PADDING_SIZE >= AV_INPUT_BUFFER_PADDING_SIZE,
+	"receiver payload padding must cover the libavcodec input padding");
+
+// AVBuffer free callback for packets that wrap a pooled receiver payload
+static void releasePayload(void* opaque, uint8_t* data)
+{
+	raop_payload_release(opaque);
+}
+
+// Shared ownership of a decoded frame handed out as SFgDecodedPicture::opaque
+typedef struct SFgFrameRef {
+	volatile LONG refs;
+	AVFrame* frame;
+} SFgFrameRef;
+
+static void retainFrameRef(void* opaque)
+{
+	InterlockedIncrement(&((SFgFrameRef*)opaque)->refs);
+}
+
+static void releaseFrameRef(void* opaque)
+{
+	SFgFrameRef* ref = (SFgFrameRef*)opaque;
+	if (InterlockedDecrement(&ref->refs) == 0) {
+		av_frame_free(&ref->frame);
+		delete ref;
+	}
+}
+
+FgAvcodecDecoder::FgAvcodecDecoder()
+	: m_pCodec(NULL)
+	, m_pCodecCtx(NULL)
+	, m_pFrame(NULL)
+{
+}
+
+FgAvcodecDecoder::~FgAvcodecDecoder()
+{
+	close();
+	av_frame_free(&m_pFrame);
+}
+
+int FgAvcodecDecoder::open(const unsigned char* config, int configSize, const SFgDecoderConfig* pConfig)
+{
+	close();
+	if (m_pCodec == NULL) {
+		m_pCodec = avcodec_find_decoder(AV_CODEC_ID_H264);
+	}
+	if (m_pFrame == NULL) {
+		m_pFrame = av_frame_alloc();
+	}
+	if (m_pCodec == NULL || m_pFrame == NULL) {
+		return -1;
+	}
+	m_pCodecCtx = avcodec_alloc_context3(m_pCodec);
+	if (m_pCodecCtx == NULL) {
+		return -1;
+	}
+
+	m_pCodecCtx->extradata = (uint8_t*)av_mallocz(configSize + AV_INPUT_BUFFER_PADDING_SIZE);
+	m_pCodecCtx->extradata_size = configSize;
+	memcpy(m_pCodecCtx->extradata, config, configSize);
+	m_pCodecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+	// Note: NOT using AV_CODEC_FLAG2_FAST - keep full deblocking for clean video
+	// Threading comes from the channel, within the session's thread budget
+	m_pCodecCtx->thread_count = pConfig->threadCount > 0 ? pConfig->threadCount : 1;
+	if (pConfig->threading == FG_DECODE_THREADING_FRAME) {
+		// libavcodec silently falls back to slice threading under LOW_DELAY
+		m_pCodecCtx->thread_type = FF_THREAD_FRAME;
+	}
+	else {
+		m_pCodecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;  // Low latency mode - output frames immediately
+		m_pCodecCtx->thread_type = FF_THREAD_SLICE;
+	}
+
+	int res = avcodec_open2(m_pCodecCtx, m_pCodec, NULL);
+	if (res < 0)
+	{
+		printf("Failed to initialize decoder\n");
+		avcodec_free_context(&m_pCodecCtx);
+		return -1;
+	}
+
+	return 0;
+}
+
+void FgAvcodecDecoder::close()
+{
+	if (m_pCodecCtx)
+	{
+		// Frames already handed out keep their own buffer references
+		avcodec_free_context(&m_pCodecCtx);
+		m_pCodecCtx = NULL;
+	}
+}
+
+int FgAvcodecDecoder::sendPacket(const SFgH264Data* data)
+{
+	if (m_pCodecCtx == NULL) {
+		return -1;
+	}
+
+	AVPacket pkt1, * packet = &pkt1;
+	if (data->buffer != NULL) {
+		// Decode straight from the decrypted receive buffer. The packet holds a
+		// payload reference for as long as libavcodec keeps the bitstream.
+		av_init_packet(packet);
+		packet->buf = av_buffer_create(data->data, data->size + H264_DATA_PADDING_SIZE,
+			releasePayload, data->buffer, AV_BUFFER_FLAG_READONLY);
+		if (packet->buf == NULL) {
+			return -1;
+		}
+		raop_payload_retain(data->buffer);
+		packet->data = data->data;
+		packet->size = data->size;
+	}
+	else {
+		if (av_new_packet(packet, data->size) < 0) {
+			return -1;
+		}
+		memcpy(packet->data, data->data, data->size);
+	}
+
+	// Carried through reordering and frame threading to the picture
+	packet->pts = data->pts;
+	int ret = avcodec_send_packet(m_pCodecCtx, packet);
+	av_packet_unref(packet);
+
+	if (ret == AVERROR(EAGAIN)) {
+		return FG_DECODE_AGAIN;
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+int FgAvcodecDecoder::receivePicture(SFgDecodedPicture* pPicture)
+{
+	if (m_pCodecCtx == NULL) {
+		return -1;
+	}
+
+	int ret = avcodec_receive_frame(m_pCodecCtx, m_pFrame);
+	if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+		return 0;
+	}
+	if (ret < 0) {
+		return -1;
+	}
+
+	// The picture takes over the frame's buffers; m_pFrame is left blank for
+	// the next receive
+	SFgFrameRef* ref = new SFgFrameRef;
+	ref->refs = 1;
+	ref->frame = av_frame_alloc();
+	if (ref->frame == NULL) {
+		delete ref;
+		av_frame_unref(m_pFrame);
+		return -1;
+	}
+	av_frame_move_ref(ref->frame, m_pFrame);
+
+	AVFrame* pFrame = ref->frame;
+	memset(pPicture, 0, sizeof(SFgDecodedPicture));
+	pPicture->width = pFrame->width;
+	pPicture->height = pFrame->height;
+	pPicture->pts = (pFrame->pts == AV_NOPTS_VALUE) ? 0 : pFrame->pts;
+	pPicture->isKey = pFrame->key_frame;
+	pPicture->surfaceType = FG_SURFACE_SYSTEM;
+	for (int i = 0; i < 3; i++) {
+		pPicture->planes[i] = pFrame->data[i];
+		pPicture->pitch[i] = pFrame->linesize[i];
+	}
+	pPicture->opaque = ref;
+	pPicture->retain = retainFrameRef;
+	pPicture->release = releaseFrameRef;
+	return 1;
+}
+
+int FgAvcodecDecoder::download(const SFgDecodedPicture* pSource, SFgDecodedPicture* pPicture)
+{
+	if (pSource->surfaceType != FG_SURFACE_SYSTEM) {
+		return -1;
+	}
+	pSource->retain(pSource->opaque);
+	*pPicture = *pSource;
+	return 0;
+}
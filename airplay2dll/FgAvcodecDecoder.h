@@ -0,0 +1,30 @@
+#pragma once
+#include "IVideoDecoder.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+
+// Reference backend: libavcodec software decoding. Pictures reference the
+// decoder's own frame buffers, so output involves no copy.
+class FgAvcodecDecoder : public IVideoDecoder
+{
+public:
+	FgAvcodecDecoder();
+	virtual ~FgAvcodecDecoder();
+
+	virtual const char* name() const { return "libavcodec"; }
+	virtual int open(const unsigned char* config, int configSize, const SFgDecoderConfig* pConfig);
+	virtual void close();
+	virtual bool isOpen() const { return m_pCodecCtx != NULL; }
+	virtual int sendPacket(const SFgH264Data* data);
+	virtual int receivePicture(SFgDecodedPicture* pPicture);
+	virtual int download(const SFgDecodedPicture* pSource, SFgDecodedPicture* pPicture);
+
+protected:
+	AVCodec*				m_pCodec;
+	AVCodecContext*			m_pCodecCtx;
+	AVFrame*				m_pFrame;
+};
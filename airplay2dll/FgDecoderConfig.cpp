@@ -0,0 +1,281 @@
+#include "FgDecoderConfig.h"
+#include "Airplay2Head.h"
+
+#include <string.h>
+#include <vector>
+
+// Luma macroblocks in a 1280x720 picture
+#define FG_MBS_720P 3600
+
+// Reads an RBSP with the emulation prevention bytes already removed
+class FgBitReader
+{
+public:
+	FgBitReader(const unsigned char* data, int size)
+		: m_data(data)
+		, m_bits(size * 8)
+		, m_pos(0)
+	{
+	}
+
+	bool overrun() const { return m_pos > m_bits; }
+
+	unsigned int u(int n)
+	{
+		unsigned int value = 0;
+		for (int i = 0; i < n; i++) {
+			value <<= 1;
+			if (m_pos < m_bits) {
+				value |= (m_data[m_pos >> 3] >> (7 - (m_pos & 7))) & 1;
+			}
+			m_pos++;
+		}
+		return value;
+	}
+
+	unsigned int ue()
+	{
+		int zeros = 0;
+		while (u(1) == 0) {
+			if (++zeros > 31 || overrun()) {
+				return 0;
+			}
+		}
+		return ((1u << zeros) - 1) + u(zeros);
+	}
+
+	int se()
+	{
+		unsigned int value = ue();
+		return (value & 1) ? (int)((value + 1) / 2) : -(int)(value / 2);
+	}
+
+private:
+	const unsigned char* m_data;
+	int m_bits;
+	int m_pos;
+};
+
+// Finds the next Annex-B NAL unit at or after *pPos. On success *pPos is
+// advanced past it and the payload (header byte included) is returned.
+static bool nextNal(const unsigned char* data, int size, int* pPos, const unsigned char** pNal, int* pNalSize)
+{
+	int i = *pPos;
+	while (i + 2 < size && !(data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)) {
+		i++;
+	}
+	if (i + 3 >= size) {
+		return false;
+	}
+	int start = i + 3;
+	int end = start;
+	while (end + 2 < size && !(data[end] == 0 && data[end + 1] == 0 && (data[end + 2] == 1 || data[end + 2] == 0))) {
+		end++;
+	}
+	if (end + 2 >= size) {
+		end = size;
+	}
+	*pNal = data + start;
+	*pNalSize = end - start;
+	*pPos = end;
+	return true;
+}
+
+static void unescapeRbsp(const unsigned char* nal, int size, std::vector<unsigned char>& rbsp)
+{
+	rbsp.clear();
+	rbsp.reserve(size);
+	int zeros = 0;
+	for (int i = 0; i < size; i++) {
+		if (zeros >= 2 && nal[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		zeros = (nal[i] == 0) ? zeros + 1 : 0;
+		rbsp.push_back(nal[i]);
+	}
+}
+
+static void skipScalingList(FgBitReader& br, int count)
+{
+	int lastScale = 8;
+	int nextScale = 8;
+	for (int i = 0; i < count; i++) {
+		if (nextScale != 0) {
+			nextScale = (lastScale + br.se() + 256) % 256;
+		}
+		lastScale = (nextScale == 0) ? lastScale : nextScale;
+	}
+}
+
+static bool parseSps(const unsigned char* rbsp, int size, SFgH264StreamInfo* pInfo)
+{
+	FgBitReader br(rbsp, size);
+	br.u(8);	// NAL header
+	pInfo->profileIdc = br.u(8);
+	br.u(8);	// constraint flags
+	pInfo->levelIdc = br.u(8);
+	br.ue();	// seq_parameter_set_id
+
+	int chromaFormat = 1;
+	int separatePlanes = 0;
+	switch (pInfo->profileIdc) {
+	case 100: case 110: case 122: case 244: case 44:
+	case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+		chromaFormat = br.ue();
+		if (chromaFormat == 3) {
+			separatePlanes = br.u(1);
+		}
+		br.ue();	// bit_depth_luma_minus8
+		br.ue();	// bit_depth_chroma_minus8
+		br.u(1);	// qpprime_y_zero_transform_bypass_flag
+		if (br.u(1)) {
+			int lists = (chromaFormat != 3) ? 8 : 12;
+			for (int i = 0; i < lists; i++) {
+				if (br.u(1)) {
+					skipScalingList(br, i < 6 ? 16 : 64);
+				}
+			}
+		}
+		break;
+	default:
+		break;
+	}
+
+	br.ue();	// log2_max_frame_num_minus4
+	int pocType = br.ue();
+	if (pocType == 0) {
+		br.ue();	// log2_max_pic_order_cnt_lsb_minus4
+	}
+	else if (pocType == 1) {
+		br.u(1);
+		br.se();
+		br.se();
+		int cycle = br.ue();
+		for (int i = 0; i < cycle && !br.overrun(); i++) {
+			br.se();
+		}
+	}
+	pInfo->numRefFrames = br.ue();
+	br.u(1);	// gaps_in_frame_num_value_allowed_flag
+	int widthMbs = br.ue() + 1;
+	int heightMapUnits = br.ue() + 1;
+	int frameMbsOnly = br.u(1);
+	if (!frameMbsOnly) {
+		br.u(1);	// mb_adaptive_frame_field_flag
+	}
+	br.u(1);	// direct_8x8_inference_flag
+
+	int width = widthMbs * 16;
+	int height = heightMapUnits * 16 * (2 - frameMbsOnly);
+	if (br.u(1)) {
+		int cropUnitX = 1;
+		int cropUnitY = 2 - frameMbsOnly;
+		if (chromaFormat != 0 && !separatePlanes) {
+			cropUnitX *= (chromaFormat == 3) ? 1 : 2;
+			cropUnitY *= (chromaFormat == 1) ? 2 : 1;
+		}
+		int left = br.ue();
+		int right = br.ue();
+		int top = br.ue();
+		int bottom = br.ue();
+		width -= (left + right) * cropUnitX;
+		height -= (top + bottom) * cropUnitY;
+	}
+	if (br.overrun() || width <= 0 || height <= 0) {
+		return false;
+	}
+	pInfo->width = width;
+	pInfo->height = height;
+	return true;
+}
+
+bool fgParseH264Config(const unsigned char* data, int size, SFgH264StreamInfo* pInfo)
+{
+	memset(pInfo, 0, sizeof(SFgH264StreamInfo));
+	pInfo->numSliceGroups = 1;
+
+	bool bSps = false;
+	std::vector<unsigned char> rbsp;
+	const unsigned char* nal = NULL;
+	int nalSize = 0;
+	int pos = 0;
+	while (nextNal(data, size, &pos, &nal, &nalSize)) {
+		if (nalSize < 2) {
+			continue;
+		}
+		int nalType = nal[0] & 0x1f;
+		if (nalType == 7 && !bSps) {
+			unescapeRbsp(nal, nalSize, rbsp);
+			bSps = parseSps(&rbsp[0], (int)rbsp.size(), pInfo);
+		}
+		else if (nalType == 8) {
+			unescapeRbsp(nal, nalSize, rbsp);
+			FgBitReader br(&rbsp[0], (int)rbsp.size());
+			br.u(8);	// NAL header
+			br.ue();	// pic_parameter_set_id
+			br.ue();	// seq_parameter_set_id
+			br.u(1);	// entropy_coding_mode_flag
+			br.u(1);	// bottom_field_pic_order_in_frame_present_flag
+			int groups = br.ue() + 1;
+			if (!br.overrun()) {
+				pInfo->numSliceGroups = groups;
+			}
+		}
+	}
+	return bSps;
+}
+
+int fgCountSlices(const unsigned char* data, int size)
+{
+	int slices = 0;
+	for (int i = 0; i + 3 < size; i++) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			int nalType = data[i + 3] & 0x1f;
+			if (nalType == 1 || nalType == 5) {
+				slices++;
+			}
+			i += 3;
+		}
+	}
+	return slices;
+}
+
+// Slice threading splits each picture, so it costs no latency but only helps
+// when the sender encodes several slices; iOS usually sends one. Frame
+// threading works on any stream but holds back one frame per extra thread,
+// and libavcodec only enables it without AV_CODEC_FLAG_LOW_DELAY.
+void fgChooseDecoderConfig(const SFgH264StreamInfo* pInfo, int nSlices, int nThreadBudget,
+	int nMode, bool bBehind, SFgDecoderConfig* pConfig)
+{
+	const int budget = nThreadBudget > 0 ? nThreadBudget : 1;
+	const int mbs = ((pInfo->width + 15) / 16) * ((pInfo->height + 15) / 16);
+
+	pConfig->threading = FG_DECODE_THREADING_NONE;
+	pConfig->threadCount = 1;
+	pConfig->delayFrames = 0;
+	if (budget < 2) {
+		return;
+	}
+
+	if (nMode == FG_DECODE_MODE_THROUGHPUT) {
+		// Up to 720p two frames in flight already outrun any sender
+		pConfig->threading = FG_DECODE_THREADING_FRAME;
+		pConfig->threadCount = (mbs <= FG_MBS_720P && budget > 2) ? 2 : budget;
+		pConfig->delayFrames = pConfig->threadCount - 1;
+		return;
+	}
+
+	if (nSlices != 1) {
+		// Unknown counts as multi-slice until the first picture says otherwise
+		pConfig->threading = FG_DECODE_THREADING_SLICE;
+		pConfig->threadCount = (nSlices > 1 && nSlices < budget) ? nSlices : budget;
+	}
+	else if (bBehind) {
+		// A single slice that one core cannot decode in time: the shallowest
+		// frame pipeline, one frame of delay for roughly twice the throughput
+		pConfig->threading = FG_DECODE_THREADING_FRAME;
+		pConfig->threadCount = 2;
+		pConfig->delayFrames = 1;
+	}
+}
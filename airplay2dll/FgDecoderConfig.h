@@ -0,0 +1,30 @@
+#pragma once
+
+// Stream properties read from the mirror codec config packet (SPS + PPS)
+typedef struct SFgH264StreamInfo {
+	int profileIdc;
+	int levelIdc;
+	int width;				// Cropped luma size
+	int height;
+	int numRefFrames;
+	int numSliceGroups;		// From the PPS; above 1 only with Baseline FMO
+} SFgH264StreamInfo;
+
+// How libavcodec should thread one session's decoder
+typedef struct SFgDecoderConfig {
+	int threading;			// FG_DECODE_THREADING_*
+	int threadCount;
+	int delayFrames;		// Output delay the threading adds, in frames
+} SFgDecoderConfig;
+
+// Parses an Annex-B SPS/PPS pair. Returns false when no usable SPS is found.
+bool fgParseH264Config(const unsigned char* data, int size, SFgH264StreamInfo* pInfo);
+
+// Number of slice NAL units in an Annex-B access unit
+int fgCountSlices(const unsigned char* data, int size);
+
+// Picks slice or frame threading for the stream. nThreadBudget is the share of
+// the host cores the session limit grants; nSlices is 0 while unknown. bBehind
+// asks for more throughput than the current configuration delivered.
+void fgChooseDecoderConfig(const SFgH264StreamInfo* pInfo, int nSlices, int nThreadBudget,
+	int nMode, bool bBehind, SFgDecoderConfig* pConfig);
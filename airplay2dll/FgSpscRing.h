@@ -0,0 +1,74 @@
+#pragma once
+#include <Windows.h>
+
+// Bounded single-producer/single-consumer ring. The mirror receive thread
+// pushes and the channel's decode thread pops; neither side takes a lock.
+// Slots hold items by value and Capacity must be a power of two.
+template <typename T, unsigned int Capacity>
+class FgSpscRing
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+		"ring capacity must be a power of two");
+
+public:
+	FgSpscRing()
+		: m_head(0)
+		, m_tail(0)
+	{
+	}
+
+	// Producer only. Returns false when the ring is full.
+	bool push(const T& item)
+	{
+		LONG head = m_head;
+		LONG tail = InterlockedCompareExchange(&m_tail, 0, 0);
+		if ((ULONG)(head - tail) >= Capacity) {
+			return false;
+		}
+		m_slots[head & (Capacity - 1)] = item;
+		// Publish the slot before the new head becomes visible
+		InterlockedExchange(&m_head, head + 1);
+		return true;
+	}
+
+	// Consumer only. Returns false when the ring is empty.
+	bool pop(T& item)
+	{
+		LONG tail = m_tail;
+		LONG head = InterlockedCompareExchange(&m_head, 0, 0);
+		if (head == tail) {
+			return false;
+		}
+		item = m_slots[tail & (Capacity - 1)];
+		InterlockedExchange(&m_tail, tail + 1);
+		return true;
+	}
+
+	// Producer only: the item the consumer will pop next. The slot is not
+	// reused until the producer pushes over it, so reading it here is safe
+	// even while the consumer advances.
+	bool peekOldest(T& item) const
+	{
+		LONG tail = InterlockedCompareExchange((volatile LONG*)&m_tail, 0, 0);
+		if (m_head == tail) {
+			return false;
+		}
+		item = m_slots[tail & (Capacity - 1)];
+		return true;
+	}
+
+	unsigned int size() const
+	{
+		LONG head = InterlockedCompareExchange((volatile LONG*)&m_head, 0, 0);
+		LONG tail = InterlockedCompareExchange((volatile LONG*)&m_tail, 0, 0);
+		return (unsigned int)(ULONG)(head - tail);
+	}
+
+	unsigned int capacity() const { return Capacity; }
+
+private:
+	T m_slots[Capacity];
+	// Free-running counters; only the producer writes m_head, only the consumer m_tail
+	volatile LONG m_head;
+	volatile LONG m_tail;
+};
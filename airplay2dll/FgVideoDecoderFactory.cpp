@@ -0,0 +1,45 @@
+#include "IVideoDecoder.h"
+#include "FgAvcodecDecoder.h"
+
+#include <string.h>
+
+// Registered backends, most preferred first. A hardware backend goes in front
+// of the reference decoder and returns NULL from its create function when the
+// machine lacks the device, so sessions fall through to software.
+typedef IVideoDecoder* (*PFN_CREATE_VIDEO_DECODER)();
+
+static IVideoDecoder* createAvcodecDecoder()
+{
+	return new FgAvcodecDecoder();
+}
+
+static const struct {
+	const char* name;
+	PFN_CREATE_VIDEO_DECODER create;
+} s_videoDecoders[] = {
+	{ "libavcodec", createAvcodecDecoder },
+};
+
+IVideoDecoder* createVideoDecoder(const char* name)
+{
+	const int count = sizeof(s_videoDecoders) / sizeof(s_videoDecoders[0]);
+	if (name != NULL) {
+		for (int i = 0; i < count; i++) {
+			if (_stricmp(name, s_videoDecoders[i].name) == 0) {
+				IVideoDecoder* pDecoder = s_videoDecoders[i].create();
+				if (pDecoder != NULL) {
+					return pDecoder;
+				}
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		IVideoDecoder* pDecoder = s_videoDecoders[i].create();
+		if (pDecoder != NULL) {
+			return pDecoder;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <Windows.h>
+#include "FgDecoderConfig.h"
+
+// H264 data for decoding
+typedef struct SFgH264Data {
+	long long pts;		// local presentation time in ns (QPC clock), 0 when unknown
+	int size;
+	int is_key;
+	int width;
+	int height;
+	unsigned char* data;
+	void* buffer;		// pooled receiver payload backing data, NULL if data must be copied
+	int is_idr;			// first slice is an IDR
+	int is_ref;			// nal_ref_idc != 0, later frames may predict from it
+	LONG seq;			// enqueue order, compared against the IDR flush mark
+	LONGLONG enqueue_qpc;
+}SFgH264Data;
+
+// Where a decoded picture lives
+#define FG_SURFACE_SYSTEM	0	// planes hold I420 in system memory
+#define FG_SURFACE_DEVICE	1	// surface is a backend-specific GPU handle, planes are NULL
+
+// A decoded picture. It stays valid until release(opaque) drops the last
+// reference, independently of later decode calls.
+typedef struct SFgDecodedPicture {
+	int width;
+	int height;
+	long long pts;
+	int isKey;
+	int surfaceType;	// FG_SURFACE_*
+	unsigned char* planes[3];
+	int pitch[3];
+	void* surface;		// FG_SURFACE_DEVICE: e.g. an ID3D11Texture2D*
+	int surfaceIndex;	// Array slice of surface
+	void* opaque;
+	void (*retain)(void* opaque);
+	void (*release)(void* opaque);
+} SFgDecodedPicture;
+
+// sendPacket() could not take the data yet
+#define FG_DECODE_AGAIN		1
+
+// H.264 decoder backend of a mirroring session. Only the session's decode
+// thread calls it, so implementations need no locking of their own.
+class IVideoDecoder
+{
+public:
+	virtual ~IVideoDecoder() {}
+
+	virtual const char* name() const = 0;
+
+	// config is the Annex-B SPS/PPS packet. Backends that schedule their own
+	// work may ignore the threading in pConfig.
+	virtual int open(const unsigned char* config, int configSize, const SFgDecoderConfig* pConfig) = 0;
+	virtual void close() = 0;
+	virtual bool isOpen() const = 0;
+
+	// Returns 0 once the decoder holds the access unit, FG_DECODE_AGAIN when it
+	// is full and pictures must be received before the same data is sent
+	// again, and < 0 on error. Payload-backed data is referenced rather than
+	// copied for as long as the backend keeps the bitstream.
+	virtual int sendPacket(const SFgH264Data* data) = 0;
+
+	// Returns 1 and fills pPicture when a picture is ready, 0 when the decoder
+	// needs more input and < 0 on error. One packet can release several
+	// pictures, so callers receive until this returns 0.
+	virtual int receivePicture(SFgDecodedPicture* pPicture) = 0;
+
+	// Reads a picture back into system memory for consumers that cannot take a
+	// device surface. System-memory pictures are just retained.
+	virtual int download(const SFgDecodedPicture* pSource, SFgDecodedPicture* pPicture) = 0;
+};
+
+// Creates the backend registered under name, or the default one when name is
+// NULL or unknown. Returns NULL if no backend can be created.
+IVideoDecoder* createVideoDecoder(const char* name);
@@ -40,3 +40,77 @@ float fgServerScale(void* handle, float fRatio)
 
 	return 1.0f;
 }
+
+int fgServerSetVideoFrameMode(void* handle, int mode)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		return pServer->setVideoFrameMode(mode);
+	}
+
+	return FG_VIDEO_FRAME_COPY;
+}
+
+int fgServerSetDecodeMode(void* handle, int mode)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		return pServer->setDecodeMode(mode);
+	}
+
+	return FG_DECODE_MODE_LATENCY;
+}
+
+int fgServerSetMaxSessions(void* handle, int maxSessions)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		return pServer->setMaxSessions(maxSessions);
+	}
+
+	return 0;
+}
+
+int fgServerSetAudioLatency(void* handle, int latencyMs)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		return pServer->setAudioLatency(latencyMs);
+	}
+
+	return 0;
+}
+
+void fgServerSetAudioBuffer(void* handle, int lengthPackets, int prerollPackets)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		pServer->setAudioBuffer(lengthPackets, prerollPackets);
+	}
+}
+
+void fgServerSetAudioDecodeThread(void* handle, int enabled)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		pServer->setAudioDecodeThread(enabled);
+	}
+}
+
+void fgServerSetAudioSampleFormat(void* handle, int sampleFormat)
+{
+	if (handle != NULL) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		pServer->setAudioSampleFormat(sampleFormat);
+	}
+}
+
+int fgServerGetSessionStats(void* handle, SFgSessionStats* stats, int maxCount)
+{
+	if (handle != NULL && stats != NULL && maxCount > 0) {
+		FgAirplayServer* pServer = (FgAirplayServer*)handle;
+		return pServer->getSessionStats(stats, maxCount);
+	}
+
+	return 0;
+}
@@ -13,6 +13,7 @@
 #endif
 
 static BOOL GetPrimaryMacAddress(char strMac[6]);
+static int GetCpuCoreCount();
 
 FgAirplayServer::FgAirplayServer()
 	: m_pCallback(NULL)
@@ -20,6 +21,16 @@ FgAirplayServer::FgAirplayServer()
 	, m_pAirplay(NULL)
 	, m_pRaop(NULL)
 	, m_fScaleRatio(1.0f)
+	, m_nFrameMode(FG_VIDEO_FRAME_COPY)
+	, m_nDecodeMode(FG_DECODE_MODE_LATENCY)
+	, m_nAudioLatencyMs(0)
+	, m_nAudioBufferLength(0)
+	, m_nAudioPreroll(0)
+	, m_bAudioDecodeThread(false)
+	, m_nAudioSampleFormat(FG_AUDIO_FORMAT_S16)
+	, m_nCpuCores(GetCpuCoreCount())
+	, m_nMaxSessions(1)
+	, m_nDecodeThreads(1)
 {
 	memset(&m_stAirplayCB, 0, sizeof(airplay_callbacks_t));
 	memset(&m_stRaopCB, 0, sizeof(raop_callbacks_t));
@@ -42,11 +53,13 @@ FgAirplayServer::FgAirplayServer()
 	m_stRaopCB.audio_set_coverart = audio_set_coverart;
 	m_stRaopCB.audio_process = audio_process;
 	m_stRaopCB.audio_flush = audio_flush;
+	m_stRaopCB.audio_recv_stats = audio_recv_stats;
 	// m_stRaopCB.audio_destroy = audio_destroy;
 	m_stRaopCB.video_process = video_process;
 	m_stRaopCB.pin_request = pin_request;
 
 	m_mutexMap = CreateMutex(NULL, FALSE, NULL);
+	setMaxSessions(0);
 }
 
 FgAirplayServer::~FgAirplayServer()
@@ -88,16 +101,22 @@ int FgAirplayServer::start(const char serverName[AIRPLAY_NAME_LEN],
 		airplay_set_log_level(m_pAirplay, RAOP_LOG_DEBUG);
 		airplay_set_log_callback(m_pAirplay, &log_callback, this);
 
-		m_pRaop = raop_init(10, &m_stRaopCB);
+		// Sized for the largest session limit, setMaxSessions() lowers it
+		m_pRaop = raop_init(FG_MAX_SESSIONS + FG_REFUSED_CONNECTIONS, &m_stRaopCB);
 		if (m_pRaop == NULL) {
 			ret = -1;
 			break;
 		}
+		raop_set_max_clients(m_pRaop, m_nMaxSessions + FG_REFUSED_CONNECTIONS);
 
 		raop_set_log_level(m_pRaop, RAOP_LOG_DEBUG);
 		raop_set_log_callback(m_pRaop, &log_callback, this);
 		raop_set_password(m_pRaop, authPassword);
 		raop_set_display_size(m_pRaop, displayWidth, displayHeight);
+		raop_set_audio_latency(m_pRaop, (unsigned int)m_nAudioLatencyMs);
+		raop_set_audio_buffer(m_pRaop, (unsigned int)m_nAudioBufferLength, (unsigned int)m_nAudioPreroll);
+		raop_set_audio_decode_thread(m_pRaop, m_bAudioDecodeThread ? 1 : 0);
+		raop_set_audio_sample_format(m_pRaop, m_nAudioSampleFormat);
 		ret = raop_start(m_pRaop, &raop_port);
 		if (ret < 0) {
 			break;
@@ -171,6 +190,7 @@ float FgAirplayServer::setScale(float fRatio)
 {
 	m_fScaleRatio = min(10, max(0.1, fRatio));
 
+	CAutoLock oLock(m_mutexMap, "setScale");
 	FgAirplayChannelMap::iterator it;
 	for (it = m_mapChannel.begin(); it != m_mapChannel.end(); ++it)
 	{
@@ -179,30 +199,176 @@ float FgAirplayServer::setScale(float fRatio)
 	return m_fScaleRatio;
 }
 
+int FgAirplayServer::setVideoFrameMode(int nFrameMode)
+{
+	if (nFrameMode != FG_VIDEO_FRAME_REFCOUNTED && nFrameMode != FG_VIDEO_FRAME_DEVICE) {
+		nFrameMode = FG_VIDEO_FRAME_COPY;
+	}
+
+	CAutoLock oLock(m_mutexMap, "setVideoFrameMode");
+	m_nFrameMode = nFrameMode;
+	FgAirplayChannelMap::iterator it;
+	for (it = m_mapChannel.begin(); it != m_mapChannel.end(); ++it)
+	{
+		it->second->setFrameMode(m_nFrameMode);
+	}
+	return m_nFrameMode;
+}
+
+int FgAirplayServer::setDecodeMode(int nDecodeMode)
+{
+	if (nDecodeMode != FG_DECODE_MODE_THROUGHPUT) {
+		nDecodeMode = FG_DECODE_MODE_LATENCY;
+	}
+
+	CAutoLock oLock(m_mutexMap, "setDecodeMode");
+	m_nDecodeMode = nDecodeMode;
+	FgAirplayChannelMap::iterator it;
+	for (it = m_mapChannel.begin(); it != m_mapChannel.end(); ++it)
+	{
+		it->second->setDecodeMode(m_nDecodeMode);
+	}
+	return m_nDecodeMode;
+}
+
+int FgAirplayServer::setAudioLatency(int latencyMs)
+{
+	// The library caps it further by the buffer length
+	if (latencyMs < 0) {
+		latencyMs = 0;
+	}
+
+	// Sessions pick it up at their next SETUP
+	CAutoLock oLock(m_mutexMap, "setAudioLatency");
+	m_nAudioLatencyMs = latencyMs;
+	if (m_pRaop != NULL) {
+		raop_set_audio_latency(m_pRaop, (unsigned int)m_nAudioLatencyMs);
+	}
+	return m_nAudioLatencyMs;
+}
+
+void FgAirplayServer::setAudioBuffer(int lengthPackets, int prerollPackets)
+{
+	CAutoLock oLock(m_mutexMap, "setAudioBuffer");
+	m_nAudioBufferLength = max(0, lengthPackets);
+	m_nAudioPreroll = max(0, prerollPackets);
+	if (m_pRaop != NULL) {
+		raop_set_audio_buffer(m_pRaop, (unsigned int)m_nAudioBufferLength, (unsigned int)m_nAudioPreroll);
+	}
+}
+
+void FgAirplayServer::setAudioDecodeThread(int enabled)
+{
+	CAutoLock oLock(m_mutexMap, "setAudioDecodeThread");
+	m_bAudioDecodeThread = (enabled != 0);
+	if (m_pRaop != NULL) {
+		raop_set_audio_decode_thread(m_pRaop, m_bAudioDecodeThread ? 1 : 0);
+	}
+}
+
+void FgAirplayServer::setAudioSampleFormat(int sampleFormat)
+{
+	CAutoLock oLock(m_mutexMap, "setAudioSampleFormat");
+	m_nAudioSampleFormat = (sampleFormat == FG_AUDIO_FORMAT_F32) ? FG_AUDIO_FORMAT_F32 : FG_AUDIO_FORMAT_S16;
+	if (m_pRaop != NULL) {
+		raop_set_audio_sample_format(m_pRaop, m_nAudioSampleFormat);
+	}
+}
+
+int FgAirplayServer::setMaxSessions(int maxSessions)
+{
+	CAutoLock oLock(m_mutexMap, "setMaxSessions");
+	if (maxSessions <= 0) {
+		// Two decode threads per session keeps a single 1080p stream real-time
+		maxSessions = m_nCpuCores / 2;
+	}
+	m_nMaxSessions = min(FG_MAX_SESSIONS, max(1, maxSessions));
+	// Existing sessions keep their decoders; new ones get the new share
+	m_nDecodeThreads = min(4, max(1, m_nCpuCores / m_nMaxSessions));
+	if (m_pRaop != NULL) {
+		raop_set_max_clients(m_pRaop, m_nMaxSessions + FG_REFUSED_CONNECTIONS);
+	}
+	return m_nMaxSessions;
+}
+
+int FgAirplayServer::getSessionStats(SFgSessionStats* stats, int maxCount)
+{
+	CAutoLock oLock(m_mutexMap, "getSessionStats");
+	int count = 0;
+	FgAirplayChannelMap::iterator it;
+	for (it = m_mapChannel.begin(); it != m_mapChannel.end() && count < maxCount; ++it)
+	{
+		it->second->getStats(&stats[count++]);
+	}
+	return count;
+}
+
 void FgAirplayServer::clearChannels()
 {
 	CAutoLock oLock(m_mutexMap, "clearChannels");
 	while (m_mapChannel.size() > 0)
 	{
 		FgAirplayChannelMap::iterator it = m_mapChannel.begin();
+		it->second->stopDecodeThread();
 		it->second->release();
 		m_mapChannel.erase(it);
 	}
+	m_setRejected.clear();
 }
 
-FgAirplayChannel* FgAirplayServer::getChannel(const char* remoteDeviceId)
+// Looks up the device's channel, creating it when the session limit allows.
+// Must be called with m_mutexMap held.
+FgAirplayChannel* FgAirplayServer::getChannel(const char* remoteName, const char* remoteDeviceId)
 {
 	std::string deviceId(remoteDeviceId);
-	FgAirplayChannel* pChannel = m_mapChannel[deviceId];
-	if (NULL == pChannel)
+	FgAirplayChannelMap::iterator it = m_mapChannel.find(deviceId);
+	if (it != m_mapChannel.end())
 	{
-		pChannel = new FgAirplayChannel(m_pCallback);
-		m_mapChannel[deviceId] = pChannel;
+		return it->second;
 	}
+	if (m_setRejected.find(deviceId) != m_setRejected.end())
+	{
+		return NULL;
+	}
+	if ((int)m_mapChannel.size() >= m_nMaxSessions)
+	{
+		m_setRejected.insert(deviceId);
+		if (m_pCallback != NULL)
+		{
+			char msg[512];
+			sprintf_s(msg, sizeof(msg), "Refusing session from %s: %d of %d sessions in use",
+				remoteName ? remoteName : remoteDeviceId, (int)m_mapChannel.size(), m_nMaxSessions);
+			m_pCallback->log(RAOP_LOG_WARNING, msg);
+		}
+		return NULL;
+	}
+
+	FgAirplayChannel* pChannel = new FgAirplayChannel(m_pCallback, remoteName, remoteDeviceId, m_nDecodeThreads);
+	pChannel->setScale(m_fScaleRatio);
+	pChannel->setFrameMode(m_nFrameMode);
+	pChannel->setDecodeMode(m_nDecodeMode);
+	if (!pChannel->startDecodeThread())
+	{
+		pChannel->release();
+		return NULL;
+	}
+	m_mapChannel[deviceId] = pChannel;
 
 	return pChannel;
 }
 
+// Whether connected or video_process refused the device. Only looks up:
+// audio alone never takes a session, since nothing would free it again
+// for a sender that does not mirror.
+bool FgAirplayServer::isRejected(const char* remoteDeviceId)
+{
+	if (remoteDeviceId == NULL)
+	{
+		return false;
+	}
+	CAutoLock oLock(m_mutexMap, "isRejected");
+	return m_setRejected.find(remoteDeviceId) != m_setRejected.end();
+}
 
 void FgAirplayServer::connected(void* cls, const char* remoteName, const char* remoteDeviceId)
 {
@@ -212,7 +378,11 @@ void FgAirplayServer::connected(void* cls, const char* remoteName, const char* r
 		return;
 	}
 	CAutoLock oLock(pServer->m_mutexMap, "connected");
-	pServer->getChannel(remoteDeviceId);
+	if (pServer->getChannel(remoteName, remoteDeviceId) == NULL)
+	{
+		// Over the session limit: the sender stays invisible to the app
+		return;
+	}
 
 	if (pServer->m_pCallback != NULL)
 	{
@@ -228,6 +398,14 @@ void FgAirplayServer::disconnected(void* cls, const char* remoteName, const char
 		return;
 	}
 	
+	{
+		CAutoLock oLock(pServer->m_mutexMap, "disconnected");
+		if (pServer->m_setRejected.erase(std::string(remoteDeviceId)) > 0)
+		{
+			return;
+		}
+	}
+
 	// Safely call the callback
 	if (pServer->m_pCallback != NULL)
 	{
@@ -249,8 +427,9 @@ void FgAirplayServer::disconnected(void* cls, const char* remoteName, const char
 			pServer->m_mapChannel.erase(it);
 		}
 	}
-	// Release outside the critical section to avoid holding lock too long
+	// Join the decode thread outside the critical section to avoid holding lock too long
 	if (pChannel) {
+		pChannel->stopDecodeThread();
 		pChannel->release();
 	}
 }
@@ -268,6 +447,12 @@ void FgAirplayServer::audio_set_volume(void* cls, void* session, float volume, c
 		return;
 	}
 
+	// A sender refused by the session limit must not steer the shared output
+	if (pServer->isRejected(remoteDeviceId))
+	{
+		return;
+	}
+
 	if (pServer->m_pCallback != NULL)
 	{
 		// Forward volume to callback (volume is in dB: 0.0 = max, -144.0 = mute)
@@ -301,13 +486,23 @@ void FgAirplayServer::audio_process(void* cls, pcm_data_struct* data, const char
 		return;
 	}
 
+	// Audio follows the admission made for video, so a refused sender cannot
+	// claim the audio output
+	if (pServer->isRejected(remoteDeviceId))
+	{
+		return;
+	}
+
 	if (pServer->m_pCallback != NULL)
 	{
 		SFgAudioFrame* frame = new SFgAudioFrame();
 		frame->bitsPerSample = data->bits_per_sample;
 		frame->channels = data->channels;
 		frame->pts = data->pts;
+		frame->localTimeNs = data->local_time_ns;
 		frame->sampleRate = data->sample_rate;
+		frame->sampleFormat = data->sample_format;
+		frame->frames = data->frames;
 		frame->dataLen = data->data_len;
 		frame->data = new uint8_t[frame->dataLen];
 		memcpy(frame->data, data->data, frame->dataLen);
@@ -326,6 +521,23 @@ void FgAirplayServer::audio_destroy(void* cls, void* session, const char* remote
 {
 }
 
+void FgAirplayServer::audio_recv_stats(void* cls, const audio_recv_stats_struct* stats, const char* remoteName, const char* remoteDeviceId)
+{
+	FgAirplayServer* pServer = (FgAirplayServer*)cls;
+	if (!pServer || remoteDeviceId == NULL)
+	{
+		return;
+	}
+
+	// Only sessions that were admitted have a channel to report through
+	CAutoLock oLock(pServer->m_mutexMap, "audio_recv_stats");
+	FgAirplayChannelMap::iterator it = pServer->m_mapChannel.find(remoteDeviceId);
+	if (it != pServer->m_mapChannel.end())
+	{
+		it->second->setAudioRecvStats(stats);
+	}
+}
+
 void FgAirplayServer::video_process(void* cls, h264_decode_struct* h264data, const char* remoteName, const char* remoteDeviceId)
 {
 
@@ -346,21 +558,21 @@ void FgAirplayServer::video_process(void* cls, h264_decode_struct* h264data, con
 		return;
 	}
 
-	SFgH264Data* pData = new SFgH264Data();
-	memset(pData, 0, sizeof(SFgH264Data));
-
+	// The channel queues the frame for its decode thread. Encrypted frames carry
+	// their pooled buffer, which the queue retains instead of copying the bitstream.
+	SFgH264Data sData;
+	memset(&sData, 0, sizeof(SFgH264Data));
+	sData.size = h264data->data_len;
+	sData.data = h264data->data;
+	sData.buffer = h264data->buffer;
+	sData.pts = (long long)h264data->local_time_ns;
 	if (h264data->frame_type == 0)
 	{
-		pData->size = h264data->data_len;
-		pData->data = new uint8_t[pData->size];
-		pData->is_key = 1;
-		memcpy(pData->data, h264data->data, h264data->data_len);
+		sData.is_key = 1;
 	}
-	else if (h264data->frame_type == 1)
+	else if (h264data->frame_type != 1)
 	{
-		pData->size = h264data->data_len;
-		pData->data = new uint8_t[pData->size];
-		memcpy(pData->data, h264data->data, h264data->data_len);
+		return;
 	}
 
 	FgAirplayChannel* pChannel = NULL;
@@ -368,22 +580,18 @@ void FgAirplayServer::video_process(void* cls, h264_decode_struct* h264data, con
 		CAutoLock oLock(pServer->m_mutexMap, "video_process");
 		// Check again inside the lock in case we're shutting down
 		if (!pServer->m_pCallback) {
-			delete[] pData->data;
-			delete pData;
 			return;
 		}
-		pChannel = pServer->getChannel(remoteDeviceId);
+		pChannel = pServer->getChannel(remoteName, remoteDeviceId);
 		if (pChannel) {
 			pChannel->addRef();
 		}
 	}
 	if (pChannel)
 	{
-		pChannel->decodeH264Data(pData, remoteName, remoteDeviceId);
+		pChannel->pushH264Data(&sData);
 		pChannel->release();
 	}
-	delete[] pData->data;
-	delete pData;
 }
 
 void FgAirplayServer::ap_video_play(void* cls, char* url, double volume, double start_pos)
@@ -593,3 +801,10 @@ static BOOL GetPrimaryMacAddress(char strMac[6])
 	memcpy(strMac, bestAdapter->PhysicalAddress, 6);
 	return TRUE;
 }
+
+static int GetCpuCoreCount()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwNumberOfProcessors > 0 ? (int)systemInfo.dwNumberOfProcessors : 1;
+}